@@ -550,6 +550,8 @@ static void ffmpeg_cleanup(int ret)
         if (!ost)
             continue;
 
+        chunk_enc_uninit(ost);
+
         for (j = 0; j < ost->nb_bitstream_filters; j++)
             av_bsf_free(&ost->bsf_ctx[j]);
         av_freep(&ost->bsf_ctx);
@@ -586,6 +588,7 @@ static void ffmpeg_cleanup(int ret)
     free_input_threads();
 #endif
     for (i = 0; i < nb_input_files; i++) {
+        thumb_uninit(input_files[i]);
         avformat_close_input(&input_files[i]->ctx);
         av_freep(&input_files[i]);
     }
@@ -1284,14 +1287,20 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
-        ret = avcodec_send_frame(enc, in_picture);
+        if (ost->chunk_enc)
+            ret = chunk_enc_send_frame(ost, in_picture);
+        else
+            ret = avcodec_send_frame(enc, in_picture);
         if (ret < 0)
             goto error;
         // Make sure Closed Captions will not be duplicated
         av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
 
         while (1) {
-            ret = avcodec_receive_packet(enc, &pkt);
+            if (ost->chunk_enc)
+                ret = chunk_enc_receive_packet(ost, &pkt);
+            else
+                ret = avcodec_receive_packet(enc, &pkt);
             update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
             if (ret == AVERROR(EAGAIN))
                 break;
@@ -1931,8 +1940,10 @@ static void flush_encoders(void)
 
             update_benchmark(NULL);
 
-            while ((ret = avcodec_receive_packet(enc, &pkt)) == AVERROR(EAGAIN)) {
-                ret = avcodec_send_frame(enc, NULL);
+            while ((ret = ost->chunk_enc ? chunk_enc_receive_packet(ost, &pkt) :
+                                           avcodec_receive_packet(enc, &pkt)) == AVERROR(EAGAIN)) {
+                ret = ost->chunk_enc ? chunk_enc_send_frame(ost, NULL) :
+                                       avcodec_send_frame(enc, NULL);
                 if (ret < 0) {
                     av_log(NULL, AV_LOG_FATAL, "%s encoding failed: %s\n",
                            desc,
@@ -3473,6 +3484,12 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
             memcpy(ost->enc_ctx->subtitle_header, dec->subtitle_header, dec->subtitle_header_size);
             ost->enc_ctx->subtitle_header_size = dec->subtitle_header_size;
         }
+        ret = chunk_enc_init(ost);
+        if (ret < 0) {
+            snprintf(error, error_len, "Error initializing chunked encoding "
+                     "for output stream #%d:%d", ost->file_index, ost->index);
+            return ret;
+        }
         if (!av_dict_get(ost->encoder_opts, "threads", NULL, 0))
             av_dict_set(&ost->encoder_opts, "threads", "auto", 0);
         if (ost->enc->type == AVMEDIA_TYPE_AUDIO &&
@@ -4028,7 +4045,7 @@ static void *input_thread(void *arg)
 
     while (1) {
         AVPacket pkt;
-        ret = av_read_frame(f->ctx, &pkt);
+        ret = f->thumb ? thumb_read_packet(f, &pkt) : av_read_frame(f->ctx, &pkt);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -4147,6 +4164,8 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     if (nb_input_files > 1)
         return get_input_packet_mt(f, pkt);
 #endif
+    if (f->thumb)
+        return thumb_read_packet(f, pkt);
     return av_read_frame(f->ctx, pkt);
 }
 
@@ -4437,7 +4456,7 @@ static int process_input(int file_index)
     pkt_dts = av_rescale_q_rnd(pkt.dts, ist->st->time_base, AV_TIME_BASE_Q, AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
     if ((ist->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO ||
          ist->dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) &&
-        pkt_dts != AV_NOPTS_VALUE && ist->next_dts == AV_NOPTS_VALUE && !copy_ts
+        pkt_dts != AV_NOPTS_VALUE && ist->next_dts == AV_NOPTS_VALUE && !copy_ts && !ifile->thumb
         && (is->iformat->flags & AVFMT_TS_DISCONT) && ifile->last_ts != AV_NOPTS_VALUE) {
         int64_t delta   = pkt_dts - ifile->last_ts;
         if (delta < -1LL*dts_delta_threshold*AV_TIME_BASE ||
@@ -4466,7 +4485,7 @@ static int process_input(int file_index)
     if ((ist->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO ||
          ist->dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) &&
          pkt_dts != AV_NOPTS_VALUE && ist->next_dts != AV_NOPTS_VALUE &&
-        !copy_ts) {
+        !copy_ts && !ifile->thumb) {
         int64_t delta   = pkt_dts - ist->next_dts;
         if (is->iformat->flags & AVFMT_TS_DISCONT) {
             if (delta < -1LL*dts_delta_threshold*AV_TIME_BASE ||
@@ -120,6 +120,8 @@ typedef struct OptionsContext {
     int rate_emu;
     int accurate_seek;
     int thread_queue_size;
+    int thumbnails;
+    int thumbnail_candidates;
 
     SpecifierOpt *ts_scale;
     int        nb_ts_scale;
@@ -214,6 +216,10 @@ typedef struct OptionsContext {
     int        nb_pass;
     SpecifierOpt *passlogfiles;
     int        nb_passlogfiles;
+    SpecifierOpt *chunk_encoders;
+    int        nb_chunk_encoders;
+    SpecifierOpt *chunk_frames;
+    int        nb_chunk_frames;
     SpecifierOpt *max_muxing_queue_size;
     int        nb_max_muxing_queue_size;
     SpecifierOpt *guess_layout_max;
@@ -412,6 +418,9 @@ typedef struct InputFile {
     int rate_emu;
     int accurate_seek;
 
+    /* keyframe thumbnail extraction */
+    struct ThumbReader *thumb;
+
 #if HAVE_THREADS
     AVThreadMessageQueue *in_thread_queue;
     pthread_t thread;           /* thread reading from this file */
@@ -549,6 +558,11 @@ typedef struct OutputStream {
 
     /* frame encode sum of squared error values */
     int64_t error[4];
+
+    /* chunked encoding with several encoder instances in parallel */
+    int chunk_encoders;
+    int chunk_frames;
+    struct ChunkEncoder *chunk_enc;
 } OutputStream;
 
 typedef struct OutputFile {
@@ -665,4 +679,13 @@ int hw_device_setup_for_encode(OutputStream *ost);
 
 int hwaccel_decode_init(AVCodecContext *avctx);
 
+int chunk_enc_init(OutputStream *ost);
+int chunk_enc_send_frame(OutputStream *ost, const AVFrame *frame);
+int chunk_enc_receive_packet(OutputStream *ost, AVPacket *pkt);
+void chunk_enc_uninit(OutputStream *ost);
+
+int thumb_init(InputFile *f, int nb_thumbs, int nb_candidates);
+int thumb_read_packet(InputFile *f, AVPacket *pkt);
+void thumb_uninit(InputFile *f);
+
 #endif /* FFTOOLS_FFMPEG_H */
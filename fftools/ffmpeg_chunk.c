@@ -0,0 +1,526 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Chunked encoding: the frames of a video output stream are cut into
+ * chunks starting with a keyframe, every chunk is encoded by its own
+ * encoder instance on a worker thread, and the packets are handed back
+ * to the muxer in chunk order.
+ */
+
+#include <string.h>
+
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+
+#include "libavfilter/buffersink.h"
+
+#include "ffmpeg.h"
+
+#if HAVE_THREADS
+
+enum ChunkState {
+    CHUNK_FILLING,
+    CHUNK_QUEUED,
+    CHUNK_RUNNING,
+    CHUNK_DONE,
+};
+
+typedef struct Chunk {
+    struct Chunk *next;
+    int index;
+    enum ChunkState state;
+    int ret;
+
+    AVFrame **frames;
+    int    nb_frames;
+    int    frames_size;
+
+    AVPacket *pkts;
+    int    nb_pkts;
+    int    pkts_size;
+    int    pkt_index;
+} Chunk;
+
+typedef struct ChunkEncoder {
+    OutputStream *ost;
+
+    /* encoder setup replicated for every chunk */
+    AVCodecParameters *par;
+    AVDictionary *opts;
+    AVRational time_base;
+    AVRational framerate;
+    int flags, flags2;
+    int global_quality;
+    int gop_size;
+    uint16_t *intra_matrix;
+    uint16_t *inter_matrix;
+    uint16_t *chroma_intra_matrix;
+    RcOverride *rc_override;
+    int rc_override_count;
+
+    pthread_t *threads;
+    int     nb_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+
+    Chunk *head;            ///< oldest chunk not yet returned to the caller
+    Chunk *tail;            ///< newest chunk, possibly still being filled
+    int nb_submitted;       ///< chunks queued, running or done, still in the list
+    int max_submitted;
+    int nb_chunks;
+    int flushing;
+    int finished;
+} ChunkEncoder;
+
+static void free_chunk(Chunk **pc)
+{
+    Chunk *c = *pc;
+    int i;
+
+    if (!c)
+        return;
+    for (i = 0; i < c->nb_frames; i++)
+        av_frame_free(&c->frames[i]);
+    av_freep(&c->frames);
+    for (i = c->pkt_index; i < c->nb_pkts; i++)
+        av_packet_unref(&c->pkts[i]);
+    av_freep(&c->pkts);
+    av_freep(pc);
+}
+
+static int dup_matrix(uint16_t **dst, const uint16_t *src)
+{
+    if (!src)
+        return 0;
+    *dst = av_memdup(src, 64 * sizeof(*src));
+    return *dst ? 0 : AVERROR(ENOMEM);
+}
+
+static int open_chunk_encoder(ChunkEncoder *ce, Chunk *c, AVCodecContext **penc)
+{
+    OutputStream *ost = ce->ost;
+    AVCodecContext *main_enc = ost->enc_ctx;
+    AVCodecContext *enc;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    *penc = enc = avcodec_alloc_context3(ost->enc);
+    if (!enc)
+        return AVERROR(ENOMEM);
+
+    ret = avcodec_parameters_to_context(enc, ce->par);
+    if (ret < 0)
+        return ret;
+    enc->time_base      = ce->time_base;
+    enc->framerate      = ce->framerate;
+    enc->flags          = ce->flags;
+    enc->flags2         = ce->flags2;
+    enc->global_quality = ce->global_quality;
+    enc->gop_size       = ce->gop_size;
+    if ((ret = dup_matrix(&enc->intra_matrix,        ce->intra_matrix))        < 0 ||
+        (ret = dup_matrix(&enc->inter_matrix,        ce->inter_matrix))        < 0 ||
+        (ret = dup_matrix(&enc->chroma_intra_matrix, ce->chroma_intra_matrix)) < 0)
+        return ret;
+    if (ce->rc_override_count) {
+        enc->rc_override = av_memdup(ce->rc_override,
+                                     ce->rc_override_count * sizeof(*ce->rc_override));
+        if (!enc->rc_override)
+            return AVERROR(ENOMEM);
+        enc->rc_override_count = ce->rc_override_count;
+    }
+
+    ret = av_dict_copy(&opts, ce->opts, 0);
+    if (ret >= 0)
+        ret = avcodec_open2(enc, ost->enc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error opening the encoder for chunk %d "
+               "of output stream #%d:%d\n", c->index, ost->file_index, ost->index);
+        return ret;
+    }
+
+    /* the chunks all go into one stream, so they must share the global header */
+    if (enc->extradata_size != main_enc->extradata_size ||
+        (enc->extradata_size &&
+         memcmp(enc->extradata, main_enc->extradata, enc->extradata_size))) {
+        av_log(NULL, AV_LOG_ERROR, "Extradata of the encoder for chunk %d of "
+               "output stream #%d:%d differs from the stream extradata, the "
+               "chunks cannot be joined\n", c->index, ost->file_index, ost->index);
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+static int receive_chunk_packets(AVCodecContext *enc, Chunk *c)
+{
+    int ret;
+
+    for (;;) {
+        if (c->nb_pkts == c->pkts_size) {
+            int new_size = FFMAX(2 * c->pkts_size, c->nb_frames + 16);
+            AVPacket *pkts = av_realloc_array(c->pkts, new_size, sizeof(*pkts));
+            if (!pkts)
+                return AVERROR(ENOMEM);
+            c->pkts      = pkts;
+            c->pkts_size = new_size;
+        }
+        av_init_packet(&c->pkts[c->nb_pkts]);
+        c->pkts[c->nb_pkts].data = NULL;
+        c->pkts[c->nb_pkts].size = 0;
+
+        ret = avcodec_receive_packet(enc, &c->pkts[c->nb_pkts]);
+        if (ret < 0)
+            return ret;
+        c->nb_pkts++;
+    }
+}
+
+static int encode_chunk(ChunkEncoder *ce, Chunk *c)
+{
+    AVCodecContext *enc = NULL;
+    int i, ret;
+
+    ret = open_chunk_encoder(ce, c, &enc);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i <= c->nb_frames; i++) {
+        ret = avcodec_send_frame(enc, i < c->nb_frames ? c->frames[i] : NULL);
+        if (ret < 0)
+            goto end;
+        if (i < c->nb_frames)
+            av_frame_free(&c->frames[i]);
+
+        ret = receive_chunk_packets(enc, c);
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    avcodec_free_context(&enc);
+    return ret;
+}
+
+static void *chunk_worker(void *arg)
+{
+    ChunkEncoder *ce = arg;
+
+    pthread_mutex_lock(&ce->lock);
+    for (;;) {
+        Chunk *c;
+
+        if (ce->finished)
+            break;
+        for (c = ce->head; c && c->state != CHUNK_QUEUED; c = c->next)
+            ;
+        if (c) {
+            int ret;
+
+            c->state = CHUNK_RUNNING;
+            pthread_mutex_unlock(&ce->lock);
+
+            ret = encode_chunk(ce, c);
+
+            pthread_mutex_lock(&ce->lock);
+            c->ret   = ret;
+            c->state = CHUNK_DONE;
+            pthread_cond_broadcast(&ce->cond);
+            continue;
+        }
+        pthread_cond_wait(&ce->cond, &ce->lock);
+    }
+    pthread_mutex_unlock(&ce->lock);
+
+    return NULL;
+}
+
+/* must be called with the lock held */
+static void submit_chunk(ChunkEncoder *ce)
+{
+    Chunk *c = ce->tail;
+
+    if (!c || c->state != CHUNK_FILLING)
+        return;
+
+    av_log(NULL, AV_LOG_DEBUG, "Queueing chunk %d of output stream #%d:%d "
+           "with %d frames\n", c->index, ce->ost->file_index, ce->ost->index,
+           c->nb_frames);
+    c->state = CHUNK_QUEUED;
+    ce->nb_submitted++;
+    pthread_cond_broadcast(&ce->cond);
+}
+
+int chunk_enc_init(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    ChunkEncoder *ce;
+    int64_t frame_size;
+    int i, ret;
+
+    if (ost->chunk_encoders <= 1 || enc->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 0;
+
+    if (ost->filter && av_buffersink_get_hw_frames_ctx(ost->filter->filter)) {
+        av_log(NULL, AV_LOG_WARNING, "Chunked encoding of hardware frames is "
+               "not supported, disabling it for output stream #%d:%d\n",
+               ost->file_index, ost->index);
+        return 0;
+    }
+
+    ce = av_mallocz(sizeof(*ce));
+    if (!ce)
+        return AVERROR(ENOMEM);
+    ost->chunk_enc = ce;
+    ce->ost        = ost;
+
+    ce->par = avcodec_parameters_alloc();
+    if (!ce->par)
+        return AVERROR(ENOMEM);
+    ret = avcodec_parameters_from_context(ce->par, enc);
+    if (ret < 0)
+        return ret;
+    av_freep(&ce->par->extradata);
+    ce->par->extradata_size = 0;
+
+    /* the options are taken before ffmpeg defaults the encoder to
+     * automatic threading: the parallelism comes from the chunks */
+    ret = av_dict_copy(&ce->opts, ost->encoder_opts, 0);
+    if (ret < 0)
+        return ret;
+
+    ce->time_base      = enc->time_base;
+    ce->framerate      = enc->framerate;
+    ce->flags          = enc->flags;
+    ce->flags2         = enc->flags2;
+    ce->global_quality = enc->global_quality;
+    ce->gop_size       = enc->gop_size;
+    if ((ret = dup_matrix(&ce->intra_matrix,        enc->intra_matrix))        < 0 ||
+        (ret = dup_matrix(&ce->inter_matrix,        enc->inter_matrix))        < 0 ||
+        (ret = dup_matrix(&ce->chroma_intra_matrix, enc->chroma_intra_matrix)) < 0)
+        return ret;
+    if (enc->rc_override_count) {
+        ce->rc_override = av_memdup(enc->rc_override,
+                                    enc->rc_override_count * sizeof(*enc->rc_override));
+        if (!ce->rc_override)
+            return AVERROR(ENOMEM);
+        ce->rc_override_count = enc->rc_override_count;
+    }
+
+    ce->max_submitted = 2 * ost->chunk_encoders;
+
+    ce->threads = av_mallocz_array(ost->chunk_encoders, sizeof(*ce->threads));
+    if (!ce->threads)
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&ce->lock, NULL);
+    pthread_cond_init(&ce->cond, NULL);
+    for (i = 0; i < ost->chunk_encoders; i++) {
+        ret = pthread_create(&ce->threads[i], NULL, chunk_worker, ce);
+        if (ret) {
+            av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s\n", strerror(ret));
+            return AVERROR(ret);
+        }
+        ce->nb_threads++;
+    }
+
+    /* the frames of every submitted chunk and of the one being filled are
+     * kept until their chunk is encoded */
+    frame_size = av_image_get_buffer_size(enc->pix_fmt, enc->width, enc->height, 1);
+    av_log(NULL, AV_LOG_VERBOSE, "Encoding output stream #%d:%d in chunks of "
+           "%d frames with %d encoders, buffering up to %"PRId64" MiB of frames\n",
+           ost->file_index, ost->index, ost->chunk_frames, ost->chunk_encoders,
+           FFMAX(frame_size, 0) * ost->chunk_frames * (ce->max_submitted + 1) >> 20);
+
+    return 0;
+}
+
+int chunk_enc_send_frame(OutputStream *ost, const AVFrame *frame)
+{
+    ChunkEncoder *ce = ost->chunk_enc;
+    Chunk *c;
+    int ret = 0;
+
+    pthread_mutex_lock(&ce->lock);
+
+    if (ce->flushing) {
+        ret = AVERROR_EOF;
+        goto end;
+    }
+
+    if (!frame) {
+        submit_chunk(ce);
+        ce->flushing = 1;
+        pthread_cond_broadcast(&ce->cond);
+        goto end;
+    }
+
+    /* start a new chunk once the current one is full, or early on a
+     * forced keyframe so that chunk boundaries follow scene changes */
+    c = ce->tail;
+    if (c && c->state == CHUNK_FILLING &&
+        (c->nb_frames >= ost->chunk_frames ||
+         (frame->pict_type == AV_PICTURE_TYPE_I && c->nb_frames >= ost->chunk_frames / 2)))
+        submit_chunk(ce);
+
+    c = ce->tail;
+    if (!c || c->state != CHUNK_FILLING) {
+        c = av_mallocz(sizeof(*c));
+        if (!c) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        c->index = ce->nb_chunks++;
+        if (ce->tail)
+            ce->tail->next = c;
+        else
+            ce->head = c;
+        ce->tail = c;
+    }
+
+    if (c->nb_frames == c->frames_size) {
+        int new_size = FFMAX(2 * c->frames_size, 16);
+        AVFrame **frames = av_realloc_array(c->frames, new_size, sizeof(*frames));
+        if (!frames) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        c->frames      = frames;
+        c->frames_size = new_size;
+    }
+    c->frames[c->nb_frames] = av_frame_clone(frame);
+    if (!c->frames[c->nb_frames]) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    c->nb_frames++;
+
+end:
+    pthread_mutex_unlock(&ce->lock);
+    return ret;
+}
+
+int chunk_enc_receive_packet(OutputStream *ost, AVPacket *pkt)
+{
+    ChunkEncoder *ce = ost->chunk_enc;
+    int ret;
+
+    pthread_mutex_lock(&ce->lock);
+    for (;;) {
+        Chunk *c = ce->head;
+
+        if (!c || c->state == CHUNK_FILLING) {
+            ret = ce->flushing ? AVERROR_EOF : AVERROR(EAGAIN);
+            break;
+        }
+        if (c->state != CHUNK_DONE) {
+            /* only block when enough chunks are in flight to keep every
+             * encoder busy, or when draining */
+            if (!ce->flushing && ce->nb_submitted < ce->max_submitted) {
+                ret = AVERROR(EAGAIN);
+                break;
+            }
+            pthread_cond_wait(&ce->cond, &ce->lock);
+            continue;
+        }
+        if (c->ret < 0) {
+            ret = c->ret;
+            break;
+        }
+        if (c->pkt_index < c->nb_pkts) {
+            av_packet_move_ref(pkt, &c->pkts[c->pkt_index++]);
+            ret = 0;
+            break;
+        }
+
+        ce->head = c->next;
+        if (!ce->head)
+            ce->tail = NULL;
+        ce->nb_submitted--;
+        free_chunk(&c);
+    }
+    pthread_mutex_unlock(&ce->lock);
+
+    return ret;
+}
+
+void chunk_enc_uninit(OutputStream *ost)
+{
+    ChunkEncoder *ce = ost->chunk_enc;
+    int i;
+
+    if (!ce)
+        return;
+
+    if (ce->nb_threads) {
+        pthread_mutex_lock(&ce->lock);
+        ce->finished = 1;
+        pthread_cond_broadcast(&ce->cond);
+        pthread_mutex_unlock(&ce->lock);
+        for (i = 0; i < ce->nb_threads; i++)
+            pthread_join(ce->threads[i], NULL);
+    }
+    if (ce->threads) {
+        pthread_mutex_destroy(&ce->lock);
+        pthread_cond_destroy(&ce->cond);
+    }
+    av_freep(&ce->threads);
+
+    while (ce->head) {
+        Chunk *c = ce->head;
+        ce->head = c->next;
+        free_chunk(&c);
+    }
+
+    avcodec_parameters_free(&ce->par);
+    av_dict_free(&ce->opts);
+    av_freep(&ce->intra_matrix);
+    av_freep(&ce->inter_matrix);
+    av_freep(&ce->chroma_intra_matrix);
+    av_freep(&ce->rc_override);
+    av_freep(&ost->chunk_enc);
+}
+
+#else
+
+int chunk_enc_init(OutputStream *ost)
+{
+    if (ost->chunk_encoders > 1)
+        av_log(NULL, AV_LOG_WARNING, "Chunked encoding requires threading "
+               "support, encoding output stream #%d:%d serially\n",
+               ost->file_index, ost->index);
+    return 0;
+}
+
+int chunk_enc_send_frame(OutputStream *ost, const AVFrame *frame)
+{
+    return AVERROR(ENOSYS);
+}
+
+int chunk_enc_receive_packet(OutputStream *ost, AVPacket *pkt)
+{
+    return AVERROR(ENOSYS);
+}
+
+void chunk_enc_uninit(OutputStream *ost)
+{
+}
+
+#endif /* HAVE_THREADS */
@@ -1210,6 +1210,14 @@ static int open_input_file(OptionsContext *o, const char *filename)
     f->loop = o->loop;
     f->duration = 0;
     f->time_base = (AVRational){ 1, 1 };
+    if (o->thumbnails > 0) {
+        if (o->loop) {
+            av_log(NULL, AV_LOG_FATAL, "Thumbnail extraction cannot be combined with -stream_loop\n");
+            exit_program(1);
+        }
+        if (thumb_init(f, o->thumbnails, FFMAX(o->thumbnail_candidates, 1)) < 0)
+            exit_program(1);
+    }
 #if HAVE_THREADS
     f->thread_queue_size = o->thread_queue_size > 0 ? o->thread_queue_size : 8;
 #endif
@@ -1826,6 +1834,20 @@ static OutputStream *new_video_stream(OptionsContext *o, AVFormatContext *oc, in
             }
         }
 
+        MATCH_PER_STREAM_OPT(chunk_encoders, i, ost->chunk_encoders, oc, st);
+        ost->chunk_frames = 250;
+        MATCH_PER_STREAM_OPT(chunk_frames, i, ost->chunk_frames, oc, st);
+        if (ost->chunk_encoders > 1) {
+            if (do_pass) {
+                av_log(NULL, AV_LOG_FATAL, "Chunked encoding cannot be combined with two pass encoding\n");
+                exit_program(1);
+            }
+            if (ost->chunk_frames <= 0) {
+                av_log(NULL, AV_LOG_FATAL, "Invalid chunk size %d\n", ost->chunk_frames);
+                exit_program(1);
+            }
+        }
+
         MATCH_PER_STREAM_OPT(forced_key_frames, str, ost->forced_keyframes, oc, st);
         if (ost->forced_keyframes)
             ost->forced_keyframes = av_strdup(ost->forced_keyframes);
@@ -3540,6 +3562,12 @@ const OptionDef options[] = {
     { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
                                                                      { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "thumbnails",     HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                     { .off = OFFSET(thumbnails) },
+        "read only the keyframes found at this many evenly spaced positions", "n" },
+    { "thumbnail_candidates", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                     { .off = OFFSET(thumbnail_candidates) },
+        "set the number of keyframes read for each thumbnail", "n" },
     { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
 
@@ -3581,6 +3609,12 @@ const OptionDef options[] = {
     { "passlogfile",  OPT_VIDEO | HAS_ARG | OPT_STRING | OPT_EXPERT | OPT_SPEC |
                       OPT_OUTPUT,                                                { .off = OFFSET(passlogfiles) },
         "select two pass log file name prefix", "prefix" },
+    { "chunk_encoders", OPT_VIDEO | HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT |
+                      OPT_OUTPUT,                                                { .off = OFFSET(chunk_encoders) },
+        "encode independent chunks of the stream with this many encoder instances in parallel", "n" },
+    { "chunk_frames", OPT_VIDEO | HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT |
+                      OPT_OUTPUT,                                                { .off = OFFSET(chunk_frames) },
+        "number of frames in each chunk for chunked encoding", "n" },
     { "deinterlace",  OPT_VIDEO | OPT_BOOL | OPT_EXPERT,                         { &do_deinterlace },
         "this option is deprecated, use the yadif filter instead" },
     { "psnr",         OPT_VIDEO | OPT_BOOL | OPT_EXPERT,                         { &do_psnr },
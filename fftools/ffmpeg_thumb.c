@@ -0,0 +1,137 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Keyframe thumbnail reading: instead of demuxing the whole input, seek
+ * to evenly spaced timestamps and return only the keyframe packet of the
+ * video stream found at each of them.
+ */
+
+#include "libavutil/mem.h"
+
+#include "ffmpeg.h"
+
+typedef struct ThumbReader {
+    AVStream *st;
+    int64_t start;              ///< first timestamp of the stream, in stream time base
+    int64_t duration;           ///< duration of the stream, in stream time base
+    int nb_targets;
+    int next_target;
+    int last_index;             ///< index entry of the last keyframe returned, -1 if none
+    int64_t last_ts;            ///< timestamp of the last keyframe returned
+} ThumbReader;
+
+int thumb_init(InputFile *f, int nb_thumbs, int nb_candidates)
+{
+    AVFormatContext *ic = f->ctx;
+    ThumbReader *t;
+    AVStream *st;
+    int idx;
+
+    idx = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (idx < 0) {
+        av_log(ic, AV_LOG_ERROR, "No video stream to extract thumbnails from\n");
+        return idx;
+    }
+    st = ic->streams[idx];
+
+    t = av_mallocz(sizeof(*t));
+    if (!t)
+        return AVERROR(ENOMEM);
+    t->st          = st;
+    t->nb_targets  = nb_thumbs * nb_candidates;
+    t->last_index  = -1;
+    t->last_ts     = AV_NOPTS_VALUE;
+
+    if (st->start_time != AV_NOPTS_VALUE)
+        t->start = st->start_time;
+    else if (ic->start_time != AV_NOPTS_VALUE)
+        t->start = av_rescale_q(ic->start_time, AV_TIME_BASE_Q, st->time_base);
+
+    if (st->duration > 0)
+        t->duration = st->duration;
+    else if (ic->duration > 0)
+        t->duration = av_rescale_q(ic->duration, AV_TIME_BASE_Q, st->time_base);
+    if (t->duration <= 0) {
+        av_log(ic, AV_LOG_ERROR, "Cannot extract thumbnails, the duration of the input is unknown\n");
+        av_free(t);
+        return AVERROR(EINVAL);
+    }
+
+    av_log(ic, AV_LOG_VERBOSE, "Extracting %d thumbnails from %d keyframes of stream #%d\n",
+           nb_thumbs, t->nb_targets, idx);
+
+    f->thumb = t;
+    return 0;
+}
+
+/* Return the keyframe packet closest before the next target timestamp, or
+ * the first one after it when the demuxer cannot seek there exactly. Targets
+ * that would return the keyframe already returned for the previous target
+ * are skipped, so that no frame is decoded twice. */
+int thumb_read_packet(InputFile *f, AVPacket *pkt)
+{
+    AVFormatContext *ic = f->ctx;
+    ThumbReader *t = f->thumb;
+    AVStream *st = t->st;
+    int ret;
+
+    while (t->next_target < t->nb_targets) {
+        int64_t ts = t->start + av_rescale(t->duration, 2 * t->next_target + 1,
+                                           2 * t->nb_targets);
+        int index = av_index_search_timestamp(st, ts, AVSEEK_FLAG_BACKWARD);
+
+        t->next_target++;
+        if (index >= 0 && index == t->last_index)
+            continue;
+
+        ret = avformat_seek_file(ic, st->index, INT64_MIN, ts, ts, 0);
+        if (ret < 0)
+            ret = avformat_seek_file(ic, st->index, ts, ts, INT64_MAX, 0);
+        if (ret < 0) {
+            av_log(ic, AV_LOG_WARNING, "Could not seek to %0.3f for a thumbnail\n",
+                   ts * av_q2d(st->time_base));
+            continue;
+        }
+
+        while ((ret = av_read_frame(ic, pkt)) >= 0) {
+            if (pkt->stream_index == st->index && (pkt->flags & AV_PKT_FLAG_KEY))
+                break;
+            av_packet_unref(pkt);
+        }
+        if (ret < 0)
+            return ret;
+
+        ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (ts != AV_NOPTS_VALUE && t->last_ts != AV_NOPTS_VALUE && ts <= t->last_ts) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        t->last_index = index;
+        t->last_ts    = ts;
+        return 0;
+    }
+
+    return AVERROR_EOF;
+}
+
+void thumb_uninit(InputFile *f)
+{
+    av_freep(&f->thumb);
+}
@@ -0,0 +1,691 @@
+/*
+ * H.264 reduced resolution macroblock decoding
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * H.264 reduced resolution macroblock decoding
+ *
+ * With AVCodecContext.lowres set, the pictures are stored at 1/2, 1/4 or 1/8
+ * of the coded size. Inter macroblocks are reconstructed directly at that
+ * size: motion compensation interpolates bilinearly in the downscaled
+ * reference pictures and the residual goes through inverse transforms
+ * reduced to the downscaled output samples. Intra macroblocks are decoded
+ * at full size and downscaled. The loop filter is not applied. This is not
+ * a conforming decoder: the output drifts from the normative one along each
+ * GOP and is only meant for previews.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/common.h"
+#include "libavutil/mem_internal.h"
+
+#include "avcodec.h"
+#include "h264dec.h"
+#include "h264_ps.h"
+#include "thread.h"
+
+/* H.264 inverse transform basis functions averaged over groups of
+ * 1 << lowres output samples, in units of 1/64: entry [lowres][m][k] is the
+ * weight of coefficient k in downscaled sample m. A 4x4 block is smaller
+ * than an output sample at lowres 3 and only contributes a quarter of it. */
+static const int8_t lowres_idct4[4][2][4] = {
+    { { 0 } },
+    { { 64,  48,  0, -16 }, { 64, -48,  0,  16 } },
+    { { 64,   0,  0,   0 } },
+    { { 32,   0,  0,   0 } },
+};
+
+static const int8_t lowres_idct8[4][4][8] = {
+    { { 0 } },
+    { { 64,  88,  48,  28,   0, -24, -16, -12 },
+      { 64,  36, -48, -72,   0,  52,  16,  -8 },
+      { 64, -36, -48,  72,   0, -52,  16,   8 },
+      { 64, -88,  48, -28,   0,  24, -16,  12 } },
+    { { 64,  62,   0, -22,   0,  14,   0, -10 },
+      { 64, -62,   0,  22,   0, -14,   0,  10 } },
+    { { 64,   0,   0,   0,   0,   0,   0,   0 } },
+};
+
+/* position of the 4x4 luma block i in its macroblock, in samples */
+#define BLOCK_X(i) (4 * (((i) & 1) | (((i) >> 1) & 2)))
+#define BLOCK_Y(i) (4 * ((((i) >> 1) & 1) | (((i) >> 2) & 2)))
+
+/* residual of a downscaled macroblock, in units of 1/4096 */
+#define RES_STRIDE 8
+
+/**
+ * Add the downscaled inverse transform of a size x size coefficient block
+ * to the residual and clear the coefficients.
+ */
+static void add_residual(int *res, int16_t *block, int size, int lowres,
+                         int dc_only)
+{
+    const int8_t *d = size == 4 ? lowres_idct4[lowres][0] : lowres_idct8[lowres][0];
+    const int n = FFMAX(size >> lowres, 1);
+    int tmp[8][4];
+    int x, y, u, v;
+
+    if (dc_only) {
+        const int dc = block[0] * d[0] * d[0] >> 6;
+        for (y = 0; y < n; y++)
+            for (x = 0; x < n; x++)
+                res[y * RES_STRIDE + x] += dc;
+        block[0] = 0;
+        return;
+    }
+
+    /* coefficient v + size * u has the vertical frequency v and the
+     * horizontal frequency u */
+    for (v = 0; v < size; v++) {
+        for (x = 0; x < n; x++) {
+            int sum = 0;
+            for (u = 0; u < size; u++)
+                sum += d[x * size + u] * block[v + size * u];
+            tmp[v][x] = (sum + 32) >> 6;
+        }
+    }
+    for (y = 0; y < n; y++) {
+        for (x = 0; x < n; x++) {
+            int sum = 0;
+            for (v = 0; v < size; v++)
+                sum += d[y * size + v] * tmp[v][x];
+            res[y * RES_STRIDE + x] += sum;
+        }
+    }
+    memset(block, 0, size * size * sizeof(*block));
+}
+
+static void put_residual(uint8_t *dst, ptrdiff_t stride, int *res, int w, int h)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++, dst += stride, res += RES_STRIDE) {
+        for (x = 0; x < w; x++) {
+            dst[x] = av_clip_uint8(dst[x] + ((res[x] + 2048) >> 12));
+            res[x] = 0;
+        }
+    }
+}
+
+static void downscale_block(uint8_t *dst, ptrdiff_t stride,
+                            const uint8_t *src, ptrdiff_t src_stride,
+                            int size, int lowres)
+{
+    const int s     = 1 << lowres;
+    const int n     = size >> lowres;
+    const int round = 1 << (2 * lowres - 1);
+    int x, y, i, j;
+
+    for (y = 0; y < n; y++) {
+        for (x = 0; x < n; x++) {
+            const uint8_t *p = src + (y * src_stride + x) * s;
+            int sum = 0;
+            for (j = 0; j < s; j++)
+                for (i = 0; i < s; i++)
+                    sum += p[j * src_stride + i];
+            dst[y * stride + x] = (sum + round) >> (2 * lowres);
+        }
+    }
+}
+
+/* Intra macroblocks are reconstructed at full size from the full size
+ * bottom row and right column saved for their neighbours, then downscaled:
+ * predicting from downscaled neighbours turns every edge into a bias that
+ * the residual does not correct and that spreads along the prediction. */
+#define INTRA_STRIDE 48
+
+#define LUMA_OFFSET(i)   (BLOCK_X(i) + BLOCK_Y(i) * INTRA_STRIDE)
+#define CHROMA_OFFSET(i) (((i) & 1) * 4 + ((i) >> 1) * 4 * INTRA_STRIDE)
+
+static const int intra_block_offset[48] = {
+    LUMA_OFFSET(0),    LUMA_OFFSET(1),    LUMA_OFFSET(2),    LUMA_OFFSET(3),
+    LUMA_OFFSET(4),    LUMA_OFFSET(5),    LUMA_OFFSET(6),    LUMA_OFFSET(7),
+    LUMA_OFFSET(8),    LUMA_OFFSET(9),    LUMA_OFFSET(10),   LUMA_OFFSET(11),
+    LUMA_OFFSET(12),   LUMA_OFFSET(13),   LUMA_OFFSET(14),   LUMA_OFFSET(15),
+    CHROMA_OFFSET(0),  CHROMA_OFFSET(1),  CHROMA_OFFSET(2),  CHROMA_OFFSET(3),
+    [32] =
+    CHROMA_OFFSET(0),  CHROMA_OFFSET(1),  CHROMA_OFFSET(2),  CHROMA_OFFSET(3),
+};
+
+/**
+ * Copy the full size neighbours of the current macroblock around the
+ * intra reconstruction buffers. The bottom rows of the macroblock row
+ * above are in sl->top_borders[(mb_y & 1) ^ 1], unused otherwise since
+ * the loop filter is disabled.
+ */
+static void load_borders(const H264Context *h, H264SliceContext *sl,
+                         uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    uint8_t (*const top)[(16 * 3) * 2] = sl->top_borders[(sl->mb_y & 1) ^ 1];
+    const ptrdiff_t stride = INTRA_STRIDE;
+    const int mb_x = sl->mb_x;
+    int i;
+
+    memcpy(y  - stride, top[mb_x],      16);
+    memcpy(cb - stride, top[mb_x] + 16, 8);
+    memcpy(cr - stride, top[mb_x] + 32, 8);
+    if (mb_x + 1 < h->mb_width)
+        memcpy(y - stride + 16, top[mb_x + 1], 8);
+    else
+        memset(y - stride + 16, top[mb_x][15], 8);
+    if (mb_x) {
+        y [-stride - 1] = top[mb_x - 1][15];
+        cb[-stride - 1] = top[mb_x - 1][16 + 7];
+        cr[-stride - 1] = top[mb_x - 1][32 + 7];
+    }
+    for (i = 0; i < 16; i++)
+        y[i * stride - 1] = sl->lowres_left[0][i];
+    for (i = 0; i < 8; i++) {
+        cb[i * stride - 1] = sl->lowres_left[1][i];
+        cr[i * stride - 1] = sl->lowres_left[2][i];
+    }
+}
+
+/**
+ * Save the bottom row and right column of a macroblock available at full
+ * size, for the intra prediction of its neighbours.
+ */
+static void save_borders(H264SliceContext *sl,
+                         const uint8_t *y, ptrdiff_t stride,
+                         const uint8_t *cb, const uint8_t *cr, ptrdiff_t uvstride)
+{
+    uint8_t *const top = sl->top_borders[sl->mb_y & 1][sl->mb_x];
+    int i;
+
+    memcpy(top,      y  + 15 * stride,  16);
+    memcpy(top + 16, cb + 7 * uvstride, 8);
+    memcpy(top + 32, cr + 7 * uvstride, 8);
+    for (i = 0; i < 16; i++)
+        sl->lowres_left[0][i] = y[i * stride + 15];
+    for (i = 0; i < 8; i++) {
+        sl->lowres_left[1][i] = cb[i * uvstride + 7];
+        sl->lowres_left[2][i] = cr[i * uvstride + 7];
+    }
+}
+
+/**
+ * Save the borders of an inter macroblock, upsampled from its downscaled
+ * edge samples.
+ */
+static void save_borders_lowres(H264SliceContext *sl, const uint8_t *y,
+                                const uint8_t *cb, const uint8_t *cr,
+                                int lowres)
+{
+    const ptrdiff_t linesize   = sl->mb_linesize;
+    const ptrdiff_t uvlinesize = sl->mb_uvlinesize;
+    const int last  = (16 >> lowres) - 1;
+    const int clast = (8 >> lowres) - 1;
+    uint8_t *const top = sl->top_borders[sl->mb_y & 1][sl->mb_x];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        top[i]                = y[last * linesize + (i >> lowres)];
+        sl->lowres_left[0][i] = y[(i >> lowres) * linesize + last];
+    }
+    for (i = 0; i < 8; i++) {
+        top[16 + i]           = cb[clast * uvlinesize + (i >> lowres)];
+        top[32 + i]           = cr[clast * uvlinesize + (i >> lowres)];
+        sl->lowres_left[1][i] = cb[(i >> lowres) * uvlinesize + clast];
+        sl->lowres_left[2][i] = cr[(i >> lowres) * uvlinesize + clast];
+    }
+}
+
+/**
+ * Reconstruct an intra macroblock at full size, like hl_decode_mb() does
+ * for 8-bit progressive content without transform bypass.
+ */
+static void hl_decode_mb_intra(const H264Context *h, H264SliceContext *sl,
+                               int mb_type, uint8_t *dest_y,
+                               uint8_t *dest_cb, uint8_t *dest_cr, int chroma)
+{
+    const int *block_offset = intra_block_offset;
+    const ptrdiff_t stride  = INTRA_STRIDE;
+    int i;
+
+    if (IS_INTRA4x4(mb_type)) {
+        if (IS_8x8DCT(mb_type)) {
+            for (i = 0; i < 16; i += 4) {
+                uint8_t *const ptr = dest_y + block_offset[i];
+                const int dir      = sl->intra4x4_pred_mode_cache[scan8[i]];
+                const int nnz      = sl->non_zero_count_cache[scan8[i]];
+
+                h->hpc.pred8x8l[dir](ptr, (sl->topleft_samples_available << i) & 0x8000,
+                                     (sl->topright_samples_available << i) & 0x4000, stride);
+                if (nnz) {
+                    if (nnz == 1 && sl->mb[i * 16])
+                        h->h264dsp.h264_idct8_dc_add(ptr, sl->mb + i * 16, stride);
+                    else
+                        h->h264dsp.h264_idct8_add(ptr, sl->mb + i * 16, stride);
+                }
+            }
+        } else {
+            for (i = 0; i < 16; i++) {
+                uint8_t *const ptr = dest_y + block_offset[i];
+                const int dir      = sl->intra4x4_pred_mode_cache[scan8[i]];
+                const int nnz      = sl->non_zero_count_cache[scan8[i]];
+                uint8_t *topright  = NULL;
+                uint32_t tr;
+
+                if (dir == DIAG_DOWN_LEFT_PRED || dir == VERT_LEFT_PRED) {
+                    if ((sl->topright_samples_available << i) & 0x8000) {
+                        topright = ptr + 4 - stride;
+                    } else {
+                        tr       = ptr[3 - stride] * 0x01010101u;
+                        topright = (uint8_t *)&tr;
+                    }
+                }
+                h->hpc.pred4x4[dir](ptr, topright, stride);
+                if (nnz) {
+                    if (nnz == 1 && sl->mb[i * 16])
+                        h->h264dsp.h264_idct_dc_add(ptr, sl->mb + i * 16, stride);
+                    else
+                        h->h264dsp.h264_idct_add(ptr, sl->mb + i * 16, stride);
+                }
+            }
+        }
+    } else {
+        h->hpc.pred16x16[sl->intra16x16_pred_mode](dest_y, stride);
+        if (sl->non_zero_count_cache[scan8[LUMA_DC_BLOCK_INDEX]])
+            h->h264dsp.h264_luma_dc_dequant_idct(sl->mb, sl->mb_luma_dc[0],
+                                                 h->ps.pps->dequant4_coeff[0][sl->qscale][0]);
+        h->h264dsp.h264_idct_add16intra(dest_y, block_offset, sl->mb, stride,
+                                        sl->non_zero_count_cache);
+    }
+
+    if (!chroma)
+        return;
+
+    h->hpc.pred8x8[sl->chroma_pred_mode](dest_cb, stride);
+    h->hpc.pred8x8[sl->chroma_pred_mode](dest_cr, stride);
+    if (sl->cbp & 0x30) {
+        uint8_t *dest[2] = { dest_cb, dest_cr };
+
+        if (sl->non_zero_count_cache[scan8[CHROMA_DC_BLOCK_INDEX + 0]])
+            h->h264dsp.h264_chroma_dc_dequant_idct(sl->mb + 16 * 16 * 1,
+                                                   h->ps.pps->dequant4_coeff[1][sl->chroma_qp[0]][0]);
+        if (sl->non_zero_count_cache[scan8[CHROMA_DC_BLOCK_INDEX + 1]])
+            h->h264dsp.h264_chroma_dc_dequant_idct(sl->mb + 16 * 16 * 2,
+                                                   h->ps.pps->dequant4_coeff[2][sl->chroma_qp[1]][0]);
+        h->h264dsp.h264_idct_add8(dest, block_offset, sl->mb, stride,
+                                  sl->non_zero_count_cache);
+    }
+}
+
+static void residual_luma_lowres(H264SliceContext *sl, int mb_type, int lowres,
+                                 int *res)
+{
+    const int size = IS_8x8DCT(mb_type) ? 8 : 4;
+    const int step = size == 8 ? 4 : 1;
+    int i;
+
+    for (i = 0; i < 16; i += step) {
+        const int nnz = sl->non_zero_count_cache[scan8[i]];
+        if (nnz)
+            add_residual(res + (BLOCK_Y(i) >> lowres) * RES_STRIDE + (BLOCK_X(i) >> lowres),
+                         sl->mb + i * 16, size, lowres, nnz == 1 && sl->mb[i * 16]);
+    }
+}
+
+static void weight_lowres(uint8_t *block, ptrdiff_t stride, int w, int h,
+                          int log2_denom, int weight, int offset)
+{
+    int x, y;
+
+    offset = (unsigned)offset << log2_denom;
+    if (log2_denom)
+        offset += 1 << (log2_denom - 1);
+    for (y = 0; y < h; y++, block += stride)
+        for (x = 0; x < w; x++)
+            block[x] = av_clip_uint8((block[x] * weight + offset) >> log2_denom);
+}
+
+static void biweight_lowres(uint8_t *dst, const uint8_t *src, ptrdiff_t stride,
+                            int w, int h, int log2_denom,
+                            int weightd, int weights, int offset)
+{
+    int x, y;
+
+    offset = (unsigned)((offset + 1) | 1) << log2_denom;
+    for (y = 0; y < h; y++, dst += stride, src += stride)
+        for (x = 0; x < w; x++)
+            dst[x] = av_clip_uint8((src[x] * weights + dst[x] * weightd + offset) >>
+                                   (log2_denom + 1));
+}
+
+/**
+ * Predict a partition from one reference picture, bilinearly interpolated
+ * in the downscaled reference.
+ *
+ * @param x, y   partition position in the full size picture
+ * @param lw, lh downscaled luma size, 0 to skip luma
+ * @param cw, ch downscaled chroma size, 0 to skip chroma
+ */
+static void mc_dir_lowres(const H264Context *h, H264SliceContext *sl,
+                          const H264Ref *ref, int n, int list, int x, int y,
+                          int lw, int lh, int cw, int ch,
+                          uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
+                          const h264_chroma_mc_func *op, int lowres)
+{
+    const int mx         = sl->mv_cache[list][scan8[n]][0];
+    const int my         = sl->mv_cache[list][scan8[n]][1];
+    const int pic_width  = 16 * h->mb_width  >> lowres;
+    const int pic_height = 16 * h->mb_height >> lowres;
+    const ptrdiff_t linesize   = sl->mb_linesize;
+    const ptrdiff_t uvlinesize = sl->mb_uvlinesize;
+    int px, py, sx, sy, i;
+
+    if (lw) {
+        /* quarter sample luma vectors, in 1/8 of a downscaled sample */
+        const uint8_t *src;
+
+        px  = (x * 4 + mx) * 2 >> lowres;
+        py  = (y * 4 + my) * 2 >> lowres;
+        sx  = px >> 3;
+        sy  = py >> 3;
+        src = ref->data[0] + sx + sy * linesize;
+        if (sx < 0 || sy < 0 || sx + lw + 1 > pic_width || sy + lh + 1 > pic_height) {
+            h->vdsp.emulated_edge_mc(sl->edge_emu_buffer, src, linesize, linesize,
+                                     lw + 1, lh + 1, sx, sy, pic_width, pic_height);
+            src = sl->edge_emu_buffer;
+        }
+        op[3 - av_log2(lw)](dest_y, (uint8_t *)src, linesize, lh, px & 7, py & 7);
+    }
+
+    if (!cw)
+        return;
+
+    /* the luma vectors are in 1/8 of a chroma sample */
+    px = ((x >> 1) * 8 + mx) >> lowres;
+    py = ((y >> 1) * 8 + my) >> lowres;
+    sx = px >> 3;
+    sy = py >> 3;
+    for (i = 1; i < 3; i++) {
+        const uint8_t *src = ref->data[i] + sx + sy * uvlinesize;
+        uint8_t *dst       = i == 1 ? dest_cb : dest_cr;
+
+        if (sx < 0 || sy < 0 || sx + cw + 1 > pic_width >> 1 || sy + ch + 1 > pic_height >> 1) {
+            h->vdsp.emulated_edge_mc(sl->edge_emu_buffer, src, uvlinesize, uvlinesize,
+                                     cw + 1, ch + 1, sx, sy,
+                                     pic_width >> 1, pic_height >> 1);
+            src = sl->edge_emu_buffer;
+        }
+        op[3 - av_log2(cw)](dst, (uint8_t *)src, uvlinesize, ch, px & 7, py & 7);
+    }
+}
+
+/**
+ * @param x, y partition offset in the macroblock, in full size luma samples
+ * @param w, h partition size, in full size luma samples
+ */
+static void mc_part_lowres(const H264Context *h, H264SliceContext *sl,
+                           int n, int x, int y, int w, int hgt,
+                           uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
+                           int list0, int list1, int lowres)
+{
+    const int mask = (1 << lowres) - 1;
+    const ptrdiff_t linesize   = sl->mb_linesize;
+    const ptrdiff_t uvlinesize = sl->mb_uvlinesize;
+    const int refn0 = sl->ref_cache[0][scan8[n]];
+    const int refn1 = sl->ref_cache[1][scan8[n]];
+    const h264_chroma_mc_func *put = h->h264chroma.put_h264_chroma_pixels_tab;
+    const h264_chroma_mc_func *avg = h->h264chroma.avg_h264_chroma_pixels_tab;
+    int lw = w   >> lowres;
+    int lh = hgt >> lowres;
+    int cw = w   >> (lowres + 1);
+    int ch = hgt >> (lowres + 1);
+
+    /* partitions smaller than a downscaled sample are predicted once for
+     * the whole sample, from the motion of the top-left one */
+    if (!lw)
+        lw = !(x & mask);
+    if (!lh)
+        lh = !(y & mask);
+    if (!cw)
+        cw = !((x >> 1) & mask);
+    if (!ch)
+        ch = !((y >> 1) & mask);
+    if (!lw || !lh)
+        lw = lh = 0;
+    if (!cw || !ch || (CONFIG_GRAY && h->flags & AV_CODEC_FLAG_GRAY))
+        cw = ch = 0;
+    if (!lw && !cw)
+        return;
+
+    dest_y  += (x >> lowres)       + (y >> lowres)       * linesize;
+    dest_cb += (x >> (lowres + 1)) + (y >> (lowres + 1)) * uvlinesize;
+    dest_cr += (x >> (lowres + 1)) + (y >> (lowres + 1)) * uvlinesize;
+    x += 16 * sl->mb_x;
+    y += 16 * sl->mb_y;
+
+    if ((sl->pwt.use_weight == 2 && list0 && list1 &&
+         sl->pwt.implicit_weight[refn0][refn1][sl->mb_y & 1] != 32) ||
+        sl->pwt.use_weight == 1) {
+        if (list0 && list1) {
+            uint8_t *tmp_y  = sl->bipred_scratchpad;
+            uint8_t *tmp_cb = sl->bipred_scratchpad + 16 * linesize;
+            uint8_t *tmp_cr = tmp_cb + 8;
+            int log2_denom, w0[3], w1[3], offset[3], i;
+
+            mc_dir_lowres(h, sl, &sl->ref_list[0][refn0], n, 0, x, y, lw, lh, cw, ch,
+                          dest_y, dest_cb, dest_cr, put, lowres);
+            mc_dir_lowres(h, sl, &sl->ref_list[1][refn1], n, 1, x, y, lw, lh, cw, ch,
+                          tmp_y, tmp_cb, tmp_cr, put, lowres);
+
+            if (sl->pwt.use_weight == 2) {
+                w0[0] = w0[1] = w0[2] = sl->pwt.implicit_weight[refn0][refn1][sl->mb_y & 1];
+                w1[0] = w1[1] = w1[2] = 64 - w0[0];
+                offset[0] = offset[1] = offset[2] = 0;
+                log2_denom = 5;
+                if (lw)
+                    biweight_lowres(dest_y, tmp_y, linesize, lw, lh, log2_denom,
+                                    w0[0], w1[0], offset[0]);
+                if (cw) {
+                    biweight_lowres(dest_cb, tmp_cb, uvlinesize, cw, ch, log2_denom,
+                                    w0[1], w1[1], offset[1]);
+                    biweight_lowres(dest_cr, tmp_cr, uvlinesize, cw, ch, log2_denom,
+                                    w0[2], w1[2], offset[2]);
+                }
+            } else {
+                if (lw)
+                    biweight_lowres(dest_y, tmp_y, linesize, lw, lh,
+                                    sl->pwt.luma_log2_weight_denom,
+                                    sl->pwt.luma_weight[refn0][0][0],
+                                    sl->pwt.luma_weight[refn1][1][0],
+                                    sl->pwt.luma_weight[refn0][0][1] +
+                                    sl->pwt.luma_weight[refn1][1][1]);
+                for (i = 0; i < 2 && cw; i++)
+                    biweight_lowres(i ? dest_cr : dest_cb, i ? tmp_cr : tmp_cb,
+                                    uvlinesize, cw, ch,
+                                    sl->pwt.chroma_log2_weight_denom,
+                                    sl->pwt.chroma_weight[refn0][0][i][0],
+                                    sl->pwt.chroma_weight[refn1][1][i][0],
+                                    sl->pwt.chroma_weight[refn0][0][i][1] +
+                                    sl->pwt.chroma_weight[refn1][1][i][1]);
+            }
+        } else {
+            const int list = list1 ? 1 : 0;
+            const int refn = list1 ? refn1 : refn0;
+            int i;
+
+            mc_dir_lowres(h, sl, &sl->ref_list[list][refn], n, list, x, y, lw, lh, cw, ch,
+                          dest_y, dest_cb, dest_cr, put, lowres);
+            if (lw)
+                weight_lowres(dest_y, linesize, lw, lh,
+                              sl->pwt.luma_log2_weight_denom,
+                              sl->pwt.luma_weight[refn][list][0],
+                              sl->pwt.luma_weight[refn][list][1]);
+            for (i = 0; i < 2 && cw && sl->pwt.use_weight_chroma; i++)
+                weight_lowres(i ? dest_cr : dest_cb, uvlinesize, cw, ch,
+                              sl->pwt.chroma_log2_weight_denom,
+                              sl->pwt.chroma_weight[refn][list][i][0],
+                              sl->pwt.chroma_weight[refn][list][i][1]);
+        }
+        return;
+    }
+
+    if (list0)
+        mc_dir_lowres(h, sl, &sl->ref_list[0][refn0], n, 0, x, y, lw, lh, cw, ch,
+                      dest_y, dest_cb, dest_cr, put, lowres);
+    if (list1)
+        mc_dir_lowres(h, sl, &sl->ref_list[1][refn1], n, 1, x, y, lw, lh, cw, ch,
+                      dest_y, dest_cb, dest_cr, list0 ? avg : put, lowres);
+}
+
+static void hl_motion_lowres(const H264Context *h, H264SliceContext *sl,
+                             int mb_type, uint8_t *dest_y,
+                             uint8_t *dest_cb, uint8_t *dest_cr, int lowres)
+{
+    int i, j;
+
+    if (HAVE_THREADS && (h->avctx->active_thread_type & FF_THREAD_FRAME))
+        ff_h264_await_references(h, sl);
+
+    if (IS_16X16(mb_type)) {
+        mc_part_lowres(h, sl, 0, 0, 0, 16, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), lowres);
+    } else if (IS_16X8(mb_type)) {
+        mc_part_lowres(h, sl, 0, 0, 0, 16, 8, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), lowres);
+        mc_part_lowres(h, sl, 8, 0, 8, 16, 8, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1), lowres);
+    } else if (IS_8X16(mb_type)) {
+        mc_part_lowres(h, sl, 0, 0, 0, 8, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1), lowres);
+        mc_part_lowres(h, sl, 4, 8, 0, 8, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1), lowres);
+    } else {
+        av_assert2(IS_8X8(mb_type));
+
+        for (i = 0; i < 4; i++) {
+            const int sub_mb_type = sl->sub_mb_type[i];
+            const int n     = 4 * i;
+            const int x     = (i & 1) * 8;
+            const int y     = (i & 2) * 4;
+            const int list0 = IS_DIR(sub_mb_type, 0, 0);
+            const int list1 = IS_DIR(sub_mb_type, 0, 1);
+
+            if (IS_SUB_8X8(sub_mb_type)) {
+                mc_part_lowres(h, sl, n, x, y, 8, 8, dest_y, dest_cb, dest_cr,
+                               list0, list1, lowres);
+            } else if (IS_SUB_8X4(sub_mb_type)) {
+                mc_part_lowres(h, sl, n, x, y, 8, 4, dest_y, dest_cb, dest_cr,
+                               list0, list1, lowres);
+                mc_part_lowres(h, sl, n + 2, x, y + 4, 8, 4, dest_y, dest_cb, dest_cr,
+                               list0, list1, lowres);
+            } else if (IS_SUB_4X8(sub_mb_type)) {
+                mc_part_lowres(h, sl, n, x, y, 4, 8, dest_y, dest_cb, dest_cr,
+                               list0, list1, lowres);
+                mc_part_lowres(h, sl, n + 1, x + 4, y, 4, 8, dest_y, dest_cb, dest_cr,
+                               list0, list1, lowres);
+            } else {
+                av_assert2(IS_SUB_4X4(sub_mb_type));
+                for (j = 0; j < 4; j++)
+                    mc_part_lowres(h, sl, n + j, x + (j & 1) * 4, y + (j & 2) * 2,
+                                   4, 4, dest_y, dest_cb, dest_cr,
+                                   list0, list1, lowres);
+            }
+        }
+    }
+}
+
+void ff_h264_hl_decode_mb_lowres(const H264Context *h, H264SliceContext *sl)
+{
+    const int lowres   = h->cur_lowres;
+    const int mb_xy    = sl->mb_xy;
+    const int mb_type  = h->cur_pic.mb_type[mb_xy];
+    const int size     = 16 >> lowres;
+    const int csize    = 8 >> lowres;
+    const int chroma   = !CONFIG_GRAY || !(h->flags & AV_CODEC_FLAG_GRAY);
+    const ptrdiff_t linesize   = sl->linesize;
+    const ptrdiff_t uvlinesize = sl->uvlinesize;
+    uint8_t *dest_y  = h->cur_pic.f->data[0] + (sl->mb_x + sl->mb_y * linesize)   * size;
+    uint8_t *dest_cb = h->cur_pic.f->data[1] + (sl->mb_x + sl->mb_y * uvlinesize) * csize;
+    uint8_t *dest_cr = h->cur_pic.f->data[2] + (sl->mb_x + sl->mb_y * uvlinesize) * csize;
+    int res[8 * RES_STRIDE] = { 0 };
+    int i;
+
+    h->list_counts[mb_xy] = sl->list_count;
+    sl->mb_linesize       = linesize;
+    sl->mb_uvlinesize     = uvlinesize;
+
+    if (IS_INTRA(mb_type)) {
+        LOCAL_ALIGNED_16(uint8_t, buf, [26 * INTRA_STRIDE]);
+        uint8_t *const y  = buf + INTRA_STRIDE + 16;
+        uint8_t *const cb = buf + 18 * INTRA_STRIDE + 16;
+        uint8_t *const cr = cb + 16;
+
+        if (IS_INTRA_PCM(mb_type)) {
+            for (i = 0; i < 16; i++)
+                memcpy(y + i * INTRA_STRIDE, sl->intra_pcm_ptr + i * 16, 16);
+            for (i = 0; i < 8; i++) {
+                if (h->ps.sps->chroma_format_idc) {
+                    memcpy(cb + i * INTRA_STRIDE, sl->intra_pcm_ptr + 256 + i * 8,      8);
+                    memcpy(cr + i * INTRA_STRIDE, sl->intra_pcm_ptr + 256 + 64 + i * 8, 8);
+                } else {
+                    memset(cb + i * INTRA_STRIDE, 128, 8);
+                    memset(cr + i * INTRA_STRIDE, 128, 8);
+                }
+            }
+        } else {
+            load_borders(h, sl, y, cb, cr);
+            hl_decode_mb_intra(h, sl, mb_type, y, cb, cr, chroma);
+        }
+
+        downscale_block(dest_y, linesize, y, INTRA_STRIDE, 16, lowres);
+        if (chroma) {
+            downscale_block(dest_cb, uvlinesize, cb, INTRA_STRIDE, 8, lowres);
+            downscale_block(dest_cr, uvlinesize, cr, INTRA_STRIDE, 8, lowres);
+        }
+        save_borders(sl, y, INTRA_STRIDE, cb, cr, INTRA_STRIDE);
+        return;
+    }
+
+    hl_motion_lowres(h, sl, mb_type, dest_y, dest_cb, dest_cr, lowres);
+
+    if (sl->cbp & 15) {
+        residual_luma_lowres(sl, mb_type, lowres, res);
+        put_residual(dest_y, linesize, res, size, size);
+    }
+
+    if (chroma && (sl->cbp & 0x30)) {
+        for (i = 0; i < 2; i++) {
+            int16_t *mb   = sl->mb + 16 * 16 * (i + 1);
+            uint8_t *dest = i ? dest_cr : dest_cb;
+            int j;
+
+            if (sl->non_zero_count_cache[scan8[CHROMA_DC_BLOCK_INDEX + i]])
+                h->h264dsp.h264_chroma_dc_dequant_idct(mb,
+                                                       h->ps.pps->dequant4_coeff[4 + i][sl->chroma_qp[i]][0]);
+            for (j = 0; j < 4; j++) {
+                const int nnz = sl->non_zero_count_cache[scan8[16 * (i + 1) + j]];
+                if (nnz || mb[j * 16])
+                    add_residual(res + ((j >> 1) * 4 >> lowres) * RES_STRIDE + ((j & 1) * 4 >> lowres),
+                                 mb + j * 16, 4, lowres, !nnz);
+            }
+            put_residual(dest, uvlinesize, res, csize, csize);
+        }
+    }
+
+    save_borders_lowres(sl, dest_y, dest_cb, dest_cr, lowres);
+}
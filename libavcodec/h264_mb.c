@@ -93,7 +93,7 @@ static inline void get_lowest_part_y(const H264Context *h, H264SliceContext *sl,
  *
  * @param h the H.264 context
  */
-static void await_references(const H264Context *h, H264SliceContext *sl)
+void ff_h264_await_references(const H264Context *h, H264SliceContext *sl)
 {
     const int mb_xy   = sl->mb_xy;
     const int mb_type = h->cur_pic.mb_type[mb_xy];
@@ -803,6 +803,11 @@ void ff_h264_hl_decode_mb(const H264Context *h, H264SliceContext *sl)
     int is_complex    = CONFIG_SMALL || sl->is_complex ||
                         IS_INTRA_PCM(mb_type) || sl->qscale == 0;
 
+    if (h->cur_lowres) {
+        ff_h264_hl_decode_mb_lowres(h, sl);
+        return;
+    }
+
     if (CHROMA444(h)) {
         if (is_complex || h->pixel_shift)
             hl_decode_mb_444_complex(h, sl);
@@ -28,6 +28,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/display.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
 #include "libavutil/stereo3d.h"
 #include "libavutil/timer.h"
 #include "internal.h"
@@ -308,10 +309,14 @@ int ff_h264_update_thread_context(AVCodecContext *dst,
          !h->ps.sps                                            ||
          h->ps.sps->bit_depth_luma    != h1->ps.sps->bit_depth_luma    ||
          h->ps.sps->chroma_format_idc != h1->ps.sps->chroma_format_idc ||
-         h->ps.sps->colorspace        != h1->ps.sps->colorspace)) {
+         h->ps.sps->colorspace        != h1->ps.sps->colorspace        ||
+         h->cur_lowres                != h1->cur_lowres)) {
         need_reinit = 1;
     }
 
+    /* the source thread may have fallen back to full resolution */
+    h->cur_lowres = h1->cur_lowres;
+
     /* copy block_offset since frame_start may not be called */
     memcpy(h->block_offset, h1->block_offset, sizeof(h->block_offset));
 
@@ -866,6 +871,12 @@ static enum AVPixelFormat get_pixel_format(H264Context *h, int force_callback)
 
     *fmt = AV_PIX_FMT_NONE;
 
+    /* reduced resolution decoding is done in software only */
+    if (h->cur_lowres)
+        while (choices[0] != AV_PIX_FMT_NONE &&
+               av_pix_fmt_desc_get(choices[0])->flags & AV_PIX_FMT_FLAG_HWACCEL)
+            choices++;
+
     for (i=0; choices[i] != AV_PIX_FMT_NONE; i++)
         if (choices[i] == h->avctx->pix_fmt && !force_callback)
             return choices[i];
@@ -886,7 +897,8 @@ static int init_dimensions(H264Context *h)
     av_assert0(sps->crop_top + sps->crop_bottom < (unsigned)h->height);
 
     /* handle container cropping */
-    if (h->width_from_caller > 0 && h->height_from_caller > 0     &&
+    if (!h->cur_lowres                                            &&
+        h->width_from_caller > 0 && h->height_from_caller > 0     &&
         !sps->crop_top && !sps->crop_left                         &&
         FFALIGN(h->width_from_caller,  16) == FFALIGN(width,  16) &&
         FFALIGN(h->height_from_caller, 16) == FFALIGN(height, 16) &&
@@ -903,6 +915,17 @@ static int init_dimensions(H264Context *h)
         h->height_from_caller = 0;
     }
 
+    if (h->cur_lowres) {
+        const int lowres = h->cur_lowres;
+
+        width  = AV_CEIL_RSHIFT(width,  lowres);
+        height = AV_CEIL_RSHIFT(height, lowres);
+        cl >>= lowres;
+        ct >>= lowres;
+        cr   = AV_CEIL_RSHIFT(h->width,  lowres) - width  - cl;
+        cb   = AV_CEIL_RSHIFT(h->height, lowres) - height - ct;
+    }
+
     h->avctx->coded_width  = h->width;
     h->avctx->coded_height = h->height;
     h->avctx->width        = width;
@@ -1013,7 +1036,7 @@ static enum AVPixelFormat non_j_pixfmt(enum AVPixelFormat a)
 static int h264_init_ps(H264Context *h, const H264SliceContext *sl, int first_slice)
 {
     const SPS *sps;
-    int needs_reinit = 0, must_reinit, ret;
+    int needs_reinit = 0, must_reinit, lowres, ret;
 
     if (first_slice) {
         av_buffer_unref(&h->ps.pps_ref);
@@ -1045,14 +1068,29 @@ static int h264_init_ps(H264Context *h, const H264SliceContext *sl, int first_sl
     }
     sps = h->ps.sps;
 
+    /* the requested factor is kept, so that reduced resolution decoding
+     * resumes once the stream switches back to supported content */
+    lowres = h->avctx->lowres;
+    if (lowres &&
+        (sps->bit_depth_luma != 8 || sps->chroma_format_idc > 1 ||
+         !sps->frame_mbs_only_flag || sps->transform_bypass)) {
+        if (h->cur_lowres || !h->context_initialized)
+            av_log(h->avctx, AV_LOG_WARNING, "Reduced resolution decoding of interlaced, "
+                   "lossless, 4:2:2, 4:4:4 or high bit depth streams is not supported, "
+                   "decoding at full resolution\n");
+        lowres = 0;
+    }
+
     must_reinit = (h->context_initialized &&
-                    (   16*sps->mb_width != h->avctx->coded_width
+                    (   h->cur_lowres != lowres
+                     || 16*sps->mb_width != h->avctx->coded_width
                      || 16*sps->mb_height != h->avctx->coded_height
                      || h->cur_bit_depth_luma    != sps->bit_depth_luma
                      || h->cur_chroma_format_idc != sps->chroma_format_idc
                      || h->mb_width  != sps->mb_width
                      || h->mb_height != sps->mb_height
                     ));
+    h->cur_lowres = lowres;
     if (h->avctx->pix_fmt == AV_PIX_FMT_NONE
         || (non_j_pixfmt(h->avctx->pix_fmt) != non_j_pixfmt(get_pixel_format(h, 0))))
         must_reinit = 1;
@@ -1980,7 +2018,8 @@ static int h264_slice_init(H264Context *h, H264SliceContext *sl,
     if (!h->setup_finished)
         ff_h264_direct_ref_list_init(h, sl);
 
-    if (h->avctx->skip_loop_filter >= AVDISCARD_ALL ||
+    if (h->cur_lowres ||
+        h->avctx->skip_loop_filter >= AVDISCARD_ALL ||
         (h->avctx->skip_loop_filter >= AVDISCARD_NONKEY &&
          h->nal_unit_type != H264_NAL_IDR_SLICE) ||
         (h->avctx->skip_loop_filter >= AVDISCARD_NONINTRA &&
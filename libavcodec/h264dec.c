@@ -111,6 +111,12 @@ void ff_h264_draw_horiz_band(const H264Context *h, H264SliceContext *sl,
         height <<= 1;
         y      <<= 1;
     }
+    if (h->cur_lowres) {
+        height = (y + height >> h->cur_lowres) - (y >> h->cur_lowres);
+        y    >>= h->cur_lowres;
+        if (height <= 0)
+            return;
+    }
 
     height = FFMIN(height, avctx->height - y);
 
@@ -434,6 +440,10 @@ static av_cold int h264_decode_init(AVCodecContext *avctx)
     if (h->enable_er < 0 && (avctx->active_thread_type & FF_THREAD_SLICE))
         h->enable_er = 0;
 
+    /* error concealment works on full size macroblocks */
+    if (avctx->lowres)
+        h->enable_er = 0;
+
     if (h->enable_er && (avctx->active_thread_type & FF_THREAD_SLICE)) {
         av_log(avctx, AV_LOG_WARNING,
                "Error resilience with slice threads is enabled. It is unsafe and unsupported and may crash. "
@@ -1088,5 +1098,6 @@ AVCodec ff_h264_decoder = {
     .init_thread_copy      = ONLY_IF_THREADS_ENABLED(decode_init_thread_copy),
     .update_thread_context = ONLY_IF_THREADS_ENABLED(ff_h264_update_thread_context),
     .profiles              = NULL_IF_CONFIG_SMALL(ff_h264_profiles),
+    .max_lowres            = 3,
     .priv_class            = &h264_class,
 };
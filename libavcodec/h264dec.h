@@ -286,6 +286,9 @@ typedef struct H264SliceContext {
     int bipred_scratchpad_allocated;
     int edge_emu_buffer_allocated;
     int top_borders_allocated[2];
+    /* right column of the previous macroblock at full size, for the intra
+     * prediction of reduced resolution decoding */
+    uint8_t lowres_left[3][16];
 
     /**
      * non zero coeff count cache.
@@ -535,6 +538,7 @@ typedef struct H264Context {
 
     int cur_chroma_format_idc;
     int cur_bit_depth_luma;
+    int cur_lowres;      ///< lowres factor in use, 0 while the stream does not support it
     int16_t slice_row[MAX_SLICES]; ///< to detect when MAX_SLICES is too low
 
     /* original AVCodecContext dimensions, used to handle container
@@ -579,6 +583,18 @@ int ff_h264_decode_ref_pic_marking(H264SliceContext *sl, GetBitContext *gb,
                                    const H2645NAL *nal, void *logctx);
 
 void ff_h264_hl_decode_mb(const H264Context *h, H264SliceContext *sl);
+
+/**
+ * Reconstruct a macroblock at the reduced size set by AVCodecContext.lowres.
+ * This is an approximation of the normative decoding process.
+ */
+void ff_h264_hl_decode_mb_lowres(const H264Context *h, H264SliceContext *sl);
+
+/**
+ * Wait until all reference frames are available for MC operations.
+ */
+void ff_h264_await_references(const H264Context *h, H264SliceContext *sl);
+
 void ff_h264_decode_init_vlc(void);
 
 /**
@@ -39,6 +39,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/opt.h"
 #include "libavutil/timer.h"
+#include "libavutil/video_analysis.h"
 #include "avcodec.h"
 #include "dct.h"
 #include "idctdsp.h"
@@ -1139,6 +1140,16 @@ static int get_intra_count(MpegEncContext *s, uint8_t *src,
     return acc;
 }
 
+static const AVVideoAnalysis *get_analysis(MpegEncContext *s, const AVFrame *frame)
+{
+    const AVFrameSideData *sd;
+
+    if (!s->use_analysis)
+        return NULL;
+    sd = av_frame_get_side_data(frame, AV_FRAME_DATA_VIDEO_ANALYSIS);
+    return sd && sd->size >= sizeof(AVVideoAnalysis) ? (const AVVideoAnalysis *)sd->data : NULL;
+}
+
 static int alloc_picture(MpegEncContext *s, Picture *pic, int shared)
 {
     return ff_alloc_picture(s->avctx, pic, &s->me, &s->sc, shared, 1,
@@ -1274,6 +1285,15 @@ static int load_input_picture(MpegEncContext *s, const AVFrame *pic_arg)
         if (ret < 0)
             return ret;
 
+        /* scene changes found by the analysis are coded as I-frames, like
+         * the ones the encoder detects itself */
+        if (s->scenechange_threshold < 1000000000 &&
+            pic->f->pict_type == AV_PICTURE_TYPE_NONE) {
+            const AVVideoAnalysis *analysis = get_analysis(s, pic->f);
+            if (analysis && analysis->scene_change)
+                pic->f->pict_type = AV_PICTURE_TYPE_I;
+        }
+
         pic->f->display_picture_number = display_picture_number;
         pic->f->pts = pts; // we set this here to avoid modifying pic_arg
     } else {
@@ -1497,6 +1517,32 @@ fail:
     return best_b_count;
 }
 
+/**
+ * Choose the number of B-frames as b_frame_strategy 1 does, but from the
+ * analysis side data of the frames.
+ * @return the number of B-frames, or a negative value if a frame has no
+ *         analysis
+ */
+static int analysis_b_count(MpegEncContext *s)
+{
+    int i;
+
+    for (i = 1; i < s->max_b_frames + 1 && s->input_picture[i]; i++)
+        if (!get_analysis(s, s->input_picture[i]->f))
+            return -1;
+
+    for (i = 1; i < s->max_b_frames + 1; i++) {
+        const AVVideoAnalysis *analysis;
+
+        if (!s->input_picture[i])
+            break;
+        analysis = get_analysis(s, s->input_picture[i]->f);
+        if (lrint(analysis->intra_ratio * s->mb_num) > s->mb_num / s->b_sensitivity)
+            break;
+    }
+    return i - 1;
+}
+
 static int select_input_picture(MpegEncContext *s)
 {
     int i, ret;
@@ -1549,6 +1595,8 @@ static int select_input_picture(MpegEncContext *s)
                 b_frames = s->max_b_frames;
                 while (b_frames && !s->input_picture[b_frames])
                     b_frames--;
+            } else if ((b_frames = analysis_b_count(s)) >= 0) {
+                /* decided from the analysis of the frames */
             } else if (s->b_frame_strategy == 1) {
                 for (i = 1; i < s->max_b_frames + 1; i++) {
                     if (s->input_picture[i] &&
@@ -3740,7 +3788,7 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     emms_c();
 
     if (s->me.scene_change_score > s->scenechange_threshold &&
-        s->pict_type == AV_PICTURE_TYPE_P) {
+        s->pict_type == AV_PICTURE_TYPE_P && !get_analysis(s, s->new_picture.f)) {
         s->pict_type= AV_PICTURE_TYPE_I;
         for(i=0; i<s->mb_stride*s->mb_height; i++)
             s->mb_type[i]= CANDIDATE_MB_TYPE_INTRA;
@@ -30,7 +30,6 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/xga_font_data.h"
-#include "libavcodec/avfft.h"
 
 #include "audio.h"
 #include "avfilter.h"
@@ -39,125 +38,15 @@
 #include "internal.h"
 #include "af_afir.h"
 
-static void fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t len)
-{
-    int n;
-
-    for (n = 0; n < len; n++) {
-        const float cre = c[2 * n    ];
-        const float cim = c[2 * n + 1];
-        const float tre = t[2 * n    ];
-        const float tim = t[2 * n + 1];
-
-        sum[2 * n    ] += tre * cre - tim * cim;
-        sum[2 * n + 1] += tre * cim + tim * cre;
-    }
-
-    sum[2 * n] += t[2 * n] * c[2 * n];
-}
-
-static int fir_quantum(AVFilterContext *ctx, AVFrame *out, int ch, int offset)
-{
-    AudioFIRContext *s = ctx->priv;
-    const float *in = (const float *)s->in[0]->extended_data[ch] + offset;
-    float *block, *buf, *ptr = (float *)out->extended_data[ch] + offset;
-    const int nb_samples = FFMIN(s->min_part_size, out->nb_samples - offset);
-    int n, i, j;
-
-    for (int segment = 0; segment < s->nb_segments; segment++) {
-        AudioFIRSegment *seg = &s->seg[segment];
-        float *src = (float *)seg->input->extended_data[ch];
-        float *dst = (float *)seg->output->extended_data[ch];
-        float *sum = (float *)seg->sum->extended_data[ch];
-
-        s->fdsp->vector_fmul_scalar(src + seg->input_offset, in, s->dry_gain, FFALIGN(nb_samples, 4));
-        emms_c();
-
-        seg->output_offset[ch] += s->min_part_size;
-        if (seg->output_offset[ch] == seg->part_size) {
-            seg->output_offset[ch] = 0;
-        } else {
-            memmove(src, src + s->min_part_size, (seg->input_size - s->min_part_size) * sizeof(*src));
-
-            dst += seg->output_offset[ch];
-            for (n = 0; n < nb_samples; n++) {
-                ptr[n] += dst[n];
-            }
-            continue;
-        }
-
-        memset(sum, 0, sizeof(*sum) * seg->fft_length);
-        block = (float *)seg->block->extended_data[ch] + seg->part_index[ch] * seg->block_size;
-        memset(block + seg->part_size, 0, sizeof(*block) * (seg->fft_length - seg->part_size));
-
-        memcpy(block, src, sizeof(*src) * seg->part_size);
-
-        av_rdft_calc(seg->rdft[ch], block);
-        block[2 * seg->part_size] = block[1];
-        block[1] = 0;
-
-        j = seg->part_index[ch];
-
-        for (i = 0; i < seg->nb_partitions; i++) {
-            const int coffset = j * seg->coeff_size;
-            const float *block = (const float *)seg->block->extended_data[ch] + i * seg->block_size;
-            const FFTComplex *coeff = (const FFTComplex *)seg->coeff->extended_data[ch * !s->one2many] + coffset;
-
-            s->afirdsp.fcmul_add(sum, block, (const float *)coeff, seg->part_size);
-
-            if (j == 0)
-                j = seg->nb_partitions;
-            j--;
-        }
-
-        sum[1] = sum[2 * seg->part_size];
-        av_rdft_calc(seg->irdft[ch], sum);
-
-        buf = (float *)seg->buffer->extended_data[ch];
-        for (n = 0; n < seg->part_size; n++) {
-            buf[n] += sum[n];
-        }
-
-        memcpy(dst, buf, seg->part_size * sizeof(*dst));
-
-        buf = (float *)seg->buffer->extended_data[ch];
-        memcpy(buf, sum + seg->part_size, seg->part_size * sizeof(*buf));
-
-        seg->part_index[ch] = (seg->part_index[ch] + 1) % seg->nb_partitions;
-
-        memmove(src, src + s->min_part_size, (seg->input_size - s->min_part_size) * sizeof(*src));
-
-        for (n = 0; n < nb_samples; n++) {
-            ptr[n] += dst[n];
-        }
-    }
-
-    s->fdsp->vector_fmul_scalar(ptr, ptr, s->wet_gain, FFALIGN(nb_samples, 4));
-    emms_c();
-
-    return 0;
-}
-
-static int fir_channel(AVFilterContext *ctx, AVFrame *out, int ch)
-{
-    AudioFIRContext *s = ctx->priv;
-
-    for (int offset = 0; offset < out->nb_samples; offset += s->min_part_size) {
-        fir_quantum(ctx, out, ch, offset);
-    }
-
-    return 0;
-}
-
 static int fir_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    AudioFIRContext *s = ctx->priv;
     AVFrame *out = arg;
     const int start = (out->channels * jobnr) / nb_jobs;
-    const int end = (out->channels * (jobnr+1)) / nb_jobs;
 
-    for (int ch = start; ch < end; ch++) {
-        fir_channel(ctx, out, ch);
-    }
+    av_convolution_process(s->conv[jobnr], (float **)out->extended_data + start, 1,
+                           (const float **)s->in[0]->extended_data + start, 1,
+                           out->nb_samples);
 
     return 0;
 }
@@ -176,8 +65,7 @@ static int fir_frame(AudioFIRContext *s, AVFrame *in, AVFilterLink *outlink)
     if (s->pts == AV_NOPTS_VALUE)
         s->pts = in->pts;
     s->in[0] = in;
-    ctx->internal->execute(ctx, fir_channels, out, NULL, FFMIN(outlink->channels,
-                                                               ff_filter_get_nb_threads(ctx)));
+    ctx->internal->execute(ctx, fir_channels, out, NULL, s->nb_conv);
 
     out->pts = s->pts;
     if (s->pts != AV_NOPTS_VALUE)
@@ -327,44 +215,44 @@ end:
     av_free(mag);
 }
 
-static int init_segment(AVFilterContext *ctx, AudioFIRSegment *seg,
-                        int offset, int nb_partitions, int part_size)
+static int init_conv(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
+    int ret;
 
-    seg->rdft  = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->rdft));
-    seg->irdft = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->irdft));
-    if (!seg->rdft || !seg->irdft)
+    s->nb_conv = FFMIN(s->nb_channels, ff_filter_get_nb_threads(ctx));
+    s->conv = av_calloc(s->nb_conv, sizeof(*s->conv));
+    if (!s->conv)
         return AVERROR(ENOMEM);
 
-    seg->fft_length    = part_size * 2 + 1;
-    seg->part_size     = part_size;
-    seg->block_size    = FFALIGN(seg->fft_length, 32);
-    seg->coeff_size    = FFALIGN(seg->part_size + 1, 32);
-    seg->nb_partitions = nb_partitions;
-    seg->input_size    = offset + s->min_part_size;
-    seg->input_offset  = offset;
-
-    seg->part_index    = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->part_index));
-    seg->output_offset = av_calloc(ctx->inputs[0]->channels, sizeof(*seg->output_offset));
-    if (!seg->part_index || !seg->output_offset)
-        return AVERROR(ENOMEM);
+    for (int i = 0; i < s->nb_conv; i++) {
+        const int start = (s->nb_channels * i) / s->nb_conv;
+        const int end = (s->nb_channels * (i+1)) / s->nb_conv;
+        int ir = 0;
 
-    for (int ch = 0; ch < ctx->inputs[0]->channels; ch++) {
-        seg->rdft[ch]  = av_rdft_init(av_log2(2 * part_size), DFT_R2C);
-        seg->irdft[ch] = av_rdft_init(av_log2(2 * part_size), IDFT_C2R);
-        if (!seg->rdft[ch] || !seg->irdft[ch])
+        s->conv[i] = av_convolution_alloc(end - start, end - start, s->minp, s->maxp,
+                                          s->zero_latency ? 0 : AV_CONVOLUTION_FLAG_BLOCK);
+        if (!s->conv[i])
             return AVERROR(ENOMEM);
-    }
 
-    seg->sum    = ff_get_audio_buffer(ctx->inputs[0], seg->fft_length);
-    seg->block  = ff_get_audio_buffer(ctx->inputs[0], seg->nb_partitions * seg->block_size);
-    seg->buffer = ff_get_audio_buffer(ctx->inputs[0], seg->part_size);
-    seg->coeff  = ff_get_audio_buffer(ctx->inputs[1], seg->nb_partitions * seg->coeff_size * 2);
-    seg->input  = ff_get_audio_buffer(ctx->inputs[0], seg->input_size);
-    seg->output = ff_get_audio_buffer(ctx->inputs[0], seg->part_size);
-    if (!seg->buffer || !seg->sum || !seg->block || !seg->coeff || !seg->input || !seg->output)
-        return AVERROR(ENOMEM);
+        for (int ch = start; ch < end; ch++) {
+            const float *time = (const float *)s->in[1]->extended_data[!s->one2many * ch];
+
+            if (!s->one2many || ch == start) {
+                ir = av_convolution_add_ir(s->conv[i], time, s->nb_taps);
+                if (ir < 0)
+                    return ir;
+            }
+
+            ret = av_convolution_add_route(s->conv[i], ch - start, ch - start, ir);
+            if (ret < 0)
+                return ret;
+        }
+
+        ret = av_convolution_init(s->conv[i]);
+        if (ret < 0)
+            return ret;
+    }
 
     return 0;
 }
@@ -372,38 +260,13 @@ static int init_segment(AVFilterContext *ctx, AudioFIRSegment *seg,
 static int convert_coeffs(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
-    int left, offset = 0, part_size, max_part_size;
-    int ret, i, ch, n;
+    int ret, i, ch;
     float power = 0;
 
     s->nb_taps = ff_inlink_queued_samples(ctx->inputs[1]);
     if (s->nb_taps <= 0)
         return AVERROR(EINVAL);
 
-    if (s->minp > s->maxp) {
-        s->maxp = s->minp;
-    }
-
-    left = s->nb_taps;
-    part_size = 1 << av_log2(s->minp);
-    max_part_size = 1 << av_log2(s->maxp);
-
-    s->min_part_size = part_size;
-
-    for (i = 0; left > 0; i++) {
-        int step = part_size == max_part_size ? INT_MAX : 1 + (i == 0);
-        int nb_partitions = FFMIN(step, (left + part_size - 1) / part_size);
-
-        s->nb_segments = i + 1;
-        ret = init_segment(ctx, &s->seg[i], offset, nb_partitions, part_size);
-        if (ret < 0)
-            return ret;
-        offset += nb_partitions * part_size;
-        left -= nb_partitions * part_size;
-        part_size *= 2;
-        part_size = FFMIN(part_size, max_part_size);
-    }
-
     ret = ff_inlink_consume_samples(ctx->inputs[1], s->nb_taps, s->nb_taps, &s->in[1]);
     if (ret < 0)
         return ret;
@@ -452,63 +315,24 @@ static int convert_coeffs(AVFilterContext *ctx)
 
     s->gain = FFMIN(s->gain * s->ir_gain, 1.f);
     av_log(ctx, AV_LOG_DEBUG, "power %f, gain %f\n", power, s->gain);
-    for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
-        float *time = (float *)s->in[1]->extended_data[!s->one2many * ch];
-
-        s->fdsp->vector_fmul_scalar(time, time, s->gain, FFALIGN(s->nb_taps, 4));
-    }
-
     av_log(ctx, AV_LOG_DEBUG, "nb_taps: %d\n", s->nb_taps);
-    av_log(ctx, AV_LOG_DEBUG, "nb_segments: %d\n", s->nb_segments);
 
+    /* the convolution is linear, so the dry and wet gains are applied
+     * to the IR */
     for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
         float *time = (float *)s->in[1]->extended_data[!s->one2many * ch];
-        int toffset = 0;
+
+        s->fdsp->vector_fmul_scalar(time, time, s->gain * s->dry_gain * s->wet_gain,
+                                    FFALIGN(s->nb_taps, 4));
 
         for (i = FFMAX(1, s->length * s->nb_taps); i < s->nb_taps; i++)
             time[i] = 0;
-
-        av_log(ctx, AV_LOG_DEBUG, "channel: %d\n", ch);
-
-        for (int segment = 0; segment < s->nb_segments; segment++) {
-            AudioFIRSegment *seg = &s->seg[segment];
-            float *block = (float *)seg->block->extended_data[ch];
-            FFTComplex *coeff = (FFTComplex *)seg->coeff->extended_data[ch];
-
-            av_log(ctx, AV_LOG_DEBUG, "segment: %d\n", segment);
-
-            for (i = 0; i < seg->nb_partitions; i++) {
-                const float scale = 1.f / seg->part_size;
-                const int coffset = i * seg->coeff_size;
-                const int remaining = s->nb_taps - toffset;
-                const int size = remaining >= seg->part_size ? seg->part_size : remaining;
-
-                memset(block, 0, sizeof(*block) * seg->fft_length);
-                memcpy(block, time + toffset, size * sizeof(*block));
-
-                av_rdft_calc(seg->rdft[0], block);
-
-                coeff[coffset].re = block[0] * scale;
-                coeff[coffset].im = 0;
-                for (n = 1; n < seg->part_size; n++) {
-                    coeff[coffset + n].re = block[2 * n] * scale;
-                    coeff[coffset + n].im = block[2 * n + 1] * scale;
-                }
-                coeff[coffset + seg->part_size].re = block[1] * scale;
-                coeff[coffset + seg->part_size].im = 0;
-
-                toffset += size;
-            }
-
-            av_log(ctx, AV_LOG_DEBUG, "nb_partitions: %d\n", seg->nb_partitions);
-            av_log(ctx, AV_LOG_DEBUG, "partition size: %d\n", seg->part_size);
-            av_log(ctx, AV_LOG_DEBUG, "block size: %d\n", seg->block_size);
-            av_log(ctx, AV_LOG_DEBUG, "fft_length: %d\n", seg->fft_length);
-            av_log(ctx, AV_LOG_DEBUG, "coeff_size: %d\n", seg->coeff_size);
-            av_log(ctx, AV_LOG_DEBUG, "input_size: %d\n", seg->input_size);
-            av_log(ctx, AV_LOG_DEBUG, "input_offset: %d\n", seg->input_offset);
-        }
     }
+    emms_c();
+
+    ret = init_conv(ctx);
+    if (ret < 0)
+        return ret;
 
     av_frame_free(&s->in[1]);
     s->have_coeffs = 1;
@@ -536,7 +360,7 @@ static int activate(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
-    int ret, status, available, wanted;
+    int ret, status;
     AVFrame *in = NULL;
     int64_t pts;
 
@@ -568,9 +392,15 @@ static int activate(AVFilterContext *ctx)
             return ret;
     }
 
-    available = ff_inlink_queued_samples(ctx->inputs[0]);
-    wanted = FFMAX(s->min_part_size, (available / s->min_part_size) * s->min_part_size);
-    ret = ff_inlink_consume_samples(ctx->inputs[0], wanted, wanted, &in);
+    if (s->zero_latency) {
+        ret = ff_inlink_consume_frame(ctx->inputs[0], &in);
+    } else {
+        /* whole blocks, only the last frame can be shorter */
+        const int available = ff_inlink_queued_samples(ctx->inputs[0]);
+        const int wanted = FFMAX(s->block_size, (available / s->block_size) * s->block_size);
+
+        ret = ff_inlink_consume_samples(ctx->inputs[0], wanted, wanted, &in);
+    }
     if (ret > 0)
         ret = fir_frame(s, in, outlink);
 
@@ -587,7 +417,8 @@ static int activate(AVFilterContext *ctx)
         }
     }
 
-    if (ff_inlink_queued_samples(ctx->inputs[0]) >= s->min_part_size) {
+    if (s->zero_latency ? ff_inlink_queued_frames(ctx->inputs[0]) > 0 :
+                          ff_inlink_queued_samples(ctx->inputs[0]) >= s->block_size) {
         ff_filter_set_ready(ctx, 10);
         return 0;
     }
@@ -684,47 +515,19 @@ static int config_output(AVFilterLink *outlink)
     s->nb_channels = outlink->channels;
     s->nb_coef_channels = ctx->inputs[1]->channels;
     s->pts = AV_NOPTS_VALUE;
+    /* rounded and clipped like the convolution engine does */
+    s->block_size = 1 << av_log2(FFMAX(s->minp, 16));
 
     return 0;
 }
 
-static void uninit_segment(AVFilterContext *ctx, AudioFIRSegment *seg)
-{
-    AudioFIRContext *s = ctx->priv;
-
-    if (seg->rdft) {
-        for (int ch = 0; ch < s->nb_channels; ch++) {
-            av_rdft_end(seg->rdft[ch]);
-        }
-    }
-    av_freep(&seg->rdft);
-
-    if (seg->irdft) {
-        for (int ch = 0; ch < s->nb_channels; ch++) {
-            av_rdft_end(seg->irdft[ch]);
-        }
-    }
-    av_freep(&seg->irdft);
-
-    av_freep(&seg->output_offset);
-    av_freep(&seg->part_index);
-
-    av_frame_free(&seg->block);
-    av_frame_free(&seg->sum);
-    av_frame_free(&seg->buffer);
-    av_frame_free(&seg->coeff);
-    av_frame_free(&seg->input);
-    av_frame_free(&seg->output);
-    seg->input_size = 0;
-}
-
 static av_cold void uninit(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
 
-    for (int i = 0; i < s->nb_segments; i++) {
-        uninit_segment(ctx, &s->seg[i]);
-    }
+    for (int i = 0; i < s->nb_conv; i++)
+        av_convolution_free(&s->conv[i]);
+    av_freep(&s->conv);
 
     av_freep(&s->fdsp);
     av_frame_free(&s->in[1]);
@@ -753,14 +556,6 @@ static int config_video(AVFilterLink *outlink)
     return 0;
 }
 
-void ff_afir_init(AudioFIRDSPContext *dsp)
-{
-    dsp->fcmul_add = fcmul_add_c;
-
-    if (ARCH_X86)
-        ff_afir_init_x86(dsp);
-}
-
 static av_cold int init(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
@@ -804,8 +599,6 @@ static av_cold int init(AVFilterContext *ctx)
     if (!s->fdsp)
         return AVERROR(ENOMEM);
 
-    ff_afir_init(&s->afirdsp);
-
     return 0;
 }
 
@@ -844,6 +637,7 @@ static const AVOption afir_options[] = {
     { "rate",   "set video rate",    OFFSET(frame_rate), AV_OPT_TYPE_VIDEO_RATE, {.str = "25"}, 0, INT32_MAX, VF },
     { "minp",   "set min partition size", OFFSET(minp),  AV_OPT_TYPE_INT,   {.i64=8192}, 8, 32768, AF },
     { "maxp",   "set max partition size", OFFSET(maxp),  AV_OPT_TYPE_INT,   {.i64=8192}, 8, 32768, AF },
+    { "zerolat", "enable zero latency",   OFFSET(zero_latency), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, AF },
     { NULL }
 };
 
@@ -22,42 +22,15 @@
 #define AVFILTER_AFIR_H
 
 #include "libavutil/common.h"
+#include "libavutil/convolution.h"
 #include "libavutil/float_dsp.h"
 #include "libavutil/opt.h"
-#include "libavcodec/avfft.h"
 
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
 
-typedef struct AudioFIRSegment {
-    int nb_partitions;
-    int part_size;
-    int block_size;
-    int fft_length;
-    int coeff_size;
-    int input_size;
-    int input_offset;
-
-    int *output_offset;
-    int *part_index;
-
-    AVFrame *sum;
-    AVFrame *block;
-    AVFrame *buffer;
-    AVFrame *coeff;
-    AVFrame *input;
-    AVFrame *output;
-
-    RDFTContext **rdft, **irdft;
-} AudioFIRSegment;
-
-typedef struct AudioFIRDSPContext {
-    void (*fcmul_add)(float *sum, const float *t, const float *c,
-                      ptrdiff_t len);
-} AudioFIRDSPContext;
-
 typedef struct AudioFIRContext {
     const AVClass *class;
 
@@ -74,6 +47,7 @@ typedef struct AudioFIRContext {
     int ir_channel;
     int minp;
     int maxp;
+    int zero_latency;
 
     float gain;
 
@@ -84,20 +58,16 @@ typedef struct AudioFIRContext {
     int nb_coef_channels;
     int one2many;
 
-    AudioFIRSegment seg[1024];
-    int nb_segments;
+    AVConvolutionContext **conv;
+    int nb_conv;
+    int block_size;
 
     AVFrame *in[2];
     AVFrame *video;
-    int min_part_size;
     int64_t pts;
 
-    AudioFIRDSPContext afirdsp;
     AVFloatDSPContext *fdsp;
 
 } AudioFIRContext;
 
-void ff_afir_init(AudioFIRDSPContext *s);
-void ff_afir_init_x86(AudioFIRDSPContext *s);
-
 #endif /* AVFILTER_AFIR_H */
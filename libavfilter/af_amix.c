@@ -29,16 +29,15 @@
  */
 
 #include "libavutil/attributes.h"
-#include "libavutil/audio_fifo.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/common.h"
-#include "libavutil/float_dsp.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/samplefmt.h"
 
+#include "af_amixdsp.h"
 #include "audio.h"
 #include "avfilter.h"
 #include "filters.h"
@@ -46,117 +45,14 @@
 #include "internal.h"
 
 #define INPUT_ON       1    /**< input is active */
-#define INPUT_EOF      2    /**< input has reached EOF (may still be active) */
 
 #define DURATION_LONGEST  0
 #define DURATION_SHORTEST 1
 #define DURATION_FIRST    2
 
-
-typedef struct FrameInfo {
-    int nb_samples;
-    int64_t pts;
-    struct FrameInfo *next;
-} FrameInfo;
-
-/**
- * Linked list used to store timestamps and frame sizes of all frames in the
- * FIFO for the first input.
- *
- * This is needed to keep timestamps synchronized for the case where multiple
- * input frames are pushed to the filter for processing before a frame is
- * requested by the output link.
- */
-typedef struct FrameList {
-    int nb_frames;
-    int nb_samples;
-    FrameInfo *list;
-    FrameInfo *end;
-} FrameList;
-
-static void frame_list_clear(FrameList *frame_list)
-{
-    if (frame_list) {
-        while (frame_list->list) {
-            FrameInfo *info = frame_list->list;
-            frame_list->list = info->next;
-            av_free(info);
-        }
-        frame_list->nb_frames  = 0;
-        frame_list->nb_samples = 0;
-        frame_list->end        = NULL;
-    }
-}
-
-static int frame_list_next_frame_size(FrameList *frame_list)
-{
-    if (!frame_list->list)
-        return 0;
-    return frame_list->list->nb_samples;
-}
-
-static int64_t frame_list_next_pts(FrameList *frame_list)
-{
-    if (!frame_list->list)
-        return AV_NOPTS_VALUE;
-    return frame_list->list->pts;
-}
-
-static void frame_list_remove_samples(FrameList *frame_list, int nb_samples)
-{
-    if (nb_samples >= frame_list->nb_samples) {
-        frame_list_clear(frame_list);
-    } else {
-        int samples = nb_samples;
-        while (samples > 0) {
-            FrameInfo *info = frame_list->list;
-            av_assert0(info);
-            if (info->nb_samples <= samples) {
-                samples -= info->nb_samples;
-                frame_list->list = info->next;
-                if (!frame_list->list)
-                    frame_list->end = NULL;
-                frame_list->nb_frames--;
-                frame_list->nb_samples -= info->nb_samples;
-                av_free(info);
-            } else {
-                info->nb_samples       -= samples;
-                info->pts              += samples;
-                frame_list->nb_samples -= samples;
-                samples = 0;
-            }
-        }
-    }
-}
-
-static int frame_list_add_frame(FrameList *frame_list, int nb_samples, int64_t pts)
-{
-    FrameInfo *info = av_malloc(sizeof(*info));
-    if (!info)
-        return AVERROR(ENOMEM);
-    info->nb_samples = nb_samples;
-    info->pts        = pts;
-    info->next       = NULL;
-
-    if (!frame_list->list) {
-        frame_list->list = info;
-        frame_list->end  = info;
-    } else {
-        av_assert0(frame_list->end);
-        frame_list->end->next = info;
-        frame_list->end       = info;
-    }
-    frame_list->nb_frames++;
-    frame_list->nb_samples += nb_samples;
-
-    return 0;
-}
-
-/* FIXME: use directly links fifo */
-
 typedef struct MixContext {
     const AVClass *class;       /**< class for AVOptions */
-    AVFloatDSPContext *fdsp;
+    AMixDSPContext dsp;
 
     int nb_inputs;              /**< number of inputs */
     int active_inputs;          /**< number of input currently active */
@@ -167,14 +63,18 @@ typedef struct MixContext {
     int nb_channels;            /**< number of channels */
     int sample_rate;            /**< sample rate */
     int planar;
-    AVAudioFifo **fifos;        /**< audio fifo for each input */
     uint8_t *input_state;       /**< current state of each input */
-    float *input_scale;         /**< mixing scale factor for each input */
     float *weights;             /**< custom weights for every input */
     float weight_sum;           /**< sum of custom weights for every input */
     float *scale_norm;          /**< normalization factor for every input */
+    int update_scales;          /**< scales must be recomputed for the next frame */
+    int nb_mix;                 /**< number of inputs mixed in the next frame */
+    int *mix_input;             /**< index of every mixed input */
+    float *mix_scale;           /**< scale factor of every mixed input */
+    double *mix_scale_dbl;      /**< same as mix_scale, in double precision */
+    const uint8_t **mix_src;    /**< plane of every mixed input */
+    AVFrame **frames;           /**< input frames being mixed */
     int64_t next_pts;           /**< calculated pts for next output frame */
-    FrameList *frame_list;      /**< list of frame info for the first input */
 } MixContext;
 
 #define OFFSET(x) offsetof(MixContext, x)
@@ -203,33 +103,77 @@ AVFILTER_DEFINE_CLASS(amix);
  *
  * This balances the full volume range between active inputs and handles
  * volume transitions when EOF is encountered on an input but mixing continues
- * with the remaining inputs.
+ * with the remaining inputs. The factors only change when an input is
+ * switched off and during the following transition.
  */
 static void calculate_scales(MixContext *s, int nb_samples)
 {
     float weight_sum = 0.f;
-    int i;
+    int i, transition = 0;
+
+    if (!s->update_scales)
+        return;
 
     for (i = 0; i < s->nb_inputs; i++)
         if (s->input_state[i] & INPUT_ON)
             weight_sum += s->weights[i];
 
+    s->nb_mix = 0;
     for (i = 0; i < s->nb_inputs; i++) {
         if (s->input_state[i] & INPUT_ON) {
             if (s->scale_norm[i] > weight_sum / s->weights[i]) {
                 s->scale_norm[i] -= ((s->weight_sum / s->weights[i]) / s->nb_inputs) *
                                     nb_samples / (s->dropout_transition * s->sample_rate);
                 s->scale_norm[i] = FFMAX(s->scale_norm[i], weight_sum / s->weights[i]);
+                transition |= s->scale_norm[i] > weight_sum / s->weights[i];
             }
+            s->mix_input[s->nb_mix]     = i;
+            s->mix_scale[s->nb_mix]     = 1.0f / s->scale_norm[i];
+            s->mix_scale_dbl[s->nb_mix] = s->mix_scale[s->nb_mix];
+            s->nb_mix++;
         }
     }
 
-    for (i = 0; i < s->nb_inputs; i++) {
-        if (s->input_state[i] & INPUT_ON)
-            s->input_scale[i] = 1.0f / s->scale_norm[i];
-        else
-            s->input_scale[i] = 0.0f;
-    }
+    s->update_scales = transition;
+}
+
+#define MIX(name, type)                                                    \
+static void mix_##name##_c(type *dst, const type * const *src,             \
+                           const type *scale, ptrdiff_t nb_src,            \
+                           ptrdiff_t len)                                  \
+{                                                                          \
+    ptrdiff_t i;                                                           \
+                                                                           \
+    for (; nb_src >= 4; nb_src -= 4, src += 4, scale += 4) {               \
+        const type *src0 = src[0], *src1 = src[1];                         \
+        const type *src2 = src[2], *src3 = src[3];                         \
+                                                                           \
+        for (i = 0; i < len; i++) {                                        \
+            type sum = src0[i] * scale[0];                                 \
+                                                                           \
+            sum += src1[i] * scale[1];                                     \
+            sum += src2[i] * scale[2];                                     \
+            sum += src3[i] * scale[3];                                     \
+            dst[i] += sum;                                                 \
+        }                                                                  \
+    }                                                                      \
+                                                                           \
+    for (; nb_src > 0; nb_src--, src++, scale++) {                         \
+        for (i = 0; i < len; i++)                                          \
+            dst[i] += src[0][i] * scale[0];                                \
+    }                                                                      \
+}
+
+MIX(float, float)
+MIX(double, double)
+
+void ff_amix_dsp_init(AMixDSPContext *dsp)
+{
+    dsp->mix_float  = mix_float_c;
+    dsp->mix_double = mix_double_c;
+
+    if (ARCH_X86)
+        ff_amix_dsp_init_x86(dsp);
 }
 
 static int config_output(AVFilterLink *outlink)
@@ -243,21 +187,7 @@ static int config_output(AVFilterLink *outlink)
     s->sample_rate     = outlink->sample_rate;
     outlink->time_base = (AVRational){ 1, outlink->sample_rate };
     s->next_pts        = AV_NOPTS_VALUE;
-
-    s->frame_list = av_mallocz(sizeof(*s->frame_list));
-    if (!s->frame_list)
-        return AVERROR(ENOMEM);
-
-    s->fifos = av_mallocz_array(s->nb_inputs, sizeof(*s->fifos));
-    if (!s->fifos)
-        return AVERROR(ENOMEM);
-
-    s->nb_channels = outlink->channels;
-    for (i = 0; i < s->nb_inputs; i++) {
-        s->fifos[i] = av_audio_fifo_alloc(outlink->format, s->nb_channels, 1024);
-        if (!s->fifos[i])
-            return AVERROR(ENOMEM);
-    }
+    s->nb_channels     = outlink->channels;
 
     s->input_state = av_malloc(s->nb_inputs);
     if (!s->input_state)
@@ -265,12 +195,18 @@ static int config_output(AVFilterLink *outlink)
     memset(s->input_state, INPUT_ON, s->nb_inputs);
     s->active_inputs = s->nb_inputs;
 
-    s->input_scale = av_mallocz_array(s->nb_inputs, sizeof(*s->input_scale));
-    s->scale_norm  = av_mallocz_array(s->nb_inputs, sizeof(*s->scale_norm));
-    if (!s->input_scale || !s->scale_norm)
+    s->scale_norm    = av_mallocz_array(s->nb_inputs, sizeof(*s->scale_norm));
+    s->mix_input     = av_mallocz_array(s->nb_inputs, sizeof(*s->mix_input));
+    s->mix_scale     = av_mallocz_array(s->nb_inputs, sizeof(*s->mix_scale));
+    s->mix_scale_dbl = av_mallocz_array(s->nb_inputs, sizeof(*s->mix_scale_dbl));
+    s->mix_src       = av_mallocz_array(s->nb_inputs, sizeof(*s->mix_src));
+    s->frames        = av_mallocz_array(s->nb_inputs, sizeof(*s->frames));
+    if (!s->scale_norm || !s->mix_input || !s->mix_scale ||
+        !s->mix_scale_dbl || !s->mix_src || !s->frames)
         return AVERROR(ENOMEM);
     for (i = 0; i < s->nb_inputs; i++)
         s->scale_norm[i] = s->weight_sum / s->weights[i];
+    s->update_scales = 1;
     calculate_scales(s, 0);
 
     av_get_channel_layout_string(buf, sizeof(buf), -1, outlink->channel_layout);
@@ -283,23 +219,72 @@ static int config_output(AVFilterLink *outlink)
 }
 
 /**
- * Read samples from the input FIFOs, mix, and write to the output link.
+ * Add the scaled inputs to one plane of the output. The bulk goes through
+ * the DSP function, the remaining samples through the C version.
+ */
+static void mix_plane(MixContext *s, AVFrame *out, int p, int len)
+{
+    const int tail = len & 15;
+    int j;
+
+    for (j = 0; j < s->nb_mix; j++)
+        s->mix_src[j] = s->frames[s->mix_input[j]]->extended_data[p];
+
+    if (out->format == AV_SAMPLE_FMT_FLT ||
+        out->format == AV_SAMPLE_FMT_FLTP) {
+        float *dst = (float *)out->extended_data[p];
+
+        s->dsp.mix_float(dst, (const float * const *)s->mix_src,
+                         s->mix_scale, s->nb_mix, len - tail);
+        if (tail) {
+            for (j = 0; j < s->nb_mix; j++)
+                s->mix_src[j] += (len - tail) * sizeof(*dst);
+            mix_float_c(dst + len - tail, (const float * const *)s->mix_src,
+                        s->mix_scale, s->nb_mix, tail);
+        }
+    } else {
+        double *dst = (double *)out->extended_data[p];
+
+        s->dsp.mix_double(dst, (const double * const *)s->mix_src,
+                          s->mix_scale_dbl, s->nb_mix, len - tail);
+        if (tail) {
+            for (j = 0; j < s->nb_mix; j++)
+                s->mix_src[j] += (len - tail) * sizeof(*dst);
+            mix_double_c(dst + len - tail, (const double * const *)s->mix_src,
+                         s->mix_scale_dbl, s->nb_mix, tail);
+        }
+    }
+}
+
+/**
+ * Take the same number of samples from every active input, mix them and
+ * write the result to the output link. Frames are read directly from the
+ * input links; no copy is made when they all have the size of the frame
+ * from the first input.
+ *
+ * @return 1 if a frame was output, 0 if more input is needed, or a negative
+ *         error code
  */
 static int output_frame(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     MixContext      *s = ctx->priv;
-    AVFrame *out_buf, *in_buf;
-    int nb_samples, ns, i;
+    AVFrame *out_buf;
+    int nb_samples, ns, i, p, ret = 0;
 
     if (s->input_state[0] & INPUT_ON) {
         /* first input live: use the corresponding frame size */
-        nb_samples = frame_list_next_frame_size(s->frame_list);
+        AVFrame *frame;
+
+        if (!ff_inlink_queued_frames(ctx->inputs[0]))
+            return 0;
+        frame      = ff_inlink_peek_frame(ctx->inputs[0], 0);
+        nb_samples = frame->nb_samples;
         for (i = 1; i < s->nb_inputs; i++) {
             if (s->input_state[i] & INPUT_ON) {
-                ns = av_audio_fifo_size(s->fifos[i]);
+                ns = ff_inlink_queued_samples(ctx->inputs[i]);
                 if (ns < nb_samples) {
-                    if (!(s->input_state[i] & INPUT_EOF))
+                    if (!ff_inlink_check_available_samples(ctx->inputs[i], nb_samples))
                         /* unclosed input with not enough samples */
                         return 0;
                     /* closed input to drain */
@@ -307,12 +292,20 @@ static int output_frame(AVFilterLink *outlink)
                 }
             }
         }
+        if (frame->pts != AV_NOPTS_VALUE)
+            s->next_pts = av_rescale_q(frame->pts, ctx->inputs[0]->time_base,
+                                       outlink->time_base);
+        else
+            s->next_pts = AV_NOPTS_VALUE;
     } else {
-        /* first input closed: use the available samples */
+        /* first input closed: use the available samples, up to the size of
+         * the smallest queued frame */
         nb_samples = INT_MAX;
         for (i = 1; i < s->nb_inputs; i++) {
             if (s->input_state[i] & INPUT_ON) {
-                ns = av_audio_fifo_size(s->fifos[i]);
+                if (!ff_inlink_queued_frames(ctx->inputs[i]))
+                    return 0;
+                ns = ff_inlink_peek_frame(ctx->inputs[i], 0)->nb_samples;
                 nb_samples = FFMIN(nb_samples, ns);
             }
         }
@@ -322,79 +315,46 @@ static int output_frame(AVFilterLink *outlink)
         }
     }
 
-    s->next_pts = frame_list_next_pts(s->frame_list);
-    frame_list_remove_samples(s->frame_list, nb_samples);
-
-    calculate_scales(s, nb_samples);
-
     if (nb_samples == 0)
         return 0;
 
-    out_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!out_buf)
-        return AVERROR(ENOMEM);
-
-    in_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!in_buf) {
-        av_frame_free(&out_buf);
-        return AVERROR(ENOMEM);
-    }
-
     for (i = 0; i < s->nb_inputs; i++) {
         if (s->input_state[i] & INPUT_ON) {
-            int planes, plane_size, p;
+            ret = ff_inlink_consume_samples(ctx->inputs[i], nb_samples, nb_samples,
+                                            &s->frames[i]);
+            if (ret < 0)
+                goto end;
+            av_assert1(ret > 0);
+        }
+    }
 
-            av_audio_fifo_read(s->fifos[i], (void **)in_buf->extended_data,
-                               nb_samples);
+    calculate_scales(s, nb_samples);
 
-            planes     = s->planar ? s->nb_channels : 1;
-            plane_size = nb_samples * (s->planar ? 1 : s->nb_channels);
-            plane_size = FFALIGN(plane_size, 16);
+    out_buf = ff_get_audio_buffer(outlink, nb_samples);
+    if (!out_buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
 
-            if (out_buf->format == AV_SAMPLE_FMT_FLT ||
-                out_buf->format == AV_SAMPLE_FMT_FLTP) {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_fmac_scalar((float *)out_buf->extended_data[p],
-                                                (float *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            } else {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_dmac_scalar((double *)out_buf->extended_data[p],
-                                                (double *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            }
-        }
+    if (s->planar) {
+        for (p = 0; p < s->nb_channels; p++)
+            mix_plane(s, out_buf, p, nb_samples);
+    } else {
+        mix_plane(s, out_buf, 0, nb_samples * s->nb_channels);
     }
-    av_frame_free(&in_buf);
 
     out_buf->pts = s->next_pts;
     if (s->next_pts != AV_NOPTS_VALUE)
         s->next_pts += nb_samples;
 
-    return ff_filter_frame(outlink, out_buf);
-}
+    ret = ff_filter_frame(outlink, out_buf);
+    if (ret >= 0)
+        ret = 1;
 
-/**
- * Requests a frame, if needed, from each input link other than the first.
- */
-static int request_samples(AVFilterContext *ctx, int min_samples)
-{
-    MixContext *s = ctx->priv;
-    int i;
-
-    av_assert0(s->nb_inputs > 1);
-
-    for (i = 1; i < s->nb_inputs; i++) {
-        if (!(s->input_state[i] & INPUT_ON) ||
-             (s->input_state[i] & INPUT_EOF))
-            continue;
-        if (av_audio_fifo_size(s->fifos[i]) >= min_samples)
-            continue;
-        ff_inlink_request_frame(ctx->inputs[i]);
-    }
-    return output_frame(ctx->outputs[0]);
+end:
+    for (i = 0; i < s->nb_inputs; i++)
+        av_frame_free(&s->frames[i]);
+    return ret;
 }
 
 /**
@@ -422,57 +382,23 @@ static int activate(AVFilterContext *ctx)
 {
     AVFilterLink *outlink = ctx->outputs[0];
     MixContext *s = ctx->priv;
-    AVFrame *buf = NULL;
     int i, ret;
 
     FF_FILTER_FORWARD_STATUS_BACK_ALL(outlink, ctx);
 
-    for (i = 0; i < s->nb_inputs; i++) {
-        AVFilterLink *inlink = ctx->inputs[i];
-
-        if ((ret = ff_inlink_consume_frame(ctx->inputs[i], &buf)) > 0) {
-            if (i == 0) {
-                int64_t pts = av_rescale_q(buf->pts, inlink->time_base,
-                                           outlink->time_base);
-                ret = frame_list_add_frame(s->frame_list, buf->nb_samples, pts);
-                if (ret < 0) {
-                    av_frame_free(&buf);
-                    return ret;
-                }
-            }
-
-            ret = av_audio_fifo_write(s->fifos[i], (void **)buf->extended_data,
-                                      buf->nb_samples);
-            if (ret < 0) {
-                av_frame_free(&buf);
-                return ret;
-            }
-
-            av_frame_free(&buf);
-
-            ret = output_frame(outlink);
-            if (ret < 0)
-                return ret;
-        }
-    }
-
+    /* the status of an input is only acknowledged once all its frames
+     * were consumed */
     for (i = 0; i < s->nb_inputs; i++) {
         int64_t pts;
         int status;
 
         if (ff_inlink_acknowledge_status(ctx->inputs[i], &status, &pts)) {
             if (status == AVERROR_EOF) {
-                if (i == 0) {
-                    s->input_state[i] = 0;
-                    if (s->nb_inputs == 1) {
-                        ff_outlink_set_status(outlink, status, pts);
-                        return 0;
-                    }
-                } else {
-                    s->input_state[i] |= INPUT_EOF;
-                    if (av_audio_fifo_size(s->fifos[i]) == 0) {
-                        s->input_state[i] = 0;
-                    }
+                s->input_state[i] = 0;
+                s->update_scales  = 1;
+                if (i == 0 && s->nb_inputs == 1) {
+                    ff_outlink_set_status(outlink, status, pts);
+                    return 0;
                 }
             }
         }
@@ -483,21 +409,32 @@ static int activate(AVFilterContext *ctx)
         return 0;
     }
 
-    if (ff_outlink_frame_wanted(outlink)) {
-        int wanted_samples;
+    ret = output_frame(outlink);
+    if (ret < 0)
+        return ret;
+    if (ret > 0) {
+        ff_filter_set_ready(ctx, 10);
+        return 0;
+    }
 
-        if (!(s->input_state[0] & INPUT_ON))
-            return request_samples(ctx, 1);
+    if (ff_outlink_frame_wanted(outlink)) {
+        int wanted_samples = 1;
 
-        if (s->frame_list->nb_frames == 0) {
-            ff_inlink_request_frame(ctx->inputs[0]);
-            return 0;
+        if (s->input_state[0] & INPUT_ON) {
+            if (!ff_inlink_queued_frames(ctx->inputs[0])) {
+                ff_inlink_request_frame(ctx->inputs[0]);
+                return 0;
+            }
+            wanted_samples = ff_inlink_peek_frame(ctx->inputs[0], 0)->nb_samples;
         }
-        av_assert0(s->frame_list->nb_frames > 0);
 
-        wanted_samples = frame_list_next_frame_size(s->frame_list);
-
-        return request_samples(ctx, wanted_samples);
+        for (i = 1; i < s->nb_inputs; i++) {
+            if (!(s->input_state[i] & INPUT_ON))
+                continue;
+            if (ff_inlink_queued_samples(ctx->inputs[i]) >= wanted_samples)
+                continue;
+            ff_inlink_request_frame(ctx->inputs[i]);
+        }
     }
 
     return 0;
@@ -524,9 +461,7 @@ static av_cold int init(AVFilterContext *ctx)
         }
     }
 
-    s->fdsp = avpriv_float_dsp_alloc(0);
-    if (!s->fdsp)
-        return AVERROR(ENOMEM);
+    ff_amix_dsp_init(&s->dsp);
 
     s->weights = av_mallocz_array(s->nb_inputs, sizeof(*s->weights));
     if (!s->weights)
@@ -556,18 +491,14 @@ static av_cold void uninit(AVFilterContext *ctx)
     int i;
     MixContext *s = ctx->priv;
 
-    if (s->fifos) {
-        for (i = 0; i < s->nb_inputs; i++)
-            av_audio_fifo_free(s->fifos[i]);
-        av_freep(&s->fifos);
-    }
-    frame_list_clear(s->frame_list);
-    av_freep(&s->frame_list);
     av_freep(&s->input_state);
-    av_freep(&s->input_scale);
     av_freep(&s->scale_norm);
+    av_freep(&s->mix_input);
+    av_freep(&s->mix_scale);
+    av_freep(&s->mix_scale_dbl);
+    av_freep(&s->mix_src);
+    av_freep(&s->frames);
     av_freep(&s->weights);
-    av_freep(&s->fdsp);
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
@@ -0,0 +1,44 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_AMIXDSP_H
+#define AVFILTER_AMIXDSP_H
+
+#include <stddef.h>
+
+typedef struct AMixDSPContext {
+    /**
+     * Add nb_src scaled inputs to dst, four inputs per pass:
+     * dst[i] += src[0][i] * scale[0] + ... + src[nb_src - 1][i] * scale[nb_src - 1]
+     *
+     * @param dst    output, 32-byte aligned
+     * @param src    inputs, no alignment requirement
+     * @param scale  scale factor of each input
+     * @param nb_src number of inputs
+     * @param len    number of samples, multiple of 16
+     */
+    void (*mix_float)(float *dst, const float * const *src, const float *scale,
+                      ptrdiff_t nb_src, ptrdiff_t len);
+    void (*mix_double)(double *dst, const double * const *src, const double *scale,
+                       ptrdiff_t nb_src, ptrdiff_t len);
+} AMixDSPContext;
+
+void ff_amix_dsp_init(AMixDSPContext *dsp);
+void ff_amix_dsp_init_x86(AMixDSPContext *dsp);
+
+#endif /* AVFILTER_AMIXDSP_H */
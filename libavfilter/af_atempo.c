@@ -39,13 +39,14 @@
  */
 
 #include <float.h>
-#include "libavcodec/avfft.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/convolution_internal.h"
 #include "libavutil/eval.h"
 #include "libavutil/opt.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/tx.h"
 #include "avfilter.h"
 #include "audio.h"
 #include "internal.h"
@@ -66,8 +67,9 @@ typedef struct AudioFragment {
     int nsamples;
 
     // rDFT transform of the down-mixed mono fragment, used for
-    // fast waveform alignment via correlation in frequency domain:
-    FFTSample *xdat;
+    // fast waveform alignment via correlation in frequency domain;
+    // window + 1 bins, the last one holds the Nyquist frequency:
+    AVComplexFloat *xdat;
 } AudioFragment;
 
 /**
@@ -139,10 +141,16 @@ typedef struct ATempoContext {
     // current state:
     FilterState state;
 
-    // for fast correlation calculation in frequency domain:
-    RDFTContext *real_to_complex;
-    RDFTContext *complex_to_real;
-    FFTSample *correlation;
+    // for fast correlation calculation in frequency domain, the real
+    // transforms of 2 * window samples are done with complex transforms
+    // of window samples:
+    AVTXContext *real_to_complex;
+    AVTXContext *complex_to_real;
+    av_tx_fn r2c_fn;
+    av_tx_fn c2r_fn;
+    AVComplexFloat *twiddle;
+    AVComplexFloat *tx_buf;
+    float *correlation;
 
     // for managing AVFilterPad.request_frame and AVFilterPad.filter_frame
     AVFrame *dst_buffer;
@@ -155,6 +163,9 @@ typedef struct ATempoContext {
 #define YAE_ATEMPO_MIN 0.5
 #define YAE_ATEMPO_MAX 100.0
 
+// minimum number of samples times channels worth running a thread for:
+#define YAE_SLICE_SIZE 8192
+
 #define OFFSET(x) offsetof(ATempoContext, x)
 
 static const AVOption atempo_options[] = {
@@ -234,12 +245,11 @@ static void yae_release_buffers(ATempoContext *atempo)
     av_freep(&atempo->buffer);
     av_freep(&atempo->hann);
     av_freep(&atempo->correlation);
+    av_freep(&atempo->twiddle);
+    av_freep(&atempo->tx_buf);
 
-    av_rdft_end(atempo->real_to_complex);
-    atempo->real_to_complex = NULL;
-
-    av_rdft_end(atempo->complex_to_real);
-    atempo->complex_to_real = NULL;
+    av_tx_uninit(&atempo->real_to_complex);
+    av_tx_uninit(&atempo->complex_to_real);
 }
 
 /* av_realloc is not aligned enough; fortunately, the data does not need to
@@ -266,7 +276,8 @@ static int yae_reset(ATempoContext *atempo,
     const int sample_size = av_get_bytes_per_sample(format);
     uint32_t nlevels  = 0;
     uint32_t pot;
-    int i;
+    float scale = 1.f;
+    int i, ret;
 
     atempo->format   = format;
     atempo->channels = channels;
@@ -288,30 +299,37 @@ static int yae_reset(ATempoContext *atempo,
     // initialize audio fragment buffers:
     RE_MALLOC_OR_FAIL(atempo->frag[0].data, atempo->window * atempo->stride);
     RE_MALLOC_OR_FAIL(atempo->frag[1].data, atempo->window * atempo->stride);
-    RE_MALLOC_OR_FAIL(atempo->frag[0].xdat, atempo->window * sizeof(FFTComplex));
-    RE_MALLOC_OR_FAIL(atempo->frag[1].xdat, atempo->window * sizeof(FFTComplex));
+    RE_MALLOC_OR_FAIL(atempo->frag[0].xdat, (atempo->window + 1) * sizeof(AVComplexFloat));
+    RE_MALLOC_OR_FAIL(atempo->frag[1].xdat, (atempo->window + 1) * sizeof(AVComplexFloat));
 
-    // initialize rDFT contexts:
-    av_rdft_end(atempo->real_to_complex);
-    atempo->real_to_complex = NULL;
+    // initialize FFT contexts:
+    av_tx_uninit(&atempo->real_to_complex);
+    av_tx_uninit(&atempo->complex_to_real);
 
-    av_rdft_end(atempo->complex_to_real);
-    atempo->complex_to_real = NULL;
+    ret = av_tx_init(&atempo->real_to_complex, &atempo->r2c_fn,
+                     AV_TX_FLOAT_FFT, 0, atempo->window, &scale, 0);
+    if (ret < 0) {
+        yae_release_buffers(atempo);
+        return ret;
+    }
 
-    atempo->real_to_complex = av_rdft_init(nlevels + 1, DFT_R2C);
-    if (!atempo->real_to_complex) {
+    ret = av_tx_init(&atempo->complex_to_real, &atempo->c2r_fn,
+                     AV_TX_FLOAT_FFT, 1, atempo->window, &scale, 0);
+    if (ret < 0) {
         yae_release_buffers(atempo);
-        return AVERROR(ENOMEM);
+        return ret;
     }
 
-    atempo->complex_to_real = av_rdft_init(nlevels + 1, IDFT_C2R);
-    if (!atempo->complex_to_real) {
+    RE_MALLOC_OR_FAIL(atempo->correlation, (atempo->window + 1) * sizeof(AVComplexFloat));
+    RE_MALLOC_OR_FAIL(atempo->tx_buf, atempo->window * sizeof(AVComplexFloat));
+
+    av_freep(&atempo->twiddle);
+    atempo->twiddle = avpriv_rdft_alloc_twiddle(atempo->window);
+    if (!atempo->twiddle) {
         yae_release_buffers(atempo);
         return AVERROR(ENOMEM);
     }
 
-    RE_MALLOC_OR_FAIL(atempo->correlation, atempo->window * sizeof(FFTComplex));
-
     atempo->ring = atempo->window * 3;
     RE_MALLOC_OR_FAIL(atempo->buffer, atempo->ring * atempo->stride);
 
@@ -360,9 +378,9 @@ static int yae_set_tempo(AVFilterContext *ctx, const char *arg_tempo)
 #define yae_init_xdat(scalar_type, scalar_max)                          \
     do {                                                                \
         const uint8_t *src_end = src +                                  \
-            frag->nsamples * atempo->channels * sizeof(scalar_type);    \
+            (end - start) * atempo->channels * sizeof(scalar_type);     \
                                                                         \
-        FFTSample *xdat = frag->xdat;                                   \
+        float *xdat = (float *)frag->xdat + start;                      \
         scalar_type tmp;                                                \
                                                                         \
         if (atempo->channels == 1) {                                    \
@@ -370,27 +388,27 @@ static int yae_set_tempo(AVFilterContext *ctx, const char *arg_tempo)
                 tmp = *(const scalar_type *)src;                        \
                 src += sizeof(scalar_type);                             \
                                                                         \
-                *xdat = (FFTSample)tmp;                                 \
+                *xdat = (float)tmp;                                     \
             }                                                           \
         } else {                                                        \
-            FFTSample s, max, ti, si;                                   \
+            float s, max, ti, si;                                       \
             int i;                                                      \
                                                                         \
             for (; src < src_end; xdat++) {                             \
                 tmp = *(const scalar_type *)src;                        \
                 src += sizeof(scalar_type);                             \
                                                                         \
-                max = (FFTSample)tmp;                                   \
-                s = FFMIN((FFTSample)scalar_max,                        \
-                          (FFTSample)fabsf(max));                       \
+                max = (float)tmp;                                       \
+                s = FFMIN((float)scalar_max,                            \
+                          (float)fabsf(max));                           \
                                                                         \
                 for (i = 1; i < atempo->channels; i++) {                \
                     tmp = *(const scalar_type *)src;                    \
                     src += sizeof(scalar_type);                         \
                                                                         \
-                    ti = (FFTSample)tmp;                                \
-                    si = FFMIN((FFTSample)scalar_max,                   \
-                               (FFTSample)fabsf(ti));                   \
+                    ti = (float)tmp;                                    \
+                    si = FFMIN((float)scalar_max,                       \
+                               (float)fabsf(ti));                       \
                                                                         \
                     if (s < si) {                                       \
                         s   = si;                                       \
@@ -404,16 +422,19 @@ static int yae_set_tempo(AVFilterContext *ctx, const char *arg_tempo)
     } while (0)
 
 /**
- * Initialize complex data buffer of a given audio fragment
- * with down-mixed mono data of appropriate scalar type.
+ * Down-mix a range of samples of the current audio fragment,
+ * arg points to the fragment.
  */
-static void yae_downmix(ATempoContext *atempo, AudioFragment *frag)
+static int yae_downmix_slice(AVFilterContext *ctx, void *arg,
+                             int jobnr, int nb_jobs)
 {
-    // shortcuts:
-    const uint8_t *src = frag->data;
+    ATempoContext *atempo = ctx->priv;
+    const AudioFragment *frag = arg;
+    const int start = frag->nsamples *  jobnr      / nb_jobs;
+    const int end   = frag->nsamples * (jobnr + 1) / nb_jobs;
 
-    // init complex data buffer used for FFT and Correlation:
-    memset(frag->xdat, 0, sizeof(FFTComplex) * atempo->window);
+    // shortcuts:
+    const uint8_t *src = frag->data + start * atempo->stride;
 
     if (atempo->format == AV_SAMPLE_FMT_U8) {
         yae_init_xdat(uint8_t, 127);
@@ -426,6 +447,47 @@ static void yae_downmix(ATempoContext *atempo, AudioFragment *frag)
     } else if (atempo->format == AV_SAMPLE_FMT_DBL) {
         yae_init_xdat(double, 1);
     }
+
+    return 0;
+}
+
+/**
+ * Number of jobs to split the processing of nsamples samples into.
+ */
+static int yae_nb_jobs(AVFilterContext *ctx, int64_t nsamples)
+{
+    ATempoContext *atempo = ctx->priv;
+
+    return av_clip(nsamples * atempo->channels / YAE_SLICE_SIZE,
+                   1, ff_filter_get_nb_threads(ctx));
+}
+
+/**
+ * Initialize complex data buffer of a given audio fragment
+ * with down-mixed mono data of appropriate scalar type.
+ */
+static void yae_downmix(AVFilterContext *ctx, AudioFragment *frag)
+{
+    ATempoContext *atempo = ctx->priv;
+
+    // init complex data buffer used for FFT and Correlation:
+    memset(frag->xdat, 0, sizeof(AVComplexFloat) * (atempo->window + 1));
+
+    ctx->internal->execute(ctx, yae_downmix_slice, frag, NULL,
+                           yae_nb_jobs(ctx, frag->nsamples));
+}
+
+/**
+ * Apply the real to complex transform to the 2 * window real samples
+ * of a fragment, through a complex FFT of window samples: the even
+ * samples are used as the real part and the odd ones as the imaginary
+ * part, and the resulting spectrum is split into window + 1 bins.
+ */
+static void yae_rdft(ATempoContext *atempo, AudioFragment *frag)
+{
+    atempo->r2c_fn(atempo->real_to_complex, atempo->tx_buf, frag->xdat,
+                   sizeof(AVComplexFloat));
+    avpriv_rdft_split(frag->xdat, atempo->tx_buf, atempo->twiddle, atempo->window);
 }
 
 /**
@@ -609,35 +671,26 @@ static void yae_advance_to_next_frag(ATempoContext *atempo)
 /**
  * Calculate cross-correlation via rDFT.
  *
- * Multiply two vectors of complex numbers (result of real_to_complex rDFT)
- * and transform back via complex_to_real rDFT.
+ * Multiply two vectors of complex numbers (result of yae_rdft)
+ * and transform back via the inverse of yae_rdft.
  */
-static void yae_xcorr_via_rdft(FFTSample *xcorr,
-                               RDFTContext *complex_to_real,
-                               const FFTComplex *xa,
-                               const FFTComplex *xb,
-                               const int window)
+static void yae_xcorr_via_rdft(ATempoContext *atempo,
+                               const AVComplexFloat *xa,
+                               const AVComplexFloat *xb)
 {
-    FFTComplex *xc = (FFTComplex *)xcorr;
-    int i;
+    AVComplexFloat *xc = (AVComplexFloat *)atempo->correlation;
+    int k;
 
-    // NOTE: first element requires special care -- Given Y = rDFT(X),
-    // Im(Y[0]) and Im(Y[N/2]) are always zero, therefore av_rdft_calc
-    // stores Re(Y[N/2]) in place of Im(Y[0]).
-
-    xc->re = xa->re * xb->re;
-    xc->im = xa->im * xb->im;
-    xa++;
-    xb++;
-    xc++;
-
-    for (i = 1; i < window; i++, xa++, xb++, xc++) {
-        xc->re = (xa->re * xb->re + xa->im * xb->im);
-        xc->im = (xa->im * xb->re - xa->re * xb->im);
+    for (k = 0; k <= atempo->window; k++) {
+        xc[k].re = xa[k].re * xb[k].re + xa[k].im * xb[k].im;
+        xc[k].im = xa[k].im * xb[k].re - xa[k].re * xb[k].im;
     }
 
-    // apply inverse rDFT:
-    av_rdft_calc(complex_to_real, xcorr);
+    avpriv_rdft_merge(atempo->tx_buf, xc, atempo->twiddle, atempo->window);
+
+    // apply inverse FFT, the even samples are stored in the real part:
+    atempo->c2r_fn(atempo->complex_to_real, atempo->correlation, atempo->tx_buf,
+                   sizeof(AVComplexFloat));
 }
 
 /**
@@ -646,27 +699,22 @@ static void yae_xcorr_via_rdft(FFTSample *xcorr,
  *
  * @return alignment offset of current fragment relative to previous.
  */
-static int yae_align(AudioFragment *frag,
+static int yae_align(ATempoContext *atempo,
+                     AudioFragment *frag,
                      const AudioFragment *prev,
                      const int window,
                      const int delta_max,
-                     const int drift,
-                     FFTSample *correlation,
-                     RDFTContext *complex_to_real)
+                     const int drift)
 {
     int       best_offset = -drift;
-    FFTSample best_metric = -FLT_MAX;
-    FFTSample *xcorr;
+    float     best_metric = -FLT_MAX;
+    float    *xcorr;
 
     int i0;
     int i1;
     int i;
 
-    yae_xcorr_via_rdft(correlation,
-                       complex_to_real,
-                       (const FFTComplex *)prev->xdat,
-                       (const FFTComplex *)frag->xdat,
-                       window);
+    yae_xcorr_via_rdft(atempo, prev->xdat, frag->xdat);
 
     // identify search window boundaries:
     i0 = FFMAX(window / 2 - delta_max - drift, 0);
@@ -676,14 +724,14 @@ static int yae_align(AudioFragment *frag,
     i1 = FFMAX(i1, 0);
 
     // identify cross-correlation peaks within search window:
-    xcorr = correlation + i0;
+    xcorr = atempo->correlation + i0;
 
     for (i = i0; i < i1; i++, xcorr++) {
-        FFTSample metric = *xcorr;
+        float metric = *xcorr;
 
         // normalize:
-        FFTSample drifti = (FFTSample)(drift + i);
-        metric *= drifti * (FFTSample)(i - i0) * (FFTSample)(i1 - i);
+        float drifti = (float)(drift + i);
+        metric *= drifti * (float)(i - i0) * (float)(i1 - i);
 
         if (metric > best_metric) {
             best_metric = metric;
@@ -715,13 +763,12 @@ static int yae_adjust_position(ATempoContext *atempo)
     const int drift = (int)(prev_output_position - ideal_output_position);
 
     const int delta_max  = atempo->window / 2;
-    const int correction = yae_align(frag,
+    const int correction = yae_align(atempo,
+                                     frag,
                                      prev,
                                      atempo->window,
                                      delta_max,
-                                     drift,
-                                     atempo->correlation,
-                                     atempo->complex_to_real);
+                                     drift);
 
     if (correction) {
         // adjust fragment position:
@@ -734,39 +781,75 @@ static int yae_adjust_position(ATempoContext *atempo)
     return correction;
 }
 
+typedef struct ThreadData {
+    const uint8_t *a;
+    const uint8_t *b;
+    const float *wa;
+    const float *wb;
+    uint8_t *dst;
+    int nsamples;
+    int ncopy;
+} ThreadData;
+
 /**
  * A helper macro for blending the overlap region of previous
  * and current audio fragment.
  */
 #define yae_blend(scalar_type)                                          \
     do {                                                                \
-        const scalar_type *aaa = (const scalar_type *)a;                \
-        const scalar_type *bbb = (const scalar_type *)b;                \
-                                                                        \
-        scalar_type *out     = (scalar_type *)dst;                      \
-        scalar_type *out_end = (scalar_type *)dst_end;                  \
-        int64_t i;                                                      \
-                                                                        \
-        for (i = 0; i < overlap && out < out_end;                       \
-             i++, atempo->position[1]++, wa++, wb++) {                  \
-            float w0 = *wa;                                             \
-            float w1 = *wb;                                             \
-            int j;                                                      \
+        const scalar_type *aaa = (const scalar_type *)td->a;            \
+        const scalar_type *bbb = (const scalar_type *)td->b;            \
+        scalar_type *out = (scalar_type *)td->dst;                      \
+        int i, j;                                                       \
                                                                         \
-            for (j = 0; j < atempo->channels;                           \
-                 j++, aaa++, bbb++, out++) {                            \
-                float t0 = (float)*aaa;                                 \
-                float t1 = (float)*bbb;                                 \
+        for (i = start; i < end; i++) {                                 \
+            const float w0 = td->wa[i];                                 \
+            const float w1 = td->wb[i];                                 \
+            const scalar_type *a0 = aaa + i * channels;                 \
+            const scalar_type *b0 = bbb + i * channels;                 \
+            scalar_type *o = out + i * channels;                        \
                                                                         \
-                *out =                                                  \
-                    frag->position[0] + i < 0 ?                         \
-                    *aaa :                                              \
-                    (scalar_type)(t0 * w0 + t1 * w1);                   \
-            }                                                           \
+            for (j = 0; j < channels; j++)                              \
+                o[j] = (scalar_type)((float)a0[j] * w0 +                \
+                                     (float)b0[j] * w1);                \
         }                                                               \
-        dst = (uint8_t *)out;                                           \
     } while (0)
 
+/**
+ * Blend a range of samples of the overlap region, the first ncopy
+ * samples are copied from the previous fragment.
+ */
+static int yae_blend_slice(AVFilterContext *ctx, void *arg,
+                           int jobnr, int nb_jobs)
+{
+    ATempoContext *atempo = ctx->priv;
+    const ThreadData *td = arg;
+    const int channels = atempo->channels;
+    const int stride = atempo->stride;
+    int start = td->nsamples *  jobnr      / nb_jobs;
+    int end   = td->nsamples * (jobnr + 1) / nb_jobs;
+
+    if (start < td->ncopy) {
+        const int n = FFMIN(end, td->ncopy) - start;
+        memcpy(td->dst + start * stride, td->a + start * stride, n * stride);
+        start += n;
+    }
+
+    if (atempo->format == AV_SAMPLE_FMT_U8) {
+        yae_blend(uint8_t);
+    } else if (atempo->format == AV_SAMPLE_FMT_S16) {
+        yae_blend(int16_t);
+    } else if (atempo->format == AV_SAMPLE_FMT_S32) {
+        yae_blend(int);
+    } else if (atempo->format == AV_SAMPLE_FMT_FLT) {
+        yae_blend(float);
+    } else if (atempo->format == AV_SAMPLE_FMT_DBL) {
+        yae_blend(double);
+    }
+
+    return 0;
+}
+
 /**
  * Blend the overlap region of previous and current audio fragment
  * and output the results to the given destination buffer.
@@ -775,10 +858,12 @@ static int yae_adjust_position(ATempoContext *atempo)
  *   0 if the overlap region was completely stored in the dst buffer,
  *   AVERROR(EAGAIN) if more destination buffer space is required.
  */
-static int yae_overlap_add(ATempoContext *atempo,
+static int yae_overlap_add(AVFilterContext *ctx,
                            uint8_t **dst_ref,
                            uint8_t *dst_end)
 {
+    ATempoContext *atempo = ctx->priv;
+
     // shortcuts:
     const AudioFragment *prev = yae_prev_frag(atempo);
     const AudioFragment *frag = yae_curr_frag(atempo);
@@ -794,32 +879,32 @@ static int yae_overlap_add(ATempoContext *atempo,
     const int64_t ia = start_here - prev->position[1];
     const int64_t ib = start_here - frag->position[1];
 
-    const float *wa = atempo->hann + ia;
-    const float *wb = atempo->hann + ib;
-
-    const uint8_t *a = prev->data + ia * atempo->stride;
-    const uint8_t *b = frag->data + ib * atempo->stride;
-
-    uint8_t *dst = *dst_ref;
+    ThreadData td;
 
     av_assert0(start_here <= stop_here &&
                frag->position[1] <= start_here &&
                overlap <= frag->nsamples);
 
-    if (atempo->format == AV_SAMPLE_FMT_U8) {
-        yae_blend(uint8_t);
-    } else if (atempo->format == AV_SAMPLE_FMT_S16) {
-        yae_blend(int16_t);
-    } else if (atempo->format == AV_SAMPLE_FMT_S32) {
-        yae_blend(int);
-    } else if (atempo->format == AV_SAMPLE_FMT_FLT) {
-        yae_blend(float);
-    } else if (atempo->format == AV_SAMPLE_FMT_DBL) {
-        yae_blend(double);
-    }
+    td.a   = prev->data + ia * atempo->stride;
+    td.b   = frag->data + ib * atempo->stride;
+    td.wa  = atempo->hann + ia;
+    td.wb  = atempo->hann + ib;
+    td.dst = *dst_ref;
+
+    // as much of the overlap region as fits in the dst buffer:
+    td.nsamples = FFMIN(overlap, (dst_end - td.dst) / atempo->stride);
+
+    // samples before the start of the input are not blended:
+    td.ncopy = av_clip64(-frag->position[0], 0, td.nsamples);
+
+    if (td.nsamples > 0)
+        ctx->internal->execute(ctx, yae_blend_slice, &td, NULL,
+                               yae_nb_jobs(ctx, td.nsamples));
+
+    atempo->position[1] += td.nsamples;
 
     // pass-back the updated destination buffer pointer:
-    *dst_ref = dst;
+    *dst_ref = td.dst + td.nsamples * atempo->stride;
 
     return atempo->position[1] == stop_here ? 0 : AVERROR(EAGAIN);
 }
@@ -830,12 +915,14 @@ static int yae_overlap_add(ATempoContext *atempo,
  * as it is able to produce or store.
  */
 static void
-yae_apply(ATempoContext *atempo,
+yae_apply(AVFilterContext *ctx,
           const uint8_t **src_ref,
           const uint8_t *src_end,
           uint8_t **dst_ref,
           uint8_t *dst_end)
 {
+    ATempoContext *atempo = ctx->priv;
+
     while (1) {
         if (atempo->state == YAE_LOAD_FRAGMENT) {
             // load additional data for the current fragment:
@@ -844,10 +931,10 @@ yae_apply(ATempoContext *atempo,
             }
 
             // down-mix to mono:
-            yae_downmix(atempo, yae_curr_frag(atempo));
+            yae_downmix(ctx, yae_curr_frag(atempo));
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, yae_curr_frag(atempo)->xdat);
+            yae_rdft(atempo, yae_curr_frag(atempo));
 
             // must load the second fragment before alignment can start:
             if (!atempo->nfrag) {
@@ -876,17 +963,17 @@ yae_apply(ATempoContext *atempo,
             }
 
             // down-mix to mono:
-            yae_downmix(atempo, yae_curr_frag(atempo));
+            yae_downmix(ctx, yae_curr_frag(atempo));
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, yae_curr_frag(atempo)->xdat);
+            yae_rdft(atempo, yae_curr_frag(atempo));
 
             atempo->state = YAE_OUTPUT_OVERLAP_ADD;
         }
 
         if (atempo->state == YAE_OUTPUT_OVERLAP_ADD) {
             // overlap-add and output the result:
-            if (yae_overlap_add(atempo, dst_ref, dst_end) != 0) {
+            if (yae_overlap_add(ctx, dst_ref, dst_end) != 0) {
                 break;
             }
 
@@ -904,10 +991,11 @@ yae_apply(ATempoContext *atempo,
  *   0 if all data was completely stored in the dst buffer,
  *   AVERROR(EAGAIN) if more destination buffer space is required.
  */
-static int yae_flush(ATempoContext *atempo,
+static int yae_flush(AVFilterContext *ctx,
                      uint8_t **dst_ref,
                      uint8_t *dst_end)
 {
+    ATempoContext *atempo = ctx->priv;
     AudioFragment *frag = yae_curr_frag(atempo);
     int64_t overlap_end;
     int64_t start_here;
@@ -940,10 +1028,10 @@ static int yae_flush(ATempoContext *atempo,
 
         if (atempo->nfrag) {
             // down-mix to mono:
-            yae_downmix(atempo, frag);
+            yae_downmix(ctx, frag);
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, frag->xdat);
+            yae_rdft(atempo, frag);
 
             // align current fragment to previous fragment:
             if (yae_adjust_position(atempo)) {
@@ -958,7 +1046,7 @@ static int yae_flush(ATempoContext *atempo,
                                             frag->nsamples);
 
     while (atempo->position[1] < overlap_end) {
-        if (yae_overlap_add(atempo, dst_ref, dst_end) != 0) {
+        if (yae_overlap_add(ctx, dst_ref, dst_end) != 0) {
             return AVERROR(EAGAIN);
         }
     }
@@ -1119,7 +1207,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *src_buffer)
             atempo->dst_end = atempo->dst + n_out * atempo->stride;
         }
 
-        yae_apply(atempo, &src, src_end, &atempo->dst, atempo->dst_end);
+        yae_apply(ctx, &src, src_end, &atempo->dst, atempo->dst_end);
 
         if (atempo->dst == atempo->dst_end) {
             int n_samples = ((atempo->dst - atempo->dst_buffer->data[0]) /
@@ -1160,7 +1248,7 @@ static int request_frame(AVFilterLink *outlink)
                 atempo->dst_end = atempo->dst + n_max * atempo->stride;
             }
 
-            err = yae_flush(atempo, &atempo->dst, atempo->dst_end);
+            err = yae_flush(ctx, &atempo->dst, atempo->dst_end);
 
             n_out = ((atempo->dst - atempo->dst_buffer->data[0]) /
                      atempo->stride);
@@ -1222,4 +1310,5 @@ AVFilter ff_af_atempo = {
     .priv_class      = &atempo_class,
     .inputs          = atempo_inputs,
     .outputs         = atempo_outputs,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
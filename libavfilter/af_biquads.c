@@ -64,9 +64,12 @@
 
 #include "libavutil/avassert.h"
 #include "libavutil/ffmath.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "af_biquads.h"
 #include "audio.h"
 #include "avfilter.h"
+#include "filters.h"
 #include "internal.h"
 
 enum FilterType {
@@ -93,11 +96,8 @@ enum WidthType {
     NB_WTYPE,
 };
 
-typedef struct ChanCache {
-    double i1, i2;
-    double o1, o2;
-    int clippings;
-} ChanCache;
+/* samples per channel filtered through all sections at once */
+#define BIQUAD_BLOCK 256
 
 typedef struct BiquadsContext {
     const AVClass *class;
@@ -116,13 +116,25 @@ typedef struct BiquadsContext {
     double a0, a1, a2;
     double b0, b1, b2;
 
-    ChanCache *cache;
-    int block_align;
-
-    void (*filter)(struct BiquadsContext *s, const void *ibuf, void *obuf, int len,
-                   double *i1, double *i2, double *o1, double *o2,
-                   double b0, double b1, double b2, double a1, double a2, int *clippings,
-                   int disabled);
+    int nb_groups;          ///< groups of BIQUAD_LANES channels
+    int *clippings;         ///< per channel
+    double *coeffs;         ///< per group and section, see BiquadsDSPContext
+    double *state;          ///< per group and section, see BiquadsDSPContext
+    double *buf;            ///< per group, 2 * BIQUAD_BLOCK interleaved samples
+    int nb_state_sections;
+
+    /* Consecutive biquad filters are run by the first one of the chain, in
+     * a single pass over the data; the following ones forward frames. */
+    AVFilterContext **sections;
+    int nb_sections;
+    struct BiquadsContext *head;
+    int disabled;           ///< timeline state of the section for the current frame
+
+    void (*load)(double *dst, const uint8_t * const *src, int nb_channels,
+                 int offset, int len);
+    void (*store)(uint8_t **dst, const double *src, int nb_channels,
+                  int offset, int len, int *clippings);
+    BiquadsDSPContext dsp;
 } BiquadsContext;
 
 static av_cold int init(AVFilterContext *ctx)
@@ -137,6 +149,8 @@ static av_cold int init(AVFilterContext *ctx)
         }
     }
 
+    ff_biquads_dsp_init(&s->dsp);
+
     return 0;
 }
 
@@ -173,90 +187,88 @@ static int query_formats(AVFilterContext *ctx)
     return ff_set_common_samplerates(ctx, formats);
 }
 
-#define BIQUAD_FILTER(name, type, min, max, need_clipping)                    \
-static void biquad_## name (BiquadsContext *s,                                \
-                            const void *input, void *output, int len,         \
-                            double *in1, double *in2,                         \
-                            double *out1, double *out2,                       \
-                            double b0, double b1, double b2,                  \
-                            double a1, double a2, int *clippings,             \
-                            int disabled)                                     \
+#define BIQUAD_IO(name, type, min, max, need_clipping)                        \
+static void load_## name(double *dst, const uint8_t * const *src,             \
+                         int nb_channels, int offset, int len)                \
 {                                                                             \
-    const type *ibuf = input;                                                 \
-    type *obuf = output;                                                      \
-    double i1 = *in1;                                                         \
-    double i2 = *in2;                                                         \
-    double o1 = *out1;                                                        \
-    double o2 = *out2;                                                        \
-    double wet = s->mix;                                                      \
-    double dry = 1. - wet;                                                    \
-    double out;                                                               \
-    int i;                                                                    \
-    a1 = -a1;                                                                 \
-    a2 = -a2;                                                                 \
+    int ch, i;                                                                \
                                                                               \
-    for (i = 0; i+1 < len; i++) {                                             \
-        o2 = i2 * b2 + i1 * b1 + ibuf[i] * b0 + o2 * a2 + o1 * a1;            \
-        i2 = ibuf[i];                                                         \
-        out = o2 * wet + i2 * dry;                                            \
-        if (disabled) {                                                       \
-            obuf[i] = i2;                                                     \
-        } else if (need_clipping && out < min) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = min;                                                    \
-        } else if (need_clipping && out > max) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = max;                                                    \
-        } else {                                                              \
-            obuf[i] = out;                                                    \
-        }                                                                     \
-        i++;                                                                  \
-        o1 = i1 * b2 + i2 * b1 + ibuf[i] * b0 + o1 * a2 + o2 * a1;            \
-        i1 = ibuf[i];                                                         \
-        out = o1 * wet + i1 * dry;                                            \
-        if (disabled) {                                                       \
-            obuf[i] = i1;                                                     \
-        } else if (need_clipping && out < min) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = min;                                                    \
-        } else if (need_clipping && out > max) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = max;                                                    \
-        } else {                                                              \
-            obuf[i] = out;                                                    \
-        }                                                                     \
+    for (ch = 0; ch < nb_channels; ch++) {                                    \
+        const type *ibuf = (const type *)src[ch] + offset;                    \
+                                                                              \
+        for (i = 0; i < len; i++)                                             \
+            dst[i * BIQUAD_LANES + ch] = ibuf[i];                             \
     }                                                                         \
-    if (i < len) {                                                            \
-        double o0 = ibuf[i] * b0 + i1 * b1 + i2 * b2 + o1 * a1 + o2 * a2;     \
-        i2 = i1;                                                              \
-        i1 = ibuf[i];                                                         \
-        o2 = o1;                                                              \
-        o1 = o0;                                                              \
-        out = o0 * wet + i1 * dry;                                            \
-        if (disabled) {                                                       \
-            obuf[i] = i1;                                                     \
-        } else if (need_clipping && out < min) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = min;                                                    \
-        } else if (need_clipping && out > max) {                              \
-            (*clippings)++;                                                   \
-            obuf[i] = max;                                                    \
-        } else {                                                              \
-            obuf[i] = out;                                                    \
+}                                                                             \
+                                                                              \
+static void store_## name(uint8_t **dst, const double *src,                   \
+                          int nb_channels, int offset, int len,               \
+                          int *clippings)                                     \
+{                                                                             \
+    int ch, i;                                                                \
+                                                                              \
+    for (ch = 0; ch < nb_channels; ch++) {                                    \
+        type *obuf = (type *)dst[ch] + offset;                                \
+                                                                              \
+        for (i = 0; i < len; i++) {                                           \
+            const double out = src[i * BIQUAD_LANES + ch];                    \
+                                                                              \
+            if (need_clipping && out < min) {                                 \
+                clippings[ch]++;                                              \
+                obuf[i] = min;                                                \
+            } else if (need_clipping && out > max) {                          \
+                clippings[ch]++;                                              \
+                obuf[i] = max;                                                \
+            } else {                                                          \
+                obuf[i] = out;                                                \
+            }                                                                 \
         }                                                                     \
     }                                                                         \
-    *in1  = i1;                                                               \
-    *in2  = i2;                                                               \
-    *out1 = o1;                                                               \
-    *out2 = o2;                                                               \
 }
 
-BIQUAD_FILTER(s16, int16_t, INT16_MIN, INT16_MAX, 1)
-BIQUAD_FILTER(s32, int32_t, INT32_MIN, INT32_MAX, 1)
-BIQUAD_FILTER(flt, float,   -1., 1., 0)
-BIQUAD_FILTER(dbl, double,  -1., 1., 0)
+BIQUAD_IO(s16, int16_t, INT16_MIN, INT16_MAX, 1)
+BIQUAD_IO(s32, int32_t, INT32_MIN, INT32_MAX, 1)
+BIQUAD_IO(flt, float,   -1., 1., 0)
+BIQUAD_IO(dbl, double,  -1., 1., 0)
+
+static void biquad_filter_c(double *buf, const double *coeffs, double *state,
+                            ptrdiff_t len)
+{
+    const double *b0 = coeffs,                    *b1 = coeffs + BIQUAD_LANES;
+    const double *b2 = coeffs + 2 * BIQUAD_LANES, *a1 = coeffs + 3 * BIQUAD_LANES;
+    const double *a2 = coeffs + 4 * BIQUAD_LANES;
+    double s1[BIQUAD_LANES], s2[BIQUAD_LANES];
+    int i, c;
+
+    memcpy(s1, state,                sizeof(s1));
+    memcpy(s2, state + BIQUAD_LANES, sizeof(s2));
+
+    for (i = 0; i < len; i++) {
+        double *x = buf + i * BIQUAD_LANES;
+
+        for (c = 0; c < BIQUAD_LANES; c++) {
+            const double in = x[c];
+            const double y  = b0[c] * in + s1[c];
+
+            s1[c] = b1[c] * in + s2[c] + a1[c] * y;
+            s2[c] = b2[c] * in + a2[c] * y;
+            x[c]  = y;
+        }
+    }
+
+    memcpy(state,                s1, sizeof(s1));
+    memcpy(state + BIQUAD_LANES, s2, sizeof(s2));
+}
+
+av_cold void ff_biquads_dsp_init(BiquadsDSPContext *dsp)
+{
+    dsp->filter = biquad_filter_c;
 
-static int config_filter(AVFilterLink *outlink, int reset)
+    if (ARCH_X86)
+        ff_biquads_dsp_init_x86(dsp);
+}
+
+static int config_filter(AVFilterLink *outlink)
 {
     AVFilterContext *ctx    = outlink->src;
     BiquadsContext *s       = ctx->priv;
@@ -408,56 +420,153 @@ static int config_filter(AVFilterLink *outlink, int reset)
     s->b2 /= s->a0;
     s->a0 /= s->a0;
 
-    s->cache = av_realloc_f(s->cache, sizeof(ChanCache), inlink->channels);
-    if (!s->cache)
-        return AVERROR(ENOMEM);
-    if (reset)
-        memset(s->cache, 0, sizeof(ChanCache) * inlink->channels);
+    return 0;
+}
+
+static int can_fuse(AVFilterContext *ctx, AVFilterContext *next)
+{
+    return next->filter->uninit == ctx->filter->uninit;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    BiquadsContext *s    = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    BiquadsContext *head;
+    int ret;
+
+    ret = config_filter(outlink);
+    if (ret < 0)
+        return ret;
 
     switch (inlink->format) {
-    case AV_SAMPLE_FMT_S16P: s->filter = biquad_s16; break;
-    case AV_SAMPLE_FMT_S32P: s->filter = biquad_s32; break;
-    case AV_SAMPLE_FMT_FLTP: s->filter = biquad_flt; break;
-    case AV_SAMPLE_FMT_DBLP: s->filter = biquad_dbl; break;
+    case AV_SAMPLE_FMT_S16P: s->load = load_s16; s->store = store_s16; break;
+    case AV_SAMPLE_FMT_S32P: s->load = load_s32; s->store = store_s32; break;
+    case AV_SAMPLE_FMT_FLTP: s->load = load_flt; s->store = store_flt; break;
+    case AV_SAMPLE_FMT_DBLP: s->load = load_dbl; s->store = store_dbl; break;
     default: av_assert0(0);
     }
 
-    s->block_align = av_get_bytes_per_sample(inlink->format);
+    s->nb_groups   = (inlink->channels + BIQUAD_LANES - 1) / BIQUAD_LANES;
+
+    av_freep(&s->clippings);
+    av_freep(&s->buf);
+    av_freep(&s->state);
+    s->nb_state_sections = 0;
+    s->clippings = av_calloc(inlink->channels, sizeof(*s->clippings));
+    s->buf       = av_calloc(s->nb_groups * 2 * BIQUAD_BLOCK * BIQUAD_LANES, sizeof(*s->buf));
+    if (!s->clippings || !s->buf)
+        return AVERROR(ENOMEM);
+
+    /* The upstream filter is configured first, and already set head if it
+     * runs this one. */
+    if (!s->head) {
+        ret = av_reallocp_array(&s->sections, 1, sizeof(*s->sections));
+        if (ret < 0)
+            return ret;
+        s->sections[0]    = ctx;
+        s->nb_sections    = 1;
+    }
+    head = s->head ? s->head : s;
+
+    if (can_fuse(ctx, outlink->dst)) {
+        BiquadsContext *next = outlink->dst->priv;
+
+        ret = av_reallocp_array(&head->sections, head->nb_sections + 1,
+                                sizeof(*head->sections));
+        if (ret < 0)
+            return ret;
+        head->sections[head->nb_sections++] = outlink->dst;
+        next->head = head;
+        av_log(ctx, AV_LOG_VERBOSE, "Running %s in the same pass.\n",
+               outlink->dst->name);
+    }
 
     return 0;
 }
 
-static int config_output(AVFilterLink *outlink)
+/* Coefficients of every section for each channel of a group: unselected
+ * channels go through unchanged, and the dry/wet mix is folded in the
+ * numerator since wet * B / A + dry = (wet * B + dry * A) / A. */
+static void set_coeffs(AVFilterContext *ctx, double *coeffs, int group)
 {
-    return config_filter(outlink, 1);
+    AVFilterLink *inlink = ctx->inputs[0];
+    BiquadsContext *s = ctx->priv;
+    int i, c;
+
+    for (i = 0; i < s->nb_sections; i++) {
+        const BiquadsContext *t = s->sections[i]->priv;
+        const double wet = t->mix, dry = 1. - wet;
+        double *dst = coeffs + i * 5 * BIQUAD_LANES;
+
+        for (c = 0; c < BIQUAD_LANES; c++) {
+            const int ch = group * BIQUAD_LANES + c;
+
+            if (ch < inlink->channels &&
+                (av_channel_layout_extract_channel(inlink->channel_layout, ch) & t->channels)) {
+                dst[c                   ] = t->b0 * wet + dry;
+                dst[c +     BIQUAD_LANES] = t->b1 * wet + t->a1 * dry;
+                dst[c + 2 * BIQUAD_LANES] = t->b2 * wet + t->a2 * dry;
+                dst[c + 3 * BIQUAD_LANES] = -t->a1;
+                dst[c + 4 * BIQUAD_LANES] = -t->a2;
+            } else {
+                dst[c                   ] = 1.;
+                dst[c +     BIQUAD_LANES] = 0.;
+                dst[c + 2 * BIQUAD_LANES] = 0.;
+                dst[c + 3 * BIQUAD_LANES] = 0.;
+                dst[c + 4 * BIQUAD_LANES] = 0.;
+            }
+        }
+    }
 }
 
 typedef struct ThreadData {
     AVFrame *in, *out;
 } ThreadData;
 
-static int filter_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+static int filter_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     AVFilterLink *inlink = ctx->inputs[0];
     ThreadData *td = arg;
     AVFrame *buf = td->in;
     AVFrame *out_buf = td->out;
     BiquadsContext *s = ctx->priv;
-    const int start = (buf->channels * jobnr) / nb_jobs;
-    const int end = (buf->channels * (jobnr+1)) / nb_jobs;
-    int ch;
-
-    for (ch = start; ch < end; ch++) {
-        if (!((av_channel_layout_extract_channel(inlink->channel_layout, ch) & s->channels))) {
-            if (buf != out_buf)
-                memcpy(out_buf->extended_data[ch], buf->extended_data[ch],
-                       buf->nb_samples * s->block_align);
-            continue;
+    const int start = (s->nb_groups * jobnr) / nb_jobs;
+    const int end = (s->nb_groups * (jobnr+1)) / nb_jobs;
+    const int sections_size = 5 * BIQUAD_LANES * s->nb_sections;
+    int g, i, n;
+
+    for (g = start; g < end; g++) {
+        const int ch = g * BIQUAD_LANES;
+        const int nb_channels = FFMIN(BIQUAD_LANES, inlink->channels - ch);
+        double *coeffs = s->coeffs + g * sections_size;
+        double *state = s->state + g * 2 * BIQUAD_LANES * s->nb_sections;
+        double *tmp = s->buf + g * 2 * BIQUAD_BLOCK * BIQUAD_LANES;
+        double *bypass = tmp + BIQUAD_BLOCK * BIQUAD_LANES;
+
+        set_coeffs(ctx, coeffs, g);
+
+        for (n = 0; n < buf->nb_samples; n += BIQUAD_BLOCK) {
+            const int len = FFMIN(BIQUAD_BLOCK, buf->nb_samples - n);
+
+            s->load(tmp, (const uint8_t **)buf->extended_data + ch, nb_channels, n, len);
+            for (i = 0; i < s->nb_sections; i++) {
+                const BiquadsContext *t = s->sections[i]->priv;
+                double *dst = tmp;
+
+                /* when disabled, the state is still updated, from a copy
+                 * of the input passed on unchanged */
+                if (t->disabled) {
+                    memcpy(bypass, tmp, len * BIQUAD_LANES * sizeof(*tmp));
+                    dst = bypass;
+                }
+                s->dsp.filter(dst, coeffs + i * 5 * BIQUAD_LANES,
+                              state + i * 2 * BIQUAD_LANES, len);
+            }
+            s->store(out_buf->extended_data + ch, tmp, nb_channels, n, len,
+                     s->clippings + ch);
         }
-
-        s->filter(s, buf->extended_data[ch], out_buf->extended_data[ch], buf->nb_samples,
-                  &s->cache[ch].i1, &s->cache[ch].i2, &s->cache[ch].o1, &s->cache[ch].o2,
-                  s->b0, s->b1, s->b2, s->a1, s->a2, &s->cache[ch].clippings, ctx->is_disabled);
     }
 
     return 0;
@@ -470,7 +579,35 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out_buf;
     ThreadData td;
-    int ch;
+    int ch, i;
+
+    /* already filtered by the first biquad filter of the chain */
+    if (s->head)
+        return ff_filter_frame(outlink, buf);
+
+    /* the following filters of the chain only get the frame once it is
+     * filtered, so evaluate their timeline here */
+    s->disabled = ctx->is_disabled;
+    for (i = 1; i < s->nb_sections; i++) {
+        AVFilterContext *next = s->sections[i];
+        BiquadsContext *t = next->priv;
+
+        t->disabled = !ff_inlink_evaluate_timeline_at_frame(next->inputs[0], buf);
+    }
+
+    if (s->nb_state_sections != s->nb_sections) {
+        const int nb = s->nb_groups * s->nb_sections;
+
+        av_freep(&s->state);
+        av_freep(&s->coeffs);
+        s->state  = av_calloc(nb, 2 * BIQUAD_LANES * sizeof(*s->state));
+        s->coeffs = av_calloc(nb, 5 * BIQUAD_LANES * sizeof(*s->coeffs));
+        if (!s->state || !s->coeffs) {
+            av_frame_free(&buf);
+            return AVERROR(ENOMEM);
+        }
+        s->nb_state_sections = s->nb_sections;
+    }
 
     if (av_frame_is_writable(buf)) {
         out_buf = buf;
@@ -485,13 +622,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
 
     td.in = buf;
     td.out = out_buf;
-    ctx->internal->execute(ctx, filter_channel, &td, NULL, FFMIN(outlink->channels, ff_filter_get_nb_threads(ctx)));
+    ctx->internal->execute(ctx, filter_channels, &td, NULL, FFMIN(s->nb_groups, ff_filter_get_nb_threads(ctx)));
 
     for (ch = 0; ch < outlink->channels; ch++) {
-        if (s->cache[ch].clippings > 0)
+        if (s->clippings[ch] > 0)
             av_log(ctx, AV_LOG_WARNING, "Channel %d clipping %d times. Please reduce gain.\n",
-                   ch, s->cache[ch].clippings);
-        s->cache[ch].clippings = 0;
+                   ch, s->clippings[ch]);
+        s->clippings[ch] = 0;
     }
 
     if (buf != out_buf)
@@ -625,14 +762,18 @@ static int process_command(AVFilterContext *ctx, const char *cmd, const char *ar
             s->b2 = value;
     }
 
-    return config_filter(outlink, 0);
+    return config_filter(outlink);
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
 {
     BiquadsContext *s = ctx->priv;
 
-    av_freep(&s->cache);
+    av_freep(&s->clippings);
+    av_freep(&s->coeffs);
+    av_freep(&s->state);
+    av_freep(&s->buf);
+    av_freep(&s->sections);
 }
 
 static const AVFilterPad inputs[] = {
@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_AF_BIQUADS_H
+#define AVFILTER_AF_BIQUADS_H
+
+#include <stddef.h>
+
+/* number of channels filtered together, interleaved */
+#define BIQUAD_LANES 4
+
+typedef struct BiquadsDSPContext {
+    /**
+     * Filter BIQUAD_LANES interleaved channels through one biquad section,
+     * in transposed direct form II:
+     * y = b0 * x + s1, s1 = b1 * x + s2 - a1 * y, s2 = b2 * x - a2 * y
+     *
+     * @param buf    len samples of each channel, filtered in place,
+     *               32-byte aligned
+     * @param coeffs b0, b1, b2, -a1 and -a2, each repeated for every channel,
+     *               32-byte aligned
+     * @param state  s1 and s2, each repeated for every channel, 32-byte aligned
+     * @param len    number of samples per channel
+     */
+    void (*filter)(double *buf, const double *coeffs, double *state,
+                   ptrdiff_t len);
+} BiquadsDSPContext;
+
+void ff_biquads_dsp_init(BiquadsDSPContext *dsp);
+void ff_biquads_dsp_init_x86(BiquadsDSPContext *dsp);
+
+#endif /* AVFILTER_AF_BIQUADS_H */
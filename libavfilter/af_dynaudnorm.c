@@ -44,6 +44,16 @@ typedef struct cqueue {
     int first;
 } cqueue;
 
+/* monotonic queue giving the minimum of the last window_size values */
+typedef struct sliding_minimum {
+    double *values;
+    int64_t *positions;
+    int window_size;
+    int nb_elements;
+    int first;
+    int64_t count;
+} sliding_minimum;
+
 typedef struct DynamicAudioNormalizerContext {
     const AVClass *class;
 
@@ -55,6 +65,7 @@ typedef struct DynamicAudioNormalizerContext {
     int dc_correction;
     int channels_coupled;
     int alt_boundary_mode;
+    int lookahead;
 
     double peak_value;
     double max_amplification;
@@ -65,8 +76,13 @@ typedef struct DynamicAudioNormalizerContext {
     double *compress_threshold;
     double *fade_factors[2];
     double *weights;
+    double *peak;
+    double *sum_of_squares;
+    double *actual_threshold[2];
+    double *amplification_factor;
 
     int channels;
+    int prefill_size;
     int delay;
     int eof;
     int64_t pts;
@@ -74,6 +90,7 @@ typedef struct DynamicAudioNormalizerContext {
     cqueue **gain_history_original;
     cqueue **gain_history_minimum;
     cqueue **gain_history_smoothed;
+    sliding_minimum **gain_minimum;
 
     cqueue *is_enabled;
 } DynamicAudioNormalizerContext;
@@ -100,6 +117,8 @@ static const AVOption dynaudnorm_options[] = {
     { "b",           "set alternative boundary mode",    OFFSET(alt_boundary_mode), AV_OPT_TYPE_BOOL,   {.i64 = 0},      0,     1, FLAGS },
     { "compress",    "set the compress factor",          OFFSET(compress_factor),   AV_OPT_TYPE_DOUBLE, {.dbl = 0.0},  0.0,  30.0, FLAGS },
     { "s",           "set the compress factor",          OFFSET(compress_factor),   AV_OPT_TYPE_DOUBLE, {.dbl = 0.0},  0.0,  30.0, FLAGS },
+    { "lookahead",   "set the number of future frames",  OFFSET(lookahead),         AV_OPT_TYPE_INT,    {.i64 = -1},    -1,   150, FLAGS },
+    { "l",           "set the number of future frames",  OFFSET(lookahead),         AV_OPT_TYPE_INT,    {.i64 = -1},    -1,   150, FLAGS },
     { NULL }
 };
 
@@ -114,6 +133,9 @@ static av_cold int init(AVFilterContext *ctx)
         return AVERROR(EINVAL);
     }
 
+    if (s->lookahead < 0 || s->lookahead > s->filter_size / 2)
+        s->lookahead = s->filter_size / 2;
+
     return 0;
 }
 
@@ -176,7 +198,7 @@ static cqueue *cqueue_create(int size)
     q->nb_elements = 0;
     q->first = 0;
 
-    q->elements = av_malloc_array(size, sizeof(double));
+    q->elements = av_malloc_array(2 * size, sizeof(double));
     if (!q->elements) {
         av_free(q);
         return NULL;
@@ -208,8 +230,13 @@ static int cqueue_enqueue(cqueue *q, double element)
 
     av_assert2(q->nb_elements != q->size);
 
-    i = (q->first + q->nb_elements) % q->size;
-    q->elements[i] = element;
+    i = q->first + q->nb_elements;
+    if (i >= q->size)
+        i -= q->size;
+    /* every element is stored twice, so that the queue can be read as one
+     * contiguous array from q->elements + q->first */
+    q->elements[i]           = element;
+    q->elements[i + q->size] = element;
     q->nb_elements++;
 
     return 0;
@@ -218,7 +245,12 @@ static int cqueue_enqueue(cqueue *q, double element)
 static double cqueue_peek(cqueue *q, int index)
 {
     av_assert2(index < q->nb_elements);
-    return q->elements[(q->first + index) % q->size];
+    return q->elements[q->first + index];
+}
+
+static const double *cqueue_data(cqueue *q)
+{
+    return q->elements + q->first;
 }
 
 static int cqueue_dequeue(cqueue *q, double *element)
@@ -226,7 +258,8 @@ static int cqueue_dequeue(cqueue *q, double *element)
     av_assert2(!cqueue_empty(q));
 
     *element = q->elements[q->first];
-    q->first = (q->first + 1) % q->size;
+    if (++q->first == q->size)
+        q->first = 0;
     q->nb_elements--;
 
     return 0;
@@ -236,12 +269,78 @@ static int cqueue_pop(cqueue *q)
 {
     av_assert2(!cqueue_empty(q));
 
-    q->first = (q->first + 1) % q->size;
+    if (++q->first == q->size)
+        q->first = 0;
     q->nb_elements--;
 
     return 0;
 }
 
+static sliding_minimum *sliding_minimum_create(int window_size)
+{
+    sliding_minimum *m;
+
+    m = av_mallocz(sizeof(sliding_minimum));
+    if (!m)
+        return NULL;
+
+    m->window_size = window_size;
+    m->values    = av_malloc_array(window_size, sizeof(*m->values));
+    m->positions = av_malloc_array(window_size, sizeof(*m->positions));
+    if (!m->values || !m->positions) {
+        av_free(m->values);
+        av_free(m->positions);
+        av_free(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+static void sliding_minimum_free(sliding_minimum *m)
+{
+    if (m) {
+        av_free(m->values);
+        av_free(m->positions);
+    }
+    av_free(m);
+}
+
+static void sliding_minimum_add(sliding_minimum *m, double value)
+{
+    int i;
+
+    /* drop the value leaving the window */
+    if (m->nb_elements && m->positions[m->first] <= m->count - m->window_size) {
+        if (++m->first == m->window_size)
+            m->first = 0;
+        m->nb_elements--;
+    }
+
+    /* drop the values which can no longer be the minimum */
+    while (m->nb_elements) {
+        i = m->first + m->nb_elements - 1;
+        if (i >= m->window_size)
+            i -= m->window_size;
+        if (m->values[i] < value)
+            break;
+        m->nb_elements--;
+    }
+
+    i = m->first + m->nb_elements;
+    if (i >= m->window_size)
+        i -= m->window_size;
+    m->values[i]    = value;
+    m->positions[i] = m->count++;
+    m->nb_elements++;
+}
+
+static double sliding_minimum_get(sliding_minimum *m)
+{
+    av_assert2(m->nb_elements);
+    return m->values[m->first];
+}
+
 static void init_gaussian_filter(DynamicAudioNormalizerContext *s)
 {
     double total_weight = 0.0;
@@ -249,8 +348,8 @@ static void init_gaussian_filter(DynamicAudioNormalizerContext *s)
     double adjust;
     int i;
 
-    // Pre-compute constants
-    const int offset = s->filter_size / 2;
+    // Pre-compute constants, the window being centered on the current frame
+    const int offset = s->prefill_size;
     const double c1 = 1.0 / (sigma * sqrt(2.0 * M_PI));
     const double c2 = 2.0 * sigma * sigma;
 
@@ -287,11 +386,19 @@ static av_cold void uninit(AVFilterContext *ctx)
             cqueue_free(s->gain_history_minimum[c]);
         if (s->gain_history_smoothed)
             cqueue_free(s->gain_history_smoothed[c]);
+        if (s->gain_minimum)
+            sliding_minimum_free(s->gain_minimum[c]);
     }
 
     av_freep(&s->gain_history_original);
     av_freep(&s->gain_history_minimum);
     av_freep(&s->gain_history_smoothed);
+    av_freep(&s->gain_minimum);
+    av_freep(&s->peak);
+    av_freep(&s->sum_of_squares);
+    av_freep(&s->actual_threshold[0]);
+    av_freep(&s->actual_threshold[1]);
+    av_freep(&s->amplification_factor);
 
     cqueue_free(s->is_enabled);
     s->is_enabled = NULL;
@@ -321,12 +428,21 @@ static int config_input(AVFilterLink *inlink)
     s->gain_history_original = av_calloc(inlink->channels, sizeof(*s->gain_history_original));
     s->gain_history_minimum = av_calloc(inlink->channels, sizeof(*s->gain_history_minimum));
     s->gain_history_smoothed = av_calloc(inlink->channels, sizeof(*s->gain_history_smoothed));
+    s->gain_minimum = av_calloc(inlink->channels, sizeof(*s->gain_minimum));
+    s->peak = av_calloc(inlink->channels, sizeof(*s->peak));
+    s->sum_of_squares = av_calloc(inlink->channels, sizeof(*s->sum_of_squares));
+    s->actual_threshold[0] = av_calloc(inlink->channels, sizeof(*s->actual_threshold[0]));
+    s->actual_threshold[1] = av_calloc(inlink->channels, sizeof(*s->actual_threshold[1]));
+    s->amplification_factor = av_calloc(inlink->channels, sizeof(*s->amplification_factor));
     s->weights = av_malloc_array(s->filter_size, sizeof(*s->weights));
     s->is_enabled = cqueue_create(s->filter_size);
     if (!s->prev_amplification_factor || !s->dc_correction_value ||
         !s->compress_threshold || !s->fade_factors[0] || !s->fade_factors[1] ||
         !s->gain_history_original || !s->gain_history_minimum ||
-        !s->gain_history_smoothed || !s->is_enabled || !s->weights)
+        !s->gain_history_smoothed || !s->gain_minimum || !s->peak ||
+        !s->sum_of_squares || !s->actual_threshold[0] ||
+        !s->actual_threshold[1] || !s->amplification_factor ||
+        !s->is_enabled || !s->weights)
         return AVERROR(ENOMEM);
 
     for (c = 0; c < inlink->channels; c++) {
@@ -335,17 +451,21 @@ static int config_input(AVFilterLink *inlink)
         s->gain_history_original[c] = cqueue_create(s->filter_size);
         s->gain_history_minimum[c]  = cqueue_create(s->filter_size);
         s->gain_history_smoothed[c] = cqueue_create(s->filter_size);
+        s->gain_minimum[c]          = sliding_minimum_create(s->filter_size);
 
         if (!s->gain_history_original[c] || !s->gain_history_minimum[c] ||
-            !s->gain_history_smoothed[c])
+            !s->gain_history_smoothed[c] || !s->gain_minimum[c])
             return AVERROR(ENOMEM);
     }
 
+    /* the windows cover lookahead following frames and the preceding ones */
+    s->prefill_size = s->filter_size - 1 - s->lookahead;
+
     precalculate_fade_factors(s->fade_factors, s->frame_len);
     init_gaussian_filter(s);
 
     s->channels = inlink->channels;
-    s->delay = s->filter_size;
+    s->delay = 2 * s->lookahead + 1;
 
     return 0;
 }
@@ -367,51 +487,81 @@ static inline double bound(const double threshold, const double val)
     return erf(CONST * (val / threshold)) * threshold;
 }
 
-static double find_peak_magnitude(AVFrame *frame, int channel)
+/**
+ * Compute the peak magnitude and the sum of squares of one channel in a
+ * single pass, with independent accumulators so that the loop vectorizes.
+ */
+static void channel_stats(const double *data, int nb_samples,
+                          double *peak, double *sum_of_squares)
+{
+    double max[4] = { 0.0 }, sum[4] = { 0.0 };
+    int i, j;
+
+    for (i = 0; i + 4 <= nb_samples; i += 4) {
+        for (j = 0; j < 4; j++) {
+            max[j] = FFMAX(max[j], fabs(data[i + j]));
+            sum[j] += pow_2(data[i + j]);
+        }
+    }
+    for (; i < nb_samples; i++) {
+        max[0] = FFMAX(max[0], fabs(data[i]));
+        sum[0] += pow_2(data[i]);
+    }
+
+    *peak           = FFMAX(FFMAX(max[0], max[1]), FFMAX(max[2], max[3]));
+    *sum_of_squares = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+static int compute_stats(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    const int start = (s->channels *  jobnr   ) / nb_jobs;
+    const int end   = (s->channels * (jobnr+1)) / nb_jobs;
+    int c;
+
+    for (c = start; c < end; c++)
+        channel_stats((const double *)frame->extended_data[c], frame->nb_samples,
+                      &s->peak[c], &s->sum_of_squares[c]);
+
+    return 0;
+}
+
+static double find_peak_magnitude(DynamicAudioNormalizerContext *s, int channel)
 {
     double max = DBL_EPSILON;
-    int c, i;
+    int c;
 
     if (channel == -1) {
-        for (c = 0; c < frame->channels; c++) {
-            double *data_ptr = (double *)frame->extended_data[c];
-
-            for (i = 0; i < frame->nb_samples; i++)
-                max = FFMAX(max, fabs(data_ptr[i]));
-        }
+        for (c = 0; c < s->channels; c++)
+            max = FFMAX(max, s->peak[c]);
     } else {
-        double *data_ptr = (double *)frame->extended_data[channel];
-
-        for (i = 0; i < frame->nb_samples; i++)
-            max = FFMAX(max, fabs(data_ptr[i]));
+        max = FFMAX(max, s->peak[channel]);
     }
 
     return max;
 }
 
-static double compute_frame_rms(AVFrame *frame, int channel)
+static double compute_sum_of_squares(DynamicAudioNormalizerContext *s, int channel)
 {
-    double rms_value = 0.0;
-    int c, i;
+    double sum = 0.0;
+    int c;
 
-    if (channel == -1) {
-        for (c = 0; c < frame->channels; c++) {
-            const double *data_ptr = (double *)frame->extended_data[c];
+    if (channel != -1)
+        return s->sum_of_squares[channel];
 
-            for (i = 0; i < frame->nb_samples; i++) {
-                rms_value += pow_2(data_ptr[i]);
-            }
-        }
+    for (c = 0; c < s->channels; c++)
+        sum += s->sum_of_squares[c];
 
-        rms_value /= frame->nb_samples * frame->channels;
-    } else {
-        const double *data_ptr = (double *)frame->extended_data[channel];
-        for (i = 0; i < frame->nb_samples; i++) {
-            rms_value += pow_2(data_ptr[i]);
-        }
+    return sum;
+}
 
-        rms_value /= frame->nb_samples;
-    }
+static double compute_frame_rms(DynamicAudioNormalizerContext *s, AVFrame *frame,
+                                int channel)
+{
+    double rms_value = compute_sum_of_squares(s, channel);
+
+    rms_value /= frame->nb_samples * (channel == -1 ? s->channels : 1);
 
     return FFMAX(sqrt(rms_value), DBL_EPSILON);
 }
@@ -419,30 +569,19 @@ static double compute_frame_rms(AVFrame *frame, int channel)
 static double get_max_local_gain(DynamicAudioNormalizerContext *s, AVFrame *frame,
                                  int channel)
 {
-    const double maximum_gain = s->peak_value / find_peak_magnitude(frame, channel);
-    const double rms_gain = s->target_rms > DBL_EPSILON ? (s->target_rms / compute_frame_rms(frame, channel)) : DBL_MAX;
+    const double maximum_gain = s->peak_value / find_peak_magnitude(s, channel);
+    const double rms_gain = s->target_rms > DBL_EPSILON ? (s->target_rms / compute_frame_rms(s, frame, channel)) : DBL_MAX;
     return bound(s->max_amplification, FFMIN(maximum_gain, rms_gain));
 }
 
-static double minimum_filter(cqueue *q)
-{
-    double min = DBL_MAX;
-    int i;
-
-    for (i = 0; i < cqueue_size(q); i++) {
-        min = FFMIN(min, cqueue_peek(q, i));
-    }
-
-    return min;
-}
-
 static double gaussian_filter(DynamicAudioNormalizerContext *s, cqueue *q)
 {
+    const double *data = cqueue_data(q);
     double result = 0.0;
     int i;
 
     for (i = 0; i < cqueue_size(q); i++) {
-        result += cqueue_peek(q, i) * s->weights[i];
+        result += data[i] * s->weights[i];
     }
 
     return result;
@@ -453,35 +592,37 @@ static void update_gain_history(DynamicAudioNormalizerContext *s, int channel,
 {
     if (cqueue_empty(s->gain_history_original[channel]) ||
         cqueue_empty(s->gain_history_minimum[channel])) {
-        const int pre_fill_size = s->filter_size / 2;
+        const int pre_fill_size = s->prefill_size;
         const double initial_value = s->alt_boundary_mode ? current_gain_factor : 1.0;
 
         s->prev_amplification_factor[channel] = initial_value;
 
         while (cqueue_size(s->gain_history_original[channel]) < pre_fill_size) {
             cqueue_enqueue(s->gain_history_original[channel], initial_value);
+            sliding_minimum_add(s->gain_minimum[channel], initial_value);
         }
     }
 
     cqueue_enqueue(s->gain_history_original[channel], current_gain_factor);
+    sliding_minimum_add(s->gain_minimum[channel], current_gain_factor);
 
     while (cqueue_size(s->gain_history_original[channel]) >= s->filter_size) {
         double minimum;
         av_assert0(cqueue_size(s->gain_history_original[channel]) == s->filter_size);
 
         if (cqueue_empty(s->gain_history_minimum[channel])) {
-            const int pre_fill_size = s->filter_size / 2;
+            const int pre_fill_size = s->prefill_size;
             double initial_value = s->alt_boundary_mode ? cqueue_peek(s->gain_history_original[channel], 0) : 1.0;
             int input = pre_fill_size;
 
             while (cqueue_size(s->gain_history_minimum[channel]) < pre_fill_size) {
-                input++;
+                input = FFMIN(input + 1, s->filter_size - 1);
                 initial_value = FFMIN(initial_value, cqueue_peek(s->gain_history_original[channel], input));
                 cqueue_enqueue(s->gain_history_minimum[channel], initial_value);
             }
         }
 
-        minimum = minimum_filter(s->gain_history_original[channel]);
+        minimum = sliding_minimum_get(s->gain_minimum[channel]);
 
         cqueue_enqueue(s->gain_history_minimum[channel], minimum);
 
@@ -505,13 +646,17 @@ static inline double update_value(double new, double old, double aggressiveness)
     return aggressiveness * new + (1.0 - aggressiveness) * old;
 }
 
-static void perform_dc_correction(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static int perform_dc_correction(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    AVFrame *frame = arg;
     const double diff = 1.0 / frame->nb_samples;
-    int is_first_frame = cqueue_empty(s->gain_history_original[0]);
+    const int is_first_frame = cqueue_empty(s->gain_history_original[0]);
+    const int start = (s->channels *  jobnr   ) / nb_jobs;
+    const int end   = (s->channels * (jobnr+1)) / nb_jobs;
     int c, i;
 
-    for (c = 0; c < s->channels; c++) {
+    for (c = start; c < end; c++) {
         double *dst_ptr = (double *)frame->extended_data[c];
         double current_average_value = 0.0;
         double prev_value;
@@ -526,6 +671,8 @@ static void perform_dc_correction(DynamicAudioNormalizerContext *s, AVFrame *fra
             dst_ptr[i] -= fade(prev_value, s->dc_correction_value[c], i, s->fade_factors);
         }
     }
+
+    return 0;
 }
 
 static double setup_compress_thresh(double threshold)
@@ -553,34 +700,45 @@ static double setup_compress_thresh(double threshold)
 static double compute_frame_std_dev(DynamicAudioNormalizerContext *s,
                                     AVFrame *frame, int channel)
 {
-    double variance = 0.0;
-    int i, c;
+    double variance = compute_sum_of_squares(s, channel); // Assume that MEAN is *zero*
 
-    if (channel == -1) {
-        for (c = 0; c < s->channels; c++) {
-            const double *data_ptr = (double *)frame->extended_data[c];
-
-            for (i = 0; i < frame->nb_samples; i++) {
-                variance += pow_2(data_ptr[i]);  // Assume that MEAN is *zero*
-            }
-        }
+    if (channel == -1)
         variance /= (s->channels * frame->nb_samples) - 1;
-    } else {
-        const double *data_ptr = (double *)frame->extended_data[channel];
+    else
+        variance /= frame->nb_samples - 1;
+
+    return FFMAX(sqrt(variance), DBL_EPSILON);
+}
+
+static int compress_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    const int start = (s->channels *  jobnr   ) / nb_jobs;
+    const int end   = (s->channels * (jobnr+1)) / nb_jobs;
+    int c, i;
+
+    for (c = start; c < end; c++) {
+        const double prev_actual_thresh = s->actual_threshold[0][c];
+        const double curr_actual_thresh = s->actual_threshold[1][c];
+        double *const dst_ptr = (double *)frame->extended_data[c];
 
         for (i = 0; i < frame->nb_samples; i++) {
-            variance += pow_2(data_ptr[i]);      // Assume that MEAN is *zero*
+            const double localThresh = fade(prev_actual_thresh, curr_actual_thresh, i, s->fade_factors);
+            dst_ptr[i] = copysign(bound(localThresh, fabs(dst_ptr[i])), dst_ptr[i]);
         }
-        variance /= frame->nb_samples - 1;
     }
 
-    return FFMAX(sqrt(variance), DBL_EPSILON);
+    return 0;
 }
 
-static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static void perform_compression(AVFilterContext *ctx, AVFrame *frame, int nb_jobs)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
     int is_first_frame = cqueue_empty(s->gain_history_original[0]);
-    int c, i;
+    int c;
+
+    ctx->internal->execute(ctx, compute_stats, frame, NULL, nb_jobs);
 
     if (s->channels_coupled) {
         const double standard_deviation = compute_frame_std_dev(s, frame, -1);
@@ -594,11 +752,8 @@ static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame
         curr_actual_thresh = setup_compress_thresh(s->compress_threshold[0]);
 
         for (c = 0; c < s->channels; c++) {
-            double *const dst_ptr = (double *)frame->extended_data[c];
-            for (i = 0; i < frame->nb_samples; i++) {
-                const double localThresh = fade(prev_actual_thresh, curr_actual_thresh, i, s->fade_factors);
-                dst_ptr[i] = copysign(bound(localThresh, fabs(dst_ptr[i])), dst_ptr[i]);
-            }
+            s->actual_threshold[0][c] = prev_actual_thresh;
+            s->actual_threshold[1][c] = curr_actual_thresh;
         }
     } else {
         for (c = 0; c < s->channels; c++) {
@@ -606,32 +761,31 @@ static void perform_compression(DynamicAudioNormalizerContext *s, AVFrame *frame
             const double current_threshold  = setup_compress_thresh(FFMIN(1.0, s->compress_factor * standard_deviation));
 
             const double prev_value = is_first_frame ? current_threshold : s->compress_threshold[c];
-            double prev_actual_thresh, curr_actual_thresh;
-            double *dst_ptr;
             s->compress_threshold[c] = is_first_frame ? current_threshold : update_value(current_threshold, s->compress_threshold[c], 1.0/3.0);
 
-            prev_actual_thresh = setup_compress_thresh(prev_value);
-            curr_actual_thresh = setup_compress_thresh(s->compress_threshold[c]);
-
-            dst_ptr = (double *)frame->extended_data[c];
-            for (i = 0; i < frame->nb_samples; i++) {
-                const double localThresh = fade(prev_actual_thresh, curr_actual_thresh, i, s->fade_factors);
-                dst_ptr[i] = copysign(bound(localThresh, fabs(dst_ptr[i])), dst_ptr[i]);
-            }
+            s->actual_threshold[0][c] = setup_compress_thresh(prev_value);
+            s->actual_threshold[1][c] = setup_compress_thresh(s->compress_threshold[c]);
         }
     }
+
+    ctx->internal->execute(ctx, compress_channels, frame, NULL, nb_jobs);
 }
 
-static void analyze_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
+static void analyze_frame(AVFilterContext *ctx, AVFrame *frame)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    const int nb_jobs = FFMIN(s->channels, ff_filter_get_nb_threads(ctx));
+
     if (s->dc_correction) {
-        perform_dc_correction(s, frame);
+        ctx->internal->execute(ctx, perform_dc_correction, frame, NULL, nb_jobs);
     }
 
     if (s->compress_factor > DBL_EPSILON) {
-        perform_compression(s, frame);
+        perform_compression(ctx, frame, nb_jobs);
     }
 
+    ctx->internal->execute(ctx, compute_stats, frame, NULL, nb_jobs);
+
     if (s->channels_coupled) {
         const double current_gain_factor = get_max_local_gain(s, frame, -1);
         int c;
@@ -646,29 +800,46 @@ static void analyze_frame(DynamicAudioNormalizerContext *s, AVFrame *frame)
     }
 }
 
-static void amplify_frame(DynamicAudioNormalizerContext *s, AVFrame *frame, int enabled)
+static int amplify_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    const double *fade0 = s->fade_factors[0];
+    const double *fade1 = s->fade_factors[1];
+    const double peak = s->peak_value;
+    const int start = (s->channels *  jobnr   ) / nb_jobs;
+    const int end   = (s->channels * (jobnr+1)) / nb_jobs;
     int c, i;
 
-    for (c = 0; c < s->channels; c++) {
+    for (c = start; c < end; c++) {
         double *dst_ptr = (double *)frame->extended_data[c];
-        double current_amplification_factor;
+        const double prev = s->prev_amplification_factor[c];
+        const double next = s->amplification_factor[c];
 
-        cqueue_dequeue(s->gain_history_smoothed[c], &current_amplification_factor);
+        for (i = 0; i < frame->nb_samples; i++) {
+            const double amplification_factor = fade0[i] * prev + fade1[i] * next;
 
-        for (i = 0; i < frame->nb_samples && enabled; i++) {
-            const double amplification_factor = fade(s->prev_amplification_factor[c],
-                                                     current_amplification_factor, i,
-                                                     s->fade_factors);
+            dst_ptr[i] = av_clipd(dst_ptr[i] * amplification_factor, -peak, peak);
+        }
+    }
 
-            dst_ptr[i] *= amplification_factor;
+    return 0;
+}
 
-            if (fabs(dst_ptr[i]) > s->peak_value)
-                dst_ptr[i] = copysign(s->peak_value, dst_ptr[i]);
-        }
+static void amplify_frame(AVFilterContext *ctx, AVFrame *frame, int enabled)
+{
+    DynamicAudioNormalizerContext *s = ctx->priv;
+    int c;
 
-        s->prev_amplification_factor[c] = current_amplification_factor;
-    }
+    for (c = 0; c < s->channels; c++)
+        cqueue_dequeue(s->gain_history_smoothed[c], &s->amplification_factor[c]);
+
+    if (enabled)
+        ctx->internal->execute(ctx, amplify_channels, frame, NULL,
+                               FFMIN(s->channels, ff_filter_get_nb_threads(ctx)));
+
+    for (c = 0; c < s->channels; c++)
+        s->prev_amplification_factor[c] = s->amplification_factor[c];
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
@@ -684,13 +855,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         cqueue_dequeue(s->is_enabled, &is_enabled);
 
-        amplify_frame(s, out, is_enabled > 0.);
+        amplify_frame(ctx, out, is_enabled > 0.);
         ret = ff_filter_frame(outlink, out);
     }
 
     av_frame_make_writable(in);
     cqueue_enqueue(s->is_enabled, !ctx->is_disabled);
-    analyze_frame(s, in);
+    analyze_frame(ctx, in);
     ff_bufqueue_add(ctx, &s->queue, in);
 
     return ret;
@@ -814,5 +985,6 @@ AVFilter ff_af_dynaudnorm = {
     .inputs        = avfilter_af_dynaudnorm_inputs,
     .outputs       = avfilter_af_dynaudnorm_outputs,
     .priv_class    = &dynaudnorm_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -22,10 +22,10 @@
 
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/convolution.h"
 #include "libavutil/float_dsp.h"
 #include "libavutil/intmath.h"
 #include "libavutil/opt.h"
-#include "libavcodec/avfft.h"
 
 #include "avfilter.h"
 #include "filters.h"
@@ -65,18 +65,15 @@ typedef struct HeadphoneContext {
     int write[2];
 
     int buffer_length;
-    int n_fft;
     int size;
     int hrir_fmt;
 
     int *delay[2];
     float *data_ir[2];
     float *temp_src[2];
-    FFTComplex *temp_fft[2];
-    FFTComplex *temp_afft[2];
 
-    FFTContext *fft[2], *ifft[2];
-    FFTComplex *data_hrtf[2];
+    AVConvolutionContext *conv[2];
+    int nb_conv;
 
     AVFloatDSPContext *fdsp;
     struct headphone_inputs {
@@ -158,8 +155,6 @@ typedef struct ThreadData {
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
-    FFTComplex **temp_afft;
 } ThreadData;
 
 static int headphone_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -241,95 +236,31 @@ static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     HeadphoneContext *s = ctx->priv;
     ThreadData *td = arg;
     AVFrame *in = td->in, *out = td->out;
-    int offset = jobnr;
-    int *write = &td->write[jobnr];
-    FFTComplex *hrtf = s->data_hrtf[jobnr];
     int *n_clippings = &td->n_clippings[jobnr];
-    float *ringbuffer = td->ringbuffer[jobnr];
-    const int ir_len = s->ir_len;
     const float *src = (const float *)in->data[0];
-    float *dst = (float *)out->data[0];
+    float *dst[2] = { (float *)out->data[0] + jobnr, (float *)out->data[0] + 1 };
+    const int nb_outputs = nb_jobs > 1 ? 1 : 2;
     const int in_channels = in->channels;
-    const int buffer_length = s->buffer_length;
-    const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr];
-    FFTComplex *fft_acc = s->temp_afft[jobnr];
-    FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
-    const int n_fft = s->n_fft;
-    const float fft_scale = 1.0f / s->n_fft;
-    FFTComplex *hrtf_offset;
-    int wr = *write;
-    int n_read;
+    const float *src_ch[64];
     int i, j;
 
-    dst += offset;
+    for (i = 0; i < in_channels; i++)
+        src_ch[i] = src + i;
 
-    n_read = FFMIN(ir_len, in->nb_samples);
-    for (j = 0; j < n_read; j++) {
-        dst[2 * j]     = ringbuffer[wr];
-        ringbuffer[wr] = 0.0;
-        wr  = (wr + 1) & modulo;
-    }
+    av_convolution_process(s->conv[jobnr], dst, 2, src_ch, in_channels, in->nb_samples);
 
-    for (j = n_read; j < in->nb_samples; j++) {
-        dst[2 * j] = 0;
-    }
-
-    memset(fft_acc, 0, sizeof(FFTComplex) * n_fft);
-
-    for (i = 0; i < in_channels; i++) {
-        if (i == s->lfe_channel) {
-            for (j = 0; j < in->nb_samples; j++) {
-                dst[2 * j] += src[i + j * in_channels] * s->gain_lfe;
-            }
-            continue;
-        }
-
-        offset = i * n_fft;
-        hrtf_offset = hrtf + offset;
-
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
-
-        for (j = 0; j < in->nb_samples; j++) {
-            fft_in[j].re = src[j * in_channels + i];
+    for (j = 0; j < nb_outputs; j++) {
+        if (s->lfe_channel >= 0 && s->lfe_channel < in_channels) {
+            for (i = 0; i < in->nb_samples; i++)
+                dst[j][2 * i] += src[i * in_channels + s->lfe_channel] * s->gain_lfe;
         }
 
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
-        for (j = 0; j < n_fft; j++) {
-            const FFTComplex *hcomplex = hrtf_offset + j;
-            const float re = fft_in[j].re;
-            const float im = fft_in[j].im;
-
-            fft_acc[j].re += re * hcomplex->re - im * hcomplex->im;
-            fft_acc[j].im += re * hcomplex->im + im * hcomplex->re;
+        for (i = 0; i < out->nb_samples; i++) {
+            if (fabsf(dst[j][2 * i]) > 1)
+                n_clippings[0]++;
         }
     }
 
-    av_fft_permute(ifft, fft_acc);
-    av_fft_calc(ifft, fft_acc);
-
-    for (j = 0; j < in->nb_samples; j++) {
-        dst[2 * j] += fft_acc[j].re * fft_scale;
-    }
-
-    for (j = 0; j < ir_len - 1; j++) {
-        int write_pos = (wr + j) & modulo;
-
-        *(ringbuffer + write_pos) += fft_acc[in->nb_samples + j].re * fft_scale;
-    }
-
-    for (i = 0; i < out->nb_samples; i++) {
-        if (fabsf(dst[0]) > 1) {
-            n_clippings[0]++;
-        }
-
-        dst += 2;
-    }
-
-    *write = wr;
-
     return 0;
 }
 
@@ -368,13 +299,11 @@ static int headphone_frame(HeadphoneContext *s, AVFrame *in, AVFilterLink *outli
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
-    td.temp_afft = s->temp_afft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, headphone_convolute, &td, NULL, 2);
     } else {
-        ctx->internal->execute(ctx, headphone_fast_convolute, &td, NULL, 2);
+        ctx->internal->execute(ctx, headphone_fast_convolute, &td, NULL, s->nb_conv);
     }
     emms_c();
 
@@ -387,6 +316,32 @@ static int headphone_frame(HeadphoneContext *s, AVFrame *in, AVFilterLink *outli
     return ff_filter_frame(outlink, out);
 }
 
+static int add_hrir(AVFilterContext *ctx, int ear, int ch,
+                    const float *ptr, int stride, int len, int delay, float gain)
+{
+    HeadphoneContext *s = ctx->priv;
+    AVConvolutionContext *conv = s->conv[s->nb_conv > 1 ? ear : 0];
+    float *ir;
+    int j, ret;
+
+    if (ch >= ctx->inputs[0]->channels || ch == s->lfe_channel)
+        return 0;
+
+    ir = av_calloc(delay + len, sizeof(*ir));
+    if (!ir)
+        return AVERROR(ENOMEM);
+
+    for (j = 0; j < len; j++)
+        ir[delay + j] = ptr[j * stride] * gain;
+
+    ret = av_convolution_add_ir(conv, ir, delay + len);
+    if (ret >= 0)
+        ret = av_convolution_add_route(conv, ch, s->nb_conv > 1 ? 0 : ear, ret);
+    av_free(ir);
+
+    return ret;
+}
+
 static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
 {
     struct HeadphoneContext *s = ctx->priv;
@@ -394,88 +349,43 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
     int nb_irs = s->nb_irs;
     int nb_input_channels = ctx->inputs[0]->channels;
     float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10);
-    FFTComplex *data_hrtf_l = NULL;
-    FFTComplex *data_hrtf_r = NULL;
-    FFTComplex *fft_in_l = NULL;
-    FFTComplex *fft_in_r = NULL;
     float *data_ir_l = NULL;
     float *data_ir_r = NULL;
     int offset = 0, ret = 0;
-    int n_fft;
     int i, j, k;
 
     s->air_len = 1 << (32 - ff_clz(ir_len));
     s->buffer_length = 1 << (32 - ff_clz(s->air_len));
-    s->n_fft = n_fft = 1 << (32 - ff_clz(ir_len + s->size));
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
-        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
-        if (!fft_in_l || !fft_in_r) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(av_log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(av_log2(s->n_fft), 0);
-        av_fft_end(s->ifft[0]);
-        av_fft_end(s->ifft[1]);
-        s->ifft[0] = av_fft_init(av_log2(s->n_fft), 1);
-        s->ifft[1] = av_fft_init(av_log2(s->n_fft), 1);
-
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
-            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
-
-    s->data_ir[0] = av_calloc(s->air_len, sizeof(float) * s->nb_irs);
-    s->data_ir[1] = av_calloc(s->air_len, sizeof(float) * s->nb_irs);
-    s->delay[0] = av_calloc(s->nb_irs, sizeof(float));
-    s->delay[1] = av_calloc(s->nb_irs, sizeof(float));
 
     if (s->type == TIME_DOMAIN) {
+        s->data_ir[0] = av_calloc(s->air_len, sizeof(float) * s->nb_irs);
+        s->data_ir[1] = av_calloc(s->air_len, sizeof(float) * s->nb_irs);
+        s->delay[0] = av_calloc(s->nb_irs, sizeof(float));
+        s->delay[1] = av_calloc(s->nb_irs, sizeof(float));
         s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
         s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
-    } else {
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[0] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[1] = av_calloc(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1] ||
-            !s->temp_afft[0] || !s->temp_afft[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
-
-    if (!s->data_ir[0] || !s->data_ir[1] ||
-        !s->ringbuffer[0] || !s->ringbuffer[1]) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
-    if (s->type == TIME_DOMAIN) {
         s->temp_src[0] = av_calloc(s->air_len, sizeof(float));
         s->temp_src[1] = av_calloc(s->air_len, sizeof(float));
 
         data_ir_l = av_calloc(nb_irs * s->air_len, sizeof(*data_ir_l));
         data_ir_r = av_calloc(nb_irs * s->air_len, sizeof(*data_ir_r));
-        if (!data_ir_r || !data_ir_l || !s->temp_src[0] || !s->temp_src[1]) {
+        if (!s->data_ir[0] || !s->data_ir[1] || !s->delay[0] || !s->delay[1] ||
+            !s->ringbuffer[0] || !s->ringbuffer[1] ||
+            !data_ir_r || !data_ir_l || !s->temp_src[0] || !s->temp_src[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
     } else {
-        data_hrtf_l = av_calloc(n_fft, sizeof(*data_hrtf_l) * nb_irs);
-        data_hrtf_r = av_calloc(n_fft, sizeof(*data_hrtf_r) * nb_irs);
-        if (!data_hrtf_r || !data_hrtf_l) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+        /* One engine per ear when threading, else a single one sharing the
+         * input transforms between both ears. There is no latency whatever
+         * the partition sizes, the frame size only bounds the largest one. */
+        s->nb_conv = ff_filter_get_nb_threads(ctx) > 1 ? 2 : 1;
+        for (i = 0; i < s->nb_conv; i++) {
+            s->conv[i] = av_convolution_alloc(nb_input_channels, 3 - s->nb_conv, 64, s->size, 0);
+            if (!s->conv[i]) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
         }
     }
 
@@ -513,21 +423,9 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
                     data_ir_r[offset + j] = ptr[len * 2 - j * 2 - 1] * gain_lin;
                 }
             } else {
-                memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
-                memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
-
-                offset = idx * n_fft;
-                for (j = 0; j < len; j++) {
-                    fft_in_l[delay_l + j].re = ptr[j * 2    ] * gain_lin;
-                    fft_in_r[delay_r + j].re = ptr[j * 2 + 1] * gain_lin;
-                }
-
-                av_fft_permute(s->fft[0], fft_in_l);
-                av_fft_calc(s->fft[0], fft_in_l);
-                memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-                av_fft_permute(s->fft[0], fft_in_r);
-                av_fft_calc(s->fft[0], fft_in_r);
-                memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
+                if ((ret = add_hrir(ctx, 0, idx, ptr,     2, len, delay_l, gain_lin)) < 0 ||
+                    (ret = add_hrir(ctx, 1, idx, ptr + 1, 2, len, delay_r, gain_lin)) < 0)
+                    goto fail;
             }
         } else {
             int I, N = ctx->inputs[1]->channels;
@@ -556,21 +454,9 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
                         data_ir_r[offset + j] = ptr[len * N - j * N - N + I + 1] * gain_lin;
                     }
                 } else {
-                    memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
-                    memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
-
-                    offset = idx * n_fft;
-                    for (j = 0; j < len; j++) {
-                        fft_in_l[delay_l + j].re = ptr[j * N + I    ] * gain_lin;
-                        fft_in_r[delay_r + j].re = ptr[j * N + I + 1] * gain_lin;
-                    }
-
-                    av_fft_permute(s->fft[0], fft_in_l);
-                    av_fft_calc(s->fft[0], fft_in_l);
-                    memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-                    av_fft_permute(s->fft[0], fft_in_r);
-                    av_fft_calc(s->fft[0], fft_in_r);
-                    memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
+                    if ((ret = add_hrir(ctx, 0, idx, ptr + I,     N, len, delay_l, gain_lin)) < 0 ||
+                        (ret = add_hrir(ctx, 1, idx, ptr + I + 1, N, len, delay_r, gain_lin)) < 0)
+                        goto fail;
                 }
             }
         }
@@ -582,17 +468,10 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
         memcpy(s->data_ir[0], data_ir_l, sizeof(float) * nb_irs * s->air_len);
         memcpy(s->data_ir[1], data_ir_r, sizeof(float) * nb_irs * s->air_len);
     } else {
-        s->data_hrtf[0] = av_calloc(n_fft * s->nb_irs, sizeof(FFTComplex));
-        s->data_hrtf[1] = av_calloc(n_fft * s->nb_irs, sizeof(FFTComplex));
-        if (!s->data_hrtf[0] || !s->data_hrtf[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+        for (i = 0; i < s->nb_conv; i++) {
+            if ((ret = av_convolution_init(s->conv[i])) < 0)
+                goto fail;
         }
-
-        memcpy(s->data_hrtf[0], data_hrtf_l,
-            sizeof(FFTComplex) * nb_irs * n_fft);
-        memcpy(s->data_hrtf[1], data_hrtf_r,
-            sizeof(FFTComplex) * nb_irs * n_fft);
     }
 
     s->have_hrirs = 1;
@@ -605,12 +484,6 @@ fail:
     av_freep(&data_ir_l);
     av_freep(&data_ir_r);
 
-    av_freep(&data_hrtf_l);
-    av_freep(&data_hrtf_r);
-
-    av_freep(&fft_in_l);
-    av_freep(&fft_in_r);
-
     return ret;
 }
 
@@ -662,7 +535,11 @@ static int activate(AVFilterContext *ctx)
             return ret;
     }
 
-    if ((ret = ff_inlink_consume_samples(ctx->inputs[0], s->size, s->size, &in)) > 0) {
+    if (s->type == TIME_DOMAIN)
+        ret = ff_inlink_consume_samples(ctx->inputs[0], s->size, s->size, &in);
+    else
+        ret = ff_inlink_consume_frame(ctx->inputs[0], &in);
+    if (ret > 0) {
         ret = headphone_frame(s, in, outlink);
         if (ret < 0)
             return ret;
@@ -814,10 +691,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     HeadphoneContext *s = ctx->priv;
     int i;
 
-    av_fft_end(s->ifft[0]);
-    av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
+    av_convolution_free(&s->conv[0]);
+    av_convolution_free(&s->conv[1]);
     av_freep(&s->delay[0]);
     av_freep(&s->delay[1]);
     av_freep(&s->data_ir[0]);
@@ -826,12 +701,6 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->ringbuffer[1]);
     av_freep(&s->temp_src[0]);
     av_freep(&s->temp_src[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
-    av_freep(&s->temp_afft[0]);
-    av_freep(&s->temp_afft[1]);
-    av_freep(&s->data_hrtf[0]);
-    av_freep(&s->data_hrtf[1]);
     av_freep(&s->fdsp);
 
     for (i = 0; i < s->nb_inputs; i++) {
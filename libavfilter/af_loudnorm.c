@@ -20,11 +20,11 @@
 
 /* http://k.ylo.ph/2016/04/04/loudnorm.html */
 
+#include "libavutil/ebur128.h"
 #include "libavutil/opt.h"
 #include "avfilter.h"
 #include "internal.h"
 #include "audio.h"
-#include "ebur128.h"
 
 enum FrameType {
     FIRST_FRAME,
@@ -62,6 +62,8 @@ typedef struct LoudNormContext {
     int linear;
     int dual_mono;
     enum PrintFormat print_format;
+    int realtime;
+    double lookahead;
 
     double *buf;
     int buf_size;
@@ -91,8 +93,26 @@ typedef struct LoudNormContext {
     int prev_nb_samples;
     int channels;
 
-    FFEBUR128State *r128_in;
-    FFEBUR128State *r128_out;
+    AVEBUR128Context *r128_in;
+    AVEBUR128Context *r128_out;
+
+    /* realtime mode */
+    double gain;
+    double gain_next;
+    int step_size;
+    int step_pos;
+    int rt_steps;
+    double *rt_buf;
+    double *rt_gain;
+    double *rt_peaks;
+    int rt_nb_blocks;
+    int rt_block_size;
+    int rt_block_fill;
+    int64_t rt_blocks;
+    int64_t rt_pending;
+    double rt_env;
+    double rt_release;
+    AVEBUR128TruePeak *rt_tp;
 } LoudNormContext;
 
 #define OFFSET(x) offsetof(LoudNormContext, x)
@@ -119,6 +139,8 @@ static const AVOption loudnorm_options[] = {
     {     "none",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  NONE},     0,         0,  FLAGS, "print_format" },
     {     "json",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  JSON},     0,         0,  FLAGS, "print_format" },
     {     "summary",      0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  SUMMARY},  0,         0,  FLAGS, "print_format" },
+    { "realtime",         "normalize with a short lookahead",  OFFSET(realtime),         AV_OPT_TYPE_BOOL,    {.i64 =  0},        0,         1,  FLAGS },
+    { "lookahead",        "set realtime lookahead in ms",      OFFSET(lookahead),        AV_OPT_TYPE_DOUBLE,  {.dbl =  200.},    10.,      1000.,  FLAGS },
     { NULL }
 };
 
@@ -406,6 +428,180 @@ static void true_peak_limiter(LoudNormContext *s, double *out, int nb_samples, i
     }
 }
 
+static void scale_samples(double *dst, const double *src, int nb_samples,
+                          int channels, double gain, double gain_inc)
+{
+    int n, c;
+
+    for (n = 0; n < nb_samples; n++) {
+        for (c = 0; c < channels; c++)
+            dst[c] = src[c] * gain;
+        gain += gain_inc;
+        src += channels;
+        dst += channels;
+    }
+}
+
+static void realtime_update_gain(LoudNormContext *s)
+{
+    double global, shortterm, relative_threshold, delta;
+    int n;
+
+    /* measure on the audio received so far until the short-term window is full */
+    s->rt_steps = FFMIN(s->rt_steps + 1, 30);
+    av_ebur128_loudness_window(s->r128_in, s->rt_steps * 100, &shortterm);
+    av_ebur128_loudness_global(s->r128_in, &global);
+    av_ebur128_relative_threshold(s->r128_in, &relative_threshold);
+
+    if (global == -HUGE_VAL || shortterm < relative_threshold || shortterm <= -70.) {
+        delta = s->prev_delta;
+    } else {
+        double env_global = av_clipd(shortterm - global, -s->target_lra / 2., s->target_lra / 2.);
+        delta = pow(10., (s->target_i - shortterm + env_global) / 20.);
+
+        if (!s->above_threshold) {
+            for (n = 0; n < 30; n++)
+                s->delta[n] = delta;
+            s->above_threshold = 1;
+        }
+    }
+
+    s->delta[s->index] = s->prev_delta = delta;
+    /* the gain follows the 21 last values, centered one second ago */
+    s->gain      = s->gain_next;
+    s->gain_next = gaussian_filter(s, s->index >= 10 ? s->index - 10 : s->index + 20) * s->offset;
+    s->index++;
+    if (s->index >= 30)
+        s->index -= 30;
+}
+
+/**
+ * Limit the block which leaves the lookahead once the block rt_blocks was
+ * filled. The limiter gain moves linearly so that it is below the gain
+ * required by every block of the lookahead when that block starts.
+ *
+ * @return 1 if a block was written to dst
+ */
+static int realtime_limit_block(LoudNormContext *s, double *dst, int channels)
+{
+    const int block_size = s->rt_block_size, nb_blocks = s->rt_nb_blocks;
+    const int64_t k = s->rt_blocks++;
+    const double ceiling = s->target_tp;
+    double *block = s->rt_buf + (k % (nb_blocks + 1)) * block_size * channels;
+    double *tp = av_ebur128_true_peak_get_buffer(s->rt_tp, block_size);
+    double peak = 0., env, env_next;
+    int64_t j;
+    int c, d, n;
+
+    memcpy(tp, block, block_size * channels * sizeof(*tp));
+    memset(s->rt_peaks, 0, channels * sizeof(*s->rt_peaks));
+    av_ebur128_true_peak_process(s->rt_tp, block_size, s->rt_peaks);
+    for (c = 0; c < channels; c++)
+        peak = FFMAX(peak, s->rt_peaks[c]);
+    s->rt_gain[k % (nb_blocks + 1)] = peak > ceiling ? ceiling / peak : 1.;
+
+    if (k < nb_blocks)
+        return 0;
+
+    j = k - nb_blocks;
+    env = s->rt_env;
+    env_next = env + (1. - env) * s->rt_release;
+    for (d = 0; d <= nb_blocks; d++) {
+        const double gain = s->rt_gain[(j + d) % (nb_blocks + 1)];
+        env_next = FFMIN(env_next, d ? env + (gain - env) / d : gain);
+    }
+    if (!j)
+        env = env_next;
+
+    block = s->rt_buf + (j % (nb_blocks + 1)) * block_size * channels;
+    scale_samples(dst, block, block_size, channels, env, (env_next - env) / block_size);
+    for (n = 0; n < block_size * channels; n++)
+        dst[n] = av_clipd(dst[n], -ceiling, ceiling);
+    s->rt_env = env_next;
+
+    return 1;
+}
+
+static int realtime_filter_frame(AVFilterLink *inlink, AVFrame *in, int flush)
+{
+    AVFilterContext *ctx = inlink->dst;
+    LoudNormContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    const int channels = inlink->channels;
+    const int block_size = s->rt_block_size;
+    const double *src = (const double *)in->data[0];
+    int nb_samples = in->nb_samples, nb_blocks, nb_out;
+    AVFrame *out;
+    double *dst;
+
+    /* blocks completed by this frame which leave the lookahead */
+    nb_blocks = (s->rt_block_fill + nb_samples) / block_size;
+    nb_blocks -= av_clip64(s->rt_nb_blocks - s->rt_blocks, 0, nb_blocks);
+    nb_out = nb_blocks * block_size;
+    if (flush)
+        nb_out = FFMIN(nb_out, s->rt_pending);
+    else
+        s->rt_pending += nb_samples;
+
+    if (s->pts == AV_NOPTS_VALUE)
+        s->pts = in->pts;
+
+    out = NULL;
+    dst = NULL;
+    if (nb_blocks > 0) {
+        out = ff_get_audio_buffer(outlink, nb_blocks * block_size);
+        if (!out) {
+            av_frame_free(&in);
+            return AVERROR(ENOMEM);
+        }
+        av_frame_copy_props(out, in);
+        out->pts = s->pts;
+        out->nb_samples = FFMAX(nb_out, 0);
+        dst = (double *)out->data[0];
+    }
+
+    while (nb_samples > 0) {
+        const int len = FFMIN3(nb_samples, block_size - s->rt_block_fill,
+                               s->step_size - s->step_pos);
+        const double gain_inc = (s->gain_next - s->gain) / s->step_size;
+        double *buf = s->rt_buf + ((s->rt_blocks % (s->rt_nb_blocks + 1)) * block_size +
+                                   s->rt_block_fill) * channels;
+
+        if (!flush)
+            av_ebur128_add_frames_double(s->r128_in, src, len);
+        scale_samples(buf, src, len, channels, s->gain + s->step_pos * gain_inc, gain_inc);
+
+        src              += len * channels;
+        nb_samples       -= len;
+        s->rt_block_fill += len;
+        s->step_pos      += len;
+
+        if (s->step_pos == s->step_size) {
+            s->step_pos = 0;
+            if (!flush)
+                realtime_update_gain(s);
+        }
+        if (s->rt_block_fill == block_size) {
+            s->rt_block_fill = 0;
+            if (realtime_limit_block(s, dst, channels))
+                dst += block_size * channels;
+        }
+    }
+    av_frame_free(&in);
+
+    if (!out)
+        return 0;
+    if (!out->nb_samples) {
+        av_frame_free(&out);
+        return 0;
+    }
+
+    av_ebur128_add_frames_double(s->r128_out, (const double *)out->data[0], out->nb_samples);
+    s->rt_pending -= out->nb_samples;
+    s->pts        += out->nb_samples;
+    return ff_filter_frame(outlink, out);
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -420,6 +616,9 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     double gain, gain_next, env_global, env_shortterm,
     global, shortterm, lra, relative_threshold;
 
+    if (s->realtime && s->frame_type != LINEAR_MODE)
+        return realtime_filter_frame(inlink, in, 0);
+
     if (av_frame_is_writable(in)) {
         out = in;
     } else {
@@ -440,15 +639,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     buf = s->buf;
     limiter_buf = s->limiter_buf;
 
-    ff_ebur128_add_frames_double(s->r128_in, src, in->nb_samples);
+    av_ebur128_add_frames_double(s->r128_in, src, in->nb_samples);
 
     if (s->frame_type == FIRST_FRAME && in->nb_samples < frame_size(inlink->sample_rate, 3000)) {
         double offset, offset_tp, true_peak;
 
-        ff_ebur128_loudness_global(s->r128_in, &global);
+        av_ebur128_loudness_global(s->r128_in, &global);
         for (c = 0; c < inlink->channels; c++) {
             double tmp;
-            ff_ebur128_sample_peak(s->r128_in, c, &tmp);
+            av_ebur128_sample_peak(s->r128_in, c, &tmp);
             if (c == 0 || tmp > true_peak)
                 true_peak = tmp;
         }
@@ -470,7 +669,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             s->buf_index += inlink->channels;
         }
 
-        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        av_ebur128_loudness_shortterm(s->r128_in, &shortterm);
 
         if (shortterm < s->measured_thresh) {
             s->above_threshold = 0;
@@ -500,7 +699,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
         subframe_length = frame_size(inlink->sample_rate, 100);
         true_peak_limiter(s, dst, subframe_length, inlink->channels);
-        ff_ebur128_add_frames_double(s->r128_out, dst, subframe_length);
+        av_ebur128_add_frames_double(s->r128_out, dst, subframe_length);
 
         s->pts +=
         out->nb_samples =
@@ -539,12 +738,12 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         s->limiter_buf_index = s->limiter_buf_index + subframe_length < s->limiter_buf_size ? s->limiter_buf_index + subframe_length : s->limiter_buf_index + subframe_length - s->limiter_buf_size;
 
         true_peak_limiter(s, dst, in->nb_samples, inlink->channels);
-        ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        av_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
 
-        ff_ebur128_loudness_range(s->r128_in, &lra);
-        ff_ebur128_loudness_global(s->r128_in, &global);
-        ff_ebur128_loudness_shortterm(s->r128_in, &shortterm);
-        ff_ebur128_relative_threshold(s->r128_in, &relative_threshold);
+        av_ebur128_loudness_range(s->r128_in, &lra);
+        av_ebur128_loudness_global(s->r128_in, &global);
+        av_ebur128_loudness_shortterm(s->r128_in, &shortterm);
+        av_ebur128_relative_threshold(s->r128_in, &relative_threshold);
 
         if (s->above_threshold == 0) {
             double shortterm_out;
@@ -552,7 +751,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             if (shortterm > s->measured_thresh)
                 s->prev_delta *= 1.0058;
 
-            ff_ebur128_loudness_shortterm(s->r128_out, &shortterm_out);
+            av_ebur128_loudness_shortterm(s->r128_out, &shortterm_out);
             if (shortterm_out >= s->target_i)
                 s->above_threshold = 1;
         }
@@ -614,7 +813,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         }
 
         dst = (double *)out->data[0];
-        ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        av_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
         break;
 
     case LINEAR_MODE:
@@ -627,7 +826,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         }
 
         dst = (double *)out->data[0];
-        ff_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
+        av_ebur128_add_frames_double(s->r128_out, dst, in->nb_samples);
         s->pts += in->nb_samples;
         break;
     }
@@ -646,7 +845,22 @@ static int request_frame(AVFilterLink *outlink)
     LoudNormContext *s = ctx->priv;
 
     ret = ff_request_frame(inlink);
-    if (ret == AVERROR_EOF && s->frame_type == INNER_FRAME) {
+    if (ret == AVERROR_EOF && s->realtime && s->frame_type == FIRST_FRAME) {
+        AVFrame *frame;
+
+        if (s->rt_pending <= 0)
+            return ret;
+
+        /* push the lookahead out with silence */
+        frame = ff_get_audio_buffer(outlink, (s->rt_nb_blocks + 1) * s->rt_block_size);
+        if (!frame)
+            return AVERROR(ENOMEM);
+        av_samples_set_silence(frame->extended_data, 0, frame->nb_samples,
+                               frame->channels, frame->format);
+        frame->pts = s->pts;
+        s->frame_type = FINAL_FRAME;
+        ret = realtime_filter_frame(inlink, frame, 1);
+    } else if (ret == AVERROR_EOF && s->frame_type == INNER_FRAME) {
         double *src;
         double *buf;
         int nb_samples, n, c, offset;
@@ -711,7 +925,7 @@ static int query_formats(AVFilterContext *ctx)
     if (ret < 0)
         return ret;
 
-    if (s->frame_type != LINEAR_MODE) {
+    if (s->frame_type != LINEAR_MODE && !s->realtime) {
         formats = ff_make_format_list(input_srate);
         if (!formats)
             return AVERROR(ENOMEM);
@@ -726,44 +940,85 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
+static int config_realtime(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    LoudNormContext *s = ctx->priv;
+    const int channels = inlink->channels;
+    double delta = 1.;
+    int n;
+
+    s->rt_block_size = frame_size(inlink->sample_rate, 1);
+    s->rt_nb_blocks  = FFMAX(lrint(s->lookahead * inlink->sample_rate / (1000. * s->rt_block_size)), 1);
+    s->rt_release    = 1. - exp(-s->rt_block_size / (0.1 * inlink->sample_rate));
+    s->step_size     = (inlink->sample_rate + 5) / 10;
+
+    s->rt_buf = av_malloc_array((s->rt_nb_blocks + 1) * s->rt_block_size,
+                                channels * sizeof(*s->rt_buf));
+    s->rt_gain  = av_malloc_array(s->rt_nb_blocks + 1, sizeof(*s->rt_gain));
+    s->rt_peaks = av_malloc_array(channels, sizeof(*s->rt_peaks));
+    if (!s->rt_buf || !s->rt_gain || !s->rt_peaks)
+        return AVERROR(ENOMEM);
+
+    s->rt_tp = av_ebur128_true_peak_alloc(channels);
+    if (!s->rt_tp || !av_ebur128_true_peak_get_buffer(s->rt_tp, s->rt_block_size))
+        return AVERROR(ENOMEM);
+
+    /* start from the measured loudness if it is known */
+    if (s->measured_i != 0.)
+        delta = pow(10., (s->target_i - s->measured_i) / 20.);
+    for (n = 0; n < 30; n++)
+        s->delta[n] = delta;
+    s->prev_delta = delta;
+    s->rt_env = 1.;
+
+    return 0;
+}
+
 static int config_input(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
     LoudNormContext *s = ctx->priv;
 
-    s->r128_in = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | FF_EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_in = av_ebur128_alloc(inlink->channels, inlink->sample_rate, 0, AV_EBUR128_MODE_I | AV_EBUR128_MODE_S | AV_EBUR128_MODE_LRA | AV_EBUR128_MODE_SAMPLE_PEAK);
     if (!s->r128_in)
         return AVERROR(ENOMEM);
 
-    s->r128_out = ff_ebur128_init(inlink->channels, inlink->sample_rate, 0, FF_EBUR128_MODE_I | FF_EBUR128_MODE_S | FF_EBUR128_MODE_LRA | FF_EBUR128_MODE_SAMPLE_PEAK);
+    s->r128_out = av_ebur128_alloc(inlink->channels, inlink->sample_rate, 0, AV_EBUR128_MODE_I | AV_EBUR128_MODE_S | AV_EBUR128_MODE_LRA | AV_EBUR128_MODE_SAMPLE_PEAK);
     if (!s->r128_out)
         return AVERROR(ENOMEM);
 
     if (inlink->channels == 1 && s->dual_mono) {
-        ff_ebur128_set_channel(s->r128_in,  0, FF_EBUR128_DUAL_MONO);
-        ff_ebur128_set_channel(s->r128_out, 0, FF_EBUR128_DUAL_MONO);
+        av_ebur128_set_channel(s->r128_in,  0, AV_EBUR128_DUAL_MONO);
+        av_ebur128_set_channel(s->r128_out, 0, AV_EBUR128_DUAL_MONO);
     }
 
-    s->buf_size = frame_size(inlink->sample_rate, 3000) * inlink->channels;
-    s->buf = av_malloc_array(s->buf_size, sizeof(*s->buf));
-    if (!s->buf)
-        return AVERROR(ENOMEM);
+    init_gaussian_filter(s);
 
-    s->limiter_buf_size = frame_size(inlink->sample_rate, 210) * inlink->channels;
-    s->limiter_buf = av_malloc_array(s->buf_size, sizeof(*s->limiter_buf));
-    if (!s->limiter_buf)
-        return AVERROR(ENOMEM);
+    if (s->frame_type != LINEAR_MODE && s->realtime) {
+        int ret = config_realtime(inlink);
+        if (ret < 0)
+            return ret;
+    } else {
+        s->buf_size = frame_size(inlink->sample_rate, 3000) * inlink->channels;
+        s->buf = av_malloc_array(s->buf_size, sizeof(*s->buf));
+        if (!s->buf)
+            return AVERROR(ENOMEM);
 
-    s->prev_smp = av_malloc_array(inlink->channels, sizeof(*s->prev_smp));
-    if (!s->prev_smp)
-        return AVERROR(ENOMEM);
+        s->limiter_buf_size = frame_size(inlink->sample_rate, 210) * inlink->channels;
+        s->limiter_buf = av_malloc_array(s->buf_size, sizeof(*s->limiter_buf));
+        if (!s->limiter_buf)
+            return AVERROR(ENOMEM);
 
-    init_gaussian_filter(s);
+        s->prev_smp = av_malloc_array(inlink->channels, sizeof(*s->prev_smp));
+        if (!s->prev_smp)
+            return AVERROR(ENOMEM);
 
-    if (s->frame_type != LINEAR_MODE) {
-        inlink->min_samples =
-        inlink->max_samples =
-        inlink->partial_buf_size = frame_size(inlink->sample_rate, 3000);
+        if (s->frame_type != LINEAR_MODE) {
+            inlink->min_samples =
+            inlink->max_samples =
+            inlink->partial_buf_size = frame_size(inlink->sample_rate, 3000);
+        }
     }
 
     s->pts = AV_NOPTS_VALUE;
@@ -777,6 +1032,8 @@ static int config_input(AVFilterLink *inlink)
     s->target_tp = pow(10., s->target_tp / 20.);
     s->attack_length = frame_size(inlink->sample_rate, 10);
     s->release_length = frame_size(inlink->sample_rate, 100);
+    s->gain =
+    s->gain_next = s->prev_delta * s->offset;
 
     return 0;
 }
@@ -811,22 +1068,22 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (!s->r128_in || !s->r128_out)
         goto end;
 
-    ff_ebur128_loudness_range(s->r128_in, &lra_in);
-    ff_ebur128_loudness_global(s->r128_in, &i_in);
-    ff_ebur128_relative_threshold(s->r128_in, &thresh_in);
+    av_ebur128_loudness_range(s->r128_in, &lra_in);
+    av_ebur128_loudness_global(s->r128_in, &i_in);
+    av_ebur128_relative_threshold(s->r128_in, &thresh_in);
     for (c = 0; c < s->channels; c++) {
         double tmp;
-        ff_ebur128_sample_peak(s->r128_in, c, &tmp);
+        av_ebur128_sample_peak(s->r128_in, c, &tmp);
         if ((c == 0) || (tmp > tp_in))
             tp_in = tmp;
     }
 
-    ff_ebur128_loudness_range(s->r128_out, &lra_out);
-    ff_ebur128_loudness_global(s->r128_out, &i_out);
-    ff_ebur128_relative_threshold(s->r128_out, &thresh_out);
+    av_ebur128_loudness_range(s->r128_out, &lra_out);
+    av_ebur128_loudness_global(s->r128_out, &i_out);
+    av_ebur128_relative_threshold(s->r128_out, &thresh_out);
     for (c = 0; c < s->channels; c++) {
         double tmp;
-        ff_ebur128_sample_peak(s->r128_out, c, &tmp);
+        av_ebur128_sample_peak(s->r128_out, c, &tmp);
         if ((c == 0) || (tmp > tp_out))
             tp_out = tmp;
     }
@@ -892,13 +1149,15 @@ static av_cold void uninit(AVFilterContext *ctx)
     }
 
 end:
-    if (s->r128_in)
-        ff_ebur128_destroy(&s->r128_in);
-    if (s->r128_out)
-        ff_ebur128_destroy(&s->r128_out);
+    av_ebur128_free(&s->r128_in);
+    av_ebur128_free(&s->r128_out);
     av_freep(&s->limiter_buf);
     av_freep(&s->prev_smp);
     av_freep(&s->buf);
+    av_freep(&s->rt_buf);
+    av_freep(&s->rt_gain);
+    av_freep(&s->rt_peaks);
+    av_ebur128_true_peak_free(&s->rt_tp);
 }
 
 static const AVFilterPad avfilter_af_loudnorm_inputs[] = {
@@ -28,9 +28,9 @@
 #include <math.h>
 #include <mysofa.h>
 
-#include "libavcodec/avfft.h"
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/convolution.h"
 #include "libavutil/float_dsp.h"
 #include "libavutil/intmath.h"
 #include "libavutil/opt.h"
@@ -81,8 +81,6 @@ typedef struct SOFAlizerContext {
     int write[2];               /* current write position to ringbuffer */
     int buffer_length;          /* is: longest IR plus max. delay in all SOFA files */
                                 /* then choose next power of 2 */
-    int n_fft;                  /* number of samples in one FFT block */
-    int nb_samples;
 
                                 /* netCDF variables */
     int *delay[2];              /* broadband delay for each channel/IR to be convolved */
@@ -90,8 +88,6 @@ typedef struct SOFAlizerContext {
     float *data_ir[2];          /* IRs for all channels to be convolved */
                                 /* (this excludes the LFE) */
     float *temp_src[2];
-    FFTComplex *temp_fft[2];    /* Array to hold FFT values */
-    FFTComplex *temp_afft[2];   /* Array to accumulate FFT values prior to IFFT */
 
                          /* control variables */
     float gain;          /* filter gain (in dB) */
@@ -108,8 +104,8 @@ typedef struct SOFAlizerContext {
 
     VirtualSpeaker vspkrpos[64];
 
-    FFTContext *fft[2], *ifft[2];
-    FFTComplex *data_hrtf[2];
+    AVConvolutionContext *conv[2]; /* partitioned convolution, per ear or for both */
+    int nb_conv;
 
     AVFloatDSPContext *fdsp;
 } SOFAlizerContext;
@@ -324,8 +320,6 @@ typedef struct ThreadData {
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
-    FFTComplex **temp_afft;
 } ThreadData;
 
 static int sofalizer_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -433,136 +427,45 @@ static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr,
     SOFAlizerContext *s = ctx->priv;
     ThreadData *td = arg;
     AVFrame *in = td->in, *out = td->out;
-    int offset = jobnr;
-    int *write = &td->write[jobnr];
-    FFTComplex *hrtf = s->data_hrtf[jobnr]; /* get pointers to current HRTF data */
     int *n_clippings = &td->n_clippings[jobnr];
-    float *ringbuffer = td->ringbuffer[jobnr];
-    const int ir_samples = s->sofa.ir_samples; /* length of one IR */
     const int planar = in->format == AV_SAMPLE_FMT_FLTP;
     const int mult = 1 + !planar;
-    float *dst = (float *)out->extended_data[jobnr * planar]; /* get pointer to audio output buffer */
     const int in_channels = s->n_conv; /* number of input channels */
-    /* ring buffer length is: longest IR plus max. delay -> next power of 2 */
-    const int buffer_length = s->buffer_length;
-    /* -1 for AND instead of MODULO (applied to powers of 2): */
-    const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr]; /* temporary array for FFT input/output data */
-    FFTComplex *fft_acc = s->temp_afft[jobnr];
-    FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
-    const int n_conv = s->n_conv;
-    const int n_fft = s->n_fft;
-    const float fft_scale = 1.0f / s->n_fft;
-    FFTComplex *hrtf_offset;
-    int wr = *write;
-    int n_read;
+    /* one output per engine when threading, both ears otherwise */
+    const int nb_outputs = nb_jobs > 1 ? 1 : 2;
+    const float *src[64];
+    float *dst[2];
     int i, j;
 
-    if (!planar)
-        dst += offset;
-
-    /* find minimum between number of samples and output buffer length:
-     * (important, if one IR is longer than the output buffer) */
-    n_read = FFMIN(ir_samples, in->nb_samples);
-    for (j = 0; j < n_read; j++) {
-        /* initialize output buf with saved signal from overflow buf */
-        dst[mult * j]  = ringbuffer[wr];
-        ringbuffer[wr] = 0.0f; /* re-set read samples to zero */
-        /* update ringbuffer read/write position */
-        wr  = (wr + 1) & modulo;
-    }
-
-    /* initialize rest of output buffer with 0 */
-    for (j = n_read; j < in->nb_samples; j++) {
-        dst[mult * j] = 0;
-    }
+    for (i = 0; i < in_channels; i++)
+        src[i] = planar ? (const float *)in->extended_data[i] : (const float *)in->data[0] + i;
+    for (j = 0; j < nb_outputs; j++)
+        dst[j] = planar ? (float *)out->extended_data[jobnr + j] : (float *)out->data[0] + jobnr + j;
 
-    /* fill FFT accumulation with 0 */
-    memset(fft_acc, 0, sizeof(FFTComplex) * n_fft);
+    /* convolve all input channels but the LFE, without latency */
+    av_convolution_process(s->conv[jobnr], dst, mult, src, planar ? 1 : in_channels,
+                           in->nb_samples);
 
-    for (i = 0; i < n_conv; i++) {
-        const float *src = (const float *)in->extended_data[i * planar]; /* get pointer to audio input buffer */
+    for (j = 0; j < nb_outputs; j++) {
+        if (s->lfe_channel >= 0 && s->lfe_channel < in_channels) {
+            const float *lfe = src[s->lfe_channel];
+            const int stride = planar ? 1 : in_channels;
 
-        if (i == s->lfe_channel) { /* LFE */
-            if (in->format == AV_SAMPLE_FMT_FLT) {
-                for (j = 0; j < in->nb_samples; j++) {
-                    /* apply gain to LFE signal and add to output buffer */
-                    dst[2 * j] += src[i + j * in_channels] * s->gain_lfe;
-                }
-            } else {
-                for (j = 0; j < in->nb_samples; j++) {
-                    /* apply gain to LFE signal and add to output buffer */
-                    dst[j] += src[j] * s->gain_lfe;
-                }
+            for (i = 0; i < in->nb_samples; i++) {
+                /* apply gain to LFE signal and add to output buffer */
+                dst[j][mult * i] += lfe[i * stride] * s->gain_lfe;
             }
-            continue;
         }
 
-        /* outer loop: go through all input channels to be convolved */
-        offset = i * n_fft; /* no. samples already processed */
-        hrtf_offset = hrtf + offset;
-
-        /* fill FFT input with 0 (we want to zero-pad) */
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
-
-        if (in->format == AV_SAMPLE_FMT_FLT) {
-            for (j = 0; j < in->nb_samples; j++) {
-                /* prepare input for FFT */
-                /* write all samples of current input channel to FFT input array */
-                fft_in[j].re = src[j * in_channels + i];
-            }
-        } else {
-            for (j = 0; j < in->nb_samples; j++) {
-                /* prepare input for FFT */
-                /* write all samples of current input channel to FFT input array */
-                fft_in[j].re = src[j];
+        /* go through all samples of current output buffer: count clippings */
+        for (i = 0; i < out->nb_samples; i++) {
+            /* clippings counter */
+            if (fabsf(dst[j][i * mult]) > 1) { /* if current output sample > 1 */
+                n_clippings[0]++;
             }
         }
-
-        /* transform input signal of current channel to frequency domain */
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
-        for (j = 0; j < n_fft; j++) {
-            const FFTComplex *hcomplex = hrtf_offset + j;
-            const float re = fft_in[j].re;
-            const float im = fft_in[j].im;
-
-            /* complex multiplication of input signal and HRTFs */
-            /* output channel (real): */
-            fft_acc[j].re += re * hcomplex->re - im * hcomplex->im;
-            /* output channel (imag): */
-            fft_acc[j].im += re * hcomplex->im + im * hcomplex->re;
-        }
-    }
-
-    /* transform output signal of current channel back to time domain */
-    av_fft_permute(ifft, fft_acc);
-    av_fft_calc(ifft, fft_acc);
-
-    for (j = 0; j < in->nb_samples; j++) {
-        /* write output signal of current channel to output buffer */
-        dst[mult * j] += fft_acc[j].re * fft_scale;
-    }
-
-    for (j = 0; j < ir_samples - 1; j++) { /* overflow length is IR length - 1 */
-        /* write the rest of output signal to overflow buffer */
-        int write_pos = (wr + j) & modulo;
-
-        *(ringbuffer + write_pos) += fft_acc[in->nb_samples + j].re * fft_scale;
-    }
-
-    /* go through all samples of current output buffer: count clippings */
-    for (i = 0; i < out->nb_samples; i++) {
-        /* clippings counter */
-        if (fabsf(dst[i * mult]) > 1) { /* if current output sample > 1 */
-            n_clippings[0]++;
-        }
     }
 
-    /* remember read/write position in ringbuffer for next call */
-    *write = wr;
-
     return 0;
 }
 
@@ -585,13 +488,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
-    td.temp_afft = s->temp_afft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, sofalizer_convolute, &td, NULL, 2);
     } else if (s->type == FREQUENCY_DOMAIN) {
-        ctx->internal->execute(ctx, sofalizer_fast_convolute, &td, NULL, 2);
+        ctx->internal->execute(ctx, sofalizer_fast_convolute, &td, NULL, s->nb_conv);
     }
     emms_c();
 
@@ -609,16 +510,12 @@ static int activate(AVFilterContext *ctx)
 {
     AVFilterLink *inlink = ctx->inputs[0];
     AVFilterLink *outlink = ctx->outputs[0];
-    SOFAlizerContext *s = ctx->priv;
     AVFrame *in;
     int ret;
 
     FF_FILTER_FORWARD_STATUS_BACK(outlink, inlink);
 
-    if (s->nb_samples)
-        ret = ff_inlink_consume_samples(inlink, s->nb_samples, s->nb_samples, &in);
-    else
-        ret = ff_inlink_consume_frame(inlink, &in);
+    ret = ff_inlink_consume_frame(inlink, &in);
     if (ret < 0)
         return ret;
     if (ret > 0)
@@ -722,15 +619,11 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
     int n_samples;
     int ir_samples;
     int n_conv = s->n_conv; /* no. channels to convolve */
-    int n_fft;
     float delay_l; /* broadband delay for each IR */
     float delay_r;
     int nb_input_channels = ctx->inputs[0]->channels; /* no. input channels */
     float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10); /* gain - 3dB/channel */
-    FFTComplex *data_hrtf_l = NULL;
-    FFTComplex *data_hrtf_r = NULL;
-    FFTComplex *fft_in_l = NULL;
-    FFTComplex *fft_in_r = NULL;
+    float *fir = NULL;
     float *data_ir_l = NULL;
     float *data_ir_r = NULL;
     int offset = 0; /* used for faster pointer arithmetics in for-loop */
@@ -830,59 +723,29 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
     /* buffer length is longest IR plus max. delay -> next power of 2
        (32 - count leading zeros gives required exponent)  */
     s->buffer_length = 1 << (32 - ff_clz(n_max));
-    s->n_fft = n_fft = 1 << (32 - ff_clz(n_max + s->framesize));
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(av_log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(av_log2(s->n_fft), 0);
-        av_fft_end(s->ifft[0]);
-        av_fft_end(s->ifft[1]);
-        s->ifft[0] = av_fft_init(av_log2(s->n_fft), 1);
-        s->ifft[1] = av_fft_init(av_log2(s->n_fft), 1);
-
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
-            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
 
     if (s->type == TIME_DOMAIN) {
         s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
         s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
-    } else if (s->type == FREQUENCY_DOMAIN) {
-        /* get temporary HRTF memory for L and R channel */
-        data_hrtf_l = av_malloc_array(n_fft, sizeof(*data_hrtf_l) * n_conv);
-        data_hrtf_r = av_malloc_array(n_fft, sizeof(*data_hrtf_r) * n_conv);
-        if (!data_hrtf_r || !data_hrtf_l) {
+        if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
-
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_afft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1] ||
-            !s->temp_afft[0] || !s->temp_afft[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+    } else if (s->type == FREQUENCY_DOMAIN) {
+        /* one engine per ear when threading, else a single one which
+         * transforms each input once for both ears; there is no latency
+         * whatever the partition sizes, the frame size bounds the largest */
+        s->nb_conv = ff_filter_get_nb_threads(ctx) > 1 ? 2 : 1;
+        for (i = 0; i < s->nb_conv; i++) {
+            s->conv[i] = av_convolution_alloc(n_conv, 3 - s->nb_conv, 64, s->framesize, 0);
+            if (!s->conv[i]) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
         }
-    }
-
-    if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
 
-    if (s->type == FREQUENCY_DOMAIN) {
-        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
-        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
-        if (!fft_in_l || !fft_in_r) {
+        fir = av_calloc(n_max, sizeof(*fir));
+        if (!fir) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
@@ -903,53 +766,42 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
                 s->data_ir[0][offset + j] = lir[ir_samples - 1 - j] * gain_lin;
                 s->data_ir[1][offset + j] = rir[ir_samples - 1 - j] * gain_lin;
             }
-        } else if (s->type == FREQUENCY_DOMAIN) {
-            memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
-            memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
+        } else if (s->type == FREQUENCY_DOMAIN && i != s->lfe_channel) {
+            int ear;
+
+            for (ear = 0; ear < 2; ear++) {
+                AVConvolutionContext *conv = s->conv[s->nb_conv > 1 ? ear : 0];
+                const float *ir = ear ? rir : lir;
+                const int delay = s->delay[ear][i];
 
-            offset = i * n_fft; /* no. samples already written */
-            for (j = 0; j < ir_samples; j++) {
                 /* load non-reversed IRs of the specified source position
                  * sample-by-sample and apply gain,
-                 * L channel is loaded to real part, R channel to imag part,
                  * IRs are shifted by L and R delay */
-                fft_in_l[s->delay[0][i] + j].re = lir[j] * gain_lin;
-                fft_in_r[s->delay[1][i] + j].re = rir[j] * gain_lin;
+                memset(fir, 0, delay * sizeof(*fir));
+                for (j = 0; j < ir_samples; j++)
+                    fir[delay + j] = ir[j] * gain_lin;
+
+                ret = av_convolution_add_ir(conv, fir, delay + ir_samples);
+                if (ret >= 0)
+                    ret = av_convolution_add_route(conv, i, s->nb_conv > 1 ? 0 : ear, ret);
+                if (ret < 0)
+                    goto fail;
             }
-
-            /* actually transform to frequency domain (IRs -> HRTFs) */
-            av_fft_permute(s->fft[0], fft_in_l);
-            av_fft_calc(s->fft[0], fft_in_l);
-            memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-            av_fft_permute(s->fft[0], fft_in_r);
-            av_fft_calc(s->fft[0], fft_in_r);
-            memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
         }
     }
 
     if (s->type == FREQUENCY_DOMAIN) {
-        s->data_hrtf[0] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        s->data_hrtf[1] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        if (!s->data_hrtf[0] || !s->data_hrtf[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
+        for (i = 0; i < s->nb_conv; i++) {
+            if ((ret = av_convolution_init(s->conv[i])) < 0)
+                goto fail;
         }
-
-        memcpy(s->data_hrtf[0], data_hrtf_l, /* copy HRTF data to */
-            sizeof(FFTComplex) * n_conv * n_fft); /* filter struct */
-        memcpy(s->data_hrtf[1], data_hrtf_r,
-            sizeof(FFTComplex) * n_conv * n_fft);
     }
 
 fail:
-    av_freep(&data_hrtf_l); /* free temporary HRTF memory */
-    av_freep(&data_hrtf_r);
-
     av_freep(&data_ir_l); /* free temprary IR memory */
     av_freep(&data_ir_r);
 
-    av_freep(&fft_in_l); /* free temporary FFT memory */
-    av_freep(&fft_in_r);
+    av_freep(&fir); /* free temporary convolution input */
 
     return ret;
 }
@@ -991,9 +843,6 @@ static int config_input(AVFilterLink *inlink)
     SOFAlizerContext *s = ctx->priv;
     int ret;
 
-    if (s->type == FREQUENCY_DOMAIN)
-        s->nb_samples = s->framesize;
-
     /* gain -3 dB per channel */
     s->gain_lfe = expf((s->gain - 3 * inlink->channels + s->lfe_gain) / 20 * M_LN10);
 
@@ -1014,14 +863,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     SOFAlizerContext *s = ctx->priv;
 
     close_sofa(&s->sofa);
-    av_fft_end(s->ifft[0]);
-    av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
-    s->ifft[0] = NULL;
-    s->ifft[1] = NULL;
-    s->fft[0] = NULL;
-    s->fft[1] = NULL;
+    av_convolution_free(&s->conv[0]);
+    av_convolution_free(&s->conv[1]);
     av_freep(&s->delay[0]);
     av_freep(&s->delay[1]);
     av_freep(&s->data_ir[0]);
@@ -1032,12 +875,6 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->speaker_elev);
     av_freep(&s->temp_src[0]);
     av_freep(&s->temp_src[1]);
-    av_freep(&s->temp_afft[0]);
-    av_freep(&s->temp_afft[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
-    av_freep(&s->data_hrtf[0]);
-    av_freep(&s->data_hrtf[1]);
     av_freep(&s->fdsp);
 }
 
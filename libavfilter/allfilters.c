@@ -144,6 +144,7 @@ extern AVFilter ff_asrc_sine;
 extern AVFilter ff_asink_anullsink;
 
 extern AVFilter ff_vf_addroi;
+extern AVFilter ff_vf_adm;
 extern AVFilter ff_vf_alphaextract;
 extern AVFilter ff_vf_alphamerge;
 extern AVFilter ff_vf_amplify;
@@ -213,6 +214,7 @@ extern AVFilter ff_vf_drawgrid;
 extern AVFilter ff_vf_drawtext;
 extern AVFilter ff_vf_edgedetect;
 extern AVFilter ff_vf_elbg;
+extern AVFilter ff_vf_encanalysis;
 extern AVFilter ff_vf_entropy;
 extern AVFilter ff_vf_eq;
 extern AVFilter ff_vf_erosion;
@@ -399,6 +401,7 @@ extern AVFilter ff_vf_vfrdet;
 extern AVFilter ff_vf_vibrance;
 extern AVFilter ff_vf_vidstabdetect;
 extern AVFilter ff_vf_vidstabtransform;
+extern AVFilter ff_vf_vif;
 extern AVFilter ff_vf_vignette;
 extern AVFilter ff_vf_vmafmotion;
 extern AVFilter ff_vf_vpp_qsv;
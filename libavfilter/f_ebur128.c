@@ -33,11 +33,11 @@
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/dict.h"
+#include "libavutil/ebur128.h"
 #include "libavutil/ffmath.h"
 #include "libavutil/xga_font_data.h"
 #include "libavutil/opt.h"
 #include "libavutil/timestamp.h"
-#include "libswresample/swresample.h"
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
@@ -98,11 +98,7 @@ typedef struct EBUR128Context {
     double *true_peaks;             ///< true peaks per channel
     double *sample_peaks;           ///< sample peaks per channel
     double *true_peaks_per_frame;   ///< true peaks in a frame per channel
-#if CONFIG_SWRESAMPLE
-    SwrContext *swr_ctx;            ///< over-sampling context for true peak metering
-    double *swr_buf;                ///< resampled audio data for true peak metering
-    int swr_linesize;
-#endif
+    AVEBUR128TruePeak *tp;          ///< 4x over-sampling for true peak metering
 
     /* video  */
     int do_video;                   ///< 1 if video output enabled, 0 otherwise
@@ -128,6 +124,8 @@ typedef struct EBUR128Context {
     double x[MAX_CHANNELS * 3];     ///< 3 input samples cache for each channel
     double y[MAX_CHANNELS * 3];     ///< 3 pre-filter samples cache for each channel
     double z[MAX_CHANNELS * 3];     ///< 3 RLB-filter samples cache for each channel
+    double *bins;                   ///< K-weighted squared samples of the current frame
+    int nb_bins;                    ///< number of samples allocated in bins
 
 #define I400_BINS  (48000 * 4 / 10)
 #define I3000_BINS (48000 * 3)
@@ -390,10 +388,8 @@ static int config_audio_input(AVFilterLink *inlink)
 
     /* Force 100ms framing in case of metadata injection: the frames must have
      * a granularity of the window overlap to be accurately exploited.
-     * As for the true peaks mode, it just simplifies the resampling buffer
-     * allocation and the lookup in it (since sample buffers differ in size, it
-     * can be more complex to integrate in the one-sample loop of
-     * filter_frame()). */
+     * As for the true peaks mode, it keeps the per frame true peaks (FTPK)
+     * measured over 100ms. */
     if (ebur128->metadata || (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS))
         inlink->min_samples =
         inlink->max_samples =
@@ -439,31 +435,16 @@ static int config_audio_output(AVFilterLink *outlink)
             return AVERROR(ENOMEM);
     }
 
-#if CONFIG_SWRESAMPLE
     if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
-        int ret;
-
-        ebur128->swr_buf    = av_malloc_array(nb_channels, 19200 * sizeof(double));
         ebur128->true_peaks = av_calloc(nb_channels, sizeof(*ebur128->true_peaks));
         ebur128->true_peaks_per_frame = av_calloc(nb_channels, sizeof(*ebur128->true_peaks_per_frame));
-        ebur128->swr_ctx    = swr_alloc();
-        if (!ebur128->swr_buf || !ebur128->true_peaks ||
-            !ebur128->true_peaks_per_frame || !ebur128->swr_ctx)
+        if (!ebur128->true_peaks || !ebur128->true_peaks_per_frame)
             return AVERROR(ENOMEM);
 
-        av_opt_set_int(ebur128->swr_ctx, "in_channel_layout",    outlink->channel_layout, 0);
-        av_opt_set_int(ebur128->swr_ctx, "in_sample_rate",       outlink->sample_rate, 0);
-        av_opt_set_sample_fmt(ebur128->swr_ctx, "in_sample_fmt", outlink->format, 0);
-
-        av_opt_set_int(ebur128->swr_ctx, "out_channel_layout",    outlink->channel_layout, 0);
-        av_opt_set_int(ebur128->swr_ctx, "out_sample_rate",       192000, 0);
-        av_opt_set_sample_fmt(ebur128->swr_ctx, "out_sample_fmt", outlink->format, 0);
-
-        ret = swr_init(ebur128->swr_ctx);
-        if (ret < 0)
-            return ret;
+        ebur128->tp = av_ebur128_true_peak_alloc(nb_channels);
+        if (!ebur128->tp)
+            return AVERROR(ENOMEM);
     }
-#endif
 
     if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
         ebur128->sample_peaks = av_calloc(nb_channels, sizeof(*ebur128->sample_peaks));
@@ -506,12 +487,6 @@ static av_cold int init(AVFilterContext *ctx)
             ebur128->loglevel = AV_LOG_INFO;
     }
 
-    if (!CONFIG_SWRESAMPLE && (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS)) {
-        av_log(ctx, AV_LOG_ERROR,
-               "True-peak mode requires libswresample to be performed\n");
-        return AVERROR(EINVAL);
-    }
-
     // if meter is  +9 scale, scale range is from -18 LU to  +9 LU (or 3*9)
     // if meter is +18 scale, scale range is from -36 LU to +18 LU (or 3*18)
     ebur128->scale_range = 3 * ebur128->meter;
@@ -585,6 +560,62 @@ static int gate_update(struct integrator *integ, double power,
     return gate_hist_pos;
 }
 
+#define K_WEIGHTING_LANES 4
+
+/**
+ * Apply the pre-filter and RLB-filter to a whole frame and store the squared
+ * results in bins. K_WEIGHTING_LANES channels are filtered side by side with
+ * the same operations, so the lanes can be processed with vector instructions.
+ */
+static void k_weighting(EBUR128Context *ebur128, const double *samples, int nb_samples)
+{
+    const int nb_channels = ebur128->nb_channels;
+    double *bins = ebur128->bins;
+    int i, ch, l;
+
+    for (ch = 0; ch < nb_channels; ch += K_WEIGHTING_LANES) {
+        const int lanes = FFMIN(K_WEIGHTING_LANES, nb_channels - ch);
+        double x[3][K_WEIGHTING_LANES], y[3][K_WEIGHTING_LANES], z[3][K_WEIGHTING_LANES];
+
+        for (l = 0; l < lanes; l++) {
+            for (i = 0; i < 3; i++) {
+                x[i][l] = ebur128->x[(ch + l) * 3 + i];
+                y[i][l] = ebur128->y[(ch + l) * 3 + i];
+                z[i][l] = ebur128->z[(ch + l) * 3 + i];
+            }
+        }
+
+        for (i = 0; i < nb_samples; i++) {
+            const double *src = samples + i * nb_channels + ch;
+            double *dst = bins + i * nb_channels + ch;
+
+            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
+            for (l = 0; l < lanes; l++) {
+                x[0][l] = src[l];
+                y[2][l] = y[1][l];
+                y[1][l] = y[0][l];
+                y[0][l] = x[0][l]*PRE_B0 + x[1][l]*PRE_B1 + x[2][l]*PRE_B2
+                                         - y[1][l]*PRE_A1 - y[2][l]*PRE_A2;
+                x[2][l] = x[1][l];
+                x[1][l] = x[0][l];
+                z[2][l] = z[1][l];
+                z[1][l] = z[0][l];
+                z[0][l] = y[0][l]*RLB_B0 + y[1][l]*RLB_B1 + y[2][l]*RLB_B2
+                                         - z[1][l]*RLB_A1 - z[2][l]*RLB_A2;
+                dst[l] = z[0][l] * z[0][l];
+            }
+        }
+
+        for (l = 0; l < lanes; l++) {
+            for (i = 0; i < 3; i++) {
+                ebur128->x[(ch + l) * 3 + i] = x[i][l];
+                ebur128->y[(ch + l) * 3 + i] = y[i][l];
+                ebur128->z[(ch + l) * 3 + i] = z[i][l];
+            }
+        }
+    }
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 {
     int i, ch, idx_insample;
@@ -595,25 +626,28 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
     const double *samples = (double *)insamples->data[0];
     AVFrame *pic = ebur128->outpicref;
 
-#if CONFIG_SWRESAMPLE
     if (ebur128->peak_mode & PEAK_MODE_TRUE_PEAKS) {
-        const double *swr_samples = ebur128->swr_buf;
-        int ret = swr_convert(ebur128->swr_ctx, (uint8_t**)&ebur128->swr_buf, 19200,
-                              (const uint8_t **)insamples->data, nb_samples);
-        if (ret < 0)
-            return ret;
+        double *tp_samples = av_ebur128_true_peak_get_buffer(ebur128->tp, nb_samples);
+        if (!tp_samples)
+            return AVERROR(ENOMEM);
+        memcpy(tp_samples, samples, nb_samples * nb_channels * sizeof(*samples));
         for (ch = 0; ch < nb_channels; ch++)
             ebur128->true_peaks_per_frame[ch] = 0.0;
-        for (idx_insample = 0; idx_insample < ret; idx_insample++) {
-            for (ch = 0; ch < nb_channels; ch++) {
-                ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch], fabs(*swr_samples));
-                ebur128->true_peaks_per_frame[ch] = FFMAX(ebur128->true_peaks_per_frame[ch],
-                                                          fabs(*swr_samples));
-                swr_samples++;
-            }
-        }
+        av_ebur128_true_peak_process(ebur128->tp, nb_samples, ebur128->true_peaks_per_frame);
+        for (ch = 0; ch < nb_channels; ch++)
+            ebur128->true_peaks[ch] = FFMAX(ebur128->true_peaks[ch],
+                                            ebur128->true_peaks_per_frame[ch]);
     }
-#endif
+
+    if (nb_samples > ebur128->nb_bins) {
+        av_freep(&ebur128->bins);
+        ebur128->nb_bins = 0;
+        ebur128->bins = av_malloc_array(nb_samples, nb_channels * sizeof(*ebur128->bins));
+        if (!ebur128->bins)
+            return AVERROR(ENOMEM);
+        ebur128->nb_bins = nb_samples;
+    }
+    k_weighting(ebur128, samples, nb_samples);
 
     for (idx_insample = 0; idx_insample < nb_samples; idx_insample++) {
         const int bin_id_400  = ebur128->i400.cache_pos;
@@ -631,34 +665,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
         MOVE_TO_NEXT_CACHED_ENTRY(3000);
 
         for (ch = 0; ch < nb_channels; ch++) {
-            double bin;
+            const double bin = ebur128->bins[idx_insample * nb_channels + ch];
 
             if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS)
-                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch], fabs(*samples));
-
-            ebur128->x[ch * 3] = *samples++; // set X[i]
+                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch],
+                                                  fabs(samples[idx_insample * nb_channels + ch]));
 
             if (!ebur128->ch_weighting[ch])
                 continue;
 
-            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
-#define FILTER(Y, X, name) do {                                                 \
-            double *dst = ebur128->Y + ch*3;                                    \
-            double *src = ebur128->X + ch*3;                                    \
-            dst[2] = dst[1];                                                    \
-            dst[1] = dst[0];                                                    \
-            dst[0] = src[0]*name##_B0 + src[1]*name##_B1 + src[2]*name##_B2     \
-                                      - dst[1]*name##_A1 - dst[2]*name##_A2;    \
-} while (0)
-
-            // TODO: merge both filters in one?
-            FILTER(y, x, PRE);  // apply pre-filter
-            ebur128->x[ch * 3 + 2] = ebur128->x[ch * 3 + 1];
-            ebur128->x[ch * 3 + 1] = ebur128->x[ch * 3    ];
-            FILTER(z, y, RLB);  // apply RLB-filter
-
-            bin = ebur128->z[ch * 3] * ebur128->z[ch * 3];
-
             /* add the new value, and limit the sum to the cache size (400ms or 3s)
              * by removing the oldest one */
             ebur128->i400.sum [ch] = ebur128->i400.sum [ch] + bin - ebur128->i400.cache [ch][bin_id_400];
@@ -989,10 +1004,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     for (i = 0; i < ctx->nb_outputs; i++)
         av_freep(&ctx->output_pads[i].name);
     av_frame_free(&ebur128->outpicref);
-#if CONFIG_SWRESAMPLE
-    av_freep(&ebur128->swr_buf);
-    swr_free(&ebur128->swr_ctx);
-#endif
+    av_freep(&ebur128->bins);
+    av_ebur128_true_peak_free(&ebur128->tp);
 }
 
 static const AVFilterPad ebur128_inputs[] = {
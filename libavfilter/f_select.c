@@ -37,6 +37,11 @@
 #include "video.h"
 #include "scene_sad.h"
 
+enum SelectMode {
+    MODE_SELECT,
+    MODE_METADATA,
+};
+
 static const char *const var_names[] = {
     "TB",                ///< timebase
 
@@ -154,19 +159,35 @@ typedef struct SelectContext {
     ff_scene_sad_fn sad;            ///< Sum of the absolute difference function (scene detect only)
     double prev_mafd;               ///< previous MAFD                           (scene detect only)
     AVFrame *prev_picref;           ///< previous frame                          (scene detect only)
+    uint64_t *slice_sad;            ///< SAD of every slice                      (scene detect only)
+    int scene_width;                ///< requested width of the luma proxy, 0 to use the frames
+    int factor;                     ///< downscaling factor of the proxy
+    int pw, ph;                     ///< dimensions of the proxy
+    ptrdiff_t proxy_stride;
+    uint8_t *proxy[2];              ///< current and previous luma proxies
+    int have_proxy;                 ///< 1 if proxy[1] holds the previous frame
+    int rgb_offset[3];              ///< offsets of the components in a packed RGB pixel
+    int step;                       ///< size of a packed RGB pixel, 0 for planar formats
     double select;
     int select_out;                 ///< mark the selected output pad index
     int nb_outputs;
+    int mode;                       ///< SelectMode
 } SelectContext;
 
 #define OFFSET(x) offsetof(SelectContext, x)
-#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
-static const AVOption filt_name##_options[] = {                     \
+#define COMMON_OPTIONS(FLAGS)                                       \
     { "expr", "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "e",    "set an expression to use for selecting frames", OFFSET(expr_str), AV_OPT_TYPE_STRING, { .str = "1" }, .flags=FLAGS }, \
     { "outputs", "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
     { "n",       "set the number of outputs", OFFSET(nb_outputs), AV_OPT_TYPE_INT, {.i64 = 1}, 1, INT_MAX, .flags=FLAGS }, \
-    { NULL }                                                            \
+    { "mode", "set what to do with the frames", OFFSET(mode), AV_OPT_TYPE_INT, {.i64 = MODE_SELECT}, 0, MODE_METADATA, .flags=FLAGS, "mode" }, \
+        { "select",   "send the frames to the selected output or drop them", 0, AV_OPT_TYPE_CONST, {.i64 = MODE_SELECT},   .flags=FLAGS, "mode" }, \
+        { "metadata", "send all the frames to the first output and export the result as metadata", 0, AV_OPT_TYPE_CONST, {.i64 = MODE_METADATA}, .flags=FLAGS, "mode" }
+
+#define DEFINE_OPTIONS(filt_name, FLAGS)                            \
+static const AVOption filt_name##_options[] = {                     \
+    COMMON_OPTIONS(FLAGS),                                          \
+    { NULL }                                                        \
 }
 
 static int request_frame(AVFilterLink *outlink);
@@ -215,6 +236,9 @@ static int config_input(AVFilterLink *inlink)
 
     select->bitdepth = desc->comp[0].depth;
     select->nb_planes = is_yuv ? 1 : av_pix_fmt_count_planes(inlink->format);
+    select->step = desc->flags & AV_PIX_FMT_FLAG_RGB ? desc->comp[0].step : 0;
+    for (int i = 0; i < 3; i++)
+        select->rgb_offset[i] = desc->comp[i].offset;
 
     for (int plane = 0; plane < select->nb_planes; plane++) {
         ptrdiff_t line_size = av_image_get_linesize(inlink->format, inlink->w, plane);
@@ -263,43 +287,195 @@ static int config_input(AVFilterLink *inlink)
         inlink->type == AVMEDIA_TYPE_AUDIO ? inlink->sample_rate : NAN;
 
     if (CONFIG_SELECT_FILTER && select->do_scene_detect) {
-        select->sad = ff_scene_sad_get_fn(select->bitdepth == 8 ? 8 : 16);
+        AVFilterContext *ctx = inlink->dst;
+
+        if (select->scene_width) {
+            select->factor = (inlink->w + select->scene_width - 1) / select->scene_width;
+            select->factor = FFMIN(select->factor, FFMIN(inlink->w, inlink->h));
+            select->pw = inlink->w / select->factor;
+            select->ph = inlink->h / select->factor;
+            select->proxy_stride = FFALIGN(select->pw, 32);
+            select->have_proxy = 0;
+
+            for (int i = 0; i < 2; i++) {
+                av_freep(&select->proxy[i]);
+                select->proxy[i] = av_malloc(select->proxy_stride * select->ph);
+                if (!select->proxy[i])
+                    return AVERROR(ENOMEM);
+            }
+            av_log(ctx, AV_LOG_VERBOSE, "scene detection on a %dx%d luma proxy\n",
+                   select->pw, select->ph);
+        }
+
+        select->sad = ff_scene_sad_get_fn(select->bitdepth == 8 || select->scene_width ? 8 : 16);
         if (!select->sad)
             return AVERROR(EINVAL);
+
+        av_freep(&select->slice_sad);
+        select->slice_sad = av_calloc(ff_filter_get_nb_threads(ctx), sizeof(*select->slice_sad));
+        if (!select->slice_sad)
+            return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+typedef struct ThreadData {
+    const AVFrame *prev, *cur;
+} ThreadData;
+
+static void downscale_rows(SelectContext *select, const AVFrame *frame,
+                           int start, int end)
+{
+    const int factor = select->factor;
+    const ptrdiff_t linesize = frame->linesize[0];
+
+    for (int y = start; y < end; y++) {
+        const uint8_t *src = frame->data[0] + y * factor * linesize;
+        uint8_t *dst = select->proxy[0] + y * select->proxy_stride;
+
+        if (select->step) {
+            const int step = select->step;
+            const int area = 3 * factor * factor;
+
+            for (int x = 0; x < select->pw; x++) {
+                const uint8_t *s = src + x * factor * step;
+                unsigned sum = 0;
+
+                for (int j = 0; j < factor; j++, s += linesize) {
+                    for (int i = 0; i < factor * step; i += step)
+                        sum += s[i + select->rgb_offset[0]] +
+                               s[i + select->rgb_offset[1]] +
+                               s[i + select->rgb_offset[2]];
+                }
+                dst[x] = (sum + area / 2) / area;
+            }
+        } else if (select->bitdepth > 8) {
+            const int shift = select->bitdepth - 8;
+            const int area = factor * factor;
+
+            for (int x = 0; x < select->pw; x++) {
+                const uint8_t *s = src + x * factor * 2;
+                unsigned sum = 0;
+
+                for (int j = 0; j < factor; j++, s += linesize) {
+                    const uint16_t *s16 = (const uint16_t *)s;
+                    for (int i = 0; i < factor; i++)
+                        sum += s16[i];
+                }
+                dst[x] = FFMIN((sum + area / 2) / area >> shift, 255);
+            }
+        } else if (factor == 1) {
+            memcpy(dst, src, select->pw);
+        } else {
+            const int area = factor * factor;
+
+            for (int x = 0; x < select->pw; x++) {
+                const uint8_t *s = src + x * factor;
+                unsigned sum = 0;
+
+                for (int j = 0; j < factor; j++, s += linesize) {
+                    for (int i = 0; i < factor; i++)
+                        sum += s[i];
+                }
+                dst[x] = (sum + area / 2) / area;
+            }
+        }
+    }
+}
+
+static int scene_sad_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SelectContext *select = ctx->priv;
+    ThreadData *td = arg;
+    uint64_t sad = 0;
+
+    if (select->scene_width) {
+        const int start = (select->ph *  jobnr     ) / nb_jobs;
+        const int end   = (select->ph * (jobnr + 1)) / nb_jobs;
+        const ptrdiff_t offset = start * select->proxy_stride;
+
+        downscale_rows(select, td->cur, start, end);
+        if (select->have_proxy && end > start)
+            select->sad(select->proxy[1] + offset, select->proxy_stride,
+                        select->proxy[0] + offset, select->proxy_stride,
+                        select->pw, end - start, &sad);
+    } else {
+        for (int plane = 0; plane < select->nb_planes; plane++) {
+            const int start = (select->height[plane] *  jobnr     ) / nb_jobs;
+            const int end   = (select->height[plane] * (jobnr + 1)) / nb_jobs;
+            uint64_t plane_sad;
+
+            if (end <= start)
+                continue;
+            select->sad(td->prev->data[plane] + start * td->prev->linesize[plane],
+                        td->prev->linesize[plane],
+                        td->cur->data[plane] + start * td->cur->linesize[plane],
+                        td->cur->linesize[plane],
+                        select->width[plane], end - start, &plane_sad);
+            sad += plane_sad;
+        }
     }
+    emms_c();
+
+    select->slice_sad[jobnr] = sad;
     return 0;
 }
 
+static uint64_t run_scene_sad(AVFilterContext *ctx, const AVFrame *prev,
+                              const AVFrame *cur, int nb_rows)
+{
+    SelectContext *select = ctx->priv;
+    ThreadData td = { .prev = prev, .cur = cur };
+    const int nb_jobs = FFMIN(nb_rows, ff_filter_get_nb_threads(ctx));
+    uint64_t sad = 0;
+
+    ctx->internal->execute(ctx, scene_sad_slice, &td, NULL, nb_jobs);
+    for (int i = 0; i < nb_jobs; i++)
+        sad += select->slice_sad[i];
+    return sad;
+}
+
 static double get_scene_score(AVFilterContext *ctx, AVFrame *frame)
 {
     double ret = 0;
     SelectContext *select = ctx->priv;
     AVFrame *prev_picref = select->prev_picref;
+    double mafd = -1;
+    uint64_t sad;
 
-    if (prev_picref &&
-        frame->height == prev_picref->height &&
-        frame->width  == prev_picref->width) {
-        uint64_t sad = 0;
-        double mafd, diff;
-        uint64_t count = 0;
+    if (select->scene_width) {
+        AVFilterLink *inlink = ctx->inputs[0];
 
-        for (int plane = 0; plane < select->nb_planes; plane++) {
-            uint64_t plane_sad;
-            select->sad(prev_picref->data[plane], prev_picref->linesize[plane],
-                    frame->data[plane], frame->linesize[plane],
-                    select->width[plane], select->height[plane], &plane_sad);
-            sad += plane_sad;
-            count += select->width[plane] * select->height[plane];
+        if (frame->width != inlink->w || frame->height != inlink->h) {
+            select->have_proxy = 0;
+            return 0;
         }
+        sad = run_scene_sad(ctx, NULL, frame, select->ph);
+        if (select->have_proxy)
+            mafd = (double)sad / (select->pw * select->ph);
+        FFSWAP(uint8_t *, select->proxy[0], select->proxy[1]);
+        select->have_proxy = 1;
+    } else {
+        if (prev_picref &&
+            frame->height == prev_picref->height &&
+            frame->width  == prev_picref->width) {
+            uint64_t count = 0;
+
+            for (int plane = 0; plane < select->nb_planes; plane++)
+                count += select->width[plane] * select->height[plane];
 
-        emms_c();
-        mafd = (double)sad / count / (1ULL << (select->bitdepth - 8));
-        diff = fabs(mafd - select->prev_mafd);
+            sad = run_scene_sad(ctx, prev_picref, frame, select->height[0]);
+            mafd = (double)sad / count / (1ULL << (select->bitdepth - 8));
+        }
+        av_frame_free(&prev_picref);
+        select->prev_picref = av_frame_clone(frame);
+    }
+
+    if (mafd >= 0) {
+        double diff = fabs(mafd - select->prev_mafd);
         ret  = av_clipf(FFMIN(mafd, diff) / 100., 0, 1);
         select->prev_mafd = mafd;
-        av_frame_free(&prev_picref);
     }
-    select->prev_picref = av_frame_clone(frame);
     return ret;
 }
 
@@ -399,6 +575,14 @@ static void select_frame(AVFilterContext *ctx, AVFrame *frame)
 
     av_log(inlink->dst, AV_LOG_DEBUG, " -> select:%f select_out:%d\n", res, select->select_out);
 
+    if (select->mode == MODE_METADATA) {
+        char buf[32];
+
+        snprintf(buf, sizeof(buf), "%f", res);
+        av_dict_set(&frame->metadata, "lavfi.select", buf, 0);
+        select->select_out = 0;
+    }
+
     if (res) {
         select->var_values[VAR_PREV_SELECTED_N]   = select->var_values[VAR_N];
         select->var_values[VAR_PREV_SELECTED_PTS] = select->var_values[VAR_PTS];
@@ -418,7 +602,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
     SelectContext *select = ctx->priv;
 
     select_frame(ctx, frame);
-    if (select->select)
+    if (select->select || select->mode == MODE_METADATA)
         return ff_filter_frame(ctx->outputs[select->select_out], frame);
 
     av_frame_free(&frame);
@@ -445,6 +629,9 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     if (select->do_scene_detect) {
         av_frame_free(&select->prev_picref);
+        av_freep(&select->proxy[0]);
+        av_freep(&select->proxy[1]);
+        av_freep(&select->slice_sad);
     }
 }
 
@@ -520,7 +707,13 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-DEFINE_OPTIONS(select, AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM);
+#define VFLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+static const AVOption select_options[] = {
+    COMMON_OPTIONS(VFLAGS),
+    { "scene_width", "set the width of the luma proxy used for scene detection", OFFSET(scene_width), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, .flags=VFLAGS },
+    { NULL }
+};
+
 AVFILTER_DEFINE_CLASS(select);
 
 static av_cold int select_init(AVFilterContext *ctx)
@@ -552,6 +745,6 @@ AVFilter ff_vf_select = {
     .priv_size     = sizeof(SelectContext),
     .priv_class    = &select_class,
     .inputs        = avfilter_vf_select_inputs,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 #endif /* CONFIG_SELECT_FILTER */
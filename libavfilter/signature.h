@@ -37,6 +37,10 @@
 #define SIGELEM_SIZE 380
 #define DIFFELEM_SIZE 348 /* SIGELEM_SIZE - elem_a1 - elem_a2 */
 #define COARSE_SIZE 90
+#define WORD_BITS 243 /* 3^5 possible values of a word */
+
+#define INDEX_MAGIC "FFSIGIDX"
+#define INDEX_VERSION 1
 
 enum lookup_mode {
     MODE_OFF,
@@ -124,6 +128,22 @@ typedef struct StreamContext {
     int exported; /* boolean whether stream already exported */
 } StreamContext;
 
+/* signatures of one video of the index */
+typedef struct IndexEntry {
+    char *label;
+    StreamContext sc;
+    FineSignature *finesigs;
+    CoarseSignature *coarsesigs;
+    int nb_coarsesigs;
+} IndexEntry;
+
+/* coarse signature of the index, referenced by the inverted lists */
+typedef struct IndexCoarse {
+    CoarseSignature *cs;
+    int entry;
+    uint8_t popcount[5];
+} IndexCoarse;
+
 typedef struct SignatureContext {
     const AVClass *class;
     /* input parameters */
@@ -135,11 +155,23 @@ typedef struct SignatureContext {
     int thcomposdist;
     int thl1;
     int thdi;
-    int thit;
+    double thit;
+    char *index_filename;
+    int index_write;
+    char *index_label;
+    int index_candidates;
     /* end input parameters */
 
     uint8_t l1distlut[243*242/2]; /* 243 + 242 + 241 ... */
     StreamContext* streamcontexts;
+
+    /* index of reference signatures */
+    IndexEntry *index;
+    int nb_index_entries;
+    IndexCoarse *index_coarse;
+    int nb_index_coarse;
+    int *postings;        /* inverted lists of the index coarse signatures... */
+    int *postings_offset; /* ...containing each word, 5 * WORD_BITS + 1 offsets */
 } SignatureContext;
 
 
@@ -0,0 +1,459 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file
+ * MPEG-7 video signature index
+ *
+ * The index file starts with INDEX_MAGIC and a 32 bit version, followed by
+ * one entry per video: a 16 bit label length, the label, a 32 bit size and
+ * the signature in the binary format of the filter. All the numbers are big
+ * endian.
+ *
+ * The coarse signatures of the index are looked up through inverted lists
+ * of their words, only the most similar ones being compared frame by frame.
+ */
+
+#include "signature.h"
+
+/* header + coarsesignature + finesignature sizes of the binary format, in bits */
+#define BINARY_HEADER_BITS (6 * 32 + 3 * 16 + 2 + 32)
+#define BINARY_COARSE_BITS (4 * 32 + 1 + 5 * WORD_BITS)
+#define BINARY_FINE_BITS   (1 + 32 + 8 + 5 * 8 + SIGELEM_SIZE/5 * 8)
+
+static unsigned int popcount_word(const uint8_t *data)
+{
+    unsigned int val = 0, i;
+    for (i = 0; i < 31; i++)
+        val += av_popcount(data[i]);
+    return val;
+}
+
+static int import_binary(AVFilterContext *ctx, IndexEntry *e, const uint8_t *data, int size)
+{
+    StreamContext *sc = &e->sc;
+    GetBitContext gb;
+    uint32_t nb_frames, nb_segments, i, j;
+    int unit, ret;
+
+    if ((ret = init_get_bits8(&gb, data, size)) < 0)
+        return ret;
+    if (size < BINARY_HEADER_BITS / 8)
+        return AVERROR_INVALIDDATA;
+
+    if (get_bits_long(&gb, 32) != 1) /* NumOfSpatial Regions */
+        return AVERROR_PATCHWELCOME;
+    skip_bits(&gb, 1 + 32);                  /* SpatialLocationFlag, PixelX,1 PixelY,1 */
+    sc->w = get_bits(&gb, 16) + 1;
+    sc->h = get_bits(&gb, 16) + 1;
+    skip_bits_long(&gb, 32);                 /* StartFrameOfSpatialRegion */
+    nb_frames = get_bits_long(&gb, 32);
+    unit = get_bits(&gb, 16);
+    skip_bits_long(&gb, 1 + 32 + 32);        /* MediaTime of the spatial region */
+    nb_segments = get_bits_long(&gb, 32);
+
+    if (!nb_frames || !unit || nb_segments != (nb_frames + 44) / 45 ||
+        (uint64_t)nb_segments * BINARY_COARSE_BITS + 1 +
+        (uint64_t)nb_frames   * BINARY_FINE_BITS > get_bits_left(&gb))
+        return AVERROR_INVALIDDATA;
+
+    sc->time_base = (AVRational){ 1, unit };
+    sc->lastindex = nb_frames;
+
+    e->finesigs   = av_mallocz_array(nb_frames,   sizeof(*e->finesigs));
+    e->coarsesigs = av_mallocz_array(nb_segments, sizeof(*e->coarsesigs));
+    if (!e->finesigs || !e->coarsesigs)
+        return AVERROR(ENOMEM);
+    e->nb_coarsesigs = nb_segments;
+
+    /* coarsesignatures */
+    for (i = 0; i < nb_segments; i++) {
+        CoarseSignature *cs = &e->coarsesigs[i];
+        const uint32_t start = get_bits_long(&gb, 32);
+        const uint32_t end   = get_bits_long(&gb, 32);
+
+        if (start > end || end >= nb_frames)
+            return AVERROR_INVALIDDATA;
+        cs->first = &e->finesigs[start];
+        cs->last  = &e->finesigs[end];
+        cs->next  = i + 1 < nb_segments ? cs + 1 : NULL;
+        skip_bits_long(&gb, 1 + 32 + 32);    /* MediaTime of the segment */
+        for (j = 0; j < 5; j++) {
+            int k;
+            for (k = 0; k < 30; k++)
+                cs->data[j][k] = get_bits(&gb, 8);
+            cs->data[j][30] = get_bits(&gb, 3) << 5;
+        }
+    }
+
+    /* finesignatures */
+    if (get_bits1(&gb)) /* CompressionFlag */
+        return AVERROR_PATCHWELCOME;
+    for (i = 0; i < nb_frames; i++) {
+        FineSignature *fs = &e->finesigs[i];
+
+        skip_bits1(&gb);                     /* MediaTimeFlagOfFrame */
+        fs->pts        = get_bits_long(&gb, 32);
+        fs->confidence = get_bits(&gb, 8);
+        for (j = 0; j < 5; j++)
+            fs->words[j] = get_bits(&gb, 8);
+        for (j = 0; j < SIGELEM_SIZE/5; j++) {
+            fs->framesig[j] = get_bits(&gb, 8);
+            if (fs->framesig[j] >= 243)
+                return AVERROR_INVALIDDATA;
+        }
+        fs->index = i;
+        fs->prev  = i > 0             ? fs - 1 : NULL;
+        fs->next  = i + 1 < nb_frames ? fs + 1 : NULL;
+    }
+
+    sc->finesiglist   = e->finesigs;
+    sc->coarsesiglist = e->coarsesigs;
+    sc->coarseend     = &e->coarsesigs[nb_segments - 1];
+    return 0;
+}
+
+/**
+ * build the inverted lists of the index: for each word value at each of the
+ * 5 positions, the coarse signatures containing it
+ */
+static int build_postings(SignatureContext *sic)
+{
+    int i, j, k, b, n = 0, nb_postings = 0;
+    int *pos;
+
+    for (i = 0; i < sic->nb_index_entries; i++)
+        n += sic->index[i].nb_coarsesigs;
+
+    sic->nb_index_coarse = n;
+    sic->index_coarse    = av_malloc_array(n, sizeof(*sic->index_coarse));
+    sic->postings_offset = av_mallocz_array(5 * WORD_BITS + 1, sizeof(*sic->postings_offset));
+    if (!sic->index_coarse || !sic->postings_offset)
+        return AVERROR(ENOMEM);
+
+    for (i = 0, n = 0; i < sic->nb_index_entries; i++) {
+        for (j = 0; j < sic->index[i].nb_coarsesigs; j++, n++) {
+            IndexCoarse *c = &sic->index_coarse[n];
+
+            c->cs = &sic->index[i].coarsesigs[j];
+            c->entry = i;
+            for (k = 0; k < 5; k++) {
+                c->popcount[k] = popcount_word(c->cs->data[k]);
+                nb_postings += c->popcount[k];
+                for (b = 0; b < WORD_BITS; b++)
+                    if (c->cs->data[k][b >> 3] & (0x80 >> (b & 7)))
+                        sic->postings_offset[k * WORD_BITS + b + 1]++;
+            }
+        }
+    }
+    for (i = 0; i < 5 * WORD_BITS; i++)
+        sic->postings_offset[i + 1] += sic->postings_offset[i];
+
+    sic->postings = av_malloc_array(FFMAX(nb_postings, 1), sizeof(*sic->postings));
+    pos = av_memdup(sic->postings_offset, 5 * WORD_BITS * sizeof(*pos));
+    if (!sic->postings || !pos) {
+        av_free(pos);
+        return AVERROR(ENOMEM);
+    }
+    for (n = 0; n < sic->nb_index_coarse; n++) {
+        const CoarseSignature *cs = sic->index_coarse[n].cs;
+        for (k = 0; k < 5; k++)
+            for (b = 0; b < WORD_BITS; b++)
+                if (cs->data[k][b >> 3] & (0x80 >> (b & 7)))
+                    sic->postings[pos[k * WORD_BITS + b]++] = n;
+    }
+    av_free(pos);
+    return 0;
+}
+
+static int load_index(AVFilterContext *ctx, SignatureContext *sic)
+{
+    uint8_t *buf, *data = NULL;
+    size_t size, pos;
+    int ret;
+
+    /* the index is created by the first write */
+    if (sic->index_write && avio_check(sic->index_filename, AVIO_FLAG_READ) == AVERROR(ENOENT))
+        return 0;
+
+    ret = av_file_map(sic->index_filename, &buf, &size, 0, ctx);
+    if (ret < 0) {
+        av_log(ctx, AV_LOG_ERROR, "cannot open index %s\n", sic->index_filename);
+        return ret;
+    }
+
+    if (size < 12 || memcmp(buf, INDEX_MAGIC, 8) || AV_RB32(buf + 8) != INDEX_VERSION) {
+        av_log(ctx, AV_LOG_ERROR, "%s is not a signature index\n", sic->index_filename);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    for (pos = 12; pos < size; ) {
+        IndexEntry *e;
+        uint32_t label_len, sig_size;
+
+        ret = AVERROR_INVALIDDATA;
+        if (size - pos < 2 || size - pos - 2 < (label_len = AV_RB16(buf + pos)) + 4)
+            goto end;
+        sig_size = AV_RB32(buf + pos + 2 + label_len);
+        if (size - pos - 6 - label_len < sig_size)
+            goto end;
+
+        e = av_dynarray2_add((void **)&sic->index, &sic->nb_index_entries, sizeof(*e), NULL);
+        if (!e) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        memset(e, 0, sizeof(*e));
+        e->label = av_strndup(buf + pos + 2, label_len);
+        data = av_malloc(sig_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!e->label || !data) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        memcpy(data, buf + pos + 6 + label_len, sig_size);
+        memset(data + sig_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+        if ((ret = import_binary(ctx, e, data, sig_size)) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "invalid signature of %s in index %s\n",
+                   e->label, sic->index_filename);
+            goto end;
+        }
+        av_freep(&data);
+        pos += 6 + label_len + sig_size;
+    }
+
+    ret = build_postings(sic);
+    av_log(ctx, AV_LOG_VERBOSE, "loaded %d videos and %d coarse signatures from index %s\n",
+           sic->nb_index_entries, sic->nb_index_coarse, sic->index_filename);
+
+end:
+    av_free(data);
+    av_file_unmap(buf, size);
+    return ret;
+}
+
+static void free_index(SignatureContext *sic)
+{
+    int i;
+
+    for (i = 0; i < sic->nb_index_entries; i++) {
+        av_freep(&sic->index[i].label);
+        av_freep(&sic->index[i].finesigs);
+        av_freep(&sic->index[i].coarsesigs);
+    }
+    av_freep(&sic->index);
+    sic->nb_index_entries = 0;
+    av_freep(&sic->index_coarse);
+    av_freep(&sic->postings);
+    av_freep(&sic->postings_offset);
+}
+
+/* pair of coarse signatures to compare frame by frame */
+typedef struct IndexCandidate {
+    CoarseSignature *first;
+    CoarseSignature *second;
+    int entry;
+} IndexCandidate;
+
+typedef struct IndexThreadData {
+    IndexCandidate *cands;
+    int *entry_start;
+    MatchingInfo *matches;
+} IndexThreadData;
+
+/**
+ * select the coarse signatures of the index most similar to the given one,
+ * as long as less than half of their words are too far away
+ * @return number of candidates, written in best
+ */
+static int get_coarsecandidates(SignatureContext *sic, const CoarseSignature *cs,
+                                float *sim, uint8_t *inter, uint8_t *near,
+                                int *touched, int *word_touched, int *best)
+{
+    int i, j, k, b, nb_touched = 0, nb_best = 0;
+
+    for (k = 0; k < 5; k++) {
+        const unsigned int pop = popcount_word(cs->data[k]);
+        int nb_word_touched = 0;
+
+        for (b = 0; b < WORD_BITS; b++) {
+            if (!(cs->data[k][b >> 3] & (0x80 >> (b & 7))))
+                continue;
+            for (i = sic->postings_offset[k * WORD_BITS + b];
+                 i < sic->postings_offset[k * WORD_BITS + b + 1]; i++) {
+                const int n = sic->postings[i];
+                if (!inter[n]++)
+                    word_touched[nb_word_touched++] = n;
+            }
+        }
+
+        for (i = 0; i < nb_word_touched; i++) {
+            const int n = word_touched[i];
+            const float jaccard = (float)inter[n] /
+                                  (pop + sic->index_coarse[n].popcount[k] - inter[n]);
+
+            if (!sim[n] && !near[n])
+                touched[nb_touched++] = n;
+            sim[n] += jaccard;
+            if (10000 * (1.0f - jaccard) < sic->thworddist)
+                near[n]++;
+            inter[n] = 0;
+        }
+    }
+
+    for (i = 0; i < nb_touched; i++) {
+        const int n = touched[i];
+
+        if (near[n] < 3 || 10000 * (5 - sim[n]) > sic->thcomposdist)
+            continue;
+        if (nb_best == sic->index_candidates && sim[best[nb_best - 1]] >= sim[n])
+            continue;
+        /* keep the best ones sorted by decreasing similarity */
+        for (j = FFMIN(nb_best, sic->index_candidates - 1); j > 0 && sim[best[j - 1]] < sim[n]; j--)
+            best[j] = best[j - 1];
+        best[j] = n;
+        nb_best = FFMIN(nb_best + 1, sic->index_candidates);
+    }
+    for (i = 0; i < nb_touched; i++) {
+        sim[touched[i]] = 0;
+        near[touched[i]] = 0;
+    }
+    return nb_best;
+}
+
+static int lookup_index_entries(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SignatureContext *sic = ctx->priv;
+    IndexThreadData *td = arg;
+    int e, i;
+
+    for (e = jobnr; e < sic->nb_index_entries; e += nb_jobs) {
+        MatchingInfo bestmatch = { 0 };
+
+        bestmatch.meandist = 99999;
+        for (i = td->entry_start[e]; i < td->entry_start[e + 1] && !bestmatch.whole; i++) {
+            MatchingInfo *infos = get_matching_parameters(ctx, sic, td->cands[i].first->first,
+                                                          td->cands[i].second->first);
+            if (infos) {
+                bestmatch = evaluate_parameters(ctx, sic, infos, bestmatch, sic->mode);
+                sll_free(infos);
+            }
+        }
+        td->matches[e] = bestmatch;
+    }
+    return 0;
+}
+
+static int lookup_index(AVFilterContext *ctx, SignatureContext *sic, StreamContext *sc, int input)
+{
+    IndexThreadData td = { 0 };
+    IndexCandidate *cands = NULL;
+    CoarseSignature *cs;
+    float *sim;
+    uint8_t *inter, *near;
+    int *touched, *word_touched, *best, *pos = NULL;
+    int i, n, nb_cands = 0, nb_matches = 0, ret = 0;
+
+    if (!sic->nb_index_coarse)
+        return 0;
+
+    sim          = av_mallocz_array(sic->nb_index_coarse, sizeof(*sim));
+    inter        = av_mallocz(sic->nb_index_coarse);
+    near         = av_mallocz(sic->nb_index_coarse);
+    touched      = av_malloc_array(sic->nb_index_coarse, sizeof(*touched));
+    word_touched = av_malloc_array(sic->nb_index_coarse, sizeof(*word_touched));
+    best         = av_malloc_array(sic->index_candidates, sizeof(*best));
+    td.entry_start = av_mallocz_array(sic->nb_index_entries + 1, sizeof(*td.entry_start));
+    td.matches     = av_malloc_array(sic->nb_index_entries, sizeof(*td.matches));
+    if (!sim || !inter || !near || !touched || !word_touched || !best ||
+        !td.entry_start || !td.matches) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* stage 1: coarsesignature candidates through the inverted lists */
+    for (cs = sc->coarsesiglist; cs; cs = cs->next) {
+        const int nb_best = get_coarsecandidates(sic, cs, sim, inter, near,
+                                                 touched, word_touched, best);
+
+        for (i = 0; i < nb_best; i++) {
+            IndexCandidate *c = av_dynarray2_add((void **)&cands, &nb_cands, sizeof(*c), NULL);
+            if (!c) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            c->first  = cs;
+            c->second = sic->index_coarse[best[i]].cs;
+            c->entry  = sic->index_coarse[best[i]].entry;
+        }
+    }
+    av_log(ctx, AV_LOG_DEBUG, "Stage 1: %d coarsesignature pairs for video %d\n", nb_cands, input);
+
+    /* group the pairs by entry, keeping their order */
+    td.cands = av_malloc_array(FFMAX(nb_cands, 1), sizeof(*td.cands));
+    pos = av_malloc_array(sic->nb_index_entries, sizeof(*pos));
+    if (!td.cands || !pos) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (i = 0; i < nb_cands; i++)
+        td.entry_start[cands[i].entry + 1]++;
+    for (i = 0; i < sic->nb_index_entries; i++) {
+        td.entry_start[i + 1] += td.entry_start[i];
+        pos[i] = td.entry_start[i];
+    }
+    for (i = 0; i < nb_cands; i++)
+        td.cands[pos[cands[i].entry]++] = cands[i];
+
+    /* stage 2 and 3, each entry on its own */
+    ctx->internal->execute(ctx, lookup_index_entries, &td, NULL,
+                           FFMIN(sic->nb_index_entries, ff_filter_get_nb_threads(ctx)));
+
+    for (n = 0; n < sic->nb_index_entries; n++) {
+        const MatchingInfo *match = &td.matches[n];
+        const StreamContext *sc2 = &sic->index[n].sc;
+
+        if (!match->score)
+            continue;
+        av_log(ctx, AV_LOG_INFO, "matching of video %d at %f and %s at %f, %d frames matching\n",
+               input, ((double) match->first->pts * sc->time_base.num) / sc->time_base.den,
+               sic->index[n].label,
+               ((double) match->second->pts * sc2->time_base.num) / sc2->time_base.den,
+               match->matchframes);
+        if (match->whole)
+            av_log(ctx, AV_LOG_INFO, "whole video matching\n");
+        nb_matches++;
+    }
+    if (!nb_matches)
+        av_log(ctx, AV_LOG_INFO, "no matching of video %d in the index\n", input);
+
+end:
+    av_free(sim);
+    av_free(inter);
+    av_free(near);
+    av_free(touched);
+    av_free(word_touched);
+    av_free(best);
+    av_free(cands);
+    av_free(pos);
+    av_free(td.cands);
+    av_free(td.entry_start);
+    av_free(td.matches);
+    return ret;
+}
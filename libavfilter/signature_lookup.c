@@ -545,8 +545,6 @@ static MatchingInfo lookup_signatures(AVFilterContext *ctx, SignatureContext *sc
     bestmatch.meandist = 99999;
     bestmatch.whole = 0;
 
-    fill_l1distlut(sc->l1distlut);
-
     /* stage 1: coarsesignature matching */
     if (find_next_coarsecandidate(sc, second->coarsesiglist, &cs, &cs2, 1) == 0)
         return bestmatch; /* no candidate found */
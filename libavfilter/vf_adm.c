@@ -0,0 +1,627 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calculate the ADM (Additive Detail Measure, also known as DLM) between two
+ * input videos, as the elementary feature used by VMAF.
+ */
+
+#include <float.h>
+
+#include "libavutil/float_dsp.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "formats.h"
+#include "framesync.h"
+#include "internal.h"
+#include "video.h"
+
+#define NB_SCALES 4
+#define BORDER_FACTOR 0.1
+#define ENHN_GAIN_LIMIT 100.f
+
+enum ADMBand { BAND_H, BAND_V, BAND_D, NB_BANDS };
+
+enum ADMBuffers {
+    IN_REF, IN_DIS,                 ///< converted input, full resolution
+    A_REF_0, A_DIS_0,               ///< approximation bands of scales 0 and 2
+    A_REF_1, A_DIS_1,               ///< approximation bands of scales 1 and 3
+    REF_H, REF_V, REF_D,            ///< detail bands, then restored image
+    DIS_H, DIS_V, DIS_D,            ///< detail bands, then CSF filtered artifacts
+    NB_BUFS
+};
+
+static const float dwt2_db2_lo[4] = {
+     0.482962913144690,  0.836516303737469,  0.224143868041857, -0.129409522550921
+};
+
+static const float dwt2_db2_hi[4] = {
+    -0.129409522550921, -0.224143868041857,  0.836516303737469, -0.482962913144690
+};
+
+static const float dwt_7_9_basis_function_amplitudes[NB_SCALES][4] = {
+    { 0.62171,  0.67234, 0.72709, 0.67234 },
+    { 0.34537,  0.41317, 0.49428, 0.41317 },
+    { 0.18004,  0.22727, 0.28688, 0.22727 },
+    { 0.091401, 0.11792, 0.15214, 0.11792 },
+};
+
+typedef struct ADMContext {
+    const AVClass *class;
+    FFFrameSync fs;
+    const AVPixFmtDescriptor *desc;
+    int width;
+    int height;
+    ptrdiff_t stride;               ///< in floats, common to all buffers
+    int nb_threads;
+    float factor;
+    float *data_buf[NB_BUFS];
+    float **temp;                   ///< per-job line buffers
+    float *row_num[NB_BANDS];       ///< per-row sums of the current scale
+    float *row_den[NB_BANDS];
+    float rfactor[NB_SCALES][NB_BANDS];
+    double adm_sum;
+    double adm_min;
+    double adm_max;
+    uint64_t nb_frames;
+    AVFloatDSPContext *fdsp;
+} ADMContext;
+
+static const AVOption adm_options[] = {
+    { NULL }
+};
+
+FRAMESYNC_DEFINE_CLASS(adm, ADMContext, fs);
+
+typedef struct ThreadData {
+    AVFrame *main, *ref;
+    int scale;
+    int w, h;                       ///< dimensions of the input of the current scale
+    int top, bottom, left, right;   ///< area of the bands taken into account
+} ThreadData;
+
+static av_always_inline int adm_reflect(int x, int size)
+{
+    if (x < 0)
+        return -x;
+    if (x >= size)
+        return 2 * size - x - 1;
+    return x;
+}
+
+/**
+ * Quantization step of the 9/7 wavelet basis function, from Watson et al.,
+ * "Visibility of wavelet quantization noise", for a 1080 lines display
+ * viewed at three times its height.
+ */
+static float dwt_quant_step(int lambda, int theta)
+{
+    static const float a = 0.495f, k = 0.466f, f0 = 0.401f;
+    static const float g[4] = { 1.501f, 1.f, 0.534f, 1.f };
+    const float r = 3.0 * 1080 * M_PI / 180.0;
+    const float temp = log10(pow(2.0, lambda + 1) * f0 * g[theta] / r);
+
+    return 2.0 * a * pow(10.0, k * temp * temp) /
+           dwt_7_9_basis_function_amplitudes[lambda][theta];
+}
+
+static void dwt2_line(AVFloatDSPContext *fdsp, const float *src, ptrdiff_t stride,
+                      int w, int h, int y, float *tmplo, float *tmphi,
+                      float *a, float *v, float *hb, float *d)
+{
+    const int aligned_w = FFALIGN(w, 16);
+    int i, j;
+
+    memset(tmplo, 0, aligned_w * sizeof(*tmplo));
+    memset(tmphi, 0, aligned_w * sizeof(*tmphi));
+    for (i = 0; i < 4; i++) {
+        const float *line = src + adm_reflect(2 * y - 1 + i, h) * stride;
+
+        fdsp->vector_fmac_scalar(tmplo, line, dwt2_db2_lo[i], aligned_w);
+        fdsp->vector_fmac_scalar(tmphi, line, dwt2_db2_hi[i], aligned_w);
+    }
+
+    for (j = 0; j < (w + 1) / 2; j++) {
+        float sa = 0.f, sv = 0.f, sh = 0.f, sd = 0.f;
+
+        for (i = 0; i < 4; i++) {
+            const int x = adm_reflect(2 * j - 1 + i, w);
+
+            sa += dwt2_db2_lo[i] * tmplo[x];
+            sv += dwt2_db2_hi[i] * tmplo[x];
+            sh += dwt2_db2_lo[i] * tmphi[x];
+            sd += dwt2_db2_hi[i] * tmphi[x];
+        }
+        a[j]  = sa;
+        v[j]  = sv;
+        hb[j] = sh;
+        d[j]  = sd;
+    }
+}
+
+#define CONVERT_LINE(type)                                              \
+    do {                                                                \
+        const type *msrc = (const type *)(td->main->data[0] + y * td->main->linesize[0]); \
+        const type *rsrc = (const type *)(td->ref->data[0]  + y * td->ref->linesize[0]);  \
+                                                                        \
+        for (x = 0; x < td->w; x++) {                                   \
+            dis[x] = msrc[x] * s->factor - 128.f;                       \
+            ref[x] = rsrc[x] * s->factor - 128.f;                       \
+        }                                                               \
+    } while (0)
+
+static int adm_convert_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ADMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int slice_start = (td->h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (td->h * (jobnr + 1)) / nb_jobs;
+    int x, y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        float *ref = s->data_buf[IN_REF] + y * s->stride;
+        float *dis = s->data_buf[IN_DIS] + y * s->stride;
+
+        if (s->desc->comp[0].depth > 8)
+            CONVERT_LINE(uint16_t);
+        else
+            CONVERT_LINE(uint8_t);
+    }
+
+    return 0;
+}
+
+/**
+ * Decompose the reference and distorted images of the current scale, then
+ * split the distorted detail bands into the restored image, which is left in
+ * the reference bands, and the additive impairments, which are left CSF
+ * filtered in the distorted bands.
+ */
+static int adm_decompose_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    static const float cos_1deg_sq = 0.99969541350954794f;
+    static const float eps = 1.0e-30f;
+    ADMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const ptrdiff_t stride = s->stride;
+    const int w = (td->w + 1) / 2;
+    const int h = (td->h + 1) / 2;
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
+    const float *rfactor = s->rfactor[td->scale];
+    const float *src_ref, *src_dis;
+    float *dst_ref = s->data_buf[td->scale & 1 ? A_REF_1 : A_REF_0];
+    float *dst_dis = s->data_buf[td->scale & 1 ? A_DIS_1 : A_DIS_0];
+    float *tmplo = s->temp[jobnr];
+    float *tmphi = tmplo + stride;
+    int i, j, y;
+
+    if (!td->scale) {
+        src_ref = s->data_buf[IN_REF];
+        src_dis = s->data_buf[IN_DIS];
+    } else {
+        src_ref = s->data_buf[td->scale & 1 ? A_REF_0 : A_REF_1];
+        src_dis = s->data_buf[td->scale & 1 ? A_DIS_0 : A_DIS_1];
+    }
+
+    for (y = slice_start; y < slice_end; y++) {
+        const ptrdiff_t off = y * stride;
+        float *ref[NB_BANDS], *dis[NB_BANDS];
+        float den[NB_BANDS] = { 0 };
+
+        for (i = 0; i < NB_BANDS; i++) {
+            ref[i] = s->data_buf[REF_H + i] + off;
+            dis[i] = s->data_buf[DIS_H + i] + off;
+        }
+
+        dwt2_line(s->fdsp, src_ref, stride, td->w, td->h, y, tmplo, tmphi,
+                  dst_ref + off, ref[BAND_V], ref[BAND_H], ref[BAND_D]);
+        dwt2_line(s->fdsp, src_dis, stride, td->w, td->h, y, tmplo, tmphi,
+                  dst_dis + off, dis[BAND_V], dis[BAND_H], dis[BAND_D]);
+
+        for (j = 0; j < w; j++) {
+            const float oh = ref[BAND_H][j], ov = ref[BAND_V][j], od = ref[BAND_D][j];
+            const float th = dis[BAND_H][j], tv = dis[BAND_V][j], tdd = dis[BAND_D][j];
+            const float ot_dp = oh * th + ov * tv;
+            const float o_mag_sq = oh * oh + ov * ov;
+            const float t_mag_sq = th * th + tv * tv;
+            const int angle_flag = ot_dp >= 0.f &&
+                                   ot_dp * ot_dp >= cos_1deg_sq * o_mag_sq * t_mag_sq;
+            float rst_h = av_clipf(th  / (oh + eps), 0.f, 1.f) * oh;
+            float rst_v = av_clipf(tv  / (ov + eps), 0.f, 1.f) * ov;
+            float rst_d = av_clipf(tdd / (od + eps), 0.f, 1.f) * od;
+
+            if (angle_flag) {
+                rst_h = rst_h > 0.f ? FFMIN(rst_h * ENHN_GAIN_LIMIT, th)  :
+                        rst_h < 0.f ? FFMAX(rst_h * ENHN_GAIN_LIMIT, th)  : th;
+                rst_v = rst_v > 0.f ? FFMIN(rst_v * ENHN_GAIN_LIMIT, tv)  :
+                        rst_v < 0.f ? FFMAX(rst_v * ENHN_GAIN_LIMIT, tv)  : tv;
+                rst_d = rst_d > 0.f ? FFMIN(rst_d * ENHN_GAIN_LIMIT, tdd) :
+                        rst_d < 0.f ? FFMAX(rst_d * ENHN_GAIN_LIMIT, tdd) : tdd;
+            }
+
+            if (y >= td->top && y < td->bottom && j >= td->left && j < td->right) {
+                const float dh = fabsf(oh * rfactor[BAND_H]);
+                const float dv = fabsf(ov * rfactor[BAND_V]);
+                const float dd = fabsf(od * rfactor[BAND_D]);
+
+                den[BAND_H] += dh * dh * dh;
+                den[BAND_V] += dv * dv * dv;
+                den[BAND_D] += dd * dd * dd;
+            }
+
+            ref[BAND_H][j] = rst_h * rfactor[BAND_H];
+            ref[BAND_V][j] = rst_v * rfactor[BAND_V];
+            ref[BAND_D][j] = rst_d * rfactor[BAND_D];
+            dis[BAND_H][j] = fabsf((th  - rst_h) * rfactor[BAND_H]);
+            dis[BAND_V][j] = fabsf((tv  - rst_v) * rfactor[BAND_V]);
+            dis[BAND_D][j] = fabsf((tdd - rst_d) * rfactor[BAND_D]);
+        }
+
+        for (i = 0; i < NB_BANDS; i++)
+            s->row_den[i][y] = den[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Apply contrast masking to the restored image, the masking threshold being
+ * a 3x3 weighted sum of the CSF filtered impairments of all orientations.
+ */
+static int adm_cm_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ADMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const ptrdiff_t stride = s->stride;
+    const int w = (td->w + 1) / 2;
+    const int h = (td->h + 1) / 2;
+    const int slice_start = td->top + ((td->bottom - td->top) *  jobnr     ) / nb_jobs;
+    const int slice_end   = td->top + ((td->bottom - td->top) * (jobnr + 1)) / nb_jobs;
+    const float *csf[NB_BANDS];
+    int i, j, k, x, y;
+
+    for (i = 0; i < NB_BANDS; i++)
+        csf[i] = s->data_buf[DIS_H + i];
+
+    for (y = slice_start; y < slice_end; y++) {
+        const float *rst[NB_BANDS];
+        float num[NB_BANDS] = { 0 };
+        ptrdiff_t lines[3];
+
+        for (k = 0; k < 3; k++)
+            lines[k] = adm_reflect(y - 1 + k, h) * stride;
+        for (i = 0; i < NB_BANDS; i++)
+            rst[i] = s->data_buf[REF_H + i] + y * stride;
+
+        for (j = td->left; j < td->right; j++) {
+            float thr = 0.f;
+
+            for (i = 0; i < NB_BANDS; i++) {
+                for (k = 0; k < 3; k++) {
+                    for (x = -1; x <= 1; x++)
+                        thr += csf[i][lines[k] + adm_reflect(j + x, w)];
+                }
+                thr += csf[i][lines[1] + j];
+            }
+            thr *= 1.f / 30.f;
+
+            for (i = 0; i < NB_BANDS; i++) {
+                const float val = FFMAX(fabsf(rst[i][j]) - thr, 0.f);
+
+                num[i] += val * val * val;
+            }
+        }
+
+        for (i = 0; i < NB_BANDS; i++)
+            s->row_num[i][y] = num[i];
+    }
+
+    return 0;
+}
+
+static float compute_adm(AVFilterContext *ctx, AVFrame *main, AVFrame *ref,
+                         float score[NB_SCALES])
+{
+    ADMContext *s = ctx->priv;
+    const double numden_limit = 1e-10 * s->width * s->height / (1920.0 * 1080.0);
+    double num = 0.0, den = 0.0;
+    ThreadData td;
+    int scale, i, y;
+
+    td.main = main;
+    td.ref = ref;
+    td.w = s->width;
+    td.h = s->height;
+
+    ctx->internal->execute(ctx, adm_convert_slice, &td, NULL,
+                           FFMIN(td.h, s->nb_threads));
+
+    for (scale = 0; scale < NB_SCALES; scale++) {
+        const int w = (td.w + 1) / 2;
+        const int h = (td.h + 1) / 2;
+        double num_scale = 0.0, den_scale = 0.0;
+
+        td.scale = scale;
+        td.left   = w * BORDER_FACTOR - 0.5;
+        td.top    = h * BORDER_FACTOR - 0.5;
+        td.right  = w - td.left;
+        td.bottom = h - td.top;
+
+        ctx->internal->execute(ctx, adm_decompose_slice, &td, NULL,
+                               FFMIN(h, s->nb_threads));
+        ctx->internal->execute(ctx, adm_cm_slice, &td, NULL,
+                               FFMIN(td.bottom - td.top, s->nb_threads));
+
+        /* sum the rows in order, so the result does not depend on the slicing */
+        for (i = 0; i < NB_BANDS; i++) {
+            const double border = cbrt((td.bottom - td.top) * (td.right - td.left) / 32.0);
+            double band_num = 0.0, band_den = 0.0;
+
+            for (y = td.top; y < td.bottom; y++) {
+                band_num += s->row_num[i][y];
+                band_den += s->row_den[i][y];
+            }
+            num_scale += cbrt(band_num) + border;
+            den_scale += cbrt(band_den) + border;
+        }
+
+        if (num_scale < numden_limit)
+            num_scale = 0.0;
+        if (den_scale < numden_limit)
+            den_scale = 0.0;
+
+        score[scale] = den_scale == 0.0 ? 1.f : num_scale / den_scale;
+        num += num_scale;
+        den += den_scale;
+
+        td.w = w;
+        td.h = h;
+    }
+
+    return den == 0.0 ? 1.f : num / den;
+}
+
+static void set_meta(AVDictionary **metadata, const char *key, char comp, float d)
+{
+    char value[128];
+    snprintf(value, sizeof(value), "%f", d);
+    if (comp) {
+        char key2[128];
+        snprintf(key2, sizeof(key2), "%s%c", key, comp);
+        av_dict_set(metadata, key2, value, 0);
+    } else {
+        av_dict_set(metadata, key, value, 0);
+    }
+}
+
+static int do_adm(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    ADMContext *s = ctx->priv;
+    AVFrame *master, *ref;
+    float score[NB_SCALES], adm;
+    int ret, i;
+
+    ret = ff_framesync_dualinput_get(fs, &master, &ref);
+    if (ret < 0)
+        return ret;
+    if (!ref)
+        return ff_filter_frame(ctx->outputs[0], master);
+
+    adm = compute_adm(ctx, master, ref, score);
+
+    for (i = 0; i < NB_SCALES; i++)
+        set_meta(&master->metadata, "lavfi.adm.scale.", '0' + i, score[i]);
+    set_meta(&master->metadata, "lavfi.adm.score", 0, adm);
+
+    s->adm_min = FFMIN(s->adm_min, adm);
+    s->adm_max = FFMAX(s->adm_max, adm);
+    s->adm_sum += adm;
+    s->nb_frames++;
+
+    return ff_filter_frame(ctx->outputs[0], master);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    ADMContext *s = ctx->priv;
+    int scale;
+
+    s->adm_min =  DBL_MAX;
+    s->adm_max = -DBL_MAX;
+
+    for (scale = 0; scale < NB_SCALES; scale++) {
+        s->rfactor[scale][BAND_H] = 1.f / dwt_quant_step(scale, 1);
+        s->rfactor[scale][BAND_V] = 1.f / dwt_quant_step(scale, 1);
+        s->rfactor[scale][BAND_D] = 1.f / dwt_quant_step(scale, 2);
+    }
+
+    s->fs.on_event = do_adm;
+    return 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10,
+        AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY14, AV_PIX_FMT_GRAY16,
+#define PF(suf) AV_PIX_FMT_YUV420##suf, AV_PIX_FMT_YUV422##suf, AV_PIX_FMT_YUV444##suf
+        PF(P), PF(P9), PF(P10), PF(P12), PF(P14), PF(P16),
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_YUV410P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P,
+        AV_PIX_FMT_YUVJ440P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_NONE
+    };
+
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_input_ref(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx  = inlink->dst;
+    ADMContext *s = ctx->priv;
+    int i;
+
+    if (ctx->inputs[0]->w != ctx->inputs[1]->w ||
+        ctx->inputs[0]->h != ctx->inputs[1]->h) {
+        av_log(ctx, AV_LOG_ERROR, "Width and height of input videos must be same.\n");
+        return AVERROR(EINVAL);
+    }
+    if (ctx->inputs[0]->format != ctx->inputs[1]->format) {
+        av_log(ctx, AV_LOG_ERROR, "Inputs must be of same pixel format.\n");
+        return AVERROR(EINVAL);
+    }
+    /* the last scale must still have a border and a few samples left */
+    if (inlink->w < 32 || inlink->h < 32) {
+        av_log(ctx, AV_LOG_ERROR, "Input videos must be at least 32x32.\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->desc = av_pix_fmt_desc_get(inlink->format);
+    s->width = inlink->w;
+    s->height = inlink->h;
+    s->stride = FFALIGN(s->width, 16);
+    s->factor = 1.f / (1 << (s->desc->comp[0].depth - 8));
+
+    for (i = 0; i < NB_BUFS; i++) {
+        const int h = i < A_REF_0 ? s->height : (s->height + 1) / 2;
+
+        s->data_buf[i] = av_mallocz_array(s->stride * h, sizeof(*s->data_buf[i]));
+        if (!s->data_buf[i])
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < NB_BANDS; i++) {
+        s->row_num[i] = av_malloc_array((s->height + 1) / 2, sizeof(*s->row_num[i]));
+        s->row_den[i] = av_malloc_array((s->height + 1) / 2, sizeof(*s->row_den[i]));
+        if (!s->row_num[i] || !s->row_den[i])
+            return AVERROR(ENOMEM);
+    }
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
+    if (!s->temp)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(s->stride * 2, sizeof(*s->temp[i]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+
+    s->fdsp = avpriv_float_dsp_alloc(0);
+    if (!s->fdsp)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    ADMContext *s = ctx->priv;
+    AVFilterLink *mainlink = ctx->inputs[0];
+    int ret;
+
+    ret = ff_framesync_init_dualinput(&s->fs, ctx);
+    if (ret < 0)
+        return ret;
+    outlink->w = mainlink->w;
+    outlink->h = mainlink->h;
+    outlink->time_base = mainlink->time_base;
+    outlink->sample_aspect_ratio = mainlink->sample_aspect_ratio;
+    outlink->frame_rate = mainlink->frame_rate;
+
+    if ((ret = ff_framesync_configure(&s->fs)) < 0)
+        return ret;
+
+    return 0;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    ADMContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    ADMContext *s = ctx->priv;
+    int i;
+
+    if (s->nb_frames > 0)
+        av_log(ctx, AV_LOG_INFO, "ADM average:%f min:%f max:%f\n",
+               s->adm_sum / s->nb_frames, s->adm_min, s->adm_max);
+
+    for (i = 0; i < NB_BUFS; i++)
+        av_freep(&s->data_buf[i]);
+
+    if (s->temp)
+        for (i = 0; i < s->nb_threads; i++)
+            av_freep(&s->temp[i]);
+    av_freep(&s->temp);
+
+    for (i = 0; i < NB_BANDS; i++) {
+        av_freep(&s->row_num[i]);
+        av_freep(&s->row_den[i]);
+    }
+    av_freep(&s->fdsp);
+
+    ff_framesync_uninit(&s->fs);
+}
+
+static const AVFilterPad adm_inputs[] = {
+    {
+        .name         = "main",
+        .type         = AVMEDIA_TYPE_VIDEO,
+    },{
+        .name         = "reference",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input_ref,
+    },
+    { NULL }
+};
+
+static const AVFilterPad adm_outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_adm = {
+    .name          = "adm",
+    .description   = NULL_IF_CONFIG_SMALL("Calculate the ADM between two video streams."),
+    .preinit       = adm_framesync_preinit,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .activate      = activate,
+    .priv_size     = sizeof(ADMContext),
+    .priv_class    = &adm_class,
+    .inputs        = adm_inputs,
+    .outputs       = adm_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
+};
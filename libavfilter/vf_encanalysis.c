@@ -0,0 +1,400 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Compute the scene changes, complexity and motion statistics of the frames
+ * on a downscaled luma proxy, and attach them as AVVideoAnalysis side data
+ * for the encoders.
+ */
+
+#include "libavutil/imgutils.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixelutils.h"
+#include "libavutil/timestamp.h"
+#include "libavutil/video_analysis.h"
+#include "avfilter.h"
+#include "formats.h"
+#include "internal.h"
+#include "scene_sad.h"
+#include "video.h"
+
+#define BLOCK_SIZE 16
+
+typedef struct RowStats {
+    uint64_t frame_sad;
+    double intra_var;
+    double inter_var;
+    double motion;
+    int intra_blocks;
+} RowStats;
+
+typedef struct EncAnalysisContext {
+    const AVClass *class;
+    int proxy_width;
+    double threshold;
+    int range;
+
+    int factor;
+    int pw, ph;                     ///< dimensions of the proxy
+    int nb_brows, nb_bcols;
+    ptrdiff_t stride;
+    uint8_t *cur, *prev;
+    int have_prev;
+    double prev_mafd;
+    RowStats *rows;
+    av_pixelutils_sad_fn sad;
+    ff_scene_sad_fn scene_sad;
+} EncAnalysisContext;
+
+#define OFFSET(x) offsetof(EncAnalysisContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption encanalysis_options[] = {
+    { "width",     "set the width of the analysed picture, 0 to keep the input width",
+        OFFSET(proxy_width), AV_OPT_TYPE_INT,    {.i64=480}, 0, INT_MAX, FLAGS },
+    { "threshold", "set the scene change threshold",
+        OFFSET(threshold),   AV_OPT_TYPE_DOUBLE, {.dbl=0.4}, 0, 1,       FLAGS },
+    { "range",     "set the motion search range",
+        OFFSET(range),       AV_OPT_TYPE_INT,    {.i64=16},  1, 64,      FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(encanalysis);
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8,
+        AV_PIX_FMT_YUV410P, AV_PIX_FMT_YUV411P,
+        AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P,
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV444P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P,
+        AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_YUVJ440P,
+        AV_PIX_FMT_YUVA420P, AV_PIX_FMT_YUVA422P, AV_PIX_FMT_YUVA444P,
+        AV_PIX_FMT_NV12, AV_PIX_FMT_NV21,
+        AV_PIX_FMT_NONE
+    };
+
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    EncAnalysisContext *s = ctx->priv;
+
+    if (inlink->w < BLOCK_SIZE || inlink->h < BLOCK_SIZE) {
+        av_log(ctx, AV_LOG_ERROR, "Input must be at least %dx%d.\n", BLOCK_SIZE, BLOCK_SIZE);
+        return AVERROR(EINVAL);
+    }
+
+    s->factor = s->proxy_width ? FFMAX(1, (inlink->w + s->proxy_width - 1) / s->proxy_width) : 1;
+    s->factor = FFMIN3(s->factor, inlink->w / BLOCK_SIZE, inlink->h / BLOCK_SIZE);
+    s->pw = inlink->w / s->factor;
+    s->ph = inlink->h / s->factor;
+    s->nb_bcols = s->pw / BLOCK_SIZE;
+    s->nb_brows = s->ph / BLOCK_SIZE;
+    s->stride = FFALIGN(s->pw, 32);
+    s->have_prev = 0;
+
+    av_freep(&s->cur);
+    av_freep(&s->prev);
+    av_freep(&s->rows);
+    s->cur  = av_malloc_array(s->stride, s->ph);
+    s->prev = av_malloc_array(s->stride, s->ph);
+    s->rows = av_calloc(s->nb_brows, sizeof(*s->rows));
+    if (!s->cur || !s->prev || !s->rows)
+        return AVERROR(ENOMEM);
+
+    s->sad = av_pixelutils_get_sad_fn(4, 4, 0, ctx);
+    s->scene_sad = ff_scene_sad_get_fn(8);
+    if (!s->sad || !s->scene_sad)
+        return AVERROR(EINVAL);
+
+    av_log(ctx, AV_LOG_VERBOSE, "analysing at %dx%d\n", s->pw, s->ph);
+    return 0;
+}
+
+static void downscale(const EncAnalysisContext *s, uint8_t *dst,
+                      const uint8_t *src, ptrdiff_t src_linesize, int y0, int y1)
+{
+    const int f = s->factor, area = f * f;
+    int x, y, i, j;
+
+    for (y = y0; y < y1; y++) {
+        const uint8_t *line = src + y * f * src_linesize;
+
+        if (f == 1) {
+            memcpy(dst + y * s->stride, line, s->pw);
+            continue;
+        }
+        for (x = 0; x < s->pw; x++) {
+            int sum = 0;
+            for (j = 0; j < f; j++)
+                for (i = 0; i < f; i++)
+                    sum += line[j * src_linesize + x * f + i];
+            dst[y * s->stride + x] = (sum + area / 2) / area;
+        }
+    }
+}
+
+static double block_variance(const uint8_t *p, ptrdiff_t stride, int *mean)
+{
+    int x, y, sum = 0;
+    int64_t sum2 = 0;
+
+    for (y = 0; y < BLOCK_SIZE; y++) {
+        for (x = 0; x < BLOCK_SIZE; x++) {
+            sum  += p[x];
+            sum2 += p[x] * p[x];
+        }
+        p += stride;
+    }
+    if (mean)
+        *mean = (sum + BLOCK_SIZE * BLOCK_SIZE / 2) / (BLOCK_SIZE * BLOCK_SIZE);
+    return (sum2 - (double)sum * sum / (BLOCK_SIZE * BLOCK_SIZE)) / (BLOCK_SIZE * BLOCK_SIZE);
+}
+
+static int block_sae(const uint8_t *p, ptrdiff_t stride, int mean)
+{
+    int x, y, sae = 0;
+
+    for (y = 0; y < BLOCK_SIZE; y++) {
+        for (x = 0; x < BLOCK_SIZE; x++)
+            sae += FFABS(p[x] - mean);
+        p += stride;
+    }
+    return sae;
+}
+
+static double residual_variance(const uint8_t *a, const uint8_t *b, ptrdiff_t stride)
+{
+    int x, y, sum = 0;
+    int64_t sum2 = 0;
+
+    for (y = 0; y < BLOCK_SIZE; y++) {
+        for (x = 0; x < BLOCK_SIZE; x++) {
+            int d = a[x] - b[x];
+            sum  += d;
+            sum2 += d * d;
+        }
+        a += stride;
+        b += stride;
+    }
+    return (sum2 - (double)sum * sum / (BLOCK_SIZE * BLOCK_SIZE)) / (BLOCK_SIZE * BLOCK_SIZE);
+}
+
+/**
+ * Small diamond search around the best of the zero and left predictors.
+ */
+static int motion_search(const EncAnalysisContext *s, int bx, int by,
+                         int pred_x, int pred_y, int *mv_x, int *mv_y)
+{
+    static const int8_t diamond[4][2] = { { 0, -1 }, { -1, 0 }, { 1, 0 }, { 0, 1 } };
+    const int x = bx * BLOCK_SIZE, y = by * BLOCK_SIZE;
+    const int min_x = -FFMIN(s->range, x), max_x = FFMIN(s->range, s->pw - BLOCK_SIZE - x);
+    const int min_y = -FFMIN(s->range, y), max_y = FFMIN(s->range, s->ph - BLOCK_SIZE - y);
+    const uint8_t *cur = s->cur + y * s->stride + x;
+    const uint8_t *ref = s->prev + y * s->stride + x;
+    int best_x = 0, best_y = 0, best, i, moved;
+
+    best = s->sad(cur, s->stride, ref, s->stride);
+    pred_x = av_clip(pred_x, min_x, max_x);
+    pred_y = av_clip(pred_y, min_y, max_y);
+    if (pred_x || pred_y) {
+        int sad = s->sad(cur, s->stride, ref + pred_y * s->stride + pred_x, s->stride);
+        if (sad < best) {
+            best   = sad;
+            best_x = pred_x;
+            best_y = pred_y;
+        }
+    }
+
+    do {
+        int cx = best_x, cy = best_y;
+        moved = 0;
+        for (i = 0; i < 4; i++) {
+            int mx = cx + diamond[i][0], my = cy + diamond[i][1], sad;
+
+            if (mx < min_x || mx > max_x || my < min_y || my > max_y)
+                continue;
+            sad = s->sad(cur, s->stride, ref + my * s->stride + mx, s->stride);
+            if (sad < best) {
+                best   = sad;
+                best_x = mx;
+                best_y = my;
+                moved  = 1;
+            }
+        }
+    } while (moved);
+
+    *mv_x = best_x;
+    *mv_y = best_y;
+    return best;
+}
+
+static int analyse_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    EncAnalysisContext *s = ctx->priv;
+    const AVFrame *in = arg;
+    const int brow_start = (s->nb_brows *  jobnr     ) / nb_jobs;
+    const int brow_end   = (s->nb_brows * (jobnr + 1)) / nb_jobs;
+    /* the last job also takes the lines below the last row of blocks */
+    const int y_end = jobnr == nb_jobs - 1 ? s->ph : brow_end * BLOCK_SIZE;
+    int bx, by;
+
+    downscale(s, s->cur, in->data[0], in->linesize[0], brow_start * BLOCK_SIZE, y_end);
+
+    for (by = brow_start; by < brow_end; by++) {
+        RowStats *row = &s->rows[by];
+        const int y1 = by == brow_end - 1 ? y_end : (by + 1) * BLOCK_SIZE;
+        int pred_x = 0, pred_y = 0;
+
+        memset(row, 0, sizeof(*row));
+        if (s->have_prev) {
+            const ptrdiff_t offset = by * BLOCK_SIZE * s->stride;
+            s->scene_sad(s->prev + offset, s->stride, s->cur + offset, s->stride,
+                         s->pw, y1 - by * BLOCK_SIZE, &row->frame_sad);
+        }
+
+        for (bx = 0; bx < s->nb_bcols; bx++) {
+            const uint8_t *cur = s->cur + by * BLOCK_SIZE * s->stride + bx * BLOCK_SIZE;
+            int mean, mv_x, mv_y, sae, sad;
+            double var = block_variance(cur, s->stride, &mean);
+
+            row->intra_var += var;
+            if (!s->have_prev) {
+                row->inter_var += var;
+                row->intra_blocks++;
+                continue;
+            }
+
+            sae = block_sae(cur, s->stride, mean);
+            sad = motion_search(s, bx, by, pred_x, pred_y, &mv_x, &mv_y);
+            row->inter_var += residual_variance(cur, s->prev + (by * BLOCK_SIZE + mv_y) * s->stride +
+                                                bx * BLOCK_SIZE + mv_x, s->stride);
+            row->motion += sqrt(mv_x * mv_x + mv_y * mv_y);
+            /* same decision as the B-frame strategy of the mpegvideo encoders */
+            row->intra_blocks += sae + 500 < sad;
+            pred_x = mv_x;
+            pred_y = mv_y;
+        }
+    }
+    emms_c();
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *in)
+{
+    AVFilterContext *ctx = inlink->dst;
+    EncAnalysisContext *s = ctx->priv;
+    AVVideoAnalysis *analysis;
+    RowStats sum = { 0 };
+    const int nb_blocks = s->nb_brows * s->nb_bcols;
+    int i;
+
+    ctx->internal->execute(ctx, analyse_slice, in, NULL,
+                           FFMIN(s->nb_brows, ff_filter_get_nb_threads(ctx)));
+
+    for (i = 0; i < s->nb_brows; i++) {
+        sum.frame_sad    += s->rows[i].frame_sad;
+        sum.intra_var    += s->rows[i].intra_var;
+        sum.inter_var    += s->rows[i].inter_var;
+        sum.motion       += s->rows[i].motion;
+        sum.intra_blocks += s->rows[i].intra_blocks;
+    }
+
+    analysis = av_video_analysis_create_side_data(in);
+    if (!analysis) {
+        av_frame_free(&in);
+        return AVERROR(ENOMEM);
+    }
+    analysis->width      = s->pw;
+    analysis->height     = s->ph;
+    analysis->block_size = BLOCK_SIZE;
+    if (s->have_prev) {
+        /* same score as the select filter, on the luma plane */
+        double mafd = (double)sum.frame_sad / (s->pw * s->ph);
+        double diff = fabs(mafd - s->prev_mafd);
+
+        analysis->scene_score  = av_clipf(FFMIN(mafd, diff) / 100., 0, 1);
+        analysis->scene_change = analysis->scene_score >= s->threshold;
+        s->prev_mafd = mafd;
+    } else {
+        analysis->scene_score  = 1;
+        analysis->scene_change = 1;
+    }
+    analysis->intra_complexity = sum.intra_var / nb_blocks;
+    analysis->inter_complexity = sum.inter_var / nb_blocks;
+    analysis->intra_ratio      = (double)sum.intra_blocks / nb_blocks;
+    analysis->motion           = sum.motion / nb_blocks;
+
+    av_log(ctx, AV_LOG_DEBUG, "pts:%s scene:%f%s intra:%f inter:%f intra_ratio:%f motion:%f\n",
+           av_ts2str(in->pts), analysis->scene_score, analysis->scene_change ? " (change)" : "",
+           analysis->intra_complexity, analysis->inter_complexity,
+           analysis->intra_ratio, analysis->motion);
+
+    FFSWAP(uint8_t *, s->cur, s->prev);
+    s->have_prev = 1;
+
+    return ff_filter_frame(ctx->outputs[0], in);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    EncAnalysisContext *s = ctx->priv;
+
+    av_freep(&s->cur);
+    av_freep(&s->prev);
+    av_freep(&s->rows);
+}
+
+static const AVFilterPad encanalysis_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input,
+        .filter_frame = filter_frame,
+    },
+    { NULL }
+};
+
+static const AVFilterPad encanalysis_outputs[] = {
+    {
+        .name = "default",
+        .type = AVMEDIA_TYPE_VIDEO,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_encanalysis = {
+    .name          = "encanalysis",
+    .description   = NULL_IF_CONFIG_SMALL("Attach scene change, complexity and motion analysis for the encoders."),
+    .priv_size     = sizeof(EncAnalysisContext),
+    .priv_class    = &encanalysis_class,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .inputs        = encanalysis_inputs,
+    .outputs       = encanalysis_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
+};
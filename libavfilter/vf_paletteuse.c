@@ -27,6 +27,7 @@
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
 #include "libavutil/qsort.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "framesync.h"
@@ -46,6 +47,7 @@ enum color_search_method {
     COLOR_SEARCH_NNS_ITERATIVE,
     COLOR_SEARCH_NNS_RECURSIVE,
     COLOR_SEARCH_BRUTEFORCE,
+    COLOR_SEARCH_SMALL_PALETTE, /* internal, picked for small palettes instead of nns_iterative */
     NB_COLOR_SEARCHES
 };
 
@@ -65,6 +67,16 @@ struct color_node {
 #define NBITS 5
 #define CACHE_SIZE (1<<(3*NBITS))
 
+/* Palettes up to this size are searched with brute force rather than with the
+ * k-d tree, which only pays off for larger palettes. */
+#define BRUTEFORCE_MAX_COLORS 16
+
+/* Number of pixels a row must be ahead of the next one with pipelined error
+ * diffusion: the widest kernel (Sierra-2) spreads the error of a pixel over
+ * 2 pixels on each side in the next row. */
+#define DIFFUSION_LAG 5
+#define PROGRESS_STEP 32
+
 struct cached_color {
     uint32_t color;
     uint8_t pal_entry;
@@ -75,17 +87,31 @@ struct cache_node {
     int nb_entries;
 };
 
-struct PaletteUseContext;
+/* opaque colors of the palette, one array per component */
+struct bruteforce_palette {
+    int nb_colors;
+    int r[AVPALETTE_COUNT];
+    int g[AVPALETTE_COUNT];
+    int b[AVPALETTE_COUNT];
+    uint8_t pal_id[AVPALETTE_COUNT];
+};
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                              int x_start, int y_start, int width, int height);
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x_start, y_start;
+    int w, h;
+} ThreadData;
+
+typedef int (*set_frame_func)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup cache, CACHE_SIZE nodes per thread */
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
+    struct bruteforce_palette bf_pal;
     uint32_t palette[AVPALETTE_COUNT];
+    uint32_t input_palette[AVPALETTE_COUNT]; /* palette as received, before sorting */
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
     int trans_thresh;
     int palette_loaded;
@@ -97,6 +123,16 @@ typedef struct PaletteUseContext {
     int diff_mode;
     AVFrame *last_in;
     AVFrame *last_out;
+    int nb_threads;
+    int *rets;
+
+    /* error diffusion rows pipelined between the slice threads */
+    int pipeline;
+    int *row_progress;                      /* pixels processed in each row */
+#if HAVE_THREADS
+    pthread_mutex_t progress_lock;
+    pthread_cond_t  progress_cond;
+#endif
 
     /* debug options */
     char *dot_filename;
@@ -123,7 +159,7 @@ static const AVOption paletteuse_options[] = {
 
     /* following are the debug options, not part of the official API */
     { "debug_kdtree", "save Graphviz graph of the kdtree in specified file", OFFSET(dot_filename), AV_OPT_TYPE_STRING, {.str=NULL}, CHAR_MIN, CHAR_MAX, FLAGS },
-    { "color_search", "set reverse colormap color search method", OFFSET(color_search_method), AV_OPT_TYPE_INT, {.i64=COLOR_SEARCH_NNS_ITERATIVE}, 0, NB_COLOR_SEARCHES-1, FLAGS, "search" },
+    { "color_search", "set reverse colormap color search method", OFFSET(color_search_method), AV_OPT_TYPE_INT, {.i64=COLOR_SEARCH_NNS_ITERATIVE}, 0, COLOR_SEARCH_BRUTEFORCE, FLAGS, "search" },
         { "nns_iterative", "iterative search",             0, AV_OPT_TYPE_CONST, {.i64=COLOR_SEARCH_NNS_ITERATIVE}, INT_MIN, INT_MAX, FLAGS, "search" },
         { "nns_recursive", "recursive search",             0, AV_OPT_TYPE_CONST, {.i64=COLOR_SEARCH_NNS_RECURSIVE}, INT_MIN, INT_MAX, FLAGS, "search" },
         { "bruteforce",    "brute-force into the palette", 0, AV_OPT_TYPE_CONST, {.i64=COLOR_SEARCH_BRUTEFORCE},    INT_MIN, INT_MAX, FLAGS, "search" },
@@ -182,28 +218,25 @@ static av_always_inline int diff(const uint8_t *c1, const uint8_t *c2, const int
     }
 }
 
-static av_always_inline uint8_t colormap_nearest_bruteforce(const uint32_t *palette, const uint8_t *argb, const int trans_thresh)
+static av_always_inline uint8_t colormap_nearest_bruteforce(const struct bruteforce_palette *pal, const uint8_t *argb, const int trans_thresh)
 {
-    int i, pal_id = -1, min_dist = INT_MAX;
+    int i, best = INT_MAX;
 
-    for (i = 0; i < AVPALETTE_COUNT; i++) {
-        const uint32_t c = palette[i];
+    // all the opaque colors are at the same distance of a transparent one
+    if (argb[0] < trans_thresh)
+        return pal->nb_colors ? pal->pal_id[0] : -1;
 
-        if (c >> 24 >= trans_thresh) { // ignore transparent entry
-            const uint8_t palargb[] = {
-                palette[i]>>24 & 0xff,
-                palette[i]>>16 & 0xff,
-                palette[i]>> 8 & 0xff,
-                palette[i]     & 0xff,
-            };
-            const int d = diff(palargb, argb, trans_thresh);
-            if (d < min_dist) {
-                pal_id = i;
-                min_dist = d;
-            }
-        }
+    /* The distance and the palette index are packed in a single key, so the
+     * loop is branchless and ties resolve to the lowest index. */
+    for (i = 0; i < pal->nb_colors; i++) {
+        const int dr = pal->r[i] - argb[1];
+        const int dg = pal->g[i] - argb[2];
+        const int db = pal->b[i] - argb[3];
+        const int key = (dr*dr + dg*dg + db*db) << 8 | pal->pal_id[i];
+
+        best = FFMIN(best, key);
     }
-    return pal_id;
+    return best & 0xff;
 }
 
 /* Recursive form, simpler but a bit slower. Kept for reference. */
@@ -327,10 +360,42 @@ end:
     return root[best_node_id].palette_id;
 }
 
-#define COLORMAP_NEAREST(search, palette, root, target, trans_thresh)                                    \
+/**
+ * Brute force search for small palettes, returning the same entry as the
+ * k-d tree. Among equidistant colors, the tree picks the first one met while
+ * walking it, which depends on its layout, so the tree is searched whenever
+ * the nearest color is not unique.
+ */
+static av_always_inline uint8_t colormap_nearest_small(const struct bruteforce_palette *pal, const struct color_node *root,
+                                                       const uint8_t *argb, const int trans_thresh)
+{
+    int i, dist[BRUTEFORCE_MAX_COLORS], best = INT_MAX, nb_best = 0;
+
+    if (argb[0] < trans_thresh)
+        return colormap_nearest_iterative(root, argb, trans_thresh);
+
+    for (i = 0; i < pal->nb_colors; i++) {
+        const int dr = pal->r[i] - argb[1];
+        const int dg = pal->g[i] - argb[2];
+        const int db = pal->b[i] - argb[3];
+
+        dist[i] = dr*dr + dg*dg + db*db;
+        best = FFMIN(best, dist[i] << 8 | pal->pal_id[i]);
+    }
+    for (i = 0; i < pal->nb_colors; i++)
+        nb_best += dist[i] == best >> 8;
+
+    // transparent entries of the tree are at the largest possible distance
+    if (nb_best != 1 || best >> 8 >= 255*255 + 255*255 + 255*255)
+        return colormap_nearest_iterative(root, argb, trans_thresh);
+    return best & 0xff;
+}
+
+#define COLORMAP_NEAREST(search, bf_pal, root, target, trans_thresh)                                     \
     search == COLOR_SEARCH_NNS_ITERATIVE ? colormap_nearest_iterative(root, target, trans_thresh) :      \
     search == COLOR_SEARCH_NNS_RECURSIVE ? colormap_nearest_recursive(root, target, trans_thresh) :      \
-                                           colormap_nearest_bruteforce(palette, target, trans_thresh)
+    search == COLOR_SEARCH_SMALL_PALETTE ? colormap_nearest_small(bf_pal, root, target, trans_thresh) :  \
+                                           colormap_nearest_bruteforce(bf_pal, target, trans_thresh)
 
 /**
  * Check if the requested color is in the cache already. If not, find it in the
@@ -338,7 +403,8 @@ end:
  * Note: a, r, g, and b are the components of color, but are passed as well to avoid
  * recomputing them (they are generally computed by the caller for other uses).
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color,
                                       uint8_t a, uint8_t r, uint8_t g, uint8_t b,
                                       const enum color_search_method search_method)
 {
@@ -348,7 +414,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     const uint8_t ghash = g & ((1<<NBITS)-1);
     const uint8_t bhash = b & ((1<<NBITS)-1);
     const unsigned hash = rhash<<(NBITS*2) | ghash<<NBITS | bhash;
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -367,12 +433,12 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     if (!e)
         return AVERROR(ENOMEM);
     e->color = color;
-    e->pal_entry = COLORMAP_NEAREST(search_method, s->palette, s->map, argb_elts, s->trans_thresh);
+    e->pal_entry = COLORMAP_NEAREST(search_method, &s->bf_pal, s->map, argb_elts, s->trans_thresh);
 
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
 {
@@ -381,7 +447,7 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
     uint32_t dstc;
-    const int dstx = color_get(s, c, a, r, g, b, search_method);
+    const int dstx = color_get(s, cache, c, a, r, g, b, search_method);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -391,24 +457,73 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                                      int x_start, int y_start, int w, int h,
+static int await_progress(PaletteUseContext *s, int y, int x)
+{
+    int progress;
+
+#if HAVE_THREADS
+    pthread_mutex_lock(&s->progress_lock);
+    while ((progress = s->row_progress[y]) < x)
+        pthread_cond_wait(&s->progress_cond, &s->progress_lock);
+    pthread_mutex_unlock(&s->progress_lock);
+#else
+    progress = s->row_progress[y];
+#endif
+    return progress;
+}
+
+static void report_progress(PaletteUseContext *s, int y, int x)
+{
+#if HAVE_THREADS
+    pthread_mutex_lock(&s->progress_lock);
+    s->row_progress[y] = x;
+    pthread_cond_broadcast(&s->progress_cond);
+    pthread_mutex_unlock(&s->progress_lock);
+#else
+    s->row_progress[y] = x;
+#endif
+}
+
+static av_always_inline int set_frame(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs,
                                       enum dithering_mode dither,
                                       const enum color_search_method search_method)
 {
-    int x, y;
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    struct cache_node *cache = s->cache + jobnr * CACHE_SIZE;
+    const int pipeline = nb_jobs > 1 && dither != DITHERING_NONE && dither != DITHERING_BAYER;
+    const int x_start = td->x_start;
+    const int w = td->x_start + td->w;
+    const int h = td->y_start + td->h;
     const int src_linesize = in ->linesize[0] >> 2;
     const int dst_linesize = out->linesize[0];
-    uint32_t *src = ((uint32_t *)in ->data[0]) + y_start*src_linesize;
-    uint8_t  *dst =              out->data[0]  + y_start*dst_linesize;
+    int x, y, y_end, y_step, ret = 0;
+
+    if (pipeline) {
+        /* The rows are interleaved between the jobs, each row following the
+         * previous one DIFFUSION_LAG pixels behind, so the error diffused in
+         * it is the same as with a sequential scan. */
+        y      = td->y_start + jobnr;
+        y_end  = h;
+        y_step = nb_jobs;
+    } else {
+        y      = td->y_start + (td->h *  jobnr   ) / nb_jobs;
+        y_end  = td->y_start + (td->h * (jobnr+1)) / nb_jobs;
+        y_step = 1;
+    }
 
-    w += x_start;
-    h += y_start;
+    for (; y < y_end; y += y_step) {
+        uint32_t *src = (uint32_t *)in->data[0] + y*src_linesize;
+        uint8_t  *dst =             out->data[0] + y*dst_linesize;
+        int avail = pipeline && y > td->y_start ? x_start : w;
 
-    for (y = y_start; y < h; y++) {
         for (x = x_start; x < w; x++) {
             int er, eg, eb;
 
+            if (avail < FFMIN(x + DIFFUSION_LAG, w))
+                avail = await_progress(s, y - 1, FFMIN(x + DIFFUSION_LAG, w));
+
             if (dither == DITHERING_BAYER) {
                 const int d = s->ordered_dither[(y & 7)<<3 | (x & 7)];
                 const uint8_t a8 = src[x] >> 24 & 0xff;
@@ -418,18 +533,22 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const int color = color_get(s, src[x], a8, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a8, r, g, b, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
 
                 if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 3, 3);
@@ -438,10 +557,12 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
 
                 if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 7, 4);
@@ -452,10 +573,12 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
 
                 if (right)          src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 4, 4);
@@ -471,10 +594,12 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
 
                 if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 2, 2);
@@ -486,19 +611,67 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(s, src[x], a, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a, r, g, b, search_method);
 
-                if (color < 0)
-                    return color;
+                if (color < 0) {
+                    ret = color;
+                    goto end;
+                }
                 dst[x] = color;
             }
+
+            if (pipeline && !((x + 1) % PROGRESS_STEP))
+                report_progress(s, y, x + 1);
         }
-        src += src_linesize;
-        dst += dst_linesize;
+        if (pipeline)
+            report_progress(s, y, w);
     }
-    return 0;
+
+end:
+    if (pipeline) {
+        /* do not leave the next rows waiting on the ones which failed */
+        for (; y < y_end; y += y_step)
+            report_progress(s, y, w);
+    }
+    return ret;
+}
+
+#define DEFINE_SET_FRAME(color_search, name, value)                             \
+static int set_frame_##name(AVFilterContext *ctx, void *arg,                    \
+                            int jobnr, int nb_jobs)                             \
+{                                                                               \
+    return set_frame(ctx, arg, jobnr, nb_jobs, value, color_search);            \
+}
+
+#define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##none,            DITHERING_NONE)              \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##bayer,           DITHERING_BAYER)             \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##heckbert,        DITHERING_HECKBERT)          \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##floyd_steinberg, DITHERING_FLOYD_STEINBERG)   \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##sierra2,         DITHERING_SIERRA2)           \
+    DEFINE_SET_FRAME(color_search_macro, color_search##_##sierra2_4a,      DITHERING_SIERRA2_4A)        \
+
+DEFINE_SET_FRAME_COLOR_SEARCH(nns_iterative, COLOR_SEARCH_NNS_ITERATIVE)
+DEFINE_SET_FRAME_COLOR_SEARCH(nns_recursive, COLOR_SEARCH_NNS_RECURSIVE)
+DEFINE_SET_FRAME_COLOR_SEARCH(bruteforce,    COLOR_SEARCH_BRUTEFORCE)
+DEFINE_SET_FRAME_COLOR_SEARCH(small_palette, COLOR_SEARCH_SMALL_PALETTE)
+
+#define DITHERING_ENTRIES(color_search) {       \
+    set_frame_##color_search##_none,            \
+    set_frame_##color_search##_bayer,           \
+    set_frame_##color_search##_heckbert,        \
+    set_frame_##color_search##_floyd_steinberg, \
+    set_frame_##color_search##_sierra2,         \
+    set_frame_##color_search##_sierra2_4a,      \
 }
 
+static const set_frame_func set_frame_lut[NB_COLOR_SEARCHES][NB_DITHERING] = {
+    DITHERING_ENTRIES(nns_iterative),
+    DITHERING_ENTRIES(nns_recursive),
+    DITHERING_ENTRIES(bruteforce),
+    DITHERING_ENTRIES(small_palette),
+};
+
 #define INDENT 4
 static void disp_node(AVBPrint *buf,
                       const struct color_node *map,
@@ -554,7 +727,8 @@ static int disp_tree(const struct color_node *node, const char *fname)
     return 0;
 }
 
-static int debug_accuracy(const struct color_node *node, const uint32_t *palette, const int trans_thresh,
+static int debug_accuracy(const struct color_node *node, const uint32_t *palette,
+                          const struct bruteforce_palette *bf_pal, const int trans_thresh,
                           const enum color_search_method search_method)
 {
     int r, g, b, ret = 0;
@@ -563,8 +737,8 @@ static int debug_accuracy(const struct color_node *node, const uint32_t *palette
         for (g = 0; g < 256; g++) {
             for (b = 0; b < 256; b++) {
                 const uint8_t argb[] = {0xff, r, g, b};
-                const int r1 = COLORMAP_NEAREST(search_method, palette, node, argb, trans_thresh);
-                const int r2 = colormap_nearest_bruteforce(palette, argb, trans_thresh);
+                const int r1 = COLORMAP_NEAREST(search_method, bf_pal, node, argb, trans_thresh);
+                const int r2 = colormap_nearest_bruteforce(bf_pal, argb, trans_thresh);
                 if (r1 != r2) {
                     const uint32_t c1 = palette[r1];
                     const uint32_t c2 = palette[r2];
@@ -766,13 +940,33 @@ static void load_colormap(PaletteUseContext *s)
 
     colormap_insert(s->map, color_used, &nb_used, s->palette, s->trans_thresh, &box);
 
+    s->bf_pal.nb_colors = 0;
+    for (i = 0; i < AVPALETTE_COUNT; i++) {
+        const uint32_t c = s->palette[i];
+        const int n = s->bf_pal.nb_colors;
+
+        if (c >> 24 < s->trans_thresh || (i && c == s->palette[i - 1]))
+            continue;
+        s->bf_pal.r[n]      = c >> 16 & 0xff;
+        s->bf_pal.g[n]      = c >>  8 & 0xff;
+        s->bf_pal.b[n]      = c       & 0xff;
+        s->bf_pal.pal_id[n] = i;
+        s->bf_pal.nb_colors++;
+    }
+
     if (s->dot_filename)
         disp_tree(s->map, s->dot_filename);
 
     if (s->debug_accuracy) {
-        if (!debug_accuracy(s->map, s->palette, s->trans_thresh, s->color_search_method))
+        if (!debug_accuracy(s->map, s->palette, &s->bf_pal, s->trans_thresh, s->color_search_method))
             av_log(NULL, AV_LOG_INFO, "Accuracy check passed\n");
     }
+
+    if (s->color_search_method == COLOR_SEARCH_NNS_ITERATIVE &&
+        s->bf_pal.nb_colors <= BRUTEFORCE_MAX_COLORS)
+        s->set_frame = set_frame_lut[COLOR_SEARCH_SMALL_PALETTE][s->dither];
+    else
+        s->set_frame = set_frame_lut[s->color_search_method][s->dither];
 }
 
 static void debug_mean_error(PaletteUseContext *s, const AVFrame *in1,
@@ -896,10 +1090,11 @@ static void set_processing_window(enum diff_mode diff_mode,
 
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
-    int x, y, w, h, ret;
+    int i, x, y, w, h, nb_jobs, ret = 0;
     AVFilterContext *ctx = inlink->dst;
     PaletteUseContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
+    ThreadData td;
 
     AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -925,7 +1120,23 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    td.in      = in;
+    td.out     = out;
+    td.x_start = x;
+    td.y_start = y;
+    td.w       = w;
+    td.h       = h;
+
+    nb_jobs = FFMIN(h, s->nb_threads);
+    if (s->dither != DITHERING_NONE && s->dither != DITHERING_BAYER) {
+        if (!s->pipeline)
+            nb_jobs = 1;
+        for (i = y; i < y + h; i++)
+            s->row_progress[i] = x;
+    }
+    ctx->internal->execute(ctx, s->set_frame, &td, s->rets, nb_jobs);
+    for (i = 0; i < nb_jobs; i++)
+        ret = FFMIN(ret, s->rets[i]);
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -958,6 +1169,16 @@ static int config_output(AVFilterLink *outlink)
     outlink->time_base = ctx->inputs[0]->time_base;
     if ((ret = ff_framesync_configure(&s->fs)) < 0)
         return ret;
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->pipeline = HAVE_THREADS && s->nb_threads > 1 &&
+                  ctx->thread_type & AVFILTER_THREAD_SLICE && !ctx->graph->execute;
+
+    s->cache = av_calloc(s->nb_threads * CACHE_SIZE, sizeof(*s->cache));
+    s->rets = av_calloc(s->nb_threads, sizeof(*s->rets));
+    s->row_progress = av_calloc(outlink->h, sizeof(*s->row_progress));
+    if (!s->cache || !s->rets || !s->row_progress)
+        return AVERROR(ENOMEM);
     return 0;
 }
 
@@ -981,33 +1202,40 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     int i, x, y;
     const uint32_t *p = (const uint32_t *)palette_frame->data[0];
     const int p_linesize = palette_frame->linesize[0] >> 2;
-
-    s->transparency_index = -1;
-
-    if (s->new) {
-        memset(s->palette, 0, sizeof(s->palette));
-        memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
-            av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
-    }
+    uint32_t palette[AVPALETTE_COUNT];
+    int transparency_index = -1;
 
     i = 0;
     for (y = 0; y < palette_frame->height; y++) {
         for (x = 0; x < palette_frame->width; x++) {
-            s->palette[i] = p[x];
+            palette[i] = p[x];
             if (p[x]>>24 < s->trans_thresh) {
-                s->transparency_index = i; // we are assuming at most one transparent color in palette
+                transparency_index = i; // we are assuming at most one transparent color in palette
             }
             i++;
         }
         p += p_linesize;
     }
 
+    /* With a new palette for each frame, the colormap and the lookup cache
+     * stay valid as long as the palette does not actually change. */
+    if (s->palette_loaded) {
+        if (!memcmp(palette, s->input_palette, sizeof(palette)))
+            return;
+        memset(s->map, 0, sizeof(s->map));
+        for (i = 0; i < s->nb_threads * CACHE_SIZE; i++) {
+            av_freep(&s->cache[i].entries);
+            s->cache[i].nb_entries = 0;
+        }
+    }
+
+    memcpy(s->input_palette, palette, sizeof(palette));
+    memcpy(s->palette, palette, sizeof(palette));
+    s->transparency_index = transparency_index;
+
     load_colormap(s);
 
-    if (!s->new)
-        s->palette_loaded = 1;
+    s->palette_loaded = 1;
 }
 
 static int load_apply_palette(FFFrameSync *fs)
@@ -1026,7 +1254,7 @@ static int load_apply_palette(FFFrameSync *fs)
         ret = AVERROR_BUG;
         goto error;
     }
-    if (!s->palette_loaded) {
+    if (!s->palette_loaded || s->new) {
         load_palette(s, second);
     }
     ret = apply_palette(inlink, master, &out);
@@ -1039,40 +1267,6 @@ error:
     return ret;
 }
 
-#define DEFINE_SET_FRAME(color_search, name, value)                             \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
-                            int x_start, int y_start, int w, int h)             \
-{                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value, color_search);  \
-}
-
-#define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##none,            DITHERING_NONE)              \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##bayer,           DITHERING_BAYER)             \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##heckbert,        DITHERING_HECKBERT)          \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##floyd_steinberg, DITHERING_FLOYD_STEINBERG)   \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##sierra2,         DITHERING_SIERRA2)           \
-    DEFINE_SET_FRAME(color_search_macro, color_search##_##sierra2_4a,      DITHERING_SIERRA2_4A)        \
-
-DEFINE_SET_FRAME_COLOR_SEARCH(nns_iterative, COLOR_SEARCH_NNS_ITERATIVE)
-DEFINE_SET_FRAME_COLOR_SEARCH(nns_recursive, COLOR_SEARCH_NNS_RECURSIVE)
-DEFINE_SET_FRAME_COLOR_SEARCH(bruteforce,    COLOR_SEARCH_BRUTEFORCE)
-
-#define DITHERING_ENTRIES(color_search) {       \
-    set_frame_##color_search##_none,            \
-    set_frame_##color_search##_bayer,           \
-    set_frame_##color_search##_heckbert,        \
-    set_frame_##color_search##_floyd_steinberg, \
-    set_frame_##color_search##_sierra2,         \
-    set_frame_##color_search##_sierra2_4a,      \
-}
-
-static const set_frame_func set_frame_lut[NB_COLOR_SEARCHES][NB_DITHERING] = {
-    DITHERING_ENTRIES(nns_iterative),
-    DITHERING_ENTRIES(nns_recursive),
-    DITHERING_ENTRIES(bruteforce),
-};
-
 static int dither_value(int p)
 {
     const int q = p ^ (p >> 3);
@@ -1085,6 +1279,11 @@ static av_cold int init(AVFilterContext *ctx)
 {
     PaletteUseContext *s = ctx->priv;
 
+#if HAVE_THREADS
+    pthread_mutex_init(&s->progress_lock, NULL);
+    pthread_cond_init(&s->progress_cond, NULL);
+#endif
+
     s->last_in  = av_frame_alloc();
     s->last_out = av_frame_alloc();
     if (!s->last_in || !s->last_out) {
@@ -1093,8 +1292,6 @@ static av_cold int init(AVFilterContext *ctx)
         return AVERROR(ENOMEM);
     }
 
-    s->set_frame = set_frame_lut[s->color_search_method][s->dither];
-
     if (s->dither == DITHERING_BAYER) {
         int i;
         const int delta = 1 << (5 - s->bayer_scale); // to avoid too much luma
@@ -1118,10 +1315,18 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    if (s->cache)
+        for (i = 0; i < s->nb_threads * CACHE_SIZE; i++)
+            av_freep(&s->cache[i].entries);
+    av_freep(&s->cache);
+    av_freep(&s->rets);
+    av_freep(&s->row_progress);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
+#if HAVE_THREADS
+    pthread_mutex_destroy(&s->progress_lock);
+    pthread_cond_destroy(&s->progress_cond);
+#endif
 }
 
 static const AVFilterPad paletteuse_inputs[] = {
@@ -1156,4 +1361,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
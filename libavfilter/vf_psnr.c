@@ -26,6 +26,8 @@
  */
 
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
@@ -36,6 +38,13 @@
 #include "psnr.h"
 #include "video.h"
 
+enum StatsFormat {
+    STATS_FORMAT_TEXT,
+    STATS_FORMAT_CSV,
+    STATS_FORMAT_BINARY,
+    NB_STATS_FORMATS
+};
+
 typedef struct PSNRContext {
     const AVClass *class;
     FFFrameSync fs;
@@ -44,6 +53,7 @@ typedef struct PSNRContext {
     FILE *stats_file;
     char *stats_file_str;
     int stats_version;
+    int stats_format;
     int stats_header_written;
     int stats_add_max;
     int max[4], average_max;
@@ -54,6 +64,7 @@ typedef struct PSNRContext {
     int planewidth[4];
     int planeheight[4];
     double planeweight[4];
+    uint64_t (*score)[4];   ///< per-job squared error sums
     PSNRDSPContext dsp;
 } PSNRContext;
 
@@ -65,6 +76,10 @@ static const AVOption psnr_options[] = {
     {"f",          "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
     {"stats_version", "Set the format version for the stats file.",               OFFSET(stats_version),  AV_OPT_TYPE_INT,    {.i64=1},    1, 2, FLAGS },
     {"output_max",  "Add raw stats (max values) to the output log.",            OFFSET(stats_add_max), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS},
+    {"stats_format", "Set the format of the stats file.",                       OFFSET(stats_format), AV_OPT_TYPE_INT, {.i64=STATS_FORMAT_TEXT}, 0, NB_STATS_FORMATS-1, FLAGS, "stats_format" },
+        {"text",   "key:value pairs, one line per frame", 0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_TEXT},   0, 0, FLAGS, "stats_format" },
+        {"csv",    "comma separated values",              0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_CSV},    0, 0, FLAGS, "stats_format" },
+        {"binary", "fixed size little-endian records",    0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_BINARY}, 0, 0, FLAGS, "stats_format" },
     { NULL }
 };
 
@@ -104,29 +119,40 @@ static uint64_t sse_line_16bit(const uint8_t *_main_line, const uint8_t *_ref_li
     return m2;
 }
 
-static inline
-void compute_images_mse(PSNRContext *s,
-                        const uint8_t *main_data[4], const int main_linesizes[4],
-                        const uint8_t *ref_data[4], const int ref_linesizes[4],
-                        int w, int h, double mse[4])
+typedef struct ThreadData {
+    const uint8_t *main_data[4];
+    const uint8_t *ref_data[4];
+    int main_linesize[4];
+    int ref_linesize[4];
+} ThreadData;
+
+static int compute_images_mse(AVFilterContext *ctx, void *arg,
+                              int jobnr, int nb_jobs)
 {
+    PSNRContext *s = ctx->priv;
+    ThreadData *td = arg;
+    uint64_t *score = s->score[jobnr];
     int i, c;
 
     for (c = 0; c < s->nb_components; c++) {
         const int outw = s->planewidth[c];
         const int outh = s->planeheight[c];
-        const uint8_t *main_line = main_data[c];
-        const uint8_t *ref_line = ref_data[c];
-        const int ref_linesize = ref_linesizes[c];
-        const int main_linesize = main_linesizes[c];
+        const int slice_start = (outh *  jobnr     ) / nb_jobs;
+        const int slice_end   = (outh * (jobnr + 1)) / nb_jobs;
+        const int ref_linesize = td->ref_linesize[c];
+        const int main_linesize = td->main_linesize[c];
+        const uint8_t *main_line = td->main_data[c] + main_linesize * slice_start;
+        const uint8_t *ref_line = td->ref_data[c] + ref_linesize * slice_start;
         uint64_t m = 0;
-        for (i = 0; i < outh; i++) {
+        for (i = slice_start; i < slice_end; i++) {
             m += s->dsp.sse_line(main_line, ref_line, outw);
             ref_line += ref_linesize;
             main_line += main_linesize;
         }
-        mse[c] = m / (double)(outw * outh);
+        score[c] = m;
     }
+
+    return 0;
 }
 
 static void set_meta(AVDictionary **metadata, const char *key, char comp, float d)
@@ -142,14 +168,127 @@ static void set_meta(AVDictionary **metadata, const char *key, char comp, float
     }
 }
 
+static void write_stats(PSNRContext *s, double mse, const double comp_mse[4])
+{
+    int j, c;
+
+    if (s->stats_format == STATS_FORMAT_BINARY) {
+        uint8_t buf[8 * 16], *p = buf;
+
+        AV_WL64(p, s->nb_frames); p += 8;
+        AV_WL64(p, av_double2int(mse)); p += 8;
+        for (j = 0; j < s->nb_components; j++) {
+            c = s->is_rgb ? s->rgba_map[j] : j;
+            AV_WL64(p, av_double2int(comp_mse[c])); p += 8;
+        }
+        AV_WL64(p, av_double2int(get_psnr(mse, 1, s->average_max))); p += 8;
+        for (j = 0; j < s->nb_components; j++) {
+            c = s->is_rgb ? s->rgba_map[j] : j;
+            AV_WL64(p, av_double2int(get_psnr(comp_mse[c], 1, s->max[c]))); p += 8;
+        }
+        if (s->stats_add_max) {
+            AV_WL64(p, s->average_max); p += 8;
+            for (j = 0; j < s->nb_components; j++) {
+                c = s->is_rgb ? s->rgba_map[j] : j;
+                AV_WL64(p, s->max[c]); p += 8;
+            }
+        }
+        fwrite(buf, 1, p - buf, s->stats_file);
+        return;
+    }
+
+    if (s->stats_format == STATS_FORMAT_CSV) {
+        AVBPrint bp;
+
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+        if (!s->stats_header_written) {
+            av_bprintf(&bp, "n,mse_avg");
+            for (j = 0; j < s->nb_components; j++)
+                av_bprintf(&bp, ",mse_%c", s->comps[j]);
+            av_bprintf(&bp, ",psnr_avg");
+            for (j = 0; j < s->nb_components; j++)
+                av_bprintf(&bp, ",psnr_%c", s->comps[j]);
+            if (s->stats_add_max) {
+                av_bprintf(&bp, ",max_avg");
+                for (j = 0; j < s->nb_components; j++)
+                    av_bprintf(&bp, ",max_%c", s->comps[j]);
+            }
+            av_bprintf(&bp, "\n");
+            s->stats_header_written = 1;
+        }
+        av_bprintf(&bp, "%"PRId64",%0.2f", s->nb_frames, mse);
+        for (j = 0; j < s->nb_components; j++) {
+            c = s->is_rgb ? s->rgba_map[j] : j;
+            av_bprintf(&bp, ",%0.2f", comp_mse[c]);
+        }
+        av_bprintf(&bp, ",%0.2f", get_psnr(mse, 1, s->average_max));
+        for (j = 0; j < s->nb_components; j++) {
+            c = s->is_rgb ? s->rgba_map[j] : j;
+            av_bprintf(&bp, ",%0.2f", get_psnr(comp_mse[c], 1, s->max[c]));
+        }
+        if (s->stats_add_max) {
+            av_bprintf(&bp, ",%d", s->average_max);
+            for (j = 0; j < s->nb_components; j++) {
+                c = s->is_rgb ? s->rgba_map[j] : j;
+                av_bprintf(&bp, ",%d", s->max[c]);
+            }
+        }
+        av_bprintf(&bp, "\n");
+        fwrite(bp.str, 1, bp.len, s->stats_file);
+        av_bprint_finalize(&bp, NULL);
+        return;
+    }
+
+    if (s->stats_version == 2 && !s->stats_header_written) {
+        fprintf(s->stats_file, "psnr_log_version:2 fields:n");
+        fprintf(s->stats_file, ",mse_avg");
+        for (j = 0; j < s->nb_components; j++) {
+            fprintf(s->stats_file, ",mse_%c", s->comps[j]);
+        }
+        fprintf(s->stats_file, ",psnr_avg");
+        for (j = 0; j < s->nb_components; j++) {
+            fprintf(s->stats_file, ",psnr_%c", s->comps[j]);
+        }
+        if (s->stats_add_max) {
+            fprintf(s->stats_file, ",max_avg");
+            for (j = 0; j < s->nb_components; j++) {
+                fprintf(s->stats_file, ",max_%c", s->comps[j]);
+            }
+        }
+        fprintf(s->stats_file, "\n");
+        s->stats_header_written = 1;
+    }
+    fprintf(s->stats_file, "n:%"PRId64" mse_avg:%0.2f ", s->nb_frames, mse);
+    for (j = 0; j < s->nb_components; j++) {
+        c = s->is_rgb ? s->rgba_map[j] : j;
+        fprintf(s->stats_file, "mse_%c:%0.2f ", s->comps[j], comp_mse[c]);
+    }
+    fprintf(s->stats_file, "psnr_avg:%0.2f ", get_psnr(mse, 1, s->average_max));
+    for (j = 0; j < s->nb_components; j++) {
+        c = s->is_rgb ? s->rgba_map[j] : j;
+        fprintf(s->stats_file, "psnr_%c:%0.2f ", s->comps[j],
+                get_psnr(comp_mse[c], 1, s->max[c]));
+    }
+    if (s->stats_version == 2 && s->stats_add_max) {
+        fprintf(s->stats_file, "max_avg:%d ", s->average_max);
+        for (j = 0; j < s->nb_components; j++) {
+            c = s->is_rgb ? s->rgba_map[j] : j;
+            fprintf(s->stats_file, "max_%c:%d ", s->comps[j], s->max[c]);
+        }
+    }
+    fprintf(s->stats_file, "\n");
+}
+
 static int do_psnr(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
     PSNRContext *s = ctx->priv;
     AVFrame *master, *ref;
     double comp_mse[4], mse = 0;
-    int ret, j, c;
+    uint64_t comp_sum[4] = { 0 };
+    int ret, j, c, nb_jobs;
     AVDictionary **metadata;
+    ThreadData td;
 
     ret = ff_framesync_dualinput_get(fs, &master, &ref);
     if (ret < 0)
@@ -158,9 +297,22 @@ static int do_psnr(FFFrameSync *fs)
         return ff_filter_frame(ctx->outputs[0], master);
     metadata = &master->metadata;
 
-    compute_images_mse(s, (const uint8_t **)master->data, master->linesize,
-                          (const uint8_t **)ref->data, ref->linesize,
-                          master->width, master->height, comp_mse);
+    for (c = 0; c < s->nb_components; c++) {
+        td.main_data[c] = master->data[c];
+        td.main_linesize[c] = master->linesize[c];
+        td.ref_data[c] = ref->data[c];
+        td.ref_linesize[c] = ref->linesize[c];
+    }
+
+    nb_jobs = FFMIN(s->planeheight[1], ff_filter_get_nb_threads(ctx));
+    ctx->internal->execute(ctx, compute_images_mse, &td, NULL, nb_jobs);
+
+    for (j = 0; j < nb_jobs; j++)
+        for (c = 0; c < s->nb_components; c++)
+            comp_sum[c] += s->score[j][c];
+
+    for (c = 0; c < s->nb_components; c++)
+        comp_mse[c] = comp_sum[c] / (double)(s->planewidth[c] * s->planeheight[c]);
 
     for (j = 0; j < s->nb_components; j++)
         mse += comp_mse[j] * s->planeweight[j];
@@ -181,46 +333,8 @@ static int do_psnr(FFFrameSync *fs)
     set_meta(metadata, "lavfi.psnr.mse_avg", 0, mse);
     set_meta(metadata, "lavfi.psnr.psnr_avg", 0, get_psnr(mse, 1, s->average_max));
 
-    if (s->stats_file) {
-        if (s->stats_version == 2 && !s->stats_header_written) {
-            fprintf(s->stats_file, "psnr_log_version:2 fields:n");
-            fprintf(s->stats_file, ",mse_avg");
-            for (j = 0; j < s->nb_components; j++) {
-                fprintf(s->stats_file, ",mse_%c", s->comps[j]);
-            }
-            fprintf(s->stats_file, ",psnr_avg");
-            for (j = 0; j < s->nb_components; j++) {
-                fprintf(s->stats_file, ",psnr_%c", s->comps[j]);
-            }
-            if (s->stats_add_max) {
-                fprintf(s->stats_file, ",max_avg");
-                for (j = 0; j < s->nb_components; j++) {
-                    fprintf(s->stats_file, ",max_%c", s->comps[j]);
-                }
-            }
-            fprintf(s->stats_file, "\n");
-            s->stats_header_written = 1;
-        }
-        fprintf(s->stats_file, "n:%"PRId64" mse_avg:%0.2f ", s->nb_frames, mse);
-        for (j = 0; j < s->nb_components; j++) {
-            c = s->is_rgb ? s->rgba_map[j] : j;
-            fprintf(s->stats_file, "mse_%c:%0.2f ", s->comps[j], comp_mse[c]);
-        }
-        fprintf(s->stats_file, "psnr_avg:%0.2f ", get_psnr(mse, 1, s->average_max));
-        for (j = 0; j < s->nb_components; j++) {
-            c = s->is_rgb ? s->rgba_map[j] : j;
-            fprintf(s->stats_file, "psnr_%c:%0.2f ", s->comps[j],
-                    get_psnr(comp_mse[c], 1, s->max[c]));
-        }
-        if (s->stats_version == 2 && s->stats_add_max) {
-            fprintf(s->stats_file, "max_avg:%d ", s->average_max);
-            for (j = 0; j < s->nb_components; j++) {
-                c = s->is_rgb ? s->rgba_map[j] : j;
-                fprintf(s->stats_file, "max_%c:%d ", s->comps[j], s->max[c]);
-            }
-        }
-        fprintf(s->stats_file, "\n");
-    }
+    if (s->stats_file)
+        write_stats(s, mse, comp_mse);
 
     return ff_filter_frame(ctx->outputs[0], master);
 }
@@ -233,7 +347,7 @@ static av_cold int init(AVFilterContext *ctx)
     s->max_mse = -INFINITY;
 
     if (s->stats_file_str) {
-        if (s->stats_version < 2 && s->stats_add_max) {
+        if (s->stats_version < 2 && s->stats_format == STATS_FORMAT_TEXT && s->stats_add_max) {
             av_log(ctx, AV_LOG_ERROR,
                 "stats_add_max was specified but stats_version < 2.\n" );
             return AVERROR(EINVAL);
@@ -241,7 +355,7 @@ static av_cold int init(AVFilterContext *ctx)
         if (!strcmp(s->stats_file_str, "-")) {
             s->stats_file = stdout;
         } else {
-            s->stats_file = fopen(s->stats_file_str, "w");
+            s->stats_file = fopen(s->stats_file_str, s->stats_format == STATS_FORMAT_BINARY ? "wb" : "w");
             if (!s->stats_file) {
                 int err = AVERROR(errno);
                 char buf[128];
@@ -325,6 +439,11 @@ static int config_input_ref(AVFilterLink *inlink)
     }
     s->average_max = lrint(average_max);
 
+    av_freep(&s->score);
+    s->score = av_calloc(ff_filter_get_nb_threads(ctx), sizeof(*s->score));
+    if (!s->score)
+        return AVERROR(ENOMEM);
+
     s->dsp.sse_line = desc->comp[0].depth > 8 ? sse_line_16bit : sse_line_8bit;
     if (ARCH_X86)
         ff_psnr_init_x86(&s->dsp, desc->comp[0].depth);
@@ -384,6 +503,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     if (s->stats_file && s->stats_file != stdout)
         fclose(s->stats_file);
+
+    av_freep(&s->score);
 }
 
 static const AVFilterPad psnr_inputs[] = {
@@ -419,4 +540,5 @@ AVFilter ff_vf_psnr = {
     .priv_class    = &psnr_class,
     .inputs        = psnr_inputs,
     .outputs       = psnr_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
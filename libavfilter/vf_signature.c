@@ -25,16 +25,19 @@
  */
 
 #include <float.h>
+#include "libavcodec/get_bits.h"
 #include "libavcodec/put_bits.h"
 #include "libavformat/avformat.h"
 #include "libavutil/opt.h"
 #include "libavutil/avstring.h"
+#include "libavutil/file.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/timestamp.h"
 #include "avfilter.h"
 #include "internal.h"
 #include "signature.h"
 #include "signature_lookup.c"
+#include "signature_index.c"
 
 #define OFFSET(x) offsetof(SignatureContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM | AV_OPT_FLAG_VIDEO_PARAM
@@ -64,6 +67,14 @@ static const AVOption signature_options[] = {
         OFFSET(thdi),         AV_OPT_TYPE_INT,    {.i64 = 0},        0, INT_MAX,          FLAGS },
     { "th_it",      "threshold for relation of good to all frames",
         OFFSET(thit),         AV_OPT_TYPE_DOUBLE, {.dbl = 0.5},    0.0, 1.0,              FLAGS },
+    { "index",      "index of reference signatures to look the inputs up in",
+        OFFSET(index_filename), AV_OPT_TYPE_STRING, {.str = NULL},   0, 0,                FLAGS },
+    { "index_write", "append the signatures of the inputs to the index",
+        OFFSET(index_write),  AV_OPT_TYPE_BOOL,   {.i64 = 0},        0, 1,                FLAGS },
+    { "index_label", "label of the inputs in the index",
+        OFFSET(index_label),  AV_OPT_TYPE_STRING, {.str = NULL},     0, 0,                FLAGS },
+    { "index_candidates", "maximum number of index coarsesignatures compared to each coarsesignature",
+        OFFSET(index_candidates), AV_OPT_TYPE_INT, {.i64 = 8},       1, INT_MAX,          FLAGS },
     { NULL }
 };
 
@@ -488,9 +499,12 @@ static int xml_export(AVFilterContext *ctx, StreamContext *sc, const char* filen
     return 0;
 }
 
-static int binary_export(AVFilterContext *ctx, StreamContext *sc, const char* filename)
+/**
+ * write the signature in binary format to a newly allocated buffer
+ * @return size of the signature in bytes or a negative error code
+ */
+static int binary_serialize(StreamContext *sc, uint8_t **out)
 {
-    FILE* f;
     FineSignature* fs;
     CoarseSignature* cs;
     uint32_t numofsegments = (sc->lastindex + 44)/45;
@@ -504,15 +518,6 @@ static int binary_export(AVFilterContext *ctx, StreamContext *sc, const char* fi
     if (!buffer)
         return AVERROR(ENOMEM);
 
-    f = fopen(filename, "wb");
-    if (!f) {
-        int err = AVERROR(EINVAL);
-        char buf[128];
-        av_strerror(err, buf, sizeof(buf));
-        av_log(ctx, AV_LOG_ERROR, "cannot open file %s: %s\n", filename, buf);
-        av_freep(&buffer);
-        return err;
-    }
     init_put_bits(&buf, buffer, len);
 
     put_bits32(&buf, 1); /* NumOfSpatial Regions, only 1 supported */
@@ -561,12 +566,85 @@ static int binary_export(AVFilterContext *ctx, StreamContext *sc, const char* fi
 
     avpriv_align_put_bits(&buf);
     flush_put_bits(&buf);
-    fwrite(buffer, 1, put_bits_count(&buf)/8, f);
+    *out = buffer;
+    return put_bits_count(&buf)/8;
+}
+
+static int binary_export(AVFilterContext *ctx, StreamContext *sc, const char* filename)
+{
+    FILE* f;
+    uint8_t* buffer;
+    int len = binary_serialize(sc, &buffer);
+    if (len < 0)
+        return len;
+
+    f = fopen(filename, "wb");
+    if (!f) {
+        int err = AVERROR(EINVAL);
+        char buf[128];
+        av_strerror(err, buf, sizeof(buf));
+        av_log(ctx, AV_LOG_ERROR, "cannot open file %s: %s\n", filename, buf);
+        av_freep(&buffer);
+        return err;
+    }
+    fwrite(buffer, 1, len, f);
     fclose(f);
     av_freep(&buffer);
     return 0;
 }
 
+/**
+ * append the signature to the index file, creating it if needed
+ */
+static int index_export(AVFilterContext *ctx, StreamContext *sc, int input)
+{
+    SignatureContext* sic = ctx->priv;
+    char label[1024];
+    uint8_t header[12], *buffer;
+    size_t label_len;
+    FILE* f;
+    int len, ret = 0;
+
+    if (sic->index_label && sic->nb_inputs > 1) {
+        /* error already handled */
+        av_assert0(av_get_frame_filename(label, sizeof(label), sic->index_label, input) == 0);
+    } else if (sic->index_label) {
+        av_strlcpy(label, sic->index_label, sizeof(label));
+    } else {
+        snprintf(label, sizeof(label), "%d", input);
+    }
+    label_len = FFMIN(strlen(label), UINT16_MAX);
+
+    len = binary_serialize(sc, &buffer);
+    if (len < 0)
+        return len;
+
+    f = fopen(sic->index_filename, "ab");
+    if (!f) {
+        ret = AVERROR(errno);
+        av_log(ctx, AV_LOG_ERROR, "cannot open index %s: %s\n", sic->index_filename, av_err2str(ret));
+        av_freep(&buffer);
+        return ret;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        memcpy(header, INDEX_MAGIC, 8);
+        AV_WB32(header + 8, INDEX_VERSION);
+        fwrite(header, 1, 12, f);
+    }
+    AV_WB16(header, label_len);
+    fwrite(header, 1, 2, f);
+    fwrite(label, 1, label_len, f);
+    AV_WB32(header, len);
+    fwrite(header, 1, 4, f);
+    if (fwrite(buffer, 1, len, f) != len)
+        ret = AVERROR(EIO);
+    if (fclose(f) && !ret)
+        ret = AVERROR(errno);
+    av_freep(&buffer);
+    return ret;
+}
+
 static int export(AVFilterContext *ctx, StreamContext *sc, int input)
 {
     SignatureContext* sic = ctx->priv;
@@ -612,6 +690,17 @@ static int request_frame(AVFilterLink *outlink)
                 if (export(ctx, sc, i) < 0)
                     return ret;
             }
+            /* look up before appending it, not to find the input itself */
+            if (sic->mode != MODE_OFF && sic->nb_index_coarse && sc->lastindex > 0) {
+                int err = lookup_index(ctx, sic, sc, i);
+                if (err < 0)
+                    return err;
+            }
+            if (sic->index_write && sc->lastindex > 0) {
+                int err = index_export(ctx, sc, i);
+                if (err < 0)
+                    return err;
+            }
             sc->exported = 1;
         }
         lookup &= sc->exported;
@@ -693,6 +782,20 @@ static av_cold int init(AVFilterContext *ctx)
         return AVERROR(EINVAL);
     }
 
+    if (sic->index_write && !sic->index_filename) {
+        av_log(ctx, AV_LOG_ERROR, "index_write needs an index.\n");
+        return AVERROR(EINVAL);
+    }
+    if (sic->nb_inputs > 1 && sic->index_label && av_get_frame_filename(tmp, sizeof(tmp), sic->index_label, 0) == -1) {
+        av_log(ctx, AV_LOG_ERROR, "The index_label must contain %%d or %%0nd, if you have more than one input.\n");
+        return AVERROR(EINVAL);
+    }
+
+    fill_l1distlut(sic->l1distlut);
+
+    if (sic->index_filename && (ret = load_index(ctx, sic)) < 0)
+        return ret;
+
     return 0;
 }
 
@@ -731,6 +834,7 @@ static av_cold void uninit(AVFilterContext *ctx)
         }
         av_freep(&sic->streamcontexts);
     }
+    free_index(sic);
 }
 
 static int config_output(AVFilterLink *outlink)
@@ -767,5 +871,5 @@ AVFilter ff_vf_signature = {
     .query_formats = query_formats,
     .outputs       = signature_outputs,
     .inputs        = NULL,
-    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
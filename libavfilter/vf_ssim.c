@@ -35,6 +35,8 @@
  */
 
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
 #include "avfilter.h"
@@ -45,11 +47,20 @@
 #include "ssim.h"
 #include "video.h"
 
+enum StatsFormat {
+    STATS_FORMAT_TEXT,
+    STATS_FORMAT_CSV,
+    STATS_FORMAT_BINARY,
+    NB_STATS_FORMATS
+};
+
 typedef struct SSIMContext {
     const AVClass *class;
     FFFrameSync fs;
     FILE *stats_file;
     char *stats_file_str;
+    int stats_format;
+    int stats_header_written;
     int nb_components;
     int max;
     uint64_t nb_frames;
@@ -59,13 +70,15 @@ typedef struct SSIMContext {
     uint8_t rgba_map[4];
     int planewidth[4];
     int planeheight[4];
-    int *temp;
+    void **temp;            ///< per-job line sums
+    int nb_threads;
+    float *score[4];        ///< per-plane SSIM of each 4x4 block row
     int is_rgb;
-    float (*ssim_plane)(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max);
+    void (*ssim_plane)(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int slice_start, int slice_end,
+                       void *temp, int max, float *score);
     SSIMDSPContext dsp;
 } SSIMContext;
 
@@ -75,6 +88,10 @@ typedef struct SSIMContext {
 static const AVOption ssim_options[] = {
     {"stats_file", "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
     {"f",          "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    {"stats_format", "Set the format of the stats file.",                      OFFSET(stats_format), AV_OPT_TYPE_INT, {.i64=STATS_FORMAT_TEXT}, 0, NB_STATS_FORMATS-1, FLAGS, "stats_format" },
+        {"text",   "key:value pairs, one line per frame", 0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_TEXT},   0, 0, FLAGS, "stats_format" },
+        {"csv",    "comma separated values",              0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_CSV},    0, 0, FLAGS, "stats_format" },
+        {"binary", "fixed size little-endian records",    0, AV_OPT_TYPE_CONST, {.i64=STATS_FORMAT_BINARY}, 0, 0, FLAGS, "stats_format" },
     { NULL }
 };
 
@@ -221,21 +238,24 @@ static float ssim_endn_8bit(const int (*sum0)[4], const int (*sum1)[4], int widt
 
 #define SUM_LEN(w) (((w) >> 2) + 3)
 
-static float ssim_plane_16bit(SSIMDSPContext *dsp,
-                              uint8_t *main, int main_stride,
-                              uint8_t *ref, int ref_stride,
-                              int width, int height, void *temp,
-                              int max)
+/*
+ * Compute the SSIM of the 4x4 block rows [slice_start, slice_end) into
+ * score[], slice_start being at least 1. The rows are summed up by the
+ * caller in order, so that the result does not depend on the slicing.
+ */
+static void ssim_plane_16bit(SSIMDSPContext *dsp,
+                             uint8_t *main, int main_stride,
+                             uint8_t *ref, int ref_stride,
+                             int width, int slice_start, int slice_end,
+                             void *temp, int max, float *score)
 {
-    int z = 0, y;
-    float ssim = 0.0;
+    int z = slice_start - 1, y;
     int64_t (*sum0)[4] = temp;
     int64_t (*sum1)[4] = sum0 + SUM_LEN(width);
 
     width >>= 2;
-    height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             ssim_4x4xn_16bit(&main[4 * z * main_stride], main_stride,
@@ -243,27 +263,23 @@ static float ssim_plane_16bit(SSIMDSPContext *dsp,
                              sum0, width);
         }
 
-        ssim += ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
+        score[y] = ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
     }
-
-    return ssim / ((height - 1) * (width - 1));
 }
 
-static float ssim_plane(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max)
+static void ssim_plane(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int slice_start, int slice_end,
+                       void *temp, int max, float *score)
 {
-    int z = 0, y;
-    float ssim = 0.0;
+    int z = slice_start - 1, y;
     int (*sum0)[4] = temp;
     int (*sum1)[4] = sum0 + SUM_LEN(width);
 
     width >>= 2;
-    height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             dsp->ssim_4x4_line(&main[4 * z * main_stride], main_stride,
@@ -271,10 +287,32 @@ static float ssim_plane(SSIMDSPContext *dsp,
                                sum0, width);
         }
 
-        ssim += dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
+        score[y] = dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
+    }
+}
+
+typedef struct ThreadData {
+    AVFrame *main, *ref;
+} ThreadData;
+
+static int ssim_plane_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SSIMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int i;
+
+    for (i = 0; i < s->nb_components; i++) {
+        const int nb_rows = (s->planeheight[i] >> 2) - 1;
+        const int slice_start = 1 + (nb_rows *  jobnr     ) / nb_jobs;
+        const int slice_end   = 1 + (nb_rows * (jobnr + 1)) / nb_jobs;
+
+        s->ssim_plane(&s->dsp, td->main->data[i], td->main->linesize[i],
+                      td->ref->data[i], td->ref->linesize[i],
+                      s->planewidth[i], slice_start, slice_end,
+                      s->temp[jobnr], s->max, s->score[i]);
     }
 
-    return ssim / ((height - 1) * (width - 1));
+    return 0;
 }
 
 static double ssim_db(double ssim, double weight)
@@ -282,14 +320,65 @@ static double ssim_db(double ssim, double weight)
     return 10 * log10(weight / (weight - ssim));
 }
 
+static void write_stats(SSIMContext *s, const float c[4], float ssimv)
+{
+    int i;
+
+    if (s->stats_format == STATS_FORMAT_BINARY) {
+        uint8_t buf[8 * 7], *p = buf;
+
+        AV_WL64(p, s->nb_frames); p += 8;
+        for (i = 0; i < s->nb_components; i++) {
+            int cidx = s->is_rgb ? s->rgba_map[i] : i;
+            AV_WL64(p, av_double2int(c[cidx])); p += 8;
+        }
+        AV_WL64(p, av_double2int(ssimv)); p += 8;
+        AV_WL64(p, av_double2int(ssim_db(ssimv, 1.0))); p += 8;
+        fwrite(buf, 1, p - buf, s->stats_file);
+        return;
+    }
+
+    if (s->stats_format == STATS_FORMAT_CSV) {
+        AVBPrint bp;
+
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+        if (!s->stats_header_written) {
+            av_bprintf(&bp, "n");
+            for (i = 0; i < s->nb_components; i++)
+                av_bprintf(&bp, ",%c", s->comps[i]);
+            av_bprintf(&bp, ",All,dB\n");
+            s->stats_header_written = 1;
+        }
+        av_bprintf(&bp, "%"PRId64, s->nb_frames);
+        for (i = 0; i < s->nb_components; i++) {
+            int cidx = s->is_rgb ? s->rgba_map[i] : i;
+            av_bprintf(&bp, ",%f", c[cidx]);
+        }
+        av_bprintf(&bp, ",%f,%f\n", ssimv, ssim_db(ssimv, 1.0));
+        fwrite(bp.str, 1, bp.len, s->stats_file);
+        av_bprint_finalize(&bp, NULL);
+        return;
+    }
+
+    fprintf(s->stats_file, "n:%"PRId64" ", s->nb_frames);
+
+    for (i = 0; i < s->nb_components; i++) {
+        int cidx = s->is_rgb ? s->rgba_map[i] : i;
+        fprintf(s->stats_file, "%c:%f ", s->comps[i], c[cidx]);
+    }
+
+    fprintf(s->stats_file, "All:%f (%f)\n", ssimv, ssim_db(ssimv, 1.0));
+}
+
 static int do_ssim(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
     SSIMContext *s = ctx->priv;
     AVFrame *master, *ref;
     AVDictionary **metadata;
+    ThreadData td;
     float c[4], ssimv = 0.0;
-    int ret, i;
+    int ret, i, y;
 
     ret = ff_framesync_dualinput_get(fs, &master, &ref);
     if (ret < 0)
@@ -300,11 +389,19 @@ static int do_ssim(FFFrameSync *fs)
 
     s->nb_frames++;
 
+    td.main = master;
+    td.ref = ref;
+    ctx->internal->execute(ctx, ssim_plane_slice, &td, NULL,
+                           FFMAX(1, FFMIN((s->planeheight[1] >> 2) - 1, s->nb_threads)));
+
     for (i = 0; i < s->nb_components; i++) {
-        c[i] = s->ssim_plane(&s->dsp, master->data[i], master->linesize[i],
-                             ref->data[i], ref->linesize[i],
-                             s->planewidth[i], s->planeheight[i], s->temp,
-                             s->max);
+        const int width = s->planewidth[i] >> 2;
+        const int height = s->planeheight[i] >> 2;
+        float ssim = 0.0;
+
+        for (y = 1; y < height; y++)
+            ssim += s->score[i][y];
+        c[i] = ssim / ((height - 1) * (width - 1));
         ssimv += s->coefs[i] * c[i];
         s->ssim[i] += c[i];
     }
@@ -317,16 +414,8 @@ static int do_ssim(FFFrameSync *fs)
     set_meta(metadata, "lavfi.ssim.All", 0, ssimv);
     set_meta(metadata, "lavfi.ssim.dB", 0, ssim_db(ssimv, 1.0));
 
-    if (s->stats_file) {
-        fprintf(s->stats_file, "n:%"PRId64" ", s->nb_frames);
-
-        for (i = 0; i < s->nb_components; i++) {
-            int cidx = s->is_rgb ? s->rgba_map[i] : i;
-            fprintf(s->stats_file, "%c:%f ", s->comps[i], c[cidx]);
-        }
-
-        fprintf(s->stats_file, "All:%f (%f)\n", ssimv, ssim_db(ssimv, 1.0));
-    }
+    if (s->stats_file)
+        write_stats(s, c, ssimv);
 
     return ff_filter_frame(ctx->outputs[0], master);
 }
@@ -339,7 +428,7 @@ static av_cold int init(AVFilterContext *ctx)
         if (!strcmp(s->stats_file_str, "-")) {
             s->stats_file = stdout;
         } else {
-            s->stats_file = fopen(s->stats_file_str, "w");
+            s->stats_file = fopen(s->stats_file_str, s->stats_format == STATS_FORMAT_BINARY ? "wb" : "w");
             if (!s->stats_file) {
                 int err = AVERROR(errno);
                 char buf[128];
@@ -410,9 +499,21 @@ static int config_input_ref(AVFilterLink *inlink)
     for (i = 0; i < s->nb_components; i++)
         s->coefs[i] = (double) s->planeheight[i] * s->planewidth[i] / sum;
 
-    s->temp = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
     if (!s->temp)
         return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < s->nb_components; i++) {
+        av_freep(&s->score[i]);
+        s->score[i] = av_mallocz_array(FFMAX(1, s->planeheight[i] >> 2), sizeof(*s->score[i]));
+        if (!s->score[i])
+            return AVERROR(ENOMEM);
+    }
     s->max = (1 << desc->comp[0].depth) - 1;
 
     s->ssim_plane = desc->comp[0].depth > 8 ? ssim_plane_16bit : ssim_plane;
@@ -455,10 +556,10 @@ static int activate(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     SSIMContext *s = ctx->priv;
+    int i;
 
     if (s->nb_frames > 0) {
         char buf[256];
-        int i;
         buf[0] = 0;
         for (i = 0; i < s->nb_components; i++) {
             int c = s->is_rgb ? s->rgba_map[i] : i;
@@ -474,7 +575,12 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (s->stats_file && s->stats_file != stdout)
         fclose(s->stats_file);
 
+    if (s->temp)
+        for (i = 0; i < s->nb_threads; i++)
+            av_freep(&s->temp[i]);
     av_freep(&s->temp);
+    for (i = 0; i < 4; i++)
+        av_freep(&s->score[i]);
 }
 
 static const AVFilterPad ssim_inputs[] = {
@@ -510,4 +616,5 @@ AVFilter ff_vf_ssim = {
     .priv_class    = &ssim_class,
     .inputs        = ssim_inputs,
     .outputs       = ssim_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
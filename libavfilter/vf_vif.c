@@ -0,0 +1,539 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calculate the VIF (Visual Information Fidelity) between two input videos,
+ * as the four scale elementary feature used by VMAF.
+ */
+
+#include <float.h>
+
+#include "libavutil/float_dsp.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "formats.h"
+#include "framesync.h"
+#include "internal.h"
+#include "video.h"
+
+#define NB_SCALES 4
+
+enum VIFBuffers {
+    REF_0, DIS_0,       ///< scales 0 and 2
+    REF_1, DIS_1,       ///< scales 1 and 3
+    REF_SQ, DIS_SQ, REF_DIS,
+    NB_BUFS
+};
+
+static const float vif_filter1d_table[NB_SCALES][17] = {
+    {
+        0.00745626912, 0.0142655009, 0.0250313189, 0.0402820669, 0.0594526194,
+        0.0804751068,  0.0999041125, 0.113746084,  0.118773937,  0.113746084,
+        0.0999041125,  0.0804751068, 0.0594526194, 0.0402820669, 0.0250313189,
+        0.0142655009,  0.00745626912
+    },
+    {
+        0.0189780835, 0.0558981746, 0.120920904, 0.192116052, 0.224173605,
+        0.192116052,  0.120920904,  0.0558981746, 0.0189780835
+    },
+    {
+        0.054488685, 0.244201347, 0.402619958, 0.244201347, 0.054488685
+    },
+    {
+        0.166378498, 0.667243004, 0.166378498
+    }
+};
+
+static const int vif_filter1d_width[NB_SCALES] = { 17, 9, 5, 3 };
+
+typedef struct VIFContext {
+    const AVClass *class;
+    FFFrameSync fs;
+    const AVPixFmtDescriptor *desc;
+    int width;
+    int height;
+    ptrdiff_t stride;               ///< in floats, common to all buffers
+    int nb_threads;
+    float factor;
+    float *data_buf[NB_BUFS];
+    float **temp;                   ///< per-job line buffers
+    float *row_num;                 ///< per-row sums of the current scale
+    float *row_den;
+    double vif_sum[NB_SCALES];
+    double vif_min[NB_SCALES];
+    double vif_max[NB_SCALES];
+    uint64_t nb_frames;
+    AVFloatDSPContext *fdsp;
+} VIFContext;
+
+static const AVOption vif_options[] = {
+    { NULL }
+};
+
+FRAMESYNC_DEFINE_CLASS(vif, VIFContext, fs);
+
+typedef struct ThreadData {
+    AVFrame *main, *ref;
+    int scale;
+    int w, h;                       ///< dimensions of the current scale
+    int prev_w, prev_h;             ///< dimensions of the previous scale
+} ThreadData;
+
+static av_always_inline int vif_reflect(int x, int size)
+{
+    if (x < 0)
+        return -x;
+    if (x >= size)
+        return 2 * size - x - 1;
+    return x;
+}
+
+/**
+ * Filter line y of src with the separable filter, writing every step-th
+ * sample of it to dst.
+ */
+static void vif_filter_line(AVFloatDSPContext *fdsp,
+                            const float *filter, int filter_width,
+                            const float *src, ptrdiff_t stride,
+                            int w, int h, int y, int step,
+                            float *temp, float *dst, int dst_w)
+{
+    const int radius = filter_width / 2;
+    const int aligned_w = FFALIGN(w, 16);
+    int i, j;
+
+    memset(temp, 0, aligned_w * sizeof(*temp));
+    for (i = 0; i < filter_width; i++) {
+        const int y_tap = vif_reflect(y - radius + i, h);
+        fdsp->vector_fmac_scalar(temp, src + y_tap * stride, filter[i], aligned_w);
+    }
+
+    for (j = 0; j < dst_w; j++) {
+        const int x = j * step;
+        float sum = 0.f;
+
+        if (x >= radius && x + radius < w) {
+            const float *t = temp + x - radius;
+
+            for (i = 0; i < filter_width; i++)
+                sum += filter[i] * t[i];
+        } else {
+            for (i = 0; i < filter_width; i++)
+                sum += filter[i] * temp[vif_reflect(x - radius + i, w)];
+        }
+        dst[j] = sum;
+    }
+}
+
+static void vif_statistic(const float *mu1, const float *mu2,
+                          const float *xx_filt, const float *yy_filt,
+                          const float *xy_filt, int w,
+                          float *num, float *den)
+{
+    static const float sigma_nsq = 2.f;
+    static const float eps = 1.0e-10f;
+    static const float gain_limit = 100.f;
+    float accum_num = 0.f, accum_den = 0.f;
+    int j;
+
+    for (j = 0; j < w; j++) {
+        float sigma1_sq = xx_filt[j] - mu1[j] * mu1[j];
+        float sigma2_sq = yy_filt[j] - mu2[j] * mu2[j];
+        float sigma12   = xy_filt[j] - mu1[j] * mu2[j];
+        float g, sv_sq;
+
+        sigma1_sq = FFMAX(sigma1_sq, 0.f);
+        sigma2_sq = FFMAX(sigma2_sq, 0.f);
+        sigma12   = FFMAX(sigma12,   0.f);
+
+        g = sigma12 / (sigma1_sq + eps);
+        sv_sq = sigma2_sq - g * sigma12;
+
+        if (sigma1_sq < eps) {
+            g = 0.f;
+            sv_sq = sigma2_sq;
+            sigma1_sq = 0.f;
+        }
+
+        if (sigma2_sq < eps) {
+            g = 0.f;
+            sv_sq = 0.f;
+        }
+
+        if (g < 0.f) {
+            sv_sq = sigma2_sq;
+            g = 0.f;
+        }
+        sv_sq = FFMAX(sv_sq, eps);
+        g = FFMIN(g, gain_limit);
+
+        accum_num += log2f(1.f + g * g * sigma1_sq / (sv_sq + sigma_nsq));
+        accum_den += log2f(1.f + sigma1_sq / sigma_nsq);
+    }
+
+    *num = accum_num;
+    *den = accum_den;
+}
+
+#define CONVERT_LINE(type)                                              \
+    do {                                                                \
+        const type *msrc = (const type *)(td->main->data[0] + y * td->main->linesize[0]); \
+        const type *rsrc = (const type *)(td->ref->data[0]  + y * td->ref->linesize[0]);  \
+                                                                        \
+        for (x = 0; x < w; x++) {                                       \
+            dis[x] = msrc[x] * s->factor - 128.f;                       \
+            ref[x] = rsrc[x] * s->factor - 128.f;                       \
+        }                                                               \
+    } while (0)
+
+/**
+ * Produce the reference and distorted images of the current scale, either by
+ * converting the input frames or by low-pass filtering and decimating the
+ * previous scale, and their products.
+ */
+static int vif_prepare_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VIFContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const ptrdiff_t stride = s->stride;
+    const int w = td->w;
+    const int h = td->h;
+    const int aligned_w = FFALIGN(w, 16);
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
+    float *cur_ref = s->data_buf[td->scale & 1 ? REF_1 : REF_0];
+    float *cur_dis = s->data_buf[td->scale & 1 ? DIS_1 : DIS_0];
+    const float *prev_ref = s->data_buf[td->scale & 1 ? REF_0 : REF_1];
+    const float *prev_dis = s->data_buf[td->scale & 1 ? DIS_0 : DIS_1];
+    const float *filter = vif_filter1d_table[td->scale];
+    const int filter_width = vif_filter1d_width[td->scale];
+    int x, y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        float *ref = cur_ref + y * stride;
+        float *dis = cur_dis + y * stride;
+
+        if (!td->scale) {
+            if (s->desc->comp[0].depth > 8)
+                CONVERT_LINE(uint16_t);
+            else
+                CONVERT_LINE(uint8_t);
+        } else {
+            vif_filter_line(s->fdsp, filter, filter_width, prev_ref, stride,
+                            td->prev_w, td->prev_h, y * 2, 2, s->temp[jobnr], ref, w);
+            vif_filter_line(s->fdsp, filter, filter_width, prev_dis, stride,
+                            td->prev_w, td->prev_h, y * 2, 2, s->temp[jobnr], dis, w);
+        }
+
+        s->fdsp->vector_fmul(s->data_buf[REF_SQ]  + y * stride, ref, ref, aligned_w);
+        s->fdsp->vector_fmul(s->data_buf[DIS_SQ]  + y * stride, dis, dis, aligned_w);
+        s->fdsp->vector_fmul(s->data_buf[REF_DIS] + y * stride, ref, dis, aligned_w);
+    }
+
+    return 0;
+}
+
+static int vif_statistic_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VIFContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const ptrdiff_t stride = s->stride;
+    const int w = td->w;
+    const int h = td->h;
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
+    const float *ref = s->data_buf[td->scale & 1 ? REF_1 : REF_0];
+    const float *dis = s->data_buf[td->scale & 1 ? DIS_1 : DIS_0];
+    const float *filter = vif_filter1d_table[td->scale];
+    const int filter_width = vif_filter1d_width[td->scale];
+    float *temp = s->temp[jobnr];
+    float *mu1 = temp + stride;
+    float *mu2 = temp + stride * 2;
+    float *xx  = temp + stride * 3;
+    float *yy  = temp + stride * 4;
+    float *xy  = temp + stride * 5;
+    int y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        vif_filter_line(s->fdsp, filter, filter_width, ref, stride, w, h, y, 1, temp, mu1, w);
+        vif_filter_line(s->fdsp, filter, filter_width, dis, stride, w, h, y, 1, temp, mu2, w);
+        vif_filter_line(s->fdsp, filter, filter_width, s->data_buf[REF_SQ],  stride, w, h, y, 1, temp, xx, w);
+        vif_filter_line(s->fdsp, filter, filter_width, s->data_buf[DIS_SQ],  stride, w, h, y, 1, temp, yy, w);
+        vif_filter_line(s->fdsp, filter, filter_width, s->data_buf[REF_DIS], stride, w, h, y, 1, temp, xy, w);
+
+        vif_statistic(mu1, mu2, xx, yy, xy, w, &s->row_num[y], &s->row_den[y]);
+    }
+
+    return 0;
+}
+
+static void compute_vif(AVFilterContext *ctx, AVFrame *main, AVFrame *ref,
+                        float score[NB_SCALES])
+{
+    VIFContext *s = ctx->priv;
+    ThreadData td;
+    int scale, y;
+
+    td.main = main;
+    td.ref = ref;
+    td.w = s->width;
+    td.h = s->height;
+
+    for (scale = 0; scale < NB_SCALES; scale++) {
+        float num = 0.f, den = 0.f;
+        int nb_jobs;
+
+        if (scale) {
+            td.prev_w = td.w;
+            td.prev_h = td.h;
+            td.w /= 2;
+            td.h /= 2;
+        }
+        td.scale = scale;
+        nb_jobs = FFMIN(td.h, s->nb_threads);
+
+        ctx->internal->execute(ctx, vif_prepare_slice,   &td, NULL, nb_jobs);
+        ctx->internal->execute(ctx, vif_statistic_slice, &td, NULL, nb_jobs);
+
+        /* sum the rows in order, so the result does not depend on the slicing */
+        for (y = 0; y < td.h; y++) {
+            num += s->row_num[y];
+            den += s->row_den[y];
+        }
+
+        score[scale] = den <= FLT_EPSILON ? 1.f : num / den;
+    }
+}
+
+static void set_meta(AVDictionary **metadata, const char *key, int scale, float d)
+{
+    char value[128];
+    char key2[128];
+
+    snprintf(value, sizeof(value), "%f", d);
+    snprintf(key2, sizeof(key2), "%s%d", key, scale);
+    av_dict_set(metadata, key2, value, 0);
+}
+
+static int do_vif(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    VIFContext *s = ctx->priv;
+    AVFrame *master, *ref;
+    float score[NB_SCALES];
+    int ret, i;
+
+    ret = ff_framesync_dualinput_get(fs, &master, &ref);
+    if (ret < 0)
+        return ret;
+    if (!ref)
+        return ff_filter_frame(ctx->outputs[0], master);
+
+    compute_vif(ctx, master, ref, score);
+
+    for (i = 0; i < NB_SCALES; i++) {
+        set_meta(&master->metadata, "lavfi.vif.scale.", i, score[i]);
+
+        s->vif_min[i] = FFMIN(s->vif_min[i], score[i]);
+        s->vif_max[i] = FFMAX(s->vif_max[i], score[i]);
+        s->vif_sum[i] += score[i];
+    }
+    s->nb_frames++;
+
+    return ff_filter_frame(ctx->outputs[0], master);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    VIFContext *s = ctx->priv;
+    int i;
+
+    for (i = 0; i < NB_SCALES; i++) {
+        s->vif_min[i] =  DBL_MAX;
+        s->vif_max[i] = -DBL_MAX;
+    }
+
+    s->fs.on_event = do_vif;
+    return 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10,
+        AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY14, AV_PIX_FMT_GRAY16,
+#define PF(suf) AV_PIX_FMT_YUV420##suf, AV_PIX_FMT_YUV422##suf, AV_PIX_FMT_YUV444##suf
+        PF(P), PF(P9), PF(P10), PF(P12), PF(P14), PF(P16),
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_YUV410P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P,
+        AV_PIX_FMT_YUVJ440P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_NONE
+    };
+
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_input_ref(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx  = inlink->dst;
+    VIFContext *s = ctx->priv;
+    int i;
+
+    if (ctx->inputs[0]->w != ctx->inputs[1]->w ||
+        ctx->inputs[0]->h != ctx->inputs[1]->h) {
+        av_log(ctx, AV_LOG_ERROR, "Width and height of input videos must be same.\n");
+        return AVERROR(EINVAL);
+    }
+    if (ctx->inputs[0]->format != ctx->inputs[1]->format) {
+        av_log(ctx, AV_LOG_ERROR, "Inputs must be of same pixel format.\n");
+        return AVERROR(EINVAL);
+    }
+    /* the filters of every scale must fit in the image */
+    if (inlink->w < 16 || inlink->h < 16) {
+        av_log(ctx, AV_LOG_ERROR, "Input videos must be at least 16x16.\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->desc = av_pix_fmt_desc_get(inlink->format);
+    s->width = inlink->w;
+    s->height = inlink->h;
+    s->stride = FFALIGN(s->width, 16);
+    s->factor = 1.f / (1 << (s->desc->comp[0].depth - 8));
+
+    for (i = 0; i < NB_BUFS; i++) {
+        s->data_buf[i] = av_mallocz_array(s->stride * s->height, sizeof(*s->data_buf[i]));
+        if (!s->data_buf[i])
+            return AVERROR(ENOMEM);
+    }
+
+    s->row_num = av_malloc_array(s->height, sizeof(*s->row_num));
+    s->row_den = av_malloc_array(s->height, sizeof(*s->row_den));
+    if (!s->row_num || !s->row_den)
+        return AVERROR(ENOMEM);
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
+    if (!s->temp)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(s->stride * 6, sizeof(*s->temp[i]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+
+    s->fdsp = avpriv_float_dsp_alloc(0);
+    if (!s->fdsp)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    VIFContext *s = ctx->priv;
+    AVFilterLink *mainlink = ctx->inputs[0];
+    int ret;
+
+    ret = ff_framesync_init_dualinput(&s->fs, ctx);
+    if (ret < 0)
+        return ret;
+    outlink->w = mainlink->w;
+    outlink->h = mainlink->h;
+    outlink->time_base = mainlink->time_base;
+    outlink->sample_aspect_ratio = mainlink->sample_aspect_ratio;
+    outlink->frame_rate = mainlink->frame_rate;
+
+    if ((ret = ff_framesync_configure(&s->fs)) < 0)
+        return ret;
+
+    return 0;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    VIFContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    VIFContext *s = ctx->priv;
+    int i;
+
+    if (s->nb_frames > 0) {
+        for (i = 0; i < NB_SCALES; i++)
+            av_log(ctx, AV_LOG_INFO, "VIF scale=%d average:%f min:%f max:%f\n",
+                   i, s->vif_sum[i] / s->nb_frames, s->vif_min[i], s->vif_max[i]);
+    }
+
+    for (i = 0; i < NB_BUFS; i++)
+        av_freep(&s->data_buf[i]);
+
+    if (s->temp)
+        for (i = 0; i < s->nb_threads; i++)
+            av_freep(&s->temp[i]);
+    av_freep(&s->temp);
+
+    av_freep(&s->row_num);
+    av_freep(&s->row_den);
+    av_freep(&s->fdsp);
+
+    ff_framesync_uninit(&s->fs);
+}
+
+static const AVFilterPad vif_inputs[] = {
+    {
+        .name         = "main",
+        .type         = AVMEDIA_TYPE_VIDEO,
+    },{
+        .name         = "reference",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .config_props = config_input_ref,
+    },
+    { NULL }
+};
+
+static const AVFilterPad vif_outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_vif = {
+    .name          = "vif",
+    .description   = NULL_IF_CONFIG_SMALL("Calculate the VIF between two video streams."),
+    .preinit       = vif_framesync_preinit,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .activate      = activate,
+    .priv_size     = sizeof(VIFContext),
+    .priv_class    = &vif_class,
+    .inputs        = vif_inputs,
+    .outputs       = vif_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
+};
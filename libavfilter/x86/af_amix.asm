@@ -0,0 +1,118 @@
+;******************************************************************************
+;* x86-optimized functions for the amix filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;******************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION .text
+
+;------------------------------------------------------------------------------
+; void ff_amix_mix_<type>(<type> *dst, const <type> **src, const <type> *scale,
+;                         ptrdiff_t nb_src, ptrdiff_t len)
+;------------------------------------------------------------------------------
+
+; %1 = type, %2 = s or d, %3 = log2 of the sample size
+%macro AMIX_MIX 3
+cglobal amix_mix_%1, 5, 10, 6, dst, src, scale, nb_src, len, idx, src0, src1, src2, src3
+    shl         lenq, %3
+    jz .end
+    sub         nb_srcq, 4
+    jl .single
+
+.group:
+    mov         src0q, [srcq + 0 * gprsize]
+    mov         src1q, [srcq + 1 * gprsize]
+    mov         src2q, [srcq + 2 * gprsize]
+    mov         src3q, [srcq + 3 * gprsize]
+%ifidn %2, s
+    VBROADCASTSS m0, [scaleq + 0 * 4]
+    VBROADCASTSS m1, [scaleq + 1 * 4]
+    VBROADCASTSS m2, [scaleq + 2 * 4]
+    VBROADCASTSS m3, [scaleq + 3 * 4]
+%else
+    VBROADCASTSD m0, [scaleq + 0 * 8]
+    VBROADCASTSD m1, [scaleq + 1 * 8]
+    VBROADCASTSD m2, [scaleq + 2 * 8]
+    VBROADCASTSD m3, [scaleq + 3 * 8]
+%endif
+    xor         idxd, idxd
+ALIGN 16
+.loop4:
+    movu        m4, [src0q + idxq]
+    mulp%2      m4, m0
+    movu        m5, [src1q + idxq]
+    mulp%2      m5, m1
+    addp%2      m4, m5
+    movu        m5, [src2q + idxq]
+    mulp%2      m5, m2
+    addp%2      m4, m5
+    movu        m5, [src3q + idxq]
+    mulp%2      m5, m3
+    addp%2      m4, m5
+    addp%2      m4, [dstq + idxq]
+    mova        [dstq + idxq], m4
+    add         idxq, mmsize
+    cmp         idxq, lenq
+    jl .loop4
+
+    add         srcq, 4 * gprsize
+    add         scaleq, 4 << %3
+    sub         nb_srcq, 4
+    jge .group
+
+.single:
+    add         nb_srcq, 4
+    jz .end
+.next:
+    mov         src0q, [srcq]
+%ifidn %2, s
+    VBROADCASTSS m0, [scaleq]
+%else
+    VBROADCASTSD m0, [scaleq]
+%endif
+    xor         idxd, idxd
+.loop1:
+    movu        m4, [src0q + idxq]
+    mulp%2      m4, m0
+    addp%2      m4, [dstq + idxq]
+    mova        [dstq + idxq], m4
+    add         idxq, mmsize
+    cmp         idxq, lenq
+    jl .loop1
+
+    add         srcq, gprsize
+    add         scaleq, 1 << %3
+    dec         nb_srcq
+    jg .next
+.end:
+    RET
+%endmacro
+
+%if ARCH_X86_64
+INIT_XMM sse
+AMIX_MIX float, s, 2
+INIT_XMM sse2
+AMIX_MIX double, d, 3
+
+%if HAVE_AVX_EXTERNAL
+INIT_YMM avx
+AMIX_MIX float, s, 2
+AMIX_MIX double, d, 3
+%endif
+%endif
@@ -0,0 +1,86 @@
+;*****************************************************************************
+;* x86-optimized functions for biquad filters
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;******************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION .text
+
+;------------------------------------------------------------------------------
+; void ff_biquad_filter(double *buf, const double *coeffs, double *state,
+;                       ptrdiff_t len)
+;
+; Four interleaved channels, each one in a lane; with xmm registers the first
+; two channels are filtered, then the last two.
+;------------------------------------------------------------------------------
+
+%macro BIQUAD_FILTER 0
+cglobal biquad_filter, 4, 6, 10, buf, coeffs, state, len, idx, pass
+    shl         lenq, 5
+    jz .end
+    add         bufq, lenq
+    neg         lenq
+    mov         passd, 32 / mmsize
+.pass:
+    mova        m0, [coeffsq + 0 * 32]      ; b0
+    mova        m1, [coeffsq + 1 * 32]      ; b1
+    mova        m2, [coeffsq + 2 * 32]      ; b2
+    mova        m3, [coeffsq + 3 * 32]      ; -a1
+    mova        m4, [coeffsq + 4 * 32]      ; -a2
+    mova        m5, [stateq  + 0 * 32]      ; s1
+    mova        m6, [stateq  + 1 * 32]      ; s2
+    mov         idxq, lenq
+ALIGN 16
+.loop:
+    mova        m7, [bufq + idxq]           ; x
+    mulpd       m8, m0, m7
+    addpd       m8, m5                      ; y = b0 * x + s1
+    mulpd       m9, m1, m7
+    addpd       m9, m6                      ; b1 * x + s2
+    mulpd       m5, m3, m8
+    addpd       m5, m9                      ; s1 = b1 * x + s2 - a1 * y
+    mulpd       m6, m2, m7
+    mulpd       m9, m4, m8
+    addpd       m6, m9                      ; s2 = b2 * x - a2 * y
+    mova        [bufq + idxq], m8
+    add         idxq, 32
+    jl .loop
+
+    mova        [stateq + 0 * 32], m5
+    mova        [stateq + 1 * 32], m6
+%if mmsize == 16
+    add         bufq, mmsize
+    add         coeffsq, mmsize
+    add         stateq, mmsize
+    dec         passd
+    jg .pass
+%endif
+.end:
+    RET
+%endmacro
+
+%if ARCH_X86_64
+INIT_XMM sse2
+BIQUAD_FILTER
+
+%if HAVE_AVX_EXTERNAL
+INIT_YMM avx
+BIQUAD_FILTER
+%endif
+%endif
@@ -1951,6 +1951,26 @@ typedef struct AVFormatContext {
      * - decoding: set by user
      */
     int skip_estimate_duration_from_pts;
+
+    /**
+     * Number of threads used to run the probe decoders in
+     * avformat_find_stream_info(), 0 for automatic. With more than one
+     * thread, the packets read are decoded in batches, with the streams
+     * of a batch decoded concurrently.
+     * - encoding: unused
+     * - decoding: set by user
+     */
+    int probe_threads;
+
+    /**
+     * Directory of the cache of avformat_find_stream_info() results, or NULL
+     * to disable it. When a cached entry matches the URL and fingerprint of
+     * the input, the stream parameters are restored from it instead of
+     * probing the streams.
+     * - encoding: unused
+     * - decoding: set by user
+     */
+    char *probe_cache;
 } AVFormatContext;
 
 #if FF_API_FORMAT_GET_SET
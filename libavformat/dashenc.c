@@ -102,6 +102,7 @@ typedef struct OutputStream {
     char full_path[1024];
     char temp_path[1024];
     double availability_time_offset;
+    int64_t frag_start_pts;
     int total_pkt_size;
     int muxer_overhead;
 } OutputStream;
@@ -150,6 +151,7 @@ typedef struct DASHContext {
     int master_publish_rate;
     int nr_of_streams_to_flush;
     int nr_of_streams_flushed;
+    int64_t frag_duration;
 } DASHContext;
 
 static struct codec_string {
@@ -1311,7 +1313,10 @@ static int dash_init(AVFormatContext *s)
         }
 
         if (os->segment_type == SEGMENT_TYPE_MP4) {
-            if (c->streaming)
+            if (c->streaming && c->frag_duration)
+                // frag_custom : fragments are cut in dash_write_packet
+                av_dict_set(&opts, "movflags", "frag_custom+dash+delay_moov+skip_sidx+skip_trailer", 0);
+            else if (c->streaming)
                 // frag_every_frame : Allows lower latency streaming
                 // skip_sidx : Reduce bitrate overhead
                 // skip_trailer : Avoids growing memory usage with time
@@ -1737,7 +1742,10 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
                         sizeof(c->availability_start_time));
     }
 
-    if (!os->availability_time_offset && pkt->duration) {
+    if (!os->availability_time_offset && c->frag_duration) {
+        os->availability_time_offset = ((double) c->seg_duration -
+                                        c->frag_duration) / AV_TIME_BASE;
+    } else if (!os->availability_time_offset && pkt->duration) {
         int64_t frame_duration = av_rescale_q(pkt->duration, st->time_base,
                                               AV_TIME_BASE_Q);
          os->availability_time_offset = ((double) c->seg_duration -
@@ -1791,6 +1799,18 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         os->max_pts = pkt->pts + pkt->duration;
     else
         os->max_pts = FFMAX(os->max_pts, pkt->pts + pkt->duration);
+
+    // cut a fragment once it is long enough, it is sent out below
+    if (c->streaming && c->frag_duration && os->segment_type == SEGMENT_TYPE_MP4) {
+        if (!os->packets_written) {
+            os->frag_start_pts = pkt->pts;
+        } else if (av_compare_ts(pkt->pts - os->frag_start_pts, st->time_base,
+                                 c->frag_duration, AV_TIME_BASE_Q) >= 0) {
+            if ((ret = av_write_frame(os->ctx, NULL)) < 0)
+                return ret;
+            os->frag_start_pts = pkt->pts;
+        }
+    }
     os->packets_written++;
     os->total_pkt_size += pkt->size;
     if ((ret = ff_write_chained(os->ctx, 0, pkt, s, 0)) < 0)
@@ -1930,6 +1950,7 @@ static const AVOption options[] = {
     { "http_persistent", "Use persistent HTTP connections", OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, E },
     { "hls_playlist", "Generate HLS playlist files(master.m3u8, media_%d.m3u8)", OFFSET(hls_playlist), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "streaming", "Enable/Disable streaming mode of output. Each frame will be moof fragment", OFFSET(streaming), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { "frag_duration", "In streaming mode, group frames into fragments (CMAF chunks) of this duration instead of one per frame", OFFSET(frag_duration), AV_OPT_TYPE_DURATION, { .i64 = 0 }, 0, INT_MAX, E },
     { "timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     { "index_correction", "Enable/Disable segment index correction logic", OFFSET(index_correction), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { "format_options","set list of options for the container format (mp4/webm) used for dash", OFFSET(format_options_str), AV_OPT_TYPE_STRING, {.str = NULL},  0, 0, E},
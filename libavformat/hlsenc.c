@@ -41,6 +41,9 @@
 #include "libavutil/random_seed.h"
 #include "libavutil/opt.h"
 #include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
 #include "libavutil/time_internal.h"
 
 #include "avformat.h"
@@ -85,6 +88,37 @@ typedef struct HLSSegment {
     struct HLSSegment *next;
 } HLSSegment;
 
+typedef struct HLSPart {
+    double duration; /* in seconds */
+    int64_t pos;
+    int64_t size;
+    int independent;
+} HLSPart;
+
+typedef enum HLSIOJobType {
+    HLS_IO_WRITE,
+    HLS_IO_RENAME,
+    HLS_IO_DELETE,
+} HLSIOJobType;
+
+/* file operation handed over to the I/O thread */
+typedef struct HLSIOJob {
+    HLSIOJobType type;
+    char *url;
+    char *src;            // file to rename to url
+    AVDictionary *options;
+    uint8_t *data;
+    int size;
+    int64_t queued_time;
+} HLSIOJob;
+
+/* output opened by the muxer, buffered until it is closed */
+typedef struct HLSPendingFile {
+    AVIOContext *pb;
+    char *url;
+    AVDictionary *options;
+} HLSPendingFile;
+
 typedef enum HLSFlags {
     // Generate a single media file and use byte ranges in the playlist.
     HLS_SINGLE_FILE = (1 << 0),
@@ -165,6 +199,15 @@ typedef struct VariantStream {
     char *ccgroup; /* closed caption group name */
     char *baseurl;
     char *varname; // variant name
+
+    /* partial segments of the segment being written, for low latency output */
+    HLSPart *parts;
+    int nb_parts;
+    int parts_size;
+    int64_t part_start_pts;
+    int part_independent;
+    int64_t part_pos;     // bytes of the current segment already sent
+    int segment_out_open; // the current segment is being sent progressively
 } VariantStream;
 
 typedef struct ClosedCaptionsStream {
@@ -240,14 +283,286 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+    float part_time;       // Set by a private option.
+
+    int io_thread;
+    int io_queue_size;
+    int io_error;
+    HLSPendingFile *pending_files;
+    int nb_pending_files;
+#if HAVE_THREADS
+    AVThreadMessageQueue *io_queue;
+    pthread_t io_tid;
+    int io_thread_started;
+    int io_thread_error;  ///< first failure seen by the I/O thread, read after joining it
+#endif
+    /* I/O thread statistics */
+    int64_t io_nb_jobs;
+    int64_t io_bytes;
+    int64_t io_time_sum;
+    int64_t io_time_max;
+    int io_backlog_max;
 } HLSContext;
 
+static void hls_io_job_free(void *msg)
+{
+    HLSIOJob *job = msg;
+
+    av_freep(&job->url);
+    av_freep(&job->src);
+    av_freep(&job->data);
+    av_dict_free(&job->options);
+}
+
+#if HAVE_THREADS
+static int hls_io_run_job(AVFormatContext *s, HLSIOJob *job)
+{
+    AVIOContext *pb = NULL;
+    int ret = 0;
+
+    switch (job->type) {
+    case HLS_IO_WRITE:
+        if ((ret = s->io_open(s, &pb, job->url, AVIO_FLAG_WRITE, &job->options)) < 0)
+            break;
+        avio_write(pb, job->data, job->size);
+        avio_flush(pb);
+        ret = pb->error;
+        ff_format_io_close(s, &pb);
+        break;
+    case HLS_IO_RENAME:
+        ret = ff_rename(job->src, job->url, s);
+        break;
+    case HLS_IO_DELETE:
+        if (job->options) {
+            if ((ret = s->io_open(s, &pb, job->url, AVIO_FLAG_WRITE, &job->options)) < 0)
+                break;
+            ff_format_io_close(s, &pb);
+        } else if (unlink(job->url) < 0) {
+            ret = AVERROR(errno);
+        }
+        break;
+    }
+    return ret;
+}
+
+static void *hls_io_thread(void *arg)
+{
+    AVFormatContext *s = arg;
+    HLSContext *hls = s->priv_data;
+    HLSIOJob job;
+    int ret;
+
+    while (av_thread_message_queue_recv(hls->io_queue, &job, 0) >= 0) {
+        int64_t start = av_gettime_relative(), elapsed;
+
+        ret = hls_io_run_job(s, &job);
+        elapsed = av_gettime_relative() - start;
+        if (ret < 0) {
+            av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                   "I/O on '%s' failed: %s\n", job.url, av_err2str(ret));
+            if (!hls->ignore_io_errors) {
+                av_thread_message_queue_set_err_send(hls->io_queue, ret);
+                if (!hls->io_thread_error)
+                    hls->io_thread_error = ret;
+            }
+        } else if (job.type == HLS_IO_WRITE) {
+            av_log(s, AV_LOG_VERBOSE, "Wrote '%s' (%d bytes) in %.3fs, queued %.3fs\n",
+                   job.url, job.size, elapsed / 1000000.0,
+                   (start - job.queued_time) / 1000000.0);
+            hls->io_bytes += job.size;
+        }
+        hls->io_nb_jobs++;
+        hls->io_time_sum += elapsed;
+        hls->io_time_max  = FFMAX(hls->io_time_max, elapsed);
+        hls_io_job_free(&job);
+    }
+    return NULL;
+}
+
+static int hls_io_thread_start(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&hls->io_queue, hls->io_queue_size,
+                                        sizeof(HLSIOJob));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(hls->io_queue, hls_io_job_free);
+
+    ret = pthread_create(&hls->io_tid, NULL, hls_io_thread, s);
+    if (ret) {
+        av_log(s, AV_LOG_ERROR, "Failed to create the I/O thread: %s\n", strerror(ret));
+        av_thread_message_queue_free(&hls->io_queue);
+        return AVERROR(ret);
+    }
+    hls->io_thread_started = 1;
+    return 0;
+}
+
+/* Wait for all queued operations to complete and stop the I/O thread.
+ * Returns the first I/O error, if any. */
+static int hls_io_thread_stop(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (!hls->io_thread_started)
+        return 0;
+    av_thread_message_queue_set_err_recv(hls->io_queue, AVERROR_EOF);
+    pthread_join(hls->io_tid, NULL);
+    av_thread_message_queue_free(&hls->io_queue);
+    hls->io_thread_started = 0;
+
+    if (hls->io_nb_jobs)
+        av_log(s, AV_LOG_VERBOSE,
+               "I/O thread: %"PRId64" operations, %"PRId64" bytes written, "
+               "%.3fs average, %.3fs max, %d queued at most\n",
+               hls->io_nb_jobs, hls->io_bytes,
+               hls->io_time_sum / 1000000.0 / hls->io_nb_jobs,
+               hls->io_time_max / 1000000.0, hls->io_backlog_max);
+
+    return hls->io_thread_error ? hls->io_thread_error : hls->io_error;
+}
+
+static int hls_io_queue_job(AVFormatContext *s, HLSIOJob *job)
+{
+    HLSContext *hls = s->priv_data;
+    int ret, nb_queued;
+
+    nb_queued = av_thread_message_queue_nb_elems(hls->io_queue);
+    if (nb_queued >= hls->io_queue_size)
+        av_log(s, AV_LOG_VERBOSE, "I/O backlog full, waiting for the output\n");
+    hls->io_backlog_max = FFMAX(hls->io_backlog_max, nb_queued + 1);
+
+    job->queued_time = av_gettime_relative();
+    ret = av_thread_message_queue_send(hls->io_queue, job, 0);
+    if (ret < 0) {
+        hls_io_job_free(job);
+        if (!hls->io_error)
+            hls->io_error = ret;
+    }
+    return ret;
+}
+#endif
+
+static HLSPendingFile *find_pending_file(HLSContext *hls, AVIOContext *pb)
+{
+    int i;
+
+    for (i = 0; i < hls->nb_pending_files; i++)
+        if (hls->pending_files[i].pb == pb)
+            return &hls->pending_files[i];
+    return NULL;
+}
+
+/**
+ * With the I/O thread, outputs are written to memory and handed over to
+ * the thread when they are closed.
+ */
+static int hls_open_pending_file(AVFormatContext *s, AVIOContext **pb,
+                                 const char *url, AVDictionary **options)
+{
+    HLSContext *hls = s->priv_data;
+    HLSPendingFile *files, *file;
+    int ret;
+
+    files = av_realloc_array(hls->pending_files, hls->nb_pending_files + 1,
+                             sizeof(*files));
+    if (!files)
+        return AVERROR(ENOMEM);
+    hls->pending_files = files;
+    file = &files[hls->nb_pending_files];
+    memset(file, 0, sizeof(*file));
+
+    if (!(file->url = av_strdup(url)))
+        return AVERROR(ENOMEM);
+    if (options && (ret = av_dict_copy(&file->options, *options, 0)) < 0)
+        goto fail;
+    if ((ret = avio_open_dyn_buf(pb)) < 0)
+        goto fail;
+    file->pb = *pb;
+    hls->nb_pending_files++;
+    return 0;
+fail:
+    av_freep(&file->url);
+    av_dict_free(&file->options);
+    return ret;
+}
+
+static void hls_close_pending_file(AVFormatContext *s, HLSPendingFile *file)
+{
+    HLSContext *hls = s->priv_data;
+    HLSIOJob job = { HLS_IO_WRITE };
+
+    job.url     = file->url;
+    job.options = file->options;
+    job.size    = avio_close_dyn_buf(file->pb, &job.data);
+#if HAVE_THREADS
+    hls_io_queue_job(s, &job);
+#else
+    hls_io_job_free(&job);
+#endif
+    *file = hls->pending_files[--hls->nb_pending_files];
+}
+
+static void hls_free_pending_files(HLSContext *hls)
+{
+    int i;
+
+    for (i = 0; i < hls->nb_pending_files; i++) {
+        ffio_free_dyn_buf(&hls->pending_files[i].pb);
+        av_freep(&hls->pending_files[i].url);
+        av_dict_free(&hls->pending_files[i].options);
+    }
+    av_freep(&hls->pending_files);
+    hls->nb_pending_files = 0;
+}
+
+static int hls_queue_delete(AVFormatContext *s, const char *path, int http)
+{
+#if HAVE_THREADS
+    HLSIOJob job = { HLS_IO_DELETE };
+
+    if (!(job.url = av_strdup(path)))
+        return AVERROR(ENOMEM);
+    if (http && av_dict_set(&job.options, "method", "DELETE", 0) < 0) {
+        hls_io_job_free(&job);
+        return AVERROR(ENOMEM);
+    }
+    return hls_io_queue_job(s, &job);
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int hlsenc_rename(AVFormatContext *s, const char *oldpath, const char *newpath)
+{
+#if HAVE_THREADS
+    HLSContext *hls = s->priv_data;
+
+    if (hls->io_thread_started) {
+        HLSIOJob job = { HLS_IO_RENAME };
+        job.src = av_strdup(oldpath);
+        job.url = av_strdup(newpath);
+        if (!job.src || !job.url) {
+            hls_io_job_free(&job);
+            return AVERROR(ENOMEM);
+        }
+        return hls_io_queue_job(s, &job);
+    }
+#endif
+    return ff_rename(oldpath, newpath, s);
+}
+
+
 static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
                           AVDictionary **options) {
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
-    if (!*pb || !http_base_proto || !hls->http_persistent) {
+    if (hls->io_thread) {
+        err = hls_open_pending_file(s, pb, filename, options);
+    } else if (!*pb || !http_base_proto || !hls->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -265,9 +580,13 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
 static void hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename) {
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
+    HLSPendingFile *file;
     if (!*pb)
         return;
-    if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
+    if ((file = find_pending_file(hls, *pb))) {
+        hls_close_pending_file(s, file);
+        *pb = NULL;
+    } else if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -467,6 +786,26 @@ static int flush_dynbuf(VariantStream *vs, int *range_length)
     return avio_open_dyn_buf(&ctx->pb);
 }
 
+static int write_init_file(AVFormatContext *s, VariantStream *vs)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    uint8_t *buffer = NULL;
+    int range_length;
+
+    range_length = avio_close_dyn_buf(oc->pb, &buffer);
+    avio_write(vs->out, buffer, range_length);
+    av_free(buffer);
+    vs->init_range_length = range_length;
+    vs->packets_written = 0;
+    vs->start_pos = range_length;
+    if (!byterange_mode) {
+        hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+    }
+    return avio_open_dyn_buf(&oc->pb);
+}
+
 static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
                                    VariantStream *vs) {
 
@@ -552,7 +891,10 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         }
 
         proto = avio_find_protocol_name(s->url);
-        if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
+        if (hls->io_thread) {
+            if ((ret = hls_queue_delete(s, path, hls->method || (proto && !av_strcasecmp(proto, "http")))) < 0)
+                goto fail;
+        } else if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
             av_dict_set(&options, "method", "DELETE", 0);
             if ((ret = vs->avf->io_open(vs->avf, &out, path, AVIO_FLAG_WRITE, &options)) < 0) {
                 if (hls->ignore_io_errors)
@@ -583,7 +925,12 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
             av_strlcpy(sub_path, vtt_dirname, sub_path_size);
             av_strlcat(sub_path, segment->sub_filename, sub_path_size);
 
-            if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
+            if (hls->io_thread) {
+                if ((ret = hls_queue_delete(s, sub_path, hls->method || (proto && !av_strcasecmp(proto, "http")))) < 0) {
+                    av_free(sub_path);
+                    goto fail;
+                }
+            } else if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
                 av_dict_set(&options, "method", "DELETE", 0);
                 if ((ret = vs->vtt_avf->io_open(vs->vtt_avf, &out, sub_path, AVIO_FLAG_WRITE, &options)) < 0) {
                     if (hls->ignore_io_errors)
@@ -963,10 +1310,11 @@ static int sls_flag_check_duration_size(HLSContext *hls, VariantStream *vs)
     return ret;
 }
 
-static void sls_flag_file_rename(HLSContext *hls, VariantStream *vs, char *old_filename) {
+static void sls_flag_file_rename(AVFormatContext *s, VariantStream *vs, char *old_filename) {
+    HLSContext *hls = s->priv_data;
     if ((hls->flags & (HLS_SECOND_LEVEL_SEGMENT_SIZE | HLS_SECOND_LEVEL_SEGMENT_DURATION)) &&
         strlen(vs->current_segment_final_filename_fmt)) {
-        ff_rename(old_filename, vs->avf->url, hls);
+        hlsenc_rename(s, old_filename, vs->avf->url);
     }
 }
 
@@ -1218,7 +1566,7 @@ static int hls_rename_temp_file(AVFormatContext *s, AVFormatContext *oc)
     if (!final_filename)
         return AVERROR(ENOMEM);
     final_filename[len-4] = '\0';
-    ret = ff_rename(oc->url, final_filename, s);
+    ret = hlsenc_rename(s, oc->url, final_filename);
     oc->url[len-4] = '\0';
     av_freep(&final_filename);
     return ret;
@@ -1425,7 +1773,7 @@ fail:
     av_freep(&m3u8_rel_name);
     hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
     if (use_temp_file)
-        ff_rename(temp_filename, hls->master_m3u8_url, s);
+        hlsenc_rename(s, temp_filename, hls->master_m3u8_url);
 
     return ret;
 }
@@ -1491,6 +1839,8 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     if (vs->has_video && (hls->flags & HLS_INDEPENDENT_SEGMENTS)) {
         avio_printf((byterange_mode || hls->segment_type == SEGMENT_TYPE_FMP4) ? hls->m3u8_out : vs->out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
     }
+    if (hls->part_time > 0)
+        ff_hls_write_part_inf(hls->m3u8_out, hls->part_time);
     for (en = vs->segments; en; en = en->next) {
         if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
                                     av_strcasecmp(en->iv_string, iv_string))) {
@@ -1516,6 +1866,19 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         }
     }
 
+    if (!last && hls->part_time > 0 && vs->segment_out_open) {
+        char *filename = (char *)av_basename(vs->avf->url);
+        int i;
+
+        if (!vs->segments)
+            ff_hls_write_init_file(hls->m3u8_out, vs->fmp4_init_filename, 0, 0, 0);
+        for (i = 0; i < vs->nb_parts; i++)
+            ff_hls_write_part(hls->m3u8_out, vs->parts[i].duration, vs->baseurl,
+                              filename, vs->parts[i].size, vs->parts[i].pos,
+                              vs->parts[i].independent);
+        ff_hls_write_preload_hint(hls->m3u8_out, vs->baseurl, filename, vs->part_pos);
+    }
+
     if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
         ff_hls_write_end_list((byterange_mode || hls->segment_type == SEGMENT_TYPE_FMP4) ? hls->m3u8_out : vs->out);
 
@@ -1547,9 +1910,9 @@ fail:
     hlsenc_io_close(s, (byterange_mode || hls->segment_type == SEGMENT_TYPE_FMP4) ? &hls->m3u8_out : &vs->out, temp_filename);
     hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
     if (use_temp_file) {
-        ff_rename(temp_filename, vs->m3u8_name, s);
+        hlsenc_rename(s, temp_filename, vs->m3u8_name);
         if (vs->vtt_m3u8_name)
-            ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+            hlsenc_rename(s, temp_vtt_filename, vs->vtt_m3u8_name);
     }
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs) < 0)
@@ -2245,6 +2608,66 @@ static int hls_write_header(AVFormatContext *s)
     return ret;
 }
 
+/**
+ * Send the samples buffered since the last part as one moof/mdat chunk
+ * of the segment being written, and announce it in the playlist.
+ */
+static int hls_flush_part(AVFormatContext *s, VariantStream *vs, double duration)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    AVDictionary *options = NULL;
+    HLSPart *part;
+    int range_length = 0;
+    int ret;
+
+    if (!vs->init_range_length) {
+        av_write_frame(oc, NULL); /* writes the moov */
+        avio_flush(oc->pb);
+        ret = write_init_file(s, vs);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (!vs->segment_out_open) {
+        set_http_options(s, &options, hls);
+        ret = hlsenc_io_open(s, &vs->out, oc->url, &options);
+        av_dict_free(&options);
+        if (ret < 0) {
+            av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                   "Failed to open file '%s'\n", oc->url);
+            return ret;
+        }
+        write_styp(vs->out);
+        vs->part_pos = avio_tell(vs->out);
+        vs->segment_out_open = 1;
+    }
+
+    ret = flush_dynbuf(vs, &range_length);
+    if (ret < 0)
+        return ret;
+    avio_flush(vs->out);
+
+    if (vs->nb_parts == vs->parts_size) {
+        int new_size = FFMAX(2 * vs->parts_size, 8);
+        HLSPart *parts = av_realloc_array(vs->parts, new_size, sizeof(*parts));
+        if (!parts)
+            return AVERROR(ENOMEM);
+        vs->parts      = parts;
+        vs->parts_size = new_size;
+    }
+    part = &vs->parts[vs->nb_parts++];
+    part->duration    = duration;
+    part->pos         = vs->part_pos;
+    part->size        = range_length;
+    part->independent = vs->part_independent;
+    vs->part_pos     += range_length;
+
+    if (hls->pl_type != PLAYLIST_TYPE_VOD)
+        return hls_window(s, 0, vs);
+    return 0;
+}
+
 static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     HLSContext *hls = s->priv_data;
@@ -2257,11 +2680,14 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
     int range_length = 0;
     const char *proto = NULL;
     int use_temp_file = 0;
-    uint8_t *buffer = NULL;
     VariantStream *vs = NULL;
     AVDictionary *options = NULL;
     char *old_filename = NULL;
 
+    /* a write or upload in the I/O thread failed */
+    if (hls->io_error)
+        return hls->io_error;
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
         for (j = 0; j < vs->nb_streams; j++) {
@@ -2334,20 +2760,17 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
         av_write_frame(oc, NULL); /* Flush any buffered data */
         new_start_pos = avio_tell(oc->pb);
+        /* the dynamic buffer restarts at every part, so count the parts
+         * already sent to get the offset into the segment */
+        if (vs->segment_out_open)
+            new_start_pos += vs->part_pos;
         vs->size = new_start_pos - vs->start_pos;
         avio_flush(oc->pb);
         if (hls->segment_type == SEGMENT_TYPE_FMP4) {
             if (!vs->init_range_length) {
-                range_length = avio_close_dyn_buf(oc->pb, &buffer);
-                avio_write(vs->out, buffer, range_length);
-                av_free(buffer);
-                vs->init_range_length = range_length;
-                avio_open_dyn_buf(&oc->pb);
-                vs->packets_written = 0;
-                vs->start_pos = range_length;
-                if (!byterange_mode) {
-                    hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
-                }
+                ret = write_init_file(s, vs);
+                if (ret < 0)
+                    return ret;
             }
         }
         if (!byterange_mode) {
@@ -2386,21 +2809,28 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
                 if (!filename) {
                     return AVERROR(ENOMEM);
                 }
-                ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                if (ret < 0) {
-                    av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
-                           "Failed to open file '%s'\n", filename);
-                    return hls->ignore_io_errors ? 0 : ret;
-                }
-                if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-                    write_styp(vs->out);
+                if (!vs->segment_out_open) {
+                    ret = hlsenc_io_open(s, &vs->out, filename, &options);
+                    if (ret < 0) {
+                        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                               "Failed to open file '%s'\n", filename);
+                        av_free(filename);
+                        return hls->ignore_io_errors ? 0 : ret;
+                    }
+                    if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+                        write_styp(vs->out);
+                    }
                 }
                 ret = flush_dynbuf(vs, &range_length);
                 if (ret < 0) {
+                    av_free(filename);
                     return ret;
                 }
+                if (vs->segment_out_open)
+                    vs->size = vs->part_pos + range_length;
                 hlsenc_io_close(s, &vs->out, filename);
                 av_free(filename);
+                vs->segment_out_open = 0;
             }
         }
 
@@ -2417,6 +2847,10 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             ret = hls_append_segment(s, hls, vs, vs->duration, vs->start_pos, vs->size);
             vs->end_pts = pkt->pts;
             vs->duration = 0;
+            vs->nb_parts = 0;
+            vs->part_pos = 0;
+            vs->part_start_pts = pkt->pts;
+            vs->part_independent = 1;
             if (ret < 0) {
                 av_free(old_filename);
                 return ret;
@@ -2438,7 +2872,7 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             vs->start_pos = new_start_pos;
             if (vs->size >= hls->max_seg_size) {
                 vs->sequence++;
-                sls_flag_file_rename(hls, vs, old_filename);
+                sls_flag_file_rename(s, vs, old_filename);
                 ret = hls_start(s, vs);
                 vs->start_pos = 0;
                 /* When split segment by byte, the duration is short than hls_time,
@@ -2448,7 +2882,7 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             vs->number++;
         } else {
             vs->start_pos = new_start_pos;
-            sls_flag_file_rename(hls, vs, old_filename);
+            sls_flag_file_rename(s, vs, old_filename);
             ret = hls_start(s, vs);
         }
         av_free(old_filename);
@@ -2459,6 +2893,22 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     }
 
+    if (hls->part_time > 0 && is_ref_pkt && oc == vs->avf) {
+        if (vs->part_start_pts == AV_NOPTS_VALUE) {
+            vs->part_start_pts = pkt->pts;
+            vs->part_independent = 1;
+        } else if (vs->packets_written &&
+                   av_compare_ts(pkt->pts - vs->part_start_pts, st->time_base,
+                                 lrint(hls->part_time * AV_TIME_BASE), AV_TIME_BASE_Q) >= 0) {
+            ret = hls_flush_part(s, vs, (double)(pkt->pts - vs->part_start_pts) *
+                                        st->time_base.num / st->time_base.den);
+            if (ret < 0)
+                return hls->ignore_io_errors ? 0 : ret;
+            vs->part_start_pts = pkt->pts;
+            vs->part_independent = !vs->has_video || (pkt->flags & AV_PKT_FLAG_KEY);
+        }
+    }
+
     vs->packets_written++;
     if (oc->pb) {
         ret = ff_write_chained(oc, stream_index, pkt, s, 0);
@@ -2502,6 +2952,7 @@ static void hls_free_variant_streams(struct HLSContext *hls)
         av_freep(&vs->ccgroup);
         av_freep(&vs->baseurl);
         av_freep(&vs->varname);
+        av_freep(&vs->parts);
     }
 }
 
@@ -2557,12 +3008,12 @@ static int hls_write_trailer(struct AVFormatContext *s)
                 vs->start_pos = range_length;
                 byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
                 if (!byterange_mode) {
-                    ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+                    ff_format_io_close(s, &vs->out);
                 }
             }
         }
-        if (!(hls->flags & HLS_SINGLE_FILE)) {
+        if (!(hls->flags & HLS_SINGLE_FILE) && !vs->segment_out_open) {
             set_http_options(s, &options, hls);
             ret = hlsenc_io_open(s, &vs->out, filename, &options);
             if (ret < 0) {
@@ -2576,9 +3027,11 @@ static int hls_write_trailer(struct AVFormatContext *s)
         if (ret < 0)
             goto failed;
 
-        vs->size = range_length;
+        vs->size = vs->segment_out_open ? vs->part_pos + range_length : range_length;
         hlsenc_io_close(s, &vs->out, filename);
         av_free(filename);
+        vs->segment_out_open = 0;
+        vs->nb_parts = 0;
 
 failed:
         av_write_trailer(oc);
@@ -2601,12 +3054,13 @@ failed:
         /* after av_write_trailer, then duration + 1 duration per packet */
         hls_append_segment(s, hls, vs, vs->duration + vs->dpp, vs->start_pos, vs->size);
 
-        sls_flag_file_rename(hls, vs, old_filename);
+        sls_flag_file_rename(s, vs, old_filename);
 
         if (vtt_oc) {
             if (vtt_oc->pb)
                 av_write_trailer(vtt_oc);
             vs->size = avio_tell(vs->vtt_avf->pb) - vs->start_pos;
+            hlsenc_io_close(s, &vtt_oc->pb, vtt_oc->url);
             ff_format_io_close(s, &vtt_oc->pb);
             avformat_free_context(vtt_oc);
         }
@@ -2626,13 +3080,19 @@ failed:
         av_freep(&ccs->language);
     }
 
-    ff_format_io_close(s, &hls->m3u8_out);
-    ff_format_io_close(s, &hls->sub_m3u8_out);
+    hlsenc_io_close(s, &hls->m3u8_out, NULL);
+    hlsenc_io_close(s, &hls->sub_m3u8_out, NULL);
     av_freep(&hls->key_basename);
     av_freep(&hls->var_streams);
     av_freep(&hls->cc_streams);
     av_freep(&hls->master_m3u8_url);
+
+#if HAVE_THREADS
+    /* the last segments and playlists may still be queued */
+    return hls_io_thread_stop(s);
+#else
     return 0;
+#endif
 }
 
 
@@ -2717,6 +3177,25 @@ static int hls_init(AVFormatContext *s)
         av_log(hls, AV_LOG_DEBUG, "start_number evaluated to %"PRId64"\n", hls->start_sequence);
     }
 
+    if (hls->io_thread) {
+        if (!HAVE_THREADS) {
+            av_log(s, AV_LOG_WARNING, "Built without threads, ignoring io_thread\n");
+            hls->io_thread = 0;
+        } else if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0 || hls->part_time > 0) {
+            av_log(s, AV_LOG_WARNING,
+                   "io_thread is not supported with byte range or partial segments, ignoring it\n");
+            hls->io_thread = 0;
+        }
+    }
+#if HAVE_THREADS
+    if (hls->io_thread) {
+        if (hls->http_persistent)
+            av_log(s, AV_LOG_WARNING, "http_persistent is not used with io_thread\n");
+        if ((ret = hls_io_thread_start(s)) < 0)
+            goto fail;
+    }
+#endif
+
     hls->recording_time = (hls->init_time ? hls->init_time : hls->time) * AV_TIME_BASE;
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
@@ -2728,8 +3207,22 @@ static int hls_init(AVFormatContext *s)
         vs->sequence       = hls->start_sequence;
         vs->start_pts      = AV_NOPTS_VALUE;
         vs->end_pts      = AV_NOPTS_VALUE;
+        vs->part_start_pts = AV_NOPTS_VALUE;
         vs->current_segment_final_filename_fmt[0] = '\0';
 
+        if (hls->part_time > 0 &&
+            (hls->segment_type != SEGMENT_TYPE_FMP4 ||
+             (hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0 ||
+             hls->key_info_file || hls->encrypt)) {
+            av_log(s, AV_LOG_WARNING,
+                   "hls_part_time requires fmp4 segments written to separate unencrypted files, disabling partial segments\n");
+            hls->part_time = 0;
+        }
+        if (hls->part_time > 0 && hls->flags & HLS_TEMP_FILE) {
+            av_log(s, AV_LOG_WARNING, "Partial segments are sent as they are written, ignoring temp_file\n");
+            hls->flags &= ~HLS_TEMP_FILE;
+        }
+
         if (hls->flags & HLS_SPLIT_BY_TIME && hls->flags & HLS_INDEPENDENT_SEGMENTS) {
             // Independent segments cannot be guaranteed when splitting by time
             hls->flags &= ~HLS_INDEPENDENT_SEGMENTS;
@@ -2968,11 +3461,23 @@ fail:
     return ret;
 }
 
+static void hls_deinit(AVFormatContext *s)
+{
+    HLSContext *hls = s->priv_data;
+
+#if HAVE_THREADS
+    /* only still running if the trailer was not written */
+    hls_io_thread_stop(s);
+#endif
+    hls_free_pending_files(hls);
+}
+
 #define OFFSET(x) offsetof(HLSContext, x)
 #define E AV_OPT_FLAG_ENCODING_PARAM
 static const AVOption options[] = {
     {"start_number",  "set first number in the sequence",        OFFSET(start_sequence),AV_OPT_TYPE_INT64,  {.i64 = 0},     0, INT64_MAX, E},
     {"hls_time",      "set segment length in seconds",           OFFSET(time),    AV_OPT_TYPE_FLOAT,  {.dbl = 2},     0, FLT_MAX, E},
+    {"hls_part_time", "set partial segment length in seconds for low latency fmp4 output", OFFSET(part_time), AV_OPT_TYPE_FLOAT, {.dbl = 0}, 0, FLT_MAX, E},
     {"hls_init_time", "set segment length in seconds at init list",           OFFSET(init_time),    AV_OPT_TYPE_FLOAT,  {.dbl = 0},     0, FLT_MAX, E},
     {"hls_list_size", "set maximum number of playlist entries",  OFFSET(max_nb_segments),    AV_OPT_TYPE_INT,    {.i64 = 5},     0, INT_MAX, E},
     {"hls_delete_threshold", "set number of unreferenced segments to keep before deleting",  OFFSET(hls_delete_threshold),    AV_OPT_TYPE_INT,    {.i64 = 1},     1, INT_MAX, E},
@@ -3036,6 +3541,8 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"io_thread", "write, encrypt and upload segments and playlists in a separate thread", OFFSET(io_thread), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    {"io_queue_size", "set the maximum number of file operations waiting for the I/O thread", OFFSET(io_queue_size), AV_OPT_TYPE_INT, { .i64 = 32 }, 1, INT_MAX, E },
     { NULL },
 };
 
@@ -3060,5 +3567,6 @@ AVOutputFormat ff_hls_muxer = {
     .write_header   = hls_write_header,
     .write_packet   = hls_write_packet,
     .write_trailer  = hls_write_trailer,
+    .deinit         = hls_deinit,
     .priv_class     = &hls_class,
 };
@@ -161,6 +161,31 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
     return 0;
 }
 
+void ff_hls_write_part_inf(AVIOContext *out, double part_target) {
+    if (!out)
+        return;
+    avio_printf(out, "#EXT-X-PART-INF:PART-TARGET=%f\n", part_target);
+    avio_printf(out, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%f\n", 3 * part_target);
+}
+
+void ff_hls_write_part(AVIOContext *out, double duration,
+                       char *baseurl, char *filename,
+                       int64_t size, int64_t pos, int independent) {
+    if (!out || !filename)
+        return;
+    avio_printf(out, "#EXT-X-PART:DURATION=%f,URI=\"%s%s\",BYTERANGE=\"%"PRId64"@%"PRId64"\"%s\n",
+                duration, baseurl ? baseurl : "", filename, size, pos,
+                independent ? ",INDEPENDENT=YES" : "");
+}
+
+void ff_hls_write_preload_hint(AVIOContext *out, char *baseurl,
+                               char *filename, int64_t pos) {
+    if (!out || !filename)
+        return;
+    avio_printf(out, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%s\",BYTERANGE-START=%"PRId64"\n",
+                baseurl ? baseurl : "", filename, pos);
+}
+
 void ff_hls_write_end_list (AVIOContext *out) {
     if (!out)
         return;
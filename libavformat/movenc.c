@@ -68,6 +68,7 @@ static const AVOption options[] = {
     { "frag_custom", "Flush fragments on caller requests", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_CUSTOM}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "isml", "Create a live smooth streaming feed (for pushing to a publishing point)", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_ISML}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "faststart", "Run a second pass to put the index (moov atom) at the beginning of the file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FASTSTART}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
+    { "reserve_moov", "Reserve space for the index (moov atom) at the beginning of the file, estimated from the stream durations", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_RESERVE_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "omit_tfhd_offset", "Omit the base data offset in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_OMIT_TFHD_OFFSET}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "disable_chpl", "Disable Nero chapter atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_DISABLE_CHPL}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "default_base_moof", "Set the default-base-is-moof flag in tfhd atoms", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_DEFAULT_BASE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
@@ -6103,6 +6104,88 @@ static int mov_create_dvd_sub_decoder_specific_info(MOVTrack *track,
     return 0;
 }
 
+/*
+ * Estimate the size of the moov atom from the stream durations, so that it
+ * can be reserved at the beginning of the file. This is an upper bound for
+ * streams with a constant frame rate, assuming one chunk per sample.
+ */
+static int64_t mov_estimate_moov_size(AVFormatContext *s)
+{
+    AVDictionaryEntry *t = NULL;
+    int64_t size = 4096; /* ftyp, mvhd, iods, udta */
+    int i;
+
+    while ((t = av_dict_get(s->metadata, "", t, AV_DICT_IGNORE_SUFFIX)))
+        size += strlen(t->key) + strlen(t->value) + 32;
+    for (i = 0; i < s->nb_chapters; i++) {
+        /* chpl entry, text track sample and its tables */
+        size += 64 + 2 * 256;
+    }
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        double duration, rate;
+        int sample_size;
+
+        if (st->duration > 0)
+            duration = st->duration * av_q2d(st->time_base);
+        else if (s->duration > 0)
+            duration = s->duration / (double)AV_TIME_BASE;
+        else
+            return AVERROR(EINVAL);
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            if (st->avg_frame_rate.num && st->avg_frame_rate.den)
+                rate = av_q2d(st->avg_frame_rate);
+            else if (st->r_frame_rate.num && st->r_frame_rate.den)
+                rate = av_q2d(st->r_frame_rate);
+            else
+                return AVERROR(EINVAL);
+            /* stsz, stts, ctts, stss, co64, stsc */
+            sample_size = 4 + 8 + 8 + 4 + 8 + 12;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (par->sample_rate <= 0)
+                return AVERROR(EINVAL);
+            rate = par->sample_rate / (double)(par->frame_size > 0 ? par->frame_size : 1024);
+            /* stsz, stts, co64, stsc */
+            sample_size = 4 + 8 + 8 + 12;
+            break;
+        default:
+            /* sparse streams, assume a sample per second */
+            rate = 1;
+            sample_size = 4 + 8 + 8 + 12;
+            break;
+        }
+
+        size += 2048 + par->extradata_size;
+        while ((t = av_dict_get(st->metadata, "", t, AV_DICT_IGNORE_SUFFIX)))
+            size += strlen(t->key) + strlen(t->value) + 32;
+        size += (int64_t)(duration * rate + 1) * sample_size;
+        /* tmcd track */
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            (av_dict_get(s->metadata,  "timecode", NULL, 0) ||
+             av_dict_get(st->metadata, "timecode", NULL, 0)))
+            size += 2048;
+    }
+
+    /* some headroom for durations slightly off */
+    size += size >> 4;
+    return size > INT_MAX ? AVERROR(EINVAL) : size;
+}
+
+/*
+ * Whether the output can be opened a second time for reading, as needed to
+ * move the data after the header once it has been written.
+ */
+static int mov_can_reopen_output(AVFormatContext *s)
+{
+    return !(s->flags & AVFMT_FLAG_CUSTOM_IO) &&
+           s->pb && (s->pb->seekable & AVIO_SEEKABLE_NORMAL);
+}
+
 static int mov_init(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6158,6 +6241,36 @@ static int mov_init(AVFormatContext *s)
         mov->reserved_moov_size = -1;
     }
 
+    if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV) {
+        if (mov->flags & FF_MOV_FLAG_FRAGMENT) {
+            av_log(s, AV_LOG_WARNING, "reserve_moov is not supported with fragmented output, ignoring\n");
+            mov->flags &= ~FF_MOV_FLAG_RESERVE_MOOV;
+        } else {
+            if (mov->reserved_moov_size <= 0) {
+                int64_t size = mov_estimate_moov_size(s);
+                if (size < 0 && mov_can_reopen_output(s)) {
+                    av_log(s, AV_LOG_WARNING, "Cannot estimate the moov size without "
+                           "stream durations and rates, running a second pass instead\n");
+                    mov->flags &= ~FF_MOV_FLAG_RESERVE_MOOV;
+                    mov->flags |= FF_MOV_FLAG_FASTSTART;
+                    mov->reserved_moov_size = -1;
+                } else if (size < 0) {
+                    av_log(s, AV_LOG_WARNING, "Cannot estimate the moov size without "
+                           "stream durations and rates, writing it at the end\n");
+                    mov->flags &= ~FF_MOV_FLAG_RESERVE_MOOV;
+                    mov->reserved_moov_size = 0;
+                } else {
+                    mov->reserved_moov_size = size;
+                }
+            }
+            if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV) {
+                av_log(s, AV_LOG_VERBOSE, "Reserving %d bytes for the moov atom\n",
+                       mov->reserved_moov_size);
+                mov->flags &= ~FF_MOV_FLAG_FASTSTART;
+            }
+        }
+    }
+
     if (mov->use_editlist < 0) {
         mov->use_editlist = 1;
         if (mov->flags & FF_MOV_FLAG_FRAGMENT &&
@@ -6632,28 +6745,25 @@ static int compute_sidx_size(AVFormatContext *s)
     return sidx_size;
 }
 
-static int shift_data(AVFormatContext *s)
+/*
+ * Move the data from start to the end of the output by shift bytes.
+ */
+static int move_data(AVFormatContext *s, int64_t start, int shift)
 {
-    int ret = 0, moov_size;
-    MOVMuxContext *mov = s->priv_data;
+    int ret = 0;
     int64_t pos, pos_end = avio_tell(s->pb);
     uint8_t *buf, *read_buf[2];
     int read_buf_id = 0;
     int read_size[2];
+    /* blocks must not be smaller than the shift, not to overwrite unread data */
+    int block_size = FFMAX(shift, 1 << 16);
     AVIOContext *read_pb;
 
-    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
-        moov_size = compute_sidx_size(s);
-    else
-        moov_size = compute_moov_size(s);
-    if (moov_size < 0)
-        return moov_size;
-
-    buf = av_malloc(moov_size * 2);
+    buf = av_malloc(block_size * 2);
     if (!buf)
         return AVERROR(ENOMEM);
     read_buf[0] = buf;
-    read_buf[1] = buf + moov_size;
+    read_buf[1] = buf + block_size;
 
     /* Shift the data: the AVIO context of the output can only be used for
      * writing, so we re-open the same output, but for reading. It also avoids
@@ -6669,18 +6779,18 @@ static int shift_data(AVFormatContext *s)
     /* mark the end of the shift to up to the last data we wrote, and get ready
      * for writing */
     pos_end = avio_tell(s->pb);
-    avio_seek(s->pb, mov->reserved_header_pos + moov_size, SEEK_SET);
+    avio_seek(s->pb, start + shift, SEEK_SET);
 
-    /* start reading at where the new moov will be placed */
-    avio_seek(read_pb, mov->reserved_header_pos, SEEK_SET);
+    /* start reading at where the data will be overwritten first */
+    avio_seek(read_pb, start, SEEK_SET);
     pos = avio_tell(read_pb);
 
 #define READ_BLOCK do {                                                             \
-    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], moov_size);  \
+    read_size[read_buf_id] = avio_read(read_pb, read_buf[read_buf_id], block_size); \
     read_buf_id ^= 1;                                                               \
 } while (0)
 
-    /* shift data by chunk of at most moov_size */
+    /* shift data by chunk of at most block_size */
     READ_BLOCK;
     do {
         int n;
@@ -6698,6 +6808,65 @@ end:
     return ret;
 }
 
+static int shift_data(AVFormatContext *s)
+{
+    int moov_size;
+    MOVMuxContext *mov = s->priv_data;
+
+    if (mov->flags & FF_MOV_FLAG_FRAGMENT)
+        moov_size = compute_sidx_size(s);
+    else
+        moov_size = compute_moov_size(s);
+    if (moov_size < 0)
+        return moov_size;
+
+    return move_data(s, mov->reserved_header_pos, moov_size);
+}
+
+/*
+ * Make sure the moov atom and a free atom fit in the space reserved at the
+ * beginning of the file. If the estimate was too small, the data is moved by
+ * the missing bytes only.
+ */
+static int fit_reserved_moov(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int i, moov_size, shift = 0, ret;
+
+    while (1) {
+        int avail = mov->reserved_moov_size + shift;
+        int add;
+
+        moov_size = get_moov_size(s);
+        if (moov_size < 0)
+            return moov_size;
+        if (moov_size + 8 <= avail)
+            break;
+        /* the offsets may grow the chunk offset tables, try again */
+        add = moov_size + 8 - avail;
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset += add;
+        shift += add;
+    }
+    if (!shift)
+        return 0;
+
+    if (!mov_can_reopen_output(s)) {
+        for (i = 0; i < mov->nb_streams; i++)
+            mov->tracks[i].data_offset -= shift;
+        av_log(s, AV_LOG_WARNING, "Reserved moov size is %d bytes too small and "
+               "the output cannot be reopened, writing the moov at the end\n", shift);
+        return 1;
+    }
+
+    av_log(s, AV_LOG_WARNING, "Reserved moov size is %d bytes too small, "
+           "moving the data\n", shift);
+    if ((ret = move_data(s, mov->reserved_header_pos + mov->reserved_moov_size, shift)) < 0)
+        return ret;
+    mov->reserved_moov_size += shift;
+    return 0;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6772,8 +6941,24 @@ static int mov_write_trailer(AVFormatContext *s)
                 return res;
         } else if (mov->reserved_moov_size > 0) {
             int64_t size;
+            int moov_at_end = 0;
+            if (mov->flags & FF_MOV_FLAG_RESERVE_MOOV) {
+                avio_seek(pb, moov_pos, SEEK_SET);
+                if ((res = fit_reserved_moov(s)) < 0)
+                    return res;
+                moov_at_end = res;
+                if (!moov_at_end) {
+                    moov_pos = avio_tell(pb);
+                    avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+                }
+            }
             if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
                 return res;
+            if (moov_at_end) {
+                /* the reserved space is left as a free atom */
+                moov_pos = avio_tell(pb);
+                avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+            }
             size = mov->reserved_moov_size - (avio_tell(pb) - mov->reserved_header_pos);
             if (size < 8){
                 av_log(s, AV_LOG_ERROR, "reserved_moov_size is too small, needed %"PRId64" additional\n", 8-size);
@@ -258,6 +258,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_NEGATIVE_CTS_OFFSETS  (1 << 19)
 #define FF_MOV_FLAG_FRAG_EVERY_FRAME      (1 << 20)
 #define FF_MOV_FLAG_SKIP_SIDX             (1 << 21)
+#define FF_MOV_FLAG_RESERVE_MOOV          (1 << 22)
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
@@ -0,0 +1,459 @@
+/*
+ * Stream probing results cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Cache of the results of avformat_find_stream_info(), one text file per
+ * URL in the directory set with the probe_cache option. An entry is only
+ * used if the fingerprint of the input still matches.
+ */
+
+#include <sys/stat.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/md5.h"
+#include "libavutil/pixdesc.h"
+#include "libavcodec/avcodec.h"
+#include "avformat.h"
+#include "internal.h"
+#include "os_support.h"
+#include "probecache.h"
+
+#define HEAD_SIZE 4096
+#define MAX_ENTRY_SIZE (1 << 20)
+
+#define PAR(x, type) { #x, offsetof(AVCodecParameters, x), type }
+enum { PAR_INT, PAR_INT64 };
+
+static const struct {
+    const char *name;
+    int offset;
+    int type;
+} par_fields[] = {
+    PAR(codec_type,            PAR_INT),
+    PAR(codec_id,              PAR_INT),
+    PAR(codec_tag,             PAR_INT),
+    PAR(format,                PAR_INT),
+    PAR(bit_rate,              PAR_INT64),
+    PAR(bits_per_coded_sample, PAR_INT),
+    PAR(bits_per_raw_sample,   PAR_INT),
+    PAR(profile,               PAR_INT),
+    PAR(level,                 PAR_INT),
+    PAR(width,                 PAR_INT),
+    PAR(height,                PAR_INT),
+    PAR(sample_aspect_ratio.num, PAR_INT),
+    PAR(sample_aspect_ratio.den, PAR_INT),
+    PAR(field_order,           PAR_INT),
+    PAR(color_range,           PAR_INT),
+    PAR(color_primaries,       PAR_INT),
+    PAR(color_trc,             PAR_INT),
+    PAR(color_space,           PAR_INT),
+    PAR(chroma_location,       PAR_INT),
+    PAR(video_delay,           PAR_INT),
+    PAR(channel_layout,        PAR_INT64),
+    PAR(channels,              PAR_INT),
+    PAR(sample_rate,           PAR_INT),
+    PAR(block_align,           PAR_INT),
+    PAR(frame_size,            PAR_INT),
+    PAR(initial_padding,       PAR_INT),
+    PAR(trailing_padding,      PAR_INT),
+    PAR(seek_preroll,          PAR_INT),
+};
+
+static const char *local_path(const char *url)
+{
+    const char *proto = avio_find_protocol_name(url);
+
+    if (!proto || strcmp(proto, "file"))
+        return NULL;
+    av_strstart(url, "file:", &url);
+    return url;
+}
+
+static int local_file_info(const char *url, int64_t *size, int64_t *mtime)
+{
+    const char *path = local_path(url);
+    struct stat st;
+
+    *size  = -1;
+    *mtime = -1;
+    if (!path || stat(path, &st) < 0)
+        return 0;
+    *size  = st.st_size;
+    *mtime = st.st_mtime;
+    return 1;
+}
+
+static char *entry_path(AVFormatContext *s, const char *url)
+{
+    uint8_t md5[16];
+    char hex[2 * sizeof(md5) + 1];
+
+    av_md5_sum(md5, (const uint8_t *)url, strlen(url));
+    ff_data_to_hex(hex, md5, sizeof(md5), 1);
+    hex[2 * sizeof(md5)] = '\0';
+    return av_asprintf("%s/%s.probe", s->probe_cache, hex);
+}
+
+static int read_entry(AVFormatContext *s, const char *url, AVBPrint *bp)
+{
+    AVIOContext *pb = NULL;
+    char *path = entry_path(s, url);
+    int ret;
+
+    if (!path)
+        return AVERROR(ENOMEM);
+    ret = avio_open2(&pb, path, AVIO_FLAG_READ, &s->interrupt_callback, NULL);
+    av_free(path);
+    if (ret < 0)
+        return ret;
+    ret = avio_read_to_bprint(pb, bp, MAX_ENTRY_SIZE);
+    avio_closep(&pb);
+    if (ret < 0)
+        return ret;
+    return av_bprint_is_complete(bp) ? 0 : AVERROR(ENOMEM);
+}
+
+ff_const59 AVInputFormat *ff_probe_cache_find_format(AVFormatContext *s, const char *url,
+                                                     int *score)
+{
+    ff_const59 AVInputFormat *fmt = NULL;
+    int64_t size, mtime, cached_size, cached_mtime;
+    char name[64], *line, *next;
+    AVBPrint bp;
+
+    if (!local_file_info(url, &size, &mtime))
+        return NULL;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    if (read_entry(s, url, &bp) < 0)
+        goto end;
+
+    for (line = av_strtok(bp.str, "\n", &next); line; line = av_strtok(NULL, "\n", &next)) {
+        if (sscanf(line, "source %"SCNd64" %"SCNd64, &cached_size, &cached_mtime) == 2) {
+            if (cached_size != size || cached_mtime != mtime)
+                break;
+        } else if (sscanf(line, "format %63s %d", name, score) == 2) {
+            fmt = av_find_input_format(name);
+            break;
+        }
+    }
+    if (fmt)
+        av_log(s, AV_LOG_VERBOSE, "Using cached input format %s\n", fmt->name);
+
+end:
+    av_bprint_finalize(&bp, NULL);
+    return fmt;
+}
+
+int ff_probe_cache_fingerprint(AVFormatContext *s,
+                               uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE])
+{
+    struct AVMD5 *md5 = av_md5_alloc();
+    int64_t size, mtime;
+    AVBPrint bp;
+    int i, ret = 0;
+
+    if (!md5)
+        return AVERROR(ENOMEM);
+    av_md5_init(md5);
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+
+    local_file_info(s->url, &size, &mtime);
+    av_bprintf(&bp, "%s\n%s\n%"PRId64" %"PRId64"\n", s->url, s->iformat->name, size, mtime);
+
+    /* A live input cannot be rewound, it is identified by its streams only. */
+    if (s->pb && (s->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        int64_t pos = avio_tell(s->pb);
+        uint8_t head[HEAD_SIZE];
+        int len;
+
+        av_bprintf(&bp, "%"PRId64"\n", avio_size(s->pb));
+        if ((ret = avio_seek(s->pb, 0, SEEK_SET)) < 0)
+            goto end;
+        len = avio_read(s->pb, head, sizeof(head));
+        if ((ret = avio_seek(s->pb, pos, SEEK_SET)) < 0)
+            goto end;
+        if (len > 0)
+            av_md5_update(md5, head, len);
+    }
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        av_bprintf(&bp, "%d %d %d %d\n", st->id, st->codecpar->codec_type,
+                   st->codecpar->codec_id, st->request_probe > 0);
+    }
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_md5_update(md5, (const uint8_t *)bp.str, bp.len);
+    av_md5_final(md5, fingerprint);
+    ret = 0;
+
+end:
+    av_bprint_finalize(&bp, NULL);
+    av_free(md5);
+    return ret < 0 ? ret : 0;
+}
+
+static int parse_stream(AVFormatContext *s, AVCodecParameters *par,
+                        AVRational *tb, AVRational *avg_frame_rate,
+                        AVRational *r_frame_rate, int64_t *start_time,
+                        const char *str)
+{
+    AVDictionary *dict = NULL;
+    AVDictionaryEntry *e;
+    int i, ret;
+
+    if ((ret = av_dict_parse_string(&dict, str, "=", ":", 0)) < 0)
+        goto end;
+
+    ret = AVERROR_INVALIDDATA;
+    for (i = 0; i < FF_ARRAY_ELEMS(par_fields); i++) {
+        uint8_t *field = (uint8_t *)par + par_fields[i].offset;
+
+        if (!(e = av_dict_get(dict, par_fields[i].name, NULL, 0)))
+            goto end;
+        if (par_fields[i].type == PAR_INT64)
+            *(int64_t *)field = strtoll(e->value, NULL, 10);
+        else
+            *(int *)field = strtol(e->value, NULL, 10);
+    }
+    if (!(e = av_dict_get(dict, "time_base", NULL, 0)) ||
+        sscanf(e->value, "%d/%d", &tb->num, &tb->den) != 2 ||
+        !(e = av_dict_get(dict, "avg_frame_rate", NULL, 0)) ||
+        sscanf(e->value, "%d/%d", &avg_frame_rate->num, &avg_frame_rate->den) != 2 ||
+        !(e = av_dict_get(dict, "r_frame_rate", NULL, 0)) ||
+        sscanf(e->value, "%d/%d", &r_frame_rate->num, &r_frame_rate->den) != 2 ||
+        !(e = av_dict_get(dict, "start_time", NULL, 0)) ||
+        sscanf(e->value, "%"SCNd64, start_time) != 1)
+        goto end;
+
+    /* do not trust a damaged or foreign entry */
+    if ((unsigned)par->codec_type >= AVMEDIA_TYPE_NB ||
+        (par->codec_id != AV_CODEC_ID_NONE && !avcodec_descriptor_get(par->codec_id)) ||
+        tb->num <= 0 || tb->den <= 0 ||
+        par->width < 0 || par->height < 0 ||
+        ((par->width || par->height) &&
+         av_image_check_size(par->width, par->height, 0, s) < 0) ||
+        par->channels < 0 || par->sample_rate < 0 ||
+        par->block_align < 0 || par->frame_size < 0)
+        goto end;
+    if (par->format != -1 &&
+        ((par->codec_type == AVMEDIA_TYPE_VIDEO && !av_pix_fmt_desc_get(par->format)) ||
+         (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+          (unsigned)par->format >= AV_SAMPLE_FMT_NB)))
+        goto end;
+
+    if ((e = av_dict_get(dict, "extradata", NULL, 0))) {
+        int len = strlen(e->value) / 2;
+
+        if (strlen(e->value) & 1)
+            goto end;
+        par->extradata = av_mallocz(len + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!par->extradata) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        par->extradata_size = len;
+        for (i = 0; i < len; i++) {
+            unsigned byte;
+            if (sscanf(e->value + 2 * i, "%2x", &byte) != 1)
+                goto end;
+            par->extradata[i] = byte;
+        }
+    }
+    ret = 0;
+
+end:
+    av_dict_free(&dict);
+    return ret;
+}
+
+int ff_probe_cache_lookup(AVFormatContext *s,
+                          const uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE],
+                          int *nb_streams)
+{
+    AVCodecParameters **pars = NULL;
+    AVRational *rates = NULL;
+    int64_t *start_times = NULL;
+    char hex[2 * PROBE_CACHE_FINGERPRINT_SIZE + 1], cached[2 * PROBE_CACHE_FINGERPRINT_SIZE + 1];
+    char *line, *next;
+    int i, nb_lines = 0, cached_nb_streams = -1, ret;
+    AVBPrint bp;
+
+    *nb_streams = 0;
+    ff_data_to_hex(hex, fingerprint, PROBE_CACHE_FINGERPRINT_SIZE, 1);
+    hex[2 * PROBE_CACHE_FINGERPRINT_SIZE] = '\0';
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    if (read_entry(s, s->url, &bp) < 0) {
+        ret = 0;
+        goto end;
+    }
+
+    pars  = av_mallocz_array(s->nb_streams, sizeof(*pars));
+    rates = av_mallocz_array(s->nb_streams, 3 * sizeof(*rates));
+    start_times = av_mallocz_array(s->nb_streams, sizeof(*start_times));
+    if (!pars || !rates || !start_times) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = 0;
+    line = av_strtok(bp.str, "\n", &next);
+    if (!line || sscanf(line, "fingerprint %32s", cached) != 1 || strcmp(cached, hex))
+        goto end;
+    while ((line = av_strtok(NULL, "\n", &next))) {
+        const AVCodecParameters *cur;
+        const char *str;
+
+        if (sscanf(line, "streams %d", &cached_nb_streams) == 1) {
+            /* The demuxer creates the streams while reading packets. */
+            if (cached_nb_streams > s->nb_streams &&
+                (s->ctx_flags & AVFMTCTX_NOHEADER)) {
+                *nb_streams = cached_nb_streams;
+                goto end;
+            }
+            if (cached_nb_streams != s->nb_streams)
+                goto end;
+            continue;
+        }
+        if (!av_strstart(line, "stream ", &str))
+            continue;
+        if (cached_nb_streams < 0 || nb_lines == s->nb_streams)
+            goto end;
+        i = nb_lines++;
+        if (!(pars[i] = avcodec_parameters_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if (parse_stream(s, pars[i], &rates[3 * i], &rates[3 * i + 1],
+                         &rates[3 * i + 2], &start_times[i], str) < 0 ||
+            av_cmp_q(rates[3 * i], s->streams[i]->time_base))
+            goto end;
+        /* what the demuxer already knows has to agree with the entry */
+        cur = s->streams[i]->codecpar;
+        if ((cur->codec_type != AVMEDIA_TYPE_UNKNOWN &&
+             cur->codec_type != pars[i]->codec_type) ||
+            (cur->codec_id != AV_CODEC_ID_NONE && !s->streams[i]->request_probe &&
+             cur->codec_id != pars[i]->codec_id))
+            goto end;
+    }
+    if (nb_lines != s->nb_streams)
+        goto end;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+
+        if ((ret = avcodec_parameters_copy(st->codecpar, pars[i])) < 0)
+            goto end;
+        st->avg_frame_rate = rates[3 * i + 1];
+        st->r_frame_rate   = rates[3 * i + 2];
+        st->start_time     = start_times[i];
+        st->request_probe  = 0;
+    }
+    av_log(s, AV_LOG_VERBOSE, "Stream parameters restored from the probe cache\n");
+    ret = 1;
+
+end:
+    for (i = 0; pars && i < s->nb_streams; i++)
+        avcodec_parameters_free(&pars[i]);
+    av_free(pars);
+    av_free(rates);
+    av_free(start_times);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
+
+int ff_probe_cache_store(AVFormatContext *s,
+                         const uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE])
+{
+    char hex[2 * PROBE_CACHE_FINGERPRINT_SIZE + 1];
+    char *path = NULL, *tmp_path = NULL;
+    AVIOContext *pb = NULL;
+    int64_t size, mtime;
+    AVBPrint bp;
+    int i, j, ret;
+
+    ff_data_to_hex(hex, fingerprint, PROBE_CACHE_FINGERPRINT_SIZE, 1);
+    hex[2 * PROBE_CACHE_FINGERPRINT_SIZE] = '\0';
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "fingerprint %s\n", hex);
+    if (local_file_info(s->url, &size, &mtime))
+        av_bprintf(&bp, "source %"PRId64" %"PRId64"\n", size, mtime);
+    av_bprintf(&bp, "format %s %d\n", s->iformat->name, s->probe_score);
+    av_bprintf(&bp, "streams %d\n", s->nb_streams);
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        AVCodecParameters *par = st->codecpar;
+
+        av_bprintf(&bp, "stream time_base=%d/%d:avg_frame_rate=%d/%d:r_frame_rate=%d/%d"
+                   ":start_time=%"PRId64,
+                   st->time_base.num, st->time_base.den,
+                   st->avg_frame_rate.num, st->avg_frame_rate.den,
+                   st->r_frame_rate.num, st->r_frame_rate.den, st->start_time);
+        for (j = 0; j < FF_ARRAY_ELEMS(par_fields); j++) {
+            const uint8_t *field = (const uint8_t *)par + par_fields[j].offset;
+            if (par_fields[j].type == PAR_INT64)
+                av_bprintf(&bp, ":%s=%"PRId64, par_fields[j].name, *(const int64_t *)field);
+            else
+                av_bprintf(&bp, ":%s=%d", par_fields[j].name, *(const int *)field);
+        }
+        if (par->extradata_size) {
+            av_bprintf(&bp, ":extradata=");
+            for (j = 0; j < par->extradata_size; j++)
+                av_bprintf(&bp, "%02x", par->extradata[j]);
+        }
+        av_bprintf(&bp, "\n");
+    }
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    /* Write a temporary file first, so that concurrent readers never see
+     * a partial entry. */
+    path     = entry_path(s, s->url);
+    tmp_path = path ? av_asprintf("%s.%p.tmp", path, s) : NULL;
+    if (!tmp_path) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avio_open2(&pb, tmp_path, AVIO_FLAG_WRITE, &s->interrupt_callback, NULL)) < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not write probe cache entry '%s'\n", tmp_path);
+        goto end;
+    }
+    avio_write(pb, bp.str, bp.len);
+    if ((ret = avio_closep(&pb)) < 0)
+        goto end;
+    ret = ff_rename(tmp_path, path, s);
+
+end:
+    av_free(path);
+    av_free(tmp_path);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
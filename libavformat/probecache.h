@@ -0,0 +1,67 @@
+/*
+ * Stream probing results cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PROBECACHE_H
+#define AVFORMAT_PROBECACHE_H
+
+#include <stdint.h>
+
+#include "avformat.h"
+
+#define PROBE_CACHE_FINGERPRINT_SIZE 16
+
+/**
+ * Return the input format cached for a local file, if the file size and
+ * modification time did not change since the entry was written.
+ *
+ * @param score set to the probe score of the cached format
+ */
+ff_const59 AVInputFormat *ff_probe_cache_find_format(AVFormatContext *s, const char *url,
+                                                     int *score);
+
+/**
+ * Compute the fingerprint of an opened input: URL, format, size, modification
+ * time and first bytes when available, and the streams created by the demuxer.
+ * The position of s->pb is preserved.
+ */
+int ff_probe_cache_fingerprint(AVFormatContext *s,
+                               uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE]);
+
+/**
+ * Restore the stream parameters from the cache entry of s->url.
+ *
+ * @param nb_streams if the format has no header and the entry has more
+ *                   streams than s, set to the number of streams of the
+ *                   entry; the lookup can be retried once the demuxer
+ *                   created them. Otherwise set to 0.
+ * @return 1 if the entry matched the fingerprint and was applied, 0 if
+ *         there is no valid entry, a negative error code on failure
+ */
+int ff_probe_cache_lookup(AVFormatContext *s,
+                          const uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE],
+                          int *nb_streams);
+
+/**
+ * Write the cache entry of s->url with the current stream parameters.
+ */
+int ff_probe_cache_store(AVFormatContext *s,
+                         const uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE]);
+
+#endif /* AVFORMAT_PROBECACHE_H */
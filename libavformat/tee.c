@@ -23,6 +23,9 @@
 #include "libavutil/avutil.h"
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
 #include "internal.h"
 #include "avformat.h"
 #include "avio_internal.h"
@@ -43,12 +46,33 @@ typedef struct {
     int use_fifo;
     AVDictionary *fifo_options;
 
+    int use_thread;
+    int thread_queue_size;
+#if HAVE_THREADS
+    pthread_t thread;
+    int thread_started;
+#endif
+    AVThreadMessageQueue *queue;
+
+    /* statistics, updated by the slave thread when there is one */
+    int64_t nb_packets;
+    int64_t latency_sum;
+    int64_t latency_max;
+    int queue_depth_max;
+
     /** map from input to output streams indexes,
      * disabled output streams are set to -1 */
     int *stream_map;
     int header_written;
+    int thread_ret;
 } TeeSlave;
 
+typedef struct TeeMessage {
+    AVPacket pkt;
+    int flush;
+    int64_t queued_time;
+} TeeMessage;
+
 typedef struct TeeContext {
     const AVClass *class;
     unsigned nb_slaves;
@@ -57,6 +81,8 @@ typedef struct TeeContext {
     int use_fifo;
     AVDictionary *fifo_options;
     char *fifo_options_str;
+    int use_thread;
+    int thread_queue_size;
 } TeeContext;
 
 static const char *const slave_delim     = "|";
@@ -69,6 +95,10 @@ static const AVOption options[] = {
          OFFSET(use_fifo), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
         {"fifo_options", "fifo pseudo-muxer options", OFFSET(fifo_options_str),
          AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM},
+        {"use_thread", "Run bitstream filtering and muxing of each slave in its own thread",
+         OFFSET(use_thread), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
+        {"thread_queue_size", "Maximum number of packets queued for each slave thread",
+         OFFSET(thread_queue_size), AV_OPT_TYPE_INT, {.i64 = 64}, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
         {NULL}
 };
 
@@ -119,18 +149,177 @@ static int parse_slave_fifo_options(const char *use_fifo,
     return ret;
 }
 
+static int parse_slave_thread_options(const char *use_thread,
+                                      const char *thread_queue_size, TeeSlave *tee_slave)
+{
+    if (use_thread) {
+        if (av_match_name(use_thread, "true,y,yes,enable,enabled,on,1")) {
+            tee_slave->use_thread = 1;
+        } else if (av_match_name(use_thread, "false,n,no,disable,disabled,off,0")) {
+            tee_slave->use_thread = 0;
+        } else {
+            return AVERROR(EINVAL);
+        }
+    }
+
+    if (thread_queue_size) {
+        char *end;
+        long size = strtol(thread_queue_size, &end, 10);
+        if (*end || size <= 0 || size > INT_MAX)
+            return AVERROR(EINVAL);
+        tee_slave->thread_queue_size = size;
+    }
+
+    return 0;
+}
+
+static int write_slave_packet(void *log_ctx, TeeSlave *tee_slave, AVPacket *pkt,
+                              int64_t queued_time)
+{
+    AVFormatContext *avf2 = tee_slave->avf;
+    AVBSFContext *bsfs;
+    int64_t latency;
+    int ret, s2;
+
+    /* Flush slave if pkt is NULL*/
+    if (!pkt)
+        return av_interleaved_write_frame(avf2, NULL);
+
+    s2 = pkt->stream_index;
+    bsfs = tee_slave->bsfs[s2];
+
+    ret = av_bsf_send_packet(bsfs, pkt);
+    if (ret < 0) {
+        av_log(log_ctx, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
+               av_err2str(ret));
+        av_packet_unref(pkt);
+        return ret;
+    }
+
+    while(1) {
+        ret = av_bsf_receive_packet(bsfs, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            break;
+        }
+
+        av_packet_rescale_ts(pkt, bsfs->time_base_out,
+                             avf2->streams[s2]->time_base);
+        ret = av_interleaved_write_frame(avf2, pkt);
+        if (ret < 0)
+            break;
+    };
+
+    latency = av_gettime_relative() - queued_time;
+    tee_slave->nb_packets++;
+    tee_slave->latency_sum += latency;
+    tee_slave->latency_max  = FFMAX(tee_slave->latency_max, latency);
+
+    return ret;
+}
+
+#if HAVE_THREADS
+static void *slave_thread(void *arg)
+{
+    TeeSlave *tee_slave = arg;
+    TeeMessage msg;
+    int ret;
+
+    while ((ret = av_thread_message_queue_recv(tee_slave->queue, &msg, 0)) >= 0) {
+        ret = write_slave_packet(tee_slave->avf, tee_slave,
+                                 msg.flush ? NULL : &msg.pkt, msg.queued_time);
+        if (ret < 0)
+            break;
+    }
+
+    /* makes the next packet sent to this slave fail with the error */
+    av_thread_message_queue_set_err_send(tee_slave->queue, ret);
+    tee_slave->thread_ret = ret;
+    return NULL;
+}
+#endif
+
+static void free_tee_message(void *msg)
+{
+    av_packet_unref(&((TeeMessage *)msg)->pkt);
+}
+
+static int start_slave_thread(AVFormatContext *avf, TeeSlave *tee_slave)
+{
+#if HAVE_THREADS
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&tee_slave->queue, tee_slave->thread_queue_size,
+                                        sizeof(TeeMessage));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(tee_slave->queue, free_tee_message);
+
+    ret = pthread_create(&tee_slave->thread, NULL, slave_thread, tee_slave);
+    if (ret) {
+        av_log(avf, AV_LOG_ERROR, "Failed to start thread for slave '%s': %s\n",
+               tee_slave->avf->url, av_err2str(AVERROR(ret)));
+        av_thread_message_queue_free(&tee_slave->queue);
+        return AVERROR(ret);
+    }
+    tee_slave->thread_started = 1;
+    return 0;
+#else
+    av_log(avf, AV_LOG_WARNING, "Threads are not supported, "
+           "slave '%s' is written from the caller thread\n", tee_slave->avf->url);
+    return 0;
+#endif
+}
+
+static int stop_slave_thread(TeeSlave *tee_slave)
+{
+    int ret = 0;
+
+#if HAVE_THREADS
+    if (tee_slave->thread_started) {
+        /* the thread drains the queue before it sees the error */
+        av_thread_message_queue_set_err_recv(tee_slave->queue, AVERROR_EOF);
+        pthread_join(tee_slave->thread, NULL);
+        tee_slave->thread_started = 0;
+        if (tee_slave->thread_ret != AVERROR_EOF)
+            ret = tee_slave->thread_ret;
+    }
+#endif
+    av_thread_message_queue_free(&tee_slave->queue);
+    return ret;
+}
+
+static void log_slave_stats(TeeSlave *tee_slave, void *log_ctx)
+{
+    if (!tee_slave->nb_packets)
+        return;
+    av_log(log_ctx, AV_LOG_VERBOSE, "Slave '%s': %"PRId64" packets, "
+           "latency avg %.3f ms max %.3f ms, queue depth max %d\n",
+           tee_slave->avf->url, tee_slave->nb_packets,
+           tee_slave->latency_sum / 1000.0 / tee_slave->nb_packets,
+           tee_slave->latency_max / 1000.0, tee_slave->queue_depth_max);
+}
+
 static int close_slave(TeeSlave *tee_slave)
 {
     AVFormatContext *avf;
     unsigned i;
-    int ret = 0;
+    int ret = 0, ret2;
 
     avf = tee_slave->avf;
     if (!avf)
         return 0;
 
-    if (tee_slave->header_written)
-        ret = av_write_trailer(avf);
+    ret = stop_slave_thread(tee_slave);
+    log_slave_stats(tee_slave, avf);
+
+    if (tee_slave->header_written) {
+        ret2 = av_write_trailer(avf);
+        if (!ret)
+            ret = ret2;
+    }
 
     if (tee_slave->bsfs) {
         for (i = 0; i < avf->nb_streams; ++i)
@@ -164,6 +353,7 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     char *filename;
     char *format = NULL, *select = NULL, *on_fail = NULL;
     char *use_fifo = NULL, *fifo_options_str = NULL;
+    char *use_thread = NULL, *thread_queue_size = NULL;
     AVFormatContext *avf2 = NULL;
     AVStream *st, *st2;
     int stream_count;
@@ -186,6 +376,8 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     STEAL_OPTION("onfail", on_fail);
     STEAL_OPTION("use_fifo", use_fifo);
     STEAL_OPTION("fifo_options", fifo_options_str);
+    STEAL_OPTION("use_thread", use_thread);
+    STEAL_OPTION("thread_queue_size", thread_queue_size);
 
     ret = parse_slave_failure_policy_option(on_fail, tee_slave);
     if (ret < 0) {
@@ -200,6 +392,12 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
         goto end;
     }
 
+    ret = parse_slave_thread_options(use_thread, thread_queue_size, tee_slave);
+    if (ret < 0) {
+        av_log(avf, AV_LOG_ERROR, "Error parsing thread options: %s\n", av_err2str(ret));
+        goto end;
+    }
+
     if (tee_slave->use_fifo) {
 
         if (options) {
@@ -394,10 +592,18 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
         goto end;
     }
 
+    if (tee_slave->use_thread) {
+        ret = start_slave_thread(avf, tee_slave);
+        if (ret < 0)
+            goto end;
+    }
+
 end:
     av_free(format);
     av_free(select);
     av_free(on_fail);
+    av_free(use_thread);
+    av_free(thread_queue_size);
     av_dict_free(&options);
     av_freep(&tmp_select);
     return ret;
@@ -483,6 +689,8 @@ static int tee_write_header(AVFormatContext *avf)
     for (i = 0; i < nb_slaves; i++) {
 
         tee->slaves[i].use_fifo = tee->use_fifo;
+        tee->slaves[i].use_thread = tee->use_thread;
+        tee->slaves[i].thread_queue_size = tee->thread_queue_size;
         ret = av_dict_copy(&tee->slaves[i].fifo_options, tee->fifo_options, 0);
         if (ret < 0)
             goto fail;
@@ -534,23 +742,43 @@ static int tee_write_trailer(AVFormatContext *avf)
     return ret_all;
 }
 
+static int send_slave_packet(AVFormatContext *avf, TeeSlave *tee_slave, AVPacket *pkt)
+{
+    TeeMessage msg = { .queued_time = av_gettime_relative() };
+    int ret;
+
+    if (!tee_slave->queue)
+        return write_slave_packet(avf, tee_slave, pkt, msg.queued_time);
+
+    if (pkt)
+        av_packet_move_ref(&msg.pkt, pkt);
+    else
+        msg.flush = 1;
+
+    ret = av_thread_message_queue_send(tee_slave->queue, &msg, 0);
+    if (ret < 0) {
+        av_packet_unref(&msg.pkt);
+        return ret;
+    }
+    tee_slave->queue_depth_max = FFMAX(tee_slave->queue_depth_max,
+                                       av_thread_message_queue_nb_elems(tee_slave->queue));
+    return 0;
+}
+
 static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
 {
     TeeContext *tee = avf->priv_data;
-    AVFormatContext *avf2;
-    AVBSFContext *bsfs;
     AVPacket pkt2;
     int ret_all = 0, ret;
     unsigned i, s;
     int s2;
 
     for (i = 0; i < tee->nb_slaves; i++) {
-        if (!(avf2 = tee->slaves[i].avf))
+        if (!tee->slaves[i].avf)
             continue;
 
-        /* Flush slave if pkt is NULL*/
         if (!pkt) {
-            ret = av_interleaved_write_frame(avf2, NULL);
+            ret = send_slave_packet(avf, &tee->slaves[i], NULL);
             if (ret < 0) {
                 ret = tee_process_slave_failure(avf, i, ret);
                 if (!ret_all && ret < 0)
@@ -570,34 +798,9 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
                 ret_all = ret;
                 continue;
             }
-        bsfs = tee->slaves[i].bsfs[s2];
         pkt2.stream_index = s2;
 
-        ret = av_bsf_send_packet(bsfs, &pkt2);
-        if (ret < 0) {
-            av_log(avf, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
-                   av_err2str(ret));
-            ret = tee_process_slave_failure(avf, i, ret);
-            if (!ret_all && ret < 0)
-                ret_all = ret;
-        }
-
-        while(1) {
-            ret = av_bsf_receive_packet(bsfs, &pkt2);
-            if (ret == AVERROR(EAGAIN)) {
-                ret = 0;
-                break;
-            } else if (ret < 0) {
-                break;
-            }
-
-            av_packet_rescale_ts(&pkt2, bsfs->time_base_out,
-                                 avf2->streams[s2]->time_base);
-            ret = av_interleaved_write_frame(avf2, &pkt2);
-            if (ret < 0)
-                break;
-        };
-
+        ret = send_slave_packet(avf, &tee->slaves[i], &pkt2);
         if (ret < 0) {
             ret = tee_process_slave_failure(avf, i, ret);
             if (!ret_all && ret < 0)
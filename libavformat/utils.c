@@ -32,6 +32,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/time_internal.h"
@@ -47,6 +48,7 @@
 #include "id3v2.h"
 #include "internal.h"
 #include "metadata.h"
+#include "probecache.h"
 #if CONFIG_NETWORK
 #include "network.h"
 #endif
@@ -538,7 +540,7 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
                         ff_const59 AVInputFormat *fmt, AVDictionary **options)
 {
     AVFormatContext *s = *ps;
-    int i, ret = 0;
+    int i, ret = 0, probe_score = 0;
     AVDictionary *tmp = NULL;
     ID3v2ExtraMeta *id3v2_extra_meta = NULL;
 
@@ -565,6 +567,9 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
         goto fail;
     }
 
+    if (s->probe_cache && !s->iformat && !s->pb)
+        s->iformat = ff_probe_cache_find_format(s, s->url, &probe_score);
+
 #if FF_API_FORMAT_FILENAME
 FF_DISABLE_DEPRECATION_WARNINGS
     av_strlcpy(s->filename, filename ? filename : "", sizeof(s->filename));
@@ -572,7 +577,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     if ((ret = init_input(s, filename, &tmp)) < 0)
         goto fail;
-    s->probe_score = ret;
+    s->probe_score = ret ? ret : probe_score;
 
     if (!s->protocol_whitelist && s->pb && s->pb->protocol_whitelist) {
         s->protocol_whitelist = av_strdup(s->pb->protocol_whitelist);
@@ -3021,7 +3026,7 @@ static int has_codec_parameters(AVStream *st, const char **errmsg_ptr)
 
 /* returns 1 or 0 if or if not decoded data was returned, or a negative error */
 static int try_decode_frame(AVFormatContext *s, AVStream *st, AVPacket *avpkt,
-                            AVDictionary **options)
+                            int codec_info_nb_frames, AVDictionary **options)
 {
     AVCodecContext *avctx = st->internal->avctx;
     const AVCodec *codec;
@@ -3078,7 +3083,7 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st, AVPacket *avpkt,
     while ((pkt.size > 0 || (!pkt.data && got_picture)) &&
            ret >= 0 &&
            (!has_codec_parameters(st, NULL) || !has_decode_delay_been_guessed(st) ||
-            (!st->codec_info_nb_frames &&
+            (!codec_info_nb_frames &&
              (avctx->codec->capabilities & AV_CODEC_CAP_CHANNEL_CONF)))) {
         got_picture = 0;
         if (avctx->codec_type == AVMEDIA_TYPE_VIDEO ||
@@ -3570,6 +3575,141 @@ static int extract_extradata(AVStream *st, AVPacket *pkt)
     return 0;
 }
 
+typedef struct ProbeDecodeQueue {
+    AVPacket *pkts;
+    int *codec_info_nb_frames;
+    int nb_pkts;
+    int size;
+    AVDictionary **options;
+} ProbeDecodeQueue;
+
+/**
+ * Decoding of the packets read by avformat_find_stream_info() on several
+ * threads: packets are queued per stream and a batch is decoded with one
+ * job per stream, so the packets of a stream stay in order.
+ */
+typedef struct ProbeDecodeContext {
+    AVFormatContext *ic;
+    AVSliceThread *thread;
+    int nb_threads;
+    ProbeDecodeQueue *queues;   // indexed by stream index
+    int nb_queues;
+    int *jobs;                  // indexes of the streams with queued packets
+    int nb_jobs;
+    int nb_queued;
+} ProbeDecodeContext;
+
+static void probe_decode_worker(void *priv, int jobnr, int threadnr,
+                                int nb_jobs, int nb_threads)
+{
+    ProbeDecodeContext *pd = priv;
+    int stream_index = pd->jobs[jobnr];
+    ProbeDecodeQueue *q = &pd->queues[stream_index];
+    AVStream *st = pd->ic->streams[stream_index];
+    int i;
+
+    for (i = 0; i < q->nb_pkts; i++) {
+        try_decode_frame(pd->ic, st, &q->pkts[i], q->codec_info_nb_frames[i], q->options);
+        av_packet_unref(&q->pkts[i]);
+    }
+    q->nb_pkts = 0;
+}
+
+static int probe_decode_init(ProbeDecodeContext *pd, AVFormatContext *ic)
+{
+    int ret;
+
+    memset(pd, 0, sizeof(*pd));
+    pd->ic = ic;
+    if (ic->probe_threads == 1)
+        return 0;
+
+    ret = avpriv_slicethread_create(&pd->thread, pd, probe_decode_worker,
+                                    NULL, ic->probe_threads);
+    if (ret <= 1) {
+        /* without thread support or if the threads cannot be started,
+         * decode on the calling thread */
+        avpriv_slicethread_free(&pd->thread);
+        return ret == AVERROR(ENOMEM) ? ret : 0;
+    }
+    pd->nb_threads = ret;
+    av_log(ic, AV_LOG_DEBUG, "Decoding streams on %d threads\n", ret);
+    return 0;
+}
+
+/* Decode all queued packets. */
+static void probe_decode_flush(ProbeDecodeContext *pd)
+{
+    if (!pd->nb_jobs)
+        return;
+    avpriv_slicethread_execute(pd->thread, pd->nb_jobs, 0);
+    pd->nb_jobs   = 0;
+    pd->nb_queued = 0;
+}
+
+static int probe_decode_queue(ProbeDecodeContext *pd, AVStream *st,
+                              AVPacket *pkt, AVDictionary **options)
+{
+    ProbeDecodeQueue *q;
+    int ret;
+
+    if (st->index >= pd->nb_queues) {
+        ProbeDecodeQueue *queues = av_realloc_array(pd->queues, st->index + 1,
+                                                    sizeof(*queues));
+        int *jobs = av_realloc_array(pd->jobs, st->index + 1, sizeof(*jobs));
+        if (queues)
+            pd->queues = queues;
+        if (jobs)
+            pd->jobs = jobs;
+        if (!queues || !jobs)
+            return AVERROR(ENOMEM);
+        memset(&pd->queues[pd->nb_queues], 0,
+               (st->index + 1 - pd->nb_queues) * sizeof(*queues));
+        pd->nb_queues = st->index + 1;
+    }
+    q = &pd->queues[st->index];
+
+    if (q->nb_pkts == q->size) {
+        int new_size = FFMAX(2 * q->size, 8);
+        AVPacket *pkts = av_realloc_array(q->pkts, new_size, sizeof(*pkts));
+        int *nb_frames = av_realloc_array(q->codec_info_nb_frames, new_size,
+                                          sizeof(*nb_frames));
+        if (pkts)
+            q->pkts = pkts;
+        if (nb_frames)
+            q->codec_info_nb_frames = nb_frames;
+        if (!pkts || !nb_frames)
+            return AVERROR(ENOMEM);
+        q->size = new_size;
+    }
+    if ((ret = av_packet_ref(&q->pkts[q->nb_pkts], pkt)) < 0)
+        return ret;
+    q->codec_info_nb_frames[q->nb_pkts] = st->codec_info_nb_frames;
+    q->options = options;
+    if (!q->nb_pkts++)
+        pd->jobs[pd->nb_jobs++] = st->index;
+
+    /* Decoding lags behind reading by at most one batch. */
+    if (++pd->nb_queued >= 4 * pd->nb_threads)
+        probe_decode_flush(pd);
+    return 0;
+}
+
+static void probe_decode_uninit(ProbeDecodeContext *pd)
+{
+    int i, j;
+
+    avpriv_slicethread_free(&pd->thread);
+    for (i = 0; i < pd->nb_queues; i++) {
+        for (j = 0; j < pd->queues[i].nb_pkts; j++)
+            av_packet_unref(&pd->queues[i].pkts[j]);
+        av_freep(&pd->queues[i].pkts);
+        av_freep(&pd->queues[i].codec_info_nb_frames);
+    }
+    av_freep(&pd->queues);
+    av_freep(&pd->jobs);
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     int i, count = 0, ret = 0, j;
@@ -3587,9 +3727,16 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
+    ProbeDecodeContext probe_decode;
+    uint8_t fingerprint[PROBE_CACHE_FINGERPRINT_SIZE];
+    int use_cache = !!ic->probe_cache, cache_hit = 0, cache_nb_streams = 0;
 
     flush_codecs = probesize > 0;
 
+    ret = probe_decode_init(&probe_decode, ic);
+    if (ret < 0)
+        return ret;
+
     av_opt_set(ic, "skip_clear", "1", AV_OPT_SEARCH_CHILDREN);
 
     max_stream_analyze_duration = max_analyze_duration;
@@ -3608,6 +3755,18 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         av_log(ic, AV_LOG_DEBUG, "Before avformat_find_stream_info() pos: %"PRId64" bytes read:%"PRId64" seeks:%d nb_streams:%d\n",
                avio_tell(ic->pb), ic->pb->bytes_read, ic->pb->seek_count, ic->nb_streams);
 
+    if (use_cache) {
+        ret = ff_probe_cache_fingerprint(ic, fingerprint);
+        if (ret >= 0)
+            ret = ff_probe_cache_lookup(ic, fingerprint, &cache_nb_streams);
+        if (ret < 0) {
+            av_log(ic, AV_LOG_WARNING, "Probe cache lookup failed: %s\n", av_err2str(ret));
+            use_cache = 0;
+        }
+        cache_hit = ret > 0;
+        ret = 0;
+    }
+
     for (i = 0; i < ic->nb_streams; i++) {
         const AVCodec *codec;
         AVDictionary *thread_opt = NULL;
@@ -3693,6 +3852,10 @@ FF_ENABLE_DEPRECATION_WARNINGS
         ic->streams[i]->info->fps_last_dts  = AV_NOPTS_VALUE;
     }
 
+    /* The cached parameters are complete, no need to read any packet. */
+    if (cache_hit)
+        goto analyzed;
+
     read_size = 0;
     for (;;) {
         int analyzed_all_streams;
@@ -3798,6 +3961,30 @@ FF_ENABLE_DEPRECATION_WARNINGS
                 goto find_stream_info_err;
         }
 
+        /* The cached parameters can be used once the demuxer created
+         * all the streams of the entry. */
+        if (cache_nb_streams && ic->nb_streams >= cache_nb_streams) {
+            ret = ff_probe_cache_lookup(ic, fingerprint, &cache_nb_streams);
+            cache_nb_streams = 0;
+            if (ret > 0) {
+                for (i = 0; i < ic->nb_streams; i++) {
+                    st = ic->streams[i];
+                    avcodec_close(st->internal->avctx);
+                    ret = avcodec_parameters_to_context(st->internal->avctx, st->codecpar);
+                    if (ret < 0)
+                        goto find_stream_info_err;
+                    st->internal->avctx_inited = 1;
+                }
+                cache_hit = 1;
+                ret = 0;
+                goto analyzed;
+            }
+            if (ret < 0) {
+                av_log(ic, AV_LOG_WARNING, "Probe cache lookup failed: %s\n", av_err2str(ret));
+                use_cache = 0;
+            }
+        }
+
         st = ic->streams[pkt->stream_index];
         if (!(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
             read_size += pkt->size;
@@ -3906,8 +4093,14 @@ FF_ENABLE_DEPRECATION_WARNINGS
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
          * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+        if (probe_decode.thread) {
+            ret = probe_decode_queue(&probe_decode, st, pkt,
+                                     (options && st->index < orig_nb_streams) ? &options[st->index] : NULL);
+            if (ret < 0)
+                goto find_stream_info_err;
+        } else
+            try_decode_frame(ic, st, pkt, st->codec_info_nb_frames,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(pkt);
@@ -3915,6 +4108,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         st->codec_info_nb_frames++;
         count++;
     }
+    probe_decode_flush(&probe_decode);
 
     if (eof_reached) {
         int stream_index;
@@ -3954,7 +4148,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
             /* flush the decoders */
             if (st->info->found_decoder == 1) {
                 do {
-                    err = try_decode_frame(ic, st, &empty_pkt,
+                    err = try_decode_frame(ic, st, &empty_pkt, st->codec_info_nb_frames,
                                             (options && i < orig_nb_streams)
                                             ? &options[i] : NULL);
                 } while (err > 0 && !has_codec_parameters(st, NULL));
@@ -3967,6 +4161,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
         }
     }
 
+analyzed:
     ff_rfps_calculate(ic);
 
     for (i = 0; i < ic->nb_streams; i++) {
@@ -4156,7 +4351,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
         st->internal->avctx_inited = 0;
     }
 
+    if (ret >= 0 && use_cache && !cache_hit)
+        ff_probe_cache_store(ic, fingerprint);
+
 find_stream_info_err:
+    probe_decode_uninit(&probe_decode);
     for (i = 0; i < ic->nb_streams; i++) {
         st = ic->streams[i];
         if (st->info)
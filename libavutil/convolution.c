@@ -0,0 +1,693 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "attributes.h"
+#include "common.h"
+#include "convolution.h"
+#include "convolution_internal.h"
+#include "error.h"
+#include "mathematics.h"
+#include "mem.h"
+#include "tx.h"
+
+#define MAX_PART_SIZE (1 << 16)
+
+typedef struct ConvSegment {
+    int part_size;              ///< partition size, half the FFT length
+    int nb_parts;               ///< number of partitions
+    int offset;                 ///< first tap covered by the segment
+    int bin_stride;             ///< distance between two spectra, in bins
+    int coeff_offset;           ///< position in the spectra of an IR, in bins
+    int fdl_offset;             ///< position in the spectra of an input, in bins
+    int index;                  ///< slot of the newest input spectrum
+
+    AVTXContext *fft, *ifft;
+    av_tx_fn fft_fn, ifft_fn;
+    AVComplexFloat *twiddle;
+} ConvSegment;
+
+typedef struct ConvIR {
+    float *taps;
+    int len;
+
+    float *head;                ///< taps applied in direct form
+    AVComplexFloat *coeffs;     ///< spectra of the partitions of all segments
+} ConvIR;
+
+typedef struct ConvRoute {
+    int input, output, ir;
+} ConvRoute;
+
+struct AVConvolutionContext {
+    int nb_inputs, nb_outputs;
+    int min_part_size, max_part_size;
+    int flags;
+    int head;                   ///< number of taps applied in direct form
+    int initialized;
+
+    ConvIR *irs;
+    int nb_irs;
+    ConvRoute *routes;
+    int nb_routes;
+
+    ConvSegment *segs;
+    int nb_segs;
+    int coeff_size;             ///< bins of the spectra of an IR
+    int fdl_size;               ///< bins of the spectra of an input
+
+    float **in;                 ///< input history, NULL for unused inputs
+    AVComplexFloat **fdl;       ///< input spectra, frequency domain delay lines
+    int hist_size;              ///< samples kept before the current position
+    int in_size;
+    int in_pos;
+
+    float **ring;               ///< pending output of the FFT partitions
+    unsigned ring_mask;
+    unsigned pos;
+
+    float *head_buf;
+    AVComplexFloat *acc;
+    AVComplexFloat *tmp;
+    AVComplexFloat *out;
+
+    ConvolutionDSPContext dsp;
+};
+
+static void fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t len)
+{
+    int n;
+
+    for (n = 0; n < len; n++) {
+        const float cre = c[2 * n    ];
+        const float cim = c[2 * n + 1];
+        const float tre = t[2 * n    ];
+        const float tim = t[2 * n + 1];
+
+        sum[2 * n    ] += tre * cre - tim * cim;
+        sum[2 * n + 1] += tre * cim + tim * cre;
+    }
+
+    sum[2 * n] += t[2 * n] * c[2 * n];
+}
+
+av_cold void ff_convolution_dsp_init(ConvolutionDSPContext *dsp)
+{
+    dsp->fcmul_add = fcmul_add_c;
+
+    if (ARCH_X86)
+        ff_convolution_dsp_init_x86(dsp);
+}
+
+AVComplexFloat *avpriv_rdft_alloc_twiddle(int n)
+{
+    AVComplexFloat *tw = av_malloc_array(n + 1, sizeof(*tw));
+    int k;
+
+    if (!tw)
+        return NULL;
+    for (k = 0; k <= n; k++) {
+        tw[k].re =  cos(M_PI * k / n);
+        tw[k].im = -sin(M_PI * k / n);
+    }
+    return tw;
+}
+
+void avpriv_rdft_split(AVComplexFloat *dst, const AVComplexFloat *z,
+                       const AVComplexFloat *tw, int n)
+{
+    int k;
+
+    for (k = 0; k <= n; k++) {
+        const AVComplexFloat zk = z[k & (n - 1)];
+        const AVComplexFloat zc = z[(n - k) & (n - 1)];
+
+        // spectrum of the even and odd samples:
+        const float e_re = 0.5f * (zk.re + zc.re);
+        const float e_im = 0.5f * (zk.im - zc.im);
+        const float o_re = 0.5f * (zk.im + zc.im);
+        const float o_im = 0.5f * (zc.re - zk.re);
+
+        dst[k].re = e_re + tw[k].re * o_re - tw[k].im * o_im;
+        dst[k].im = e_im + tw[k].re * o_im + tw[k].im * o_re;
+    }
+}
+
+void avpriv_rdft_merge(AVComplexFloat *z, const AVComplexFloat *src,
+                       const AVComplexFloat *tw, int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++) {
+        const AVComplexFloat a = src[k];
+        const AVComplexFloat b = src[n - k];
+
+        // merge the spectrum of the even and odd samples:
+        const float e_re = 0.5f * (a.re + b.re);
+        const float e_im = 0.5f * (a.im - b.im);
+        const float d_re = 0.5f * (a.re - b.re);
+        const float d_im = 0.5f * (a.im + b.im);
+        const float o_re = d_re * tw[k].re + d_im * tw[k].im;
+        const float o_im = d_im * tw[k].re - d_re * tw[k].im;
+
+        z[k].re = e_re - o_im;
+        z[k].im = e_im + o_re;
+    }
+}
+
+/**
+ * Transform 2 * part_size real samples into part_size + 1 bins, with a
+ * complex FFT of half the length.
+ */
+static void rdft(const ConvSegment *seg, AVComplexFloat *dst, const float *src,
+                 AVComplexFloat *tmp)
+{
+    seg->fft_fn(seg->fft, tmp, (void *)src, sizeof(AVComplexFloat));
+    avpriv_rdft_split(dst, tmp, seg->twiddle, seg->part_size);
+}
+
+/**
+ * Inverse of rdft(), scaled by part_size.
+ */
+static void irdft(const ConvSegment *seg, AVComplexFloat *dst,
+                  const AVComplexFloat *src, AVComplexFloat *tmp)
+{
+    avpriv_rdft_merge(tmp, src, seg->twiddle, seg->part_size);
+    seg->ifft_fn(seg->ifft, dst, tmp, sizeof(AVComplexFloat));
+}
+
+AVConvolutionContext *av_convolution_alloc(int nb_inputs, int nb_outputs,
+                                           int min_part_size, int max_part_size,
+                                           int flags)
+{
+    AVConvolutionContext *c;
+
+    if (nb_inputs <= 0 || nb_outputs <= 0)
+        return NULL;
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return NULL;
+
+    c->nb_inputs     = nb_inputs;
+    c->nb_outputs    = nb_outputs;
+    c->min_part_size = 1 << av_log2(av_clip(min_part_size, 16, MAX_PART_SIZE));
+    c->max_part_size = 1 << av_log2(av_clip(max_part_size, c->min_part_size,
+                                            MAX_PART_SIZE));
+    c->flags         = flags;
+    c->head          = flags & AV_CONVOLUTION_FLAG_BLOCK ? 0 : c->min_part_size;
+
+    c->in   = av_calloc(nb_inputs,  sizeof(*c->in));
+    c->fdl  = av_calloc(nb_inputs,  sizeof(*c->fdl));
+    c->ring = av_calloc(nb_outputs, sizeof(*c->ring));
+    if (!c->in || !c->fdl || !c->ring) {
+        av_convolution_free(&c);
+        return NULL;
+    }
+
+    ff_convolution_dsp_init(&c->dsp);
+
+    return c;
+}
+
+int av_convolution_add_ir(AVConvolutionContext *c, const float *ir, int len)
+{
+    ConvIR *irs;
+
+    if (c->initialized || len <= 0)
+        return AVERROR(EINVAL);
+
+    irs = av_realloc_array(c->irs, c->nb_irs + 1, sizeof(*irs));
+    if (!irs)
+        return AVERROR(ENOMEM);
+    c->irs = irs;
+
+    irs += c->nb_irs;
+    memset(irs, 0, sizeof(*irs));
+    irs->taps = av_malloc_array(len, sizeof(*irs->taps));
+    if (!irs->taps)
+        return AVERROR(ENOMEM);
+    memcpy(irs->taps, ir, len * sizeof(*irs->taps));
+    irs->len = len;
+
+    return c->nb_irs++;
+}
+
+int av_convolution_add_route(AVConvolutionContext *c, int input, int output,
+                             int ir)
+{
+    ConvRoute *routes;
+
+    if (c->initialized ||
+        input  < 0 || input  >= c->nb_inputs  ||
+        output < 0 || output >= c->nb_outputs ||
+        ir     < 0 || ir     >= c->nb_irs)
+        return AVERROR(EINVAL);
+
+    routes = av_realloc_array(c->routes, c->nb_routes + 1, sizeof(*routes));
+    if (!routes)
+        return AVERROR(ENOMEM);
+    c->routes = routes;
+
+    routes[c->nb_routes++] = (ConvRoute){ input, output, ir };
+
+    return 0;
+}
+
+static int init_segment(AVConvolutionContext *c, int offset, int nb_parts,
+                        int part_size)
+{
+    ConvSegment *seg;
+    float scale = 1.f;
+    int ret;
+
+    seg = av_realloc_array(c->segs, c->nb_segs + 1, sizeof(*seg));
+    if (!seg)
+        return AVERROR(ENOMEM);
+    c->segs = seg;
+
+    seg += c->nb_segs++;
+    memset(seg, 0, sizeof(*seg));
+    seg->part_size    = part_size;
+    seg->nb_parts     = nb_parts;
+    seg->offset       = offset;
+    seg->bin_stride   = part_size + 8;
+    seg->coeff_offset = c->coeff_size;
+    seg->fdl_offset   = c->fdl_size;
+    c->coeff_size    += nb_parts * seg->bin_stride;
+    c->fdl_size      += nb_parts * seg->bin_stride;
+
+    ret = av_tx_init(&seg->fft, &seg->fft_fn, AV_TX_FLOAT_FFT, 0,
+                     part_size, &scale, 0);
+    if (ret < 0)
+        return ret;
+    ret = av_tx_init(&seg->ifft, &seg->ifft_fn, AV_TX_FLOAT_FFT, 1,
+                     part_size, &scale, 0);
+    if (ret < 0)
+        return ret;
+
+    seg->twiddle = avpriv_rdft_alloc_twiddle(part_size);
+    if (!seg->twiddle)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int init_ir(AVConvolutionContext *c, ConvIR *ir)
+{
+    const int head = c->head;
+    float *block = (float *)c->out;
+    int i, j;
+
+    if (head) {
+        ir->head = av_calloc(head, sizeof(*ir->head));
+        if (!ir->head)
+            return AVERROR(ENOMEM);
+        memcpy(ir->head, ir->taps, FFMIN(head, ir->len) * sizeof(*ir->head));
+    }
+
+    if (!c->coeff_size)
+        return 0;
+
+    ir->coeffs = av_calloc(c->coeff_size, sizeof(*ir->coeffs));
+    if (!ir->coeffs)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < c->nb_segs; i++) {
+        const ConvSegment *seg = &c->segs[i];
+        const int part_size = seg->part_size;
+        const float scale = 1.f / part_size;
+
+        for (j = 0; j < seg->nb_parts; j++) {
+            AVComplexFloat *coeff = ir->coeffs + seg->coeff_offset + j * seg->bin_stride;
+            const int start = seg->offset + j * part_size;
+            const int size = FFMIN(ir->len - start, part_size);
+            int k;
+
+            if (size <= 0)
+                break;
+
+            memset(block, 0, 2 * part_size * sizeof(*block));
+            memcpy(block, ir->taps + start, size * sizeof(*block));
+            rdft(seg, coeff, block, c->tmp);
+
+            // the inverse transform is not normalized:
+            for (k = 0; k <= part_size; k++) {
+                coeff[k].re *= scale;
+                coeff[k].im *= scale;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int av_convolution_init(AVConvolutionContext *c)
+{
+    const int head = c->head;
+    /* in block mode, the output of the current block is read after the
+     * partitions ending with it are processed */
+    const int lag = c->min_part_size - head;
+    int max_len = 0, max_part = 0, part_size = c->min_part_size, offset = head;
+    int i, left, ret;
+
+    if (c->initialized)
+        return AVERROR(EINVAL);
+    c->initialized = 1;
+
+    for (i = 0; i < c->nb_routes; i++)
+        max_len = FFMAX(max_len, c->irs[c->routes[i].ir].len);
+
+    /* The output of a partition of size P is complete when its last input
+     * block is, so the partition must start P taps or more into the IR,
+     * less the block lag. Each size is used just enough times to allow the
+     * next one, four times larger, which keeps the number of transforms per
+     * sample low. */
+    for (left = max_len - head; left > 0; ) {
+        const int next = FFMIN(4 * part_size, c->max_part_size);
+        int nb_parts = (left + part_size - 1) / part_size;
+
+        if (part_size < c->max_part_size)
+            nb_parts = FFMIN(nb_parts, FFMAX((next - lag - offset + part_size - 1) / part_size, 1));
+
+        ret = init_segment(c, offset, nb_parts, part_size);
+        if (ret < 0)
+            return ret;
+
+        max_part  = part_size;
+        offset   += nb_parts * part_size;
+        left     -= nb_parts * part_size;
+        part_size = next;
+    }
+
+    c->hist_size = FFMAX(2 * max_part, c->min_part_size);
+    c->in_size   = 2 * c->hist_size;
+    c->in_pos    = c->hist_size;
+
+    c->head_buf = av_malloc_array(c->min_part_size, sizeof(*c->head_buf));
+    if (!c->head_buf)
+        return AVERROR(ENOMEM);
+
+    if (c->nb_segs) {
+        c->acc = av_malloc_array(max_part + 8, sizeof(*c->acc));
+        c->tmp = av_malloc_array(max_part,     sizeof(*c->tmp));
+        c->out = av_malloc_array(max_part,     sizeof(*c->out));
+        if (!c->acc || !c->tmp || !c->out)
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < c->nb_irs; i++) {
+        ret = init_ir(c, &c->irs[i]);
+        if (ret < 0)
+            return ret;
+        av_freep(&c->irs[i].taps);
+    }
+
+    for (i = 0; i < c->nb_routes; i++) {
+        const ConvRoute *r = &c->routes[i];
+
+        if (!c->in[r->input]) {
+            c->in[r->input] = av_calloc(c->in_size, sizeof(**c->in));
+            if (!c->in[r->input])
+                return AVERROR(ENOMEM);
+            if (c->fdl_size) {
+                c->fdl[r->input] = av_calloc(c->fdl_size, sizeof(**c->fdl));
+                if (!c->fdl[r->input])
+                    return AVERROR(ENOMEM);
+            }
+        }
+
+        if (!c->ring[r->output] && c->nb_segs) {
+            const int ring_size = 1 << av_ceil_log2(offset);
+
+            c->ring[r->output] = av_calloc(ring_size, sizeof(**c->ring));
+            if (!c->ring[r->output])
+                return AVERROR(ENOMEM);
+            c->ring_mask = ring_size - 1;
+        }
+    }
+
+    return 0;
+}
+
+static void process_segment(AVConvolutionContext *c, ConvSegment *seg)
+{
+    const int part_size = seg->part_size;
+    const int nb_parts = seg->nb_parts;
+    const int stride = seg->bin_stride;
+    const float *out = (const float *)c->out + part_size;
+    int i, j, o;
+
+    for (i = 0; i < c->nb_inputs; i++) {
+        if (!c->in[i])
+            continue;
+        rdft(seg, c->fdl[i] + seg->fdl_offset + seg->index * stride,
+             c->in[i] + c->in_pos - 2 * part_size, c->tmp);
+    }
+
+    for (o = 0; o < c->nb_outputs; o++) {
+        float *ring = c->ring[o];
+        unsigned start = c->pos - part_size + seg->offset;
+        int used = 0;
+
+        for (i = 0; i < c->nb_routes; i++) {
+            const ConvRoute *r = &c->routes[i];
+            const ConvIR *ir = &c->irs[r->ir];
+            const AVComplexFloat *fdl = c->fdl[r->input] + seg->fdl_offset;
+            const AVComplexFloat *coeff = ir->coeffs + seg->coeff_offset;
+            int nb;
+
+            if (r->output != o || ir->len <= seg->offset)
+                continue;
+            nb = FFMIN((ir->len - seg->offset + part_size - 1) / part_size, nb_parts);
+
+            if (!used) {
+                memset(c->acc, 0, (part_size + 1) * sizeof(*c->acc));
+                used = 1;
+            }
+
+            for (j = 0; j < nb; j++) {
+                const int slot = (seg->index - j + nb_parts) % nb_parts;
+
+                c->dsp.fcmul_add((float *)c->acc, (const float *)(fdl + slot * stride),
+                                 (const float *)(coeff + j * stride), part_size);
+            }
+        }
+
+        if (!used)
+            continue;
+
+        irdft(seg, c->out, c->acc, c->tmp);
+
+        // the last half of the block is the valid part of the convolution:
+        for (j = 0; j < part_size; j++)
+            ring[(start + j) & c->ring_mask] += out[j];
+    }
+
+    seg->index = (seg->index + 1) % nb_parts;
+}
+
+static void process_head(AVConvolutionContext *c, float *dst, int o,
+                         unsigned pos, int nb_samples, int clear)
+{
+    const int head = c->head;
+    int i, j, k;
+
+    memset(dst, 0, nb_samples * sizeof(*dst));
+
+    for (i = 0; head && i < c->nb_routes; i++) {
+        const ConvRoute *r = &c->routes[i];
+        const ConvIR *ir = &c->irs[r->ir];
+        const float *x = c->in[r->input] + c->in_pos;
+        const int len = FFMIN(ir->len, head);
+
+        if (r->output != o)
+            continue;
+
+        /* Four taps per pass over dst, to keep the loads and stores of dst
+         * from dominating. */
+        for (k = 0; k + 3 < len; k += 4) {
+            const float h0 = ir->head[k    ], h1 = ir->head[k + 1];
+            const float h2 = ir->head[k + 2], h3 = ir->head[k + 3];
+            const float *xk = x - k;
+
+            for (j = 0; j < nb_samples; j++)
+                dst[j] += h0 * xk[j] + h1 * xk[j - 1] + h2 * xk[j - 2] + h3 * xk[j - 3];
+        }
+        for (; k < len; k++) {
+            const float h = ir->head[k];
+            const float *xk = x - k;
+
+            for (j = 0; j < nb_samples; j++)
+                dst[j] += h * xk[j];
+        }
+    }
+
+    if (c->ring[o]) {
+        float *ring = c->ring[o];
+
+        for (j = 0; j < nb_samples; j++) {
+            const unsigned idx = (pos + j) & c->ring_mask;
+
+            dst[j] += ring[idx];
+            ring[idx] = 0.f;
+        }
+        for (; j < clear; j++)
+            ring[(pos + j) & c->ring_mask] = 0.f;
+    }
+}
+
+void av_convolution_process(AVConvolutionContext *c,
+                            float * const *dst, ptrdiff_t dst_stride,
+                            const float * const *src, ptrdiff_t src_stride,
+                            int nb_samples)
+{
+    const int block = c->min_part_size;
+    int done = 0;
+
+    while (done < nb_samples) {
+        const int n = FFMIN(nb_samples - done, block - (c->pos & (block - 1)));
+        const unsigned pos = c->pos;
+        int len = n;
+        int i, j;
+
+        /* an incomplete block can only be the last one, pad it */
+        if (!c->head)
+            len = block - (c->pos & (block - 1));
+
+        if (c->in_pos + len > c->in_size) {
+            for (i = 0; i < c->nb_inputs; i++) {
+                if (c->in[i])
+                    memmove(c->in[i], c->in[i] + c->in_pos - c->hist_size,
+                            c->hist_size * sizeof(**c->in));
+            }
+            c->in_pos = c->hist_size;
+        }
+
+        for (i = 0; i < c->nb_inputs; i++) {
+            const float *s;
+            float *in;
+
+            if (!c->in[i])
+                continue;
+            s  = src[i] + done * src_stride;
+            in = c->in[i] + c->in_pos;
+            for (j = 0; j < n; j++)
+                in[j] = s[j * src_stride];
+            for (; j < len; j++)
+                in[j] = 0.f;
+        }
+
+        if (c->head) {
+            for (i = 0; i < c->nb_outputs; i++) {
+                float *d = dst[i] + done * dst_stride;
+
+                process_head(c, c->head_buf, i, pos, n, n);
+                for (j = 0; j < n; j++)
+                    d[j * dst_stride] = c->head_buf[j];
+            }
+        }
+
+        c->pos    += len;
+        c->in_pos += len;
+
+        if (!(c->pos & (block - 1))) {
+            for (i = 0; i < c->nb_segs; i++) {
+                ConvSegment *seg = &c->segs[i];
+
+                if (!(c->pos & (seg->part_size - 1)))
+                    process_segment(c, seg);
+            }
+        }
+
+        if (!c->head) {
+            for (i = 0; i < c->nb_outputs; i++) {
+                float *d = dst[i] + done * dst_stride;
+
+                process_head(c, c->head_buf, i, pos, n, len);
+                for (j = 0; j < n; j++)
+                    d[j * dst_stride] = c->head_buf[j];
+            }
+        }
+
+        done += n;
+    }
+}
+
+void av_convolution_reset(AVConvolutionContext *c)
+{
+    int i;
+
+    for (i = 0; i < c->nb_inputs; i++) {
+        if (c->in[i])
+            memset(c->in[i], 0, c->in_size * sizeof(**c->in));
+        if (c->fdl[i])
+            memset(c->fdl[i], 0, c->fdl_size * sizeof(**c->fdl));
+    }
+    for (i = 0; i < c->nb_outputs; i++) {
+        if (c->ring[i])
+            memset(c->ring[i], 0, (c->ring_mask + 1) * sizeof(**c->ring));
+    }
+    for (i = 0; i < c->nb_segs; i++)
+        c->segs[i].index = 0;
+
+    c->in_pos = c->hist_size;
+    c->pos    = 0;
+}
+
+void av_convolution_free(AVConvolutionContext **pc)
+{
+    AVConvolutionContext *c = *pc;
+    int i;
+
+    if (!c)
+        return;
+
+    for (i = 0; i < c->nb_segs; i++) {
+        av_tx_uninit(&c->segs[i].fft);
+        av_tx_uninit(&c->segs[i].ifft);
+        av_freep(&c->segs[i].twiddle);
+    }
+    av_freep(&c->segs);
+
+    for (i = 0; i < c->nb_irs; i++) {
+        av_freep(&c->irs[i].taps);
+        av_freep(&c->irs[i].head);
+        av_freep(&c->irs[i].coeffs);
+    }
+    av_freep(&c->irs);
+    av_freep(&c->routes);
+
+    for (i = 0; c->in && i < c->nb_inputs; i++)
+        av_freep(&c->in[i]);
+    for (i = 0; c->fdl && i < c->nb_inputs; i++)
+        av_freep(&c->fdl[i]);
+    for (i = 0; c->ring && i < c->nb_outputs; i++)
+        av_freep(&c->ring[i]);
+    av_freep(&c->in);
+    av_freep(&c->fdl);
+    av_freep(&c->ring);
+
+    av_freep(&c->head_buf);
+    av_freep(&c->acc);
+    av_freep(&c->tmp);
+    av_freep(&c->out);
+    av_freep(pc);
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Zero latency partitioned convolution
+ */
+
+#ifndef AVUTIL_CONVOLUTION_H
+#define AVUTIL_CONVOLUTION_H
+
+#include <stddef.h>
+
+/**
+ * @addtogroup lavu_audio
+ * @{
+ *
+ * @defgroup lavu_convolution Partitioned convolution
+ * @{
+ */
+
+/**
+ * Context for a multichannel FIR convolution engine.
+ *
+ * The first taps of each impulse response are applied in direct form and
+ * the rest with non-uniformly partitioned FFT convolution, the partition
+ * size growing up to a maximum along the response. Every output sample
+ * is available as soon as the matching input sample was given, whatever
+ * the number of samples passed per call.
+ *
+ * Each output is the sum of the inputs routed to it, every route applying
+ * one of the impulse responses added to the context. Impulse responses can
+ * be shared between routes.
+ */
+typedef struct AVConvolutionContext AVConvolutionContext;
+
+/**
+ * Filter whole blocks of min_part_size samples with FFT partitions only,
+ * without applying any tap in direct form. This is faster with long impulse
+ * responses and large blocks, but the caller has to buffer a block before
+ * its output is available: every call to av_convolution_process() but the
+ * last one must be given a multiple of min_part_size samples.
+ */
+#define AV_CONVOLUTION_FLAG_BLOCK (1 << 0)
+
+/**
+ * Allocate a convolution context.
+ *
+ * @param nb_inputs      number of input channels
+ * @param nb_outputs     number of output channels
+ * @param min_part_size  size of the smallest FFT partition, which is also
+ *                       the number of taps applied in direct form unless
+ *                       AV_CONVOLUTION_FLAG_BLOCK is set; rounded down to a
+ *                       power of two between 16 and 65536
+ * @param max_part_size  size of the largest FFT partition, rounded down to
+ *                       a power of two between min_part_size and 65536
+ * @param flags          a combination of AV_CONVOLUTION_FLAG_*
+ * @return the context or NULL on error
+ */
+AVConvolutionContext *av_convolution_alloc(int nb_inputs, int nb_outputs,
+                                           int min_part_size, int max_part_size,
+                                           int flags);
+
+/**
+ * Add an impulse response. The taps are copied.
+ *
+ * @return the index of the impulse response, for av_convolution_add_route(),
+ *         or a negative AVERROR code
+ */
+int av_convolution_add_ir(AVConvolutionContext *c, const float *ir, int len);
+
+/**
+ * Convolve an input with an impulse response and add the result to an
+ * output.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_convolution_add_route(AVConvolutionContext *c, int input, int output,
+                             int ir);
+
+/**
+ * Compute the partitions and transform the impulse responses. Must be
+ * called once after all impulse responses and routes were added, and
+ * before av_convolution_process().
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_convolution_init(AVConvolutionContext *c);
+
+/**
+ * Filter samples.
+ *
+ * @param dst         output channels, overwritten
+ * @param dst_stride  distance between two output samples, in samples
+ * @param src         input channels
+ * @param src_stride  distance between two input samples, in samples
+ * @param nb_samples  number of samples per channel
+ */
+void av_convolution_process(AVConvolutionContext *c,
+                            float * const *dst, ptrdiff_t dst_stride,
+                            const float * const *src, ptrdiff_t src_stride,
+                            int nb_samples);
+
+/**
+ * Clear the filter history, as if no sample was processed yet.
+ */
+void av_convolution_reset(AVConvolutionContext *c);
+
+/**
+ * Free a convolution context and set the pointer to NULL.
+ */
+void av_convolution_free(AVConvolutionContext **c);
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* AVUTIL_CONVOLUTION_H */
@@ -0,0 +1,71 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_CONVOLUTION_INTERNAL_H
+#define AVUTIL_CONVOLUTION_INTERNAL_H
+
+#include <stddef.h>
+
+#include "tx.h"
+
+typedef struct ConvolutionDSPContext {
+    /**
+     * Multiply two half spectra of len + 1 bins and add the result to sum.
+     * The bins are stored as interleaved real and imaginary parts, the
+     * imaginary part of the last bin is ignored.
+     *
+     * @param sum output, 32-byte aligned
+     * @param t   input, 32-byte aligned
+     * @param c   input, 32-byte aligned
+     * @param len number of bins minus one, multiple of 8
+     */
+    void (*fcmul_add)(float *sum, const float *t, const float *c,
+                      ptrdiff_t len);
+} ConvolutionDSPContext;
+
+void ff_convolution_dsp_init(ConvolutionDSPContext *dsp);
+void ff_convolution_dsp_init_x86(ConvolutionDSPContext *dsp);
+
+/*
+ * Real DFT of 2 * n samples through a complex FFT of n points: the even
+ * samples are given as the real parts and the odd ones as the imaginary
+ * parts of the FFT input.
+ */
+
+/**
+ * Allocate the n + 1 twiddle factors e^(-i * pi * k / n) used to split
+ * and merge the spectra, to be freed with av_free().
+ */
+AVComplexFloat *avpriv_rdft_alloc_twiddle(int n);
+
+/**
+ * Split the n-point FFT z of the interleaved samples into the n + 1
+ * bins of their real DFT.
+ */
+void avpriv_rdft_split(AVComplexFloat *dst, const AVComplexFloat *z,
+                       const AVComplexFloat *tw, int n);
+
+/**
+ * Inverse of avpriv_rdft_split(): merge the n + 1 bins of src into the
+ * input of an n-point inverse FFT, which then yields the even samples in
+ * the real parts and the odd ones in the imaginary parts, scaled by n.
+ */
+void avpriv_rdft_merge(AVComplexFloat *z, const AVComplexFloat *src,
+                       const AVComplexFloat *tw, int n);
+
+#endif /* AVUTIL_CONVOLUTION_INTERNAL_H */
@@ -47,9 +47,11 @@
 #include <limits.h>
 #include <math.h>               /* You may have to define _USE_MATH_DEFINES if you use MSVC */
 
-#include "libavutil/common.h"
-#include "libavutil/mem.h"
-#include "libavutil/thread.h"
+#include "avassert.h"
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "thread.h"
 
 #define CHECK_ERROR(condition, errorcode, goto_point)                          \
     if ((condition)) {                                                         \
@@ -63,7 +65,21 @@
 #define RELATIVE_GATE_FACTOR  pow(10.0, RELATIVE_GATE / 10.0)
 #define MINUS_20DB            pow(10.0, -20.0 / 10.0)
 
-struct FFEBUR128StateInternal {
+struct AVEBUR128TruePeak {
+    unsigned int channels;            /**< The number of channels. */
+    double *buf;                      /**< Filter history followed by the new samples, interleaved. */
+    unsigned int buf_size;            /**< Allocated size of buf in bytes. */
+    double *acc;                      /**< Output of the 4 phases, per channel. */
+};
+
+struct AVEBUR128Context {
+    int mode;                         /**< The current mode. */
+    unsigned int channels;            /**< The number of channels. */
+    unsigned long samplerate;         /**< The sample rate. */
+    struct EBUR128StateInternal *d;   /**< Internal state. */
+};
+
+struct EBUR128StateInternal {
     /** Filtered audio data (used as ring buffer). */
     double *audio_data;
     /** Size of audio_data array. */
@@ -82,8 +98,18 @@ struct FFEBUR128StateInternal {
     double b[5];
     /** BS.1770 filter coefficients (denominator). */
     double a[5];
-    /** BS.1770 filter state. */
-    double v[5][5];
+    /** BS.1770 filter state, v[i * channels + c] is the i-th state of
+     *  channel c so that the channels are filtered side by side. */
+    double *v;
+    /** Channel weighted energy of the last 30 blocks of 100ms, the gating
+     *  blocks and the short-term loudness are summed up from them. */
+    double sub_block_energy[30];
+    /** Index of the next entry of sub_block_energy. */
+    size_t sub_block_index;
+    /** Whether the first gating block was completed. */
+    int have_sub_blocks;
+    /** Per channel sums of squares, scratch buffer. */
+    double *channel_sum;
     /** Histograms, used to calculate LRA. */
     unsigned long *block_energy_histogram;
     unsigned long *short_term_block_energy_histogram;
@@ -91,20 +117,134 @@ struct FFEBUR128StateInternal {
     size_t short_term_frame_counter;
     /** Maximum sample peak, one per channel */
     double *sample_peak;
+    /** Maximum true peak, one per channel */
+    double *true_peak;
+    /** Oversampling for the true peak */
+    AVEBUR128TruePeak tp;
     /** The maximum window duration in ms. */
     unsigned long window;
     /** Data pointer array for interleaved data */
     void **data_ptrs;
 };
 
+#define TRUE_PEAK_PHASES 4
+#define TRUE_PEAK_TAPS   12
+
+/* ITU-R BS.1770-4 Annex 2, 4x oversampling filter, one row per phase */
+static const double true_peak_coeffs[TRUE_PEAK_PHASES][TRUE_PEAK_TAPS] = {
+    {  0.0017089843750,  0.0109863281250, -0.0196533203125,  0.0332031250000,
+      -0.0594482421875,  0.1373291015625,  0.9721679687500, -0.1022949218750,
+       0.0476074218750, -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+    { -0.0291748046875,  0.0292968750000, -0.0517578125000,  0.0891113281250,
+      -0.1665039062500,  0.4650878906250,  0.7797851562500, -0.2003173828125,
+       0.1015625000000, -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+    { -0.0189208984375,  0.0330810546875, -0.0582275390625,  0.1015625000000,
+      -0.2003173828125,  0.7797851562500,  0.4650878906250, -0.1665039062500,
+       0.0891113281250, -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+    { -0.0083007812500,  0.0148925781250, -0.0266113281250,  0.0476074218750,
+      -0.1022949218750,  0.9721679687500,  0.1373291015625, -0.0594482421875,
+       0.0332031250000, -0.0196533203125,  0.0109863281250,  0.0017089843750 },
+};
+
+static void true_peak_uninit(AVEBUR128TruePeak *tp)
+{
+    av_freep(&tp->buf);
+    av_freep(&tp->acc);
+    tp->buf_size = 0;
+}
+
+static int true_peak_init(AVEBUR128TruePeak *tp, unsigned int channels)
+{
+    tp->channels = channels;
+    tp->buf      = NULL;
+    tp->buf_size = 0;
+    tp->acc      = av_malloc_array(channels, TRUE_PEAK_PHASES * sizeof(*tp->acc));
+    if (!tp->acc || !av_ebur128_true_peak_get_buffer(tp, 0)) {
+        true_peak_uninit(tp);
+        return AVERROR(ENOMEM);
+    }
+    memset(tp->buf, 0, (TRUE_PEAK_TAPS - 1) * channels * sizeof(*tp->buf));
+    return 0;
+}
+
+AVEBUR128TruePeak *av_ebur128_true_peak_alloc(int channels)
+{
+    AVEBUR128TruePeak *tp;
+
+    if (channels <= 0)
+        return NULL;
+    tp = av_mallocz(sizeof(*tp));
+    if (!tp)
+        return NULL;
+    if (true_peak_init(tp, channels) < 0)
+        av_freep(&tp);
+    return tp;
+}
+
+void av_ebur128_true_peak_free(AVEBUR128TruePeak **tp)
+{
+    if (!*tp)
+        return;
+    true_peak_uninit(*tp);
+    av_freep(tp);
+}
+
+double *av_ebur128_true_peak_get_buffer(AVEBUR128TruePeak *tp, size_t frames)
+{
+    const size_t history = (TRUE_PEAK_TAPS - 1) * tp->channels;
+    size_t size = (history + frames * tp->channels) * sizeof(*tp->buf);
+    double *buf;
+
+    if (size > UINT_MAX)
+        return NULL;
+    if (size > tp->buf_size) {
+        /* keep the history when growing the buffer */
+        buf = av_realloc(tp->buf, size);
+        if (!buf)
+            return NULL;
+        tp->buf      = buf;
+        tp->buf_size = size;
+    }
+    return tp->buf + history;
+}
+
+void av_ebur128_true_peak_process(AVEBUR128TruePeak *tp, size_t frames,
+                                  double *peaks)
+{
+    const size_t channels = tp->channels;
+    double *acc = tp->acc;
+    size_t i, c, k, p;
+
+    for (i = 0; i < frames; i++) {
+        const double *x = tp->buf + i * channels;
+
+        for (c = 0; c < TRUE_PEAK_PHASES * channels; c++)
+            acc[c] = 0.0;
+        /* the channels are contiguous, so the inner loops vectorize */
+        for (k = 0; k < TRUE_PEAK_TAPS; k++) {
+            const double *xk = x + k * channels;
+            for (p = 0; p < TRUE_PEAK_PHASES; p++) {
+                const double coeff = true_peak_coeffs[p][k];
+                double *accp = acc + p * channels;
+                for (c = 0; c < channels; c++)
+                    accp[c] += coeff * xk[c];
+            }
+        }
+        for (p = 0; p < TRUE_PEAK_PHASES; p++)
+            for (c = 0; c < channels; c++)
+                peaks[c] = FFMAX(peaks[c], fabs(acc[p * channels + c]));
+    }
+
+    memmove(tp->buf, tp->buf + frames * channels,
+            (TRUE_PEAK_TAPS - 1) * channels * sizeof(*tp->buf));
+}
+
 static AVOnce histogram_init = AV_ONCE_INIT;
 static DECLARE_ALIGNED(32, double, histogram_energies)[1000];
 static DECLARE_ALIGNED(32, double, histogram_energy_boundaries)[1001];
 
-static void ebur128_init_filter(FFEBUR128State * st)
+static void ebur128_init_filter(AVEBUR128Context * st)
 {
-    int i, j;
-
     double f0 = 1681.974450955533;
     double G = 3.999843853973347;
     double Q = 0.7071752369554196;
@@ -143,15 +283,9 @@ static void ebur128_init_filter(FFEBUR128State * st)
     st->d->a[2] = pa[0] * ra[2] + pa[1] * ra[1] + pa[2] * ra[0];
     st->d->a[3] = pa[1] * ra[2] + pa[2] * ra[1];
     st->d->a[4] = pa[2] * ra[2];
-
-    for (i = 0; i < 5; ++i) {
-        for (j = 0; j < 5; ++j) {
-            st->d->v[i][j] = 0.0;
-        }
-    }
 }
 
-static int ebur128_init_channel_map(FFEBUR128State * st)
+static int ebur128_init_channel_map(AVEBUR128Context * st)
 {
     size_t i;
     st->d->channel_map =
@@ -159,39 +293,39 @@ static int ebur128_init_channel_map(FFEBUR128State * st)
     if (!st->d->channel_map)
         return AVERROR(ENOMEM);
     if (st->channels == 4) {
-        st->d->channel_map[0] = FF_EBUR128_LEFT;
-        st->d->channel_map[1] = FF_EBUR128_RIGHT;
-        st->d->channel_map[2] = FF_EBUR128_LEFT_SURROUND;
-        st->d->channel_map[3] = FF_EBUR128_RIGHT_SURROUND;
+        st->d->channel_map[0] = AV_EBUR128_LEFT;
+        st->d->channel_map[1] = AV_EBUR128_RIGHT;
+        st->d->channel_map[2] = AV_EBUR128_LEFT_SURROUND;
+        st->d->channel_map[3] = AV_EBUR128_RIGHT_SURROUND;
     } else if (st->channels == 5) {
-        st->d->channel_map[0] = FF_EBUR128_LEFT;
-        st->d->channel_map[1] = FF_EBUR128_RIGHT;
-        st->d->channel_map[2] = FF_EBUR128_CENTER;
-        st->d->channel_map[3] = FF_EBUR128_LEFT_SURROUND;
-        st->d->channel_map[4] = FF_EBUR128_RIGHT_SURROUND;
+        st->d->channel_map[0] = AV_EBUR128_LEFT;
+        st->d->channel_map[1] = AV_EBUR128_RIGHT;
+        st->d->channel_map[2] = AV_EBUR128_CENTER;
+        st->d->channel_map[3] = AV_EBUR128_LEFT_SURROUND;
+        st->d->channel_map[4] = AV_EBUR128_RIGHT_SURROUND;
     } else {
         for (i = 0; i < st->channels; ++i) {
             switch (i) {
             case 0:
-                st->d->channel_map[i] = FF_EBUR128_LEFT;
+                st->d->channel_map[i] = AV_EBUR128_LEFT;
                 break;
             case 1:
-                st->d->channel_map[i] = FF_EBUR128_RIGHT;
+                st->d->channel_map[i] = AV_EBUR128_RIGHT;
                 break;
             case 2:
-                st->d->channel_map[i] = FF_EBUR128_CENTER;
+                st->d->channel_map[i] = AV_EBUR128_CENTER;
                 break;
             case 3:
-                st->d->channel_map[i] = FF_EBUR128_UNUSED;
+                st->d->channel_map[i] = AV_EBUR128_UNUSED;
                 break;
             case 4:
-                st->d->channel_map[i] = FF_EBUR128_LEFT_SURROUND;
+                st->d->channel_map[i] = AV_EBUR128_LEFT_SURROUND;
                 break;
             case 5:
-                st->d->channel_map[i] = FF_EBUR128_RIGHT_SURROUND;
+                st->d->channel_map[i] = AV_EBUR128_RIGHT_SURROUND;
                 break;
             default:
-                st->d->channel_map[i] = FF_EBUR128_UNUSED;
+                st->d->channel_map[i] = AV_EBUR128_UNUSED;
                 break;
             }
         }
@@ -214,17 +348,17 @@ static inline void init_histogram(void)
     }
 }
 
-FFEBUR128State *ff_ebur128_init(unsigned int channels,
-                                unsigned long samplerate,
-                                unsigned long window, int mode)
+AVEBUR128Context *av_ebur128_alloc(unsigned int channels,
+                                   unsigned long samplerate,
+                                   unsigned long window, int mode)
 {
     int errcode;
-    FFEBUR128State *st;
+    AVEBUR128Context *st;
 
-    st = (FFEBUR128State *) av_malloc(sizeof(FFEBUR128State));
+    st = (AVEBUR128Context *) av_malloc(sizeof(AVEBUR128Context));
     CHECK_ERROR(!st, 0, exit)
-    st->d = (struct FFEBUR128StateInternal *)
-        av_malloc(sizeof(struct FFEBUR128StateInternal));
+    st->d = (struct EBUR128StateInternal *)
+        av_mallocz(sizeof(struct EBUR128StateInternal));
     CHECK_ERROR(!st->d, 0, free_state)
     st->channels = channels;
     errcode = ebur128_init_channel_map(st);
@@ -237,9 +371,9 @@ FFEBUR128State *ff_ebur128_init(unsigned int channels,
     st->samplerate = samplerate;
     st->d->samples_in_100ms = (st->samplerate + 5) / 10;
     st->mode = mode;
-    if ((mode & FF_EBUR128_MODE_S) == FF_EBUR128_MODE_S) {
+    if ((mode & AV_EBUR128_MODE_S) == AV_EBUR128_MODE_S) {
         st->d->window = FFMAX(window, 3000);
-    } else if ((mode & FF_EBUR128_MODE_M) == FF_EBUR128_MODE_M) {
+    } else if ((mode & AV_EBUR128_MODE_M) == AV_EBUR128_MODE_M) {
         st->d->window = FFMAX(window, 400);
     } else {
         goto free_sample_peak;
@@ -256,8 +390,22 @@ FFEBUR128State *ff_ebur128_init(unsigned int channels,
                                     st->channels * sizeof(double));
     CHECK_ERROR(!st->d->audio_data, 0, free_sample_peak)
 
+    st->d->v = av_mallocz_array(5 * st->channels, sizeof(*st->d->v));
+    CHECK_ERROR(!st->d->v, 0, free_audio_data)
+    st->d->channel_sum = av_malloc_array(st->channels, sizeof(*st->d->channel_sum));
+    CHECK_ERROR(!st->d->channel_sum, 0, free_audio_data)
     ebur128_init_filter(st);
 
+    if ((mode & AV_EBUR128_MODE_TRUE_PEAK) == AV_EBUR128_MODE_TRUE_PEAK) {
+        st->d->true_peak = av_mallocz_array(channels, sizeof(*st->d->true_peak));
+        CHECK_ERROR(!st->d->true_peak, 0, free_audio_data)
+        errcode = true_peak_init(&st->d->tp, channels);
+        CHECK_ERROR(errcode, 0, free_audio_data)
+        /* sized for the longest block up front, filtering cannot run out of memory */
+        CHECK_ERROR(!av_ebur128_true_peak_get_buffer(&st->d->tp, st->d->samples_in_100ms * 4),
+                    0, free_audio_data)
+    }
+
     st->d->block_energy_histogram =
         av_mallocz(1000 * sizeof(unsigned long));
     CHECK_ERROR(!st->d->block_energy_histogram, 0, free_audio_data)
@@ -286,6 +434,10 @@ free_short_term_block_energy_histogram:
 free_block_energy_histogram:
     av_free(st->d->block_energy_histogram);
 free_audio_data:
+    true_peak_uninit(&st->d->tp);
+    av_free(st->d->true_peak);
+    av_free(st->d->v);
+    av_free(st->d->channel_sum);
     av_free(st->d->audio_data);
 free_sample_peak:
     av_free(st->d->sample_peak);
@@ -299,28 +451,39 @@ exit:
     return NULL;
 }
 
-void ff_ebur128_destroy(FFEBUR128State ** st)
+void av_ebur128_free(AVEBUR128Context **st)
 {
+    if (!*st)
+        return;
     av_free((*st)->d->block_energy_histogram);
     av_free((*st)->d->short_term_block_energy_histogram);
     av_free((*st)->d->audio_data);
     av_free((*st)->d->channel_map);
     av_free((*st)->d->sample_peak);
     av_free((*st)->d->data_ptrs);
+    av_free((*st)->d->v);
+    av_free((*st)->d->channel_sum);
+    av_free((*st)->d->true_peak);
+    true_peak_uninit(&(*st)->d->tp);
     av_free((*st)->d);
     av_free(*st);
     *st = NULL;
 }
 
+/* number of channels filtered side by side */
+#define EBUR128_LANES 4
+
 #define EBUR128_FILTER(type, scaling_factor)                                       \
-static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,           \
+static void ebur128_filter_##type(AVEBUR128Context* st, const type** srcs,           \
                                   size_t src_index, size_t frames,                 \
                                   int stride) {                                    \
     double* audio_data = st->d->audio_data + st->d->audio_data_index;              \
-    size_t i, c;                                                                   \
+    const double *a = st->d->a, *b = st->d->b;                                     \
+    const size_t channels = st->channels;                                          \
+    size_t i, c, l, k;                                                             \
                                                                                    \
-    if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) == FF_EBUR128_MODE_SAMPLE_PEAK) { \
-        for (c = 0; c < st->channels; ++c) {                                       \
+    if ((st->mode & AV_EBUR128_MODE_SAMPLE_PEAK) == AV_EBUR128_MODE_SAMPLE_PEAK) { \
+        for (c = 0; c < channels; ++c) {                                           \
             double max = 0.0;                                                      \
             for (i = 0; i < frames; ++i) {                                         \
                 type v = srcs[c][src_index + i * stride];                          \
@@ -334,31 +497,52 @@ static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,
             if (max > st->d->sample_peak[c]) st->d->sample_peak[c] = max;          \
         }                                                                          \
     }                                                                              \
-    for (c = 0; c < st->channels; ++c) {                                           \
-        int ci = st->d->channel_map[c] - 1;                                        \
-        if (ci < 0) continue;                                                      \
-        else if (ci == FF_EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */            \
+    if ((st->mode & AV_EBUR128_MODE_TRUE_PEAK) == AV_EBUR128_MODE_TRUE_PEAK) {     \
+        /* never reallocates: frames is at most the 400ms allocated in init */     \
+        double *tp = av_ebur128_true_peak_get_buffer(&st->d->tp, frames);          \
+        av_assert1(tp);                                                            \
+        for (i = 0; i < frames; ++i)                                               \
+            for (c = 0; c < channels; ++c)                                         \
+                tp[i * channels + c] =                                             \
+                    srcs[c][src_index + i * stride] / scaling_factor;              \
+        av_ebur128_true_peak_process(&st->d->tp, frames, st->d->true_peak);        \
+    }                                                                              \
+    /* filter EBUR128_LANES channels at once, every lane runs the same          \
+     * operations so that they can be done with vector instructions */          \
+    for (c = 0; c < channels; c += EBUR128_LANES) {                                \
+        const size_t lanes = FFMIN(EBUR128_LANES, channels - c);                   \
+        double v[5][EBUR128_LANES] = { { 0 } };                                    \
+        const type *src[EBUR128_LANES];                                            \
+        for (l = 0; l < lanes; ++l) {                                              \
+            src[l] = srcs[c + l] + src_index;                                      \
+            for (k = 0; k < 5; ++k)                                                \
+                v[k][l] = st->d->v[k * channels + c + l];                          \
+        }                                                                          \
         for (i = 0; i < frames; ++i) {                                             \
-            st->d->v[ci][0] = (double) (srcs[c][src_index + i * stride] / scaling_factor) \
-                         - st->d->a[1] * st->d->v[ci][1]                           \
-                         - st->d->a[2] * st->d->v[ci][2]                           \
-                         - st->d->a[3] * st->d->v[ci][3]                           \
-                         - st->d->a[4] * st->d->v[ci][4];                          \
-            audio_data[i * st->channels + c] =                                     \
-                           st->d->b[0] * st->d->v[ci][0]                           \
-                         + st->d->b[1] * st->d->v[ci][1]                           \
-                         + st->d->b[2] * st->d->v[ci][2]                           \
-                         + st->d->b[3] * st->d->v[ci][3]                           \
-                         + st->d->b[4] * st->d->v[ci][4];                          \
-            st->d->v[ci][4] = st->d->v[ci][3];                                     \
-            st->d->v[ci][3] = st->d->v[ci][2];                                     \
-            st->d->v[ci][2] = st->d->v[ci][1];                                     \
-            st->d->v[ci][1] = st->d->v[ci][0];                                     \
+            double *dst = audio_data + i * channels + c;                           \
+            for (l = 0; l < lanes; ++l) {                                          \
+                v[0][l] = (double) (src[l][i * stride] / scaling_factor)           \
+                        - a[1] * v[1][l]                                           \
+                        - a[2] * v[2][l]                                           \
+                        - a[3] * v[3][l]                                           \
+                        - a[4] * v[4][l];                                          \
+                dst[l]  = b[0] * v[0][l]                                           \
+                        + b[1] * v[1][l]                                           \
+                        + b[2] * v[2][l]                                           \
+                        + b[3] * v[3][l]                                           \
+                        + b[4] * v[4][l];                                          \
+                v[4][l] = v[3][l];                                                 \
+                v[3][l] = v[2][l];                                                 \
+                v[2][l] = v[1][l];                                                 \
+                v[1][l] = v[0][l];                                                 \
+            }                                                                      \
+        }                                                                          \
+        for (l = 0; l < lanes; ++l) {                                              \
+            for (k = 1; k < 5; ++k)                                                \
+                v[k][l] = fabs(v[k][l]) < DBL_MIN ? 0.0 : v[k][l];                 \
+            for (k = 0; k < 5; ++k)                                                \
+                st->d->v[k * channels + c + l] = v[k][l];                          \
         }                                                                          \
-        st->d->v[ci][4] = fabs(st->d->v[ci][4]) < DBL_MIN ? 0.0 : st->d->v[ci][4]; \
-        st->d->v[ci][3] = fabs(st->d->v[ci][3]) < DBL_MIN ? 0.0 : st->d->v[ci][3]; \
-        st->d->v[ci][2] = fabs(st->d->v[ci][2]) < DBL_MIN ? 0.0 : st->d->v[ci][2]; \
-        st->d->v[ci][1] = fabs(st->d->v[ci][1]) < DBL_MIN ? 0.0 : st->d->v[ci][1]; \
     }                                                                              \
 }
 EBUR128_FILTER(short, -((double)SHRT_MIN))
@@ -389,137 +573,180 @@ static size_t find_histogram_index(double energy)
     return index_min;
 }
 
-static void ebur128_calc_gating_block(FFEBUR128State * st,
-                                      size_t frames_per_block,
-                                      double *optional_output)
+static double ebur128_channel_weight(int channel)
 {
-    size_t i, c;
+    switch (channel) {
+    case AV_EBUR128_UNUSED:
+        return 0.0;
+    case AV_EBUR128_Mp110:
+    case AV_EBUR128_Mm110:
+    case AV_EBUR128_Mp060:
+    case AV_EBUR128_Mm060:
+    case AV_EBUR128_Mp090:
+    case AV_EBUR128_Mm090:
+        return 1.41;
+    case AV_EBUR128_DUAL_MONO:
+        return 2.0;
+    default:
+        return 1.0;
+    }
+}
+
+/* Channel weighted sum of squares of the filtered audio in [start, end[ */
+static double ebur128_energy_sum(AVEBUR128Context * st, size_t start, size_t end)
+{
+    const size_t channels = st->channels;
+    double *channel_sum = st->d->channel_sum;
     double sum = 0.0;
-    double channel_sum;
-    for (c = 0; c < st->channels; ++c) {
-        if (st->d->channel_map[c] == FF_EBUR128_UNUSED)
-            continue;
-        channel_sum = 0.0;
-        if (st->d->audio_data_index < frames_per_block * st->channels) {
-            for (i = 0; i < st->d->audio_data_index / st->channels; ++i) {
-                channel_sum += st->d->audio_data[i * st->channels + c] *
-                    st->d->audio_data[i * st->channels + c];
-            }
-            for (i = st->d->audio_data_frames -
-                 (frames_per_block -
-                  st->d->audio_data_index / st->channels);
-                 i < st->d->audio_data_frames; ++i) {
-                channel_sum += st->d->audio_data[i * st->channels + c] *
-                    st->d->audio_data[i * st->channels + c];
-            }
-        } else {
-            for (i =
-                 st->d->audio_data_index / st->channels - frames_per_block;
-                 i < st->d->audio_data_index / st->channels; ++i) {
-                channel_sum +=
-                    st->d->audio_data[i * st->channels +
-                                      c] * st->d->audio_data[i *
-                                                             st->channels +
-                                                             c];
-            }
-        }
-        if (st->d->channel_map[c] == FF_EBUR128_Mp110 ||
-            st->d->channel_map[c] == FF_EBUR128_Mm110 ||
-            st->d->channel_map[c] == FF_EBUR128_Mp060 ||
-            st->d->channel_map[c] == FF_EBUR128_Mm060 ||
-            st->d->channel_map[c] == FF_EBUR128_Mp090 ||
-            st->d->channel_map[c] == FF_EBUR128_Mm090) {
-            channel_sum *= 1.41;
-        } else if (st->d->channel_map[c] == FF_EBUR128_DUAL_MONO) {
-            channel_sum *= 2.0;
-        }
-        sum += channel_sum;
+    size_t i, c;
+
+    for (c = 0; c < channels; ++c)
+        channel_sum[c] = 0.0;
+    for (i = start; i < end; ++i) {
+        const double *x = st->d->audio_data + i * channels;
+        for (c = 0; c < channels; ++c)
+            channel_sum[c] += x[c] * x[c];
     }
-    sum /= (double) frames_per_block;
-    if (optional_output) {
-        *optional_output = sum;
-    } else if (sum >= histogram_energy_boundaries[0]) {
-        ++st->d->block_energy_histogram[find_histogram_index(sum)];
+    for (c = 0; c < channels; ++c)
+        if (st->d->channel_map[c] != AV_EBUR128_UNUSED)
+            sum += ebur128_channel_weight(st->d->channel_map[c]) * channel_sum[c];
+    return sum;
+}
+
+static double ebur128_calc_gating_block(AVEBUR128Context * st,
+                                        size_t frames_per_block)
+{
+    size_t index = st->d->audio_data_index / st->channels;
+    double sum;
+
+    if (index < frames_per_block) {
+        sum = ebur128_energy_sum(st, 0, index) +
+              ebur128_energy_sum(st, st->d->audio_data_frames -
+                                 (frames_per_block - index),
+                                 st->d->audio_data_frames);
+    } else {
+        sum = ebur128_energy_sum(st, index - frames_per_block, index);
+    }
+    return sum / (double) frames_per_block;
+}
+
+/* Store the energy of the nb_blocks blocks of 100ms which were just
+ * filtered. They are never split by the wrap around of audio_data. */
+static void ebur128_add_sub_blocks(AVEBUR128Context * st, size_t nb_blocks)
+{
+    const size_t frames = st->d->samples_in_100ms;
+    size_t end = st->d->audio_data_index / st->channels - (nb_blocks - 1) * frames;
+
+    for (; nb_blocks > 0; nb_blocks--, end += frames) {
+        st->d->sub_block_energy[st->d->sub_block_index] =
+            ebur128_energy_sum(st, end - frames, end);
+        st->d->sub_block_index = (st->d->sub_block_index + 1) %
+                                 FF_ARRAY_ELEMS(st->d->sub_block_energy);
     }
+    st->d->have_sub_blocks = 1;
 }
 
-int ff_ebur128_set_channel(FFEBUR128State * st,
+/* Mean energy of the last nb_blocks blocks of 100ms */
+static double ebur128_sub_block_mean(AVEBUR128Context * st, size_t nb_blocks)
+{
+    const size_t size = FF_ARRAY_ELEMS(st->d->sub_block_energy);
+    size_t i, index = st->d->sub_block_index + size - nb_blocks;
+    double sum = 0.0;
+
+    for (i = 0; i < nb_blocks; i++)
+        sum += st->d->sub_block_energy[(index + i) % size];
+    return sum / (double) (nb_blocks * st->d->samples_in_100ms);
+}
+
+/* Whether the last filtered frame ends a block of 100ms, so that the
+ * loudness of whole blocks can be read from sub_block_energy. */
+static int ebur128_on_sub_block(AVEBUR128Context * st, size_t nb_blocks)
+{
+    return st->d->have_sub_blocks &&
+           st->d->needed_frames == st->d->samples_in_100ms &&
+           nb_blocks <= FF_ARRAY_ELEMS(st->d->sub_block_energy);
+}
+
+int av_ebur128_set_channel(AVEBUR128Context * st,
                            unsigned int channel_number, int value)
 {
     if (channel_number >= st->channels) {
-        return 1;
+        return AVERROR(EINVAL);
     }
-    if (value == FF_EBUR128_DUAL_MONO &&
+    if (value == AV_EBUR128_DUAL_MONO &&
         (st->channels != 1 || channel_number != 0)) {
-        return 1;
+        return AVERROR(EINVAL);
     }
     st->d->channel_map[channel_number] = value;
     return 0;
 }
 
-static int ebur128_energy_shortterm(FFEBUR128State * st, double *out);
-#define FF_EBUR128_ADD_FRAMES_PLANAR(type)                                             \
-void ff_ebur128_add_frames_planar_##type(FFEBUR128State* st, const type** srcs,        \
-                                 size_t frames, int stride) {                          \
-    size_t src_index = 0;                                                              \
-    while (frames > 0) {                                                               \
-        if (frames >= st->d->needed_frames) {                                          \
-            ebur128_filter_##type(st, srcs, src_index, st->d->needed_frames, stride);  \
-            src_index += st->d->needed_frames * stride;                                \
-            frames -= st->d->needed_frames;                                            \
-            st->d->audio_data_index += st->d->needed_frames * st->channels;            \
-            /* calculate the new gating block */                                       \
-            if ((st->mode & FF_EBUR128_MODE_I) == FF_EBUR128_MODE_I) {                 \
-                ebur128_calc_gating_block(st, st->d->samples_in_100ms * 4, NULL);      \
-            }                                                                          \
-            if ((st->mode & FF_EBUR128_MODE_LRA) == FF_EBUR128_MODE_LRA) {             \
-                st->d->short_term_frame_counter += st->d->needed_frames;               \
-                if (st->d->short_term_frame_counter == st->d->samples_in_100ms * 30) { \
-                    double st_energy;                                                  \
-                    ebur128_energy_shortterm(st, &st_energy);                          \
-                    if (st_energy >= histogram_energy_boundaries[0]) {                 \
-                        ++st->d->short_term_block_energy_histogram[                    \
-                                                    find_histogram_index(st_energy)];  \
-                    }                                                                  \
-                    st->d->short_term_frame_counter = st->d->samples_in_100ms * 20;    \
-                }                                                                      \
-            }                                                                          \
-            /* 100ms are needed for all blocks besides the first one */                \
-            st->d->needed_frames = st->d->samples_in_100ms;                            \
-            /* reset audio_data_index when buffer full */                              \
-            if (st->d->audio_data_index == st->d->audio_data_frames * st->channels) {  \
-                st->d->audio_data_index = 0;                                           \
-            }                                                                          \
-        } else {                                                                       \
-            ebur128_filter_##type(st, srcs, src_index, frames, stride);                \
-            st->d->audio_data_index += frames * st->channels;                          \
-            if ((st->mode & FF_EBUR128_MODE_LRA) == FF_EBUR128_MODE_LRA) {             \
-                st->d->short_term_frame_counter += frames;                             \
-            }                                                                          \
-            st->d->needed_frames -= frames;                                            \
-            frames = 0;                                                                \
-        }                                                                              \
-    }                                                                                  \
-}
-FF_EBUR128_ADD_FRAMES_PLANAR(short)
-FF_EBUR128_ADD_FRAMES_PLANAR(int)
-FF_EBUR128_ADD_FRAMES_PLANAR(float)
-FF_EBUR128_ADD_FRAMES_PLANAR(double)
-#define FF_EBUR128_ADD_FRAMES(type)                                            \
-void ff_ebur128_add_frames_##type(FFEBUR128State* st, const type* src,         \
+#define EBUR128_ADD_FRAMES_PLANAR(type)                                                 \
+void av_ebur128_add_frames_planar_##type(AVEBUR128Context* st, const type** srcs,       \
+                                 size_t frames, int stride) {                           \
+    size_t src_index = 0;                                                               \
+    while (frames > 0) {                                                                \
+        if (frames >= st->d->needed_frames) {                                           \
+            ebur128_filter_##type(st, srcs, src_index, st->d->needed_frames, stride);   \
+            src_index += st->d->needed_frames * stride;                                 \
+            frames -= st->d->needed_frames;                                             \
+            st->d->audio_data_index += st->d->needed_frames * st->channels;             \
+            /* the first block is 400ms long, the next ones 100ms */                    \
+            ebur128_add_sub_blocks(st, st->d->have_sub_blocks ? 1 : 4);                 \
+            /* calculate the new gating block */                                        \
+            if ((st->mode & AV_EBUR128_MODE_I) == AV_EBUR128_MODE_I) {                  \
+                double energy = ebur128_sub_block_mean(st, 4);                          \
+                if (energy >= histogram_energy_boundaries[0]) {                         \
+                    ++st->d->block_energy_histogram[find_histogram_index(energy)];      \
+                }                                                                       \
+            }                                                                           \
+            if ((st->mode & AV_EBUR128_MODE_LRA) == AV_EBUR128_MODE_LRA) {              \
+                st->d->short_term_frame_counter += st->d->needed_frames;                \
+                if (st->d->short_term_frame_counter == st->d->samples_in_100ms * 30) {  \
+                    double st_energy = ebur128_sub_block_mean(st, 30);                  \
+                    if (st_energy >= histogram_energy_boundaries[0]) {                  \
+                        ++st->d->short_term_block_energy_histogram[                     \
+                                                    find_histogram_index(st_energy)];   \
+                    }                                                                   \
+                    st->d->short_term_frame_counter = st->d->samples_in_100ms * 20;     \
+                }                                                                       \
+            }                                                                           \
+            /* 100ms are needed for all blocks besides the first one */                 \
+            st->d->needed_frames = st->d->samples_in_100ms;                             \
+            /* reset audio_data_index when buffer full */                               \
+            if (st->d->audio_data_index == st->d->audio_data_frames * st->channels) {   \
+                st->d->audio_data_index = 0;                                            \
+            }                                                                           \
+        } else {                                                                        \
+            ebur128_filter_##type(st, srcs, src_index, frames, stride);                 \
+            st->d->audio_data_index += frames * st->channels;                           \
+            if ((st->mode & AV_EBUR128_MODE_LRA) == AV_EBUR128_MODE_LRA) {              \
+                st->d->short_term_frame_counter += frames;                              \
+            }                                                                           \
+            st->d->needed_frames -= frames;                                             \
+            frames = 0;                                                                 \
+        }                                                                               \
+    }                                                                                   \
+}
+EBUR128_ADD_FRAMES_PLANAR(short)
+EBUR128_ADD_FRAMES_PLANAR(int)
+EBUR128_ADD_FRAMES_PLANAR(float)
+EBUR128_ADD_FRAMES_PLANAR(double)
+#define EBUR128_ADD_FRAMES(type)                                               \
+void av_ebur128_add_frames_##type(AVEBUR128Context* st, const type* src,       \
                                     size_t frames) {                           \
   int i;                                                                       \
   const type **buf = (const type**)st->d->data_ptrs;                           \
   for (i = 0; i < st->channels; i++)                                           \
     buf[i] = src + i;                                                          \
-  ff_ebur128_add_frames_planar_##type(st, buf, frames, st->channels);          \
+  av_ebur128_add_frames_planar_##type(st, buf, frames, st->channels);          \
 }
-FF_EBUR128_ADD_FRAMES(short)
-FF_EBUR128_ADD_FRAMES(int)
-FF_EBUR128_ADD_FRAMES(float)
-FF_EBUR128_ADD_FRAMES(double)
+EBUR128_ADD_FRAMES(short)
+EBUR128_ADD_FRAMES(int)
+EBUR128_ADD_FRAMES(float)
+EBUR128_ADD_FRAMES(double)
 
-static int ebur128_calc_relative_threshold(FFEBUR128State **sts, size_t size,
+static int ebur128_calc_relative_threshold(AVEBUR128Context **sts, size_t size,
                                            double *relative_threshold)
 {
     size_t i, j;
@@ -542,7 +769,7 @@ static int ebur128_calc_relative_threshold(FFEBUR128State **sts, size_t size,
     return above_thresh_counter;
 }
 
-static int ebur128_gated_loudness(FFEBUR128State ** sts, size_t size,
+static int ebur128_gated_loudness(AVEBUR128Context ** sts, size_t size,
                                   double *out)
 {
     double gated_loudness = 0.0;
@@ -551,7 +778,7 @@ static int ebur128_gated_loudness(FFEBUR128State ** sts, size_t size,
     size_t i, j, start_index;
 
     for (i = 0; i < size; i++)
-        if ((sts[i]->mode & FF_EBUR128_MODE_I) != FF_EBUR128_MODE_I)
+        if ((sts[i]->mode & AV_EBUR128_MODE_I) != AV_EBUR128_MODE_I)
             return AVERROR(EINVAL);
 
     if (!ebur128_calc_relative_threshold(sts, size, &relative_threshold)) {
@@ -584,11 +811,11 @@ static int ebur128_gated_loudness(FFEBUR128State ** sts, size_t size,
     return 0;
 }
 
-int ff_ebur128_relative_threshold(FFEBUR128State * st, double *out)
+int av_ebur128_relative_threshold(AVEBUR128Context * st, double *out)
 {
     double relative_threshold;
 
-    if ((st->mode & FF_EBUR128_MODE_I) != FF_EBUR128_MODE_I)
+    if ((st->mode & AV_EBUR128_MODE_I) != AV_EBUR128_MODE_I)
         return AVERROR(EINVAL);
 
     if (!ebur128_calc_relative_threshold(&st, 1, &relative_threshold)) {
@@ -600,34 +827,39 @@ int ff_ebur128_relative_threshold(FFEBUR128State * st, double *out)
     return 0;
 }
 
-int ff_ebur128_loudness_global(FFEBUR128State * st, double *out)
+int av_ebur128_loudness_global(AVEBUR128Context * st, double *out)
 {
     return ebur128_gated_loudness(&st, 1, out);
 }
 
-int ff_ebur128_loudness_global_multiple(FFEBUR128State ** sts, size_t size,
+int av_ebur128_loudness_global_multiple(AVEBUR128Context ** sts, size_t size,
                                         double *out)
 {
     return ebur128_gated_loudness(sts, size, out);
 }
 
-static int ebur128_energy_in_interval(FFEBUR128State * st,
+static int ebur128_energy_in_interval(AVEBUR128Context * st,
                                       size_t interval_frames, double *out)
 {
     if (interval_frames > st->d->audio_data_frames) {
         return AVERROR(EINVAL);
     }
-    ebur128_calc_gating_block(st, interval_frames, out);
+    if (interval_frames % st->d->samples_in_100ms == 0 &&
+        ebur128_on_sub_block(st, interval_frames / st->d->samples_in_100ms)) {
+        *out = ebur128_sub_block_mean(st, interval_frames / st->d->samples_in_100ms);
+        return 0;
+    }
+    *out = ebur128_calc_gating_block(st, interval_frames);
     return 0;
 }
 
-static int ebur128_energy_shortterm(FFEBUR128State * st, double *out)
+static int ebur128_energy_shortterm(AVEBUR128Context * st, double *out)
 {
     return ebur128_energy_in_interval(st, st->d->samples_in_100ms * 30,
                                       out);
 }
 
-int ff_ebur128_loudness_momentary(FFEBUR128State * st, double *out)
+int av_ebur128_loudness_momentary(AVEBUR128Context * st, double *out)
 {
     double energy;
     int error = ebur128_energy_in_interval(st, st->d->samples_in_100ms * 4,
@@ -642,7 +874,7 @@ int ff_ebur128_loudness_momentary(FFEBUR128State * st, double *out)
     return 0;
 }
 
-int ff_ebur128_loudness_shortterm(FFEBUR128State * st, double *out)
+int av_ebur128_loudness_shortterm(AVEBUR128Context * st, double *out)
 {
     double energy;
     int error = ebur128_energy_shortterm(st, &energy);
@@ -656,7 +888,7 @@ int ff_ebur128_loudness_shortterm(FFEBUR128State * st, double *out)
     return 0;
 }
 
-int ff_ebur128_loudness_window(FFEBUR128State * st,
+int av_ebur128_loudness_window(AVEBUR128Context * st,
                                unsigned long window, double *out)
 {
     double energy;
@@ -673,7 +905,7 @@ int ff_ebur128_loudness_window(FFEBUR128State * st,
 }
 
 /* EBU - TECH 3342 */
-int ff_ebur128_loudness_range_multiple(FFEBUR128State ** sts, size_t size,
+int av_ebur128_loudness_range_multiple(AVEBUR128Context ** sts, size_t size,
                                        double *out)
 {
     size_t i, j;
@@ -687,8 +919,8 @@ int ff_ebur128_loudness_range_multiple(FFEBUR128State ** sts, size_t size,
 
     for (i = 0; i < size; ++i) {
         if (sts[i]) {
-            if ((sts[i]->mode & FF_EBUR128_MODE_LRA) !=
-                FF_EBUR128_MODE_LRA) {
+            if ((sts[i]->mode & AV_EBUR128_MODE_LRA) !=
+                AV_EBUR128_MODE_LRA) {
                 return AVERROR(EINVAL);
             }
         }
@@ -750,16 +982,30 @@ int ff_ebur128_loudness_range_multiple(FFEBUR128State ** sts, size_t size,
     return 0;
 }
 
-int ff_ebur128_loudness_range(FFEBUR128State * st, double *out)
+int av_ebur128_loudness_range(AVEBUR128Context * st, double *out)
+{
+    return av_ebur128_loudness_range_multiple(&st, 1, out);
+}
+
+int av_ebur128_true_peak(AVEBUR128Context * st,
+                         unsigned int channel_number, double *out)
 {
-    return ff_ebur128_loudness_range_multiple(&st, 1, out);
+    if ((st->mode & AV_EBUR128_MODE_TRUE_PEAK) !=
+        AV_EBUR128_MODE_TRUE_PEAK) {
+        return AVERROR(EINVAL);
+    } else if (channel_number >= st->channels) {
+        return AVERROR(EINVAL);
+    }
+    *out = FFMAX(st->d->true_peak[channel_number],
+                 st->d->sample_peak[channel_number]);
+    return 0;
 }
 
-int ff_ebur128_sample_peak(FFEBUR128State * st,
+int av_ebur128_sample_peak(AVEBUR128Context * st,
                            unsigned int channel_number, double *out)
 {
-    if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) !=
-        FF_EBUR128_MODE_SAMPLE_PEAK) {
+    if ((st->mode & AV_EBUR128_MODE_SAMPLE_PEAK) !=
+        AV_EBUR128_MODE_SAMPLE_PEAK) {
         return AVERROR(EINVAL);
     } else if (channel_number >= st->channels) {
         return AVERROR(EINVAL);
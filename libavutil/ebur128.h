@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2011 Jan Kokemüller
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * This file is based on libebur128 which is available at
+ * https://github.com/jiixyj/libebur128/
+ *
+*/
+
+#ifndef AVUTIL_EBUR128_H
+#define AVUTIL_EBUR128_H
+
+/**
+ * @file
+ * Loudness and true-peak measurement according to EBU R128 and
+ * ITU-R BS.1770-4.
+ */
+
+#include <stddef.h>             /* for size_t */
+
+/**
+ * @addtogroup lavu_audio
+ * @{
+ *
+ * @defgroup lavu_ebur128 EBU R128 loudness meter
+ * @{
+ */
+
+/** \enum AVEBUR128Channel
+ *  Use these values when setting the channel map with av_ebur128_set_channel().
+ *  See definitions in ITU R-REC-BS 1770-4
+ */
+enum AVEBUR128Channel {
+    AV_EBUR128_UNUSED = 0,   /**< unused channel (for example LFE channel) */
+    AV_EBUR128_LEFT,
+    AV_EBUR128_Mp030 = 1,    /**< itu M+030 */
+    AV_EBUR128_RIGHT,
+    AV_EBUR128_Mm030 = 2,    /**< itu M-030 */
+    AV_EBUR128_CENTER,
+    AV_EBUR128_Mp000 = 3,    /**< itu M+000 */
+    AV_EBUR128_LEFT_SURROUND,
+    AV_EBUR128_Mp110 = 4,    /**< itu M+110 */
+    AV_EBUR128_RIGHT_SURROUND,
+    AV_EBUR128_Mm110 = 5,    /**< itu M-110 */
+    AV_EBUR128_DUAL_MONO,    /**< a channel that is counted twice */
+    AV_EBUR128_MpSC,         /**< itu M+SC */
+    AV_EBUR128_MmSC,         /**< itu M-SC */
+    AV_EBUR128_Mp060,        /**< itu M+060 */
+    AV_EBUR128_Mm060,        /**< itu M-060 */
+    AV_EBUR128_Mp090,        /**< itu M+090 */
+    AV_EBUR128_Mm090,        /**< itu M-090 */
+    AV_EBUR128_Mp135,        /**< itu M+135 */
+    AV_EBUR128_Mm135,        /**< itu M-135 */
+    AV_EBUR128_Mp180,        /**< itu M+180 */
+    AV_EBUR128_Up000,        /**< itu U+000 */
+    AV_EBUR128_Up030,        /**< itu U+030 */
+    AV_EBUR128_Um030,        /**< itu U-030 */
+    AV_EBUR128_Up045,        /**< itu U+045 */
+    AV_EBUR128_Um045,        /**< itu U-030 */
+    AV_EBUR128_Up090,        /**< itu U+090 */
+    AV_EBUR128_Um090,        /**< itu U-090 */
+    AV_EBUR128_Up110,        /**< itu U+110 */
+    AV_EBUR128_Um110,        /**< itu U-110 */
+    AV_EBUR128_Up135,        /**< itu U+135 */
+    AV_EBUR128_Um135,        /**< itu U-135 */
+    AV_EBUR128_Up180,        /**< itu U+180 */
+    AV_EBUR128_Tp000,        /**< itu T+000 */
+    AV_EBUR128_Bp000,        /**< itu B+000 */
+    AV_EBUR128_Bp045,        /**< itu B+045 */
+    AV_EBUR128_Bm045         /**< itu B-045 */
+};
+
+/** \enum AVEBUR128Mode
+ *  Use these values in av_ebur128_alloc() (or'ed). Try to use the lowest possible
+ *  modes that suit your needs, as performance will be better.
+ */
+enum AVEBUR128Mode {
+  /** can call av_ebur128_loudness_momentary */
+    AV_EBUR128_MODE_M = (1 << 0),
+  /** can call av_ebur128_loudness_shortterm */
+    AV_EBUR128_MODE_S = (1 << 1) | AV_EBUR128_MODE_M,
+  /** can call av_ebur128_loudness_global_* and av_ebur128_relative_threshold */
+    AV_EBUR128_MODE_I = (1 << 2) | AV_EBUR128_MODE_M,
+  /** can call av_ebur128_loudness_range */
+    AV_EBUR128_MODE_LRA = (1 << 3) | AV_EBUR128_MODE_S,
+  /** can call av_ebur128_sample_peak */
+    AV_EBUR128_MODE_SAMPLE_PEAK = (1 << 4) | AV_EBUR128_MODE_M,
+  /** can call av_ebur128_true_peak */
+    AV_EBUR128_MODE_TRUE_PEAK = (1 << 5) | AV_EBUR128_MODE_SAMPLE_PEAK,
+};
+
+/**
+ * 4x oversampling true-peak meter.
+ *
+ * Uses the 48 taps polyphase interpolation filter of ITU-R BS.1770-4
+ * Annex 2. The samples of all channels are filtered together, interleaved.
+ * It can be used on its own, without an AVEBUR128Context.
+ */
+typedef struct AVEBUR128TruePeak AVEBUR128TruePeak;
+
+/**
+ * Allocate a true-peak meter.
+ *
+ * @param channels number of channels
+ * @return the meter, NULL on allocation failure
+ */
+AVEBUR128TruePeak *av_ebur128_true_peak_alloc(int channels);
+
+/**
+ * Free a true-peak meter and set the pointer to NULL.
+ */
+void av_ebur128_true_peak_free(AVEBUR128TruePeak **tp);
+
+/**
+ * Get the buffer the next samples are written to.
+ *
+ * The caller writes frames * channels interleaved samples to it, scaled so
+ * that 1.0 is 0 dBFS, and calls av_ebur128_true_peak_process(). The buffer
+ * is valid until the next call of this function.
+ *
+ * @return the buffer, NULL on allocation failure
+ */
+double *av_ebur128_true_peak_get_buffer(AVEBUR128TruePeak *tp, size_t frames);
+
+/**
+ * Oversample the samples written to the buffer.
+ *
+ * @param peaks per-channel maximum absolute value of the oversampled
+ *              signal, updated with the new samples
+ */
+void av_ebur128_true_peak_process(AVEBUR128TruePeak *tp, size_t frames,
+                                  double *peaks);
+
+/**
+ * State of a loudness measurement, opaque.
+ */
+typedef struct AVEBUR128Context AVEBUR128Context;
+
+/** \brief Allocate library state.
+ *
+ *  @param channels the number of channels.
+ *  @param samplerate the sample rate.
+ *  @param window set the maximum window size in ms, set to 0 for auto.
+ *  @param mode see the AVEBUR128Mode enum for possible values.
+ *  @return an initialized library state, NULL on failure.
+ */
+AVEBUR128Context *av_ebur128_alloc(unsigned int channels,
+                                   unsigned long samplerate,
+                                   unsigned long window, int mode);
+
+/** \brief Free library state and set the pointer to NULL.
+ *
+ *  @param st pointer to a library state.
+ */
+void av_ebur128_free(AVEBUR128Context **st);
+
+/** \brief Set channel type.
+ *
+ *  The default is:
+ *  - 0 -> AV_EBUR128_LEFT
+ *  - 1 -> AV_EBUR128_RIGHT
+ *  - 2 -> AV_EBUR128_CENTER
+ *  - 3 -> AV_EBUR128_UNUSED
+ *  - 4 -> AV_EBUR128_LEFT_SURROUND
+ *  - 5 -> AV_EBUR128_RIGHT_SURROUND
+ *
+ *  @param st library state.
+ *  @param channel_number zero based channel index.
+ *  @param value channel type from the AVEBUR128Channel enum.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if invalid channel index.
+ */
+int av_ebur128_set_channel(AVEBUR128Context * st,
+                           unsigned int channel_number, int value);
+
+/** \brief Add frames to be processed.
+ *
+ *  @param st library state.
+ *  @param src array of source frames. Channels must be interleaved.
+ *  @param frames number of frames. Not number of samples!
+ */
+void av_ebur128_add_frames_short(AVEBUR128Context * st,
+                                 const short *src, size_t frames);
+/** \brief See \ref av_ebur128_add_frames_short */
+void av_ebur128_add_frames_int(AVEBUR128Context * st,
+                               const int *src, size_t frames);
+/** \brief See \ref av_ebur128_add_frames_short */
+void av_ebur128_add_frames_float(AVEBUR128Context * st,
+                                 const float *src, size_t frames);
+/** \brief See \ref av_ebur128_add_frames_short */
+void av_ebur128_add_frames_double(AVEBUR128Context * st,
+                                  const double *src, size_t frames);
+
+/** \brief Add frames to be processed.
+ *
+ *  @param st library state.
+ *  @param srcs array of source frame channel data pointers
+ *  @param frames number of frames. Not number of samples!
+ *  @param stride number of samples to skip to for the next sample of the same channel
+ */
+void av_ebur128_add_frames_planar_short(AVEBUR128Context * st,
+                                        const short **srcs,
+                                        size_t frames, int stride);
+/** \brief See \ref av_ebur128_add_frames_planar_short */
+void av_ebur128_add_frames_planar_int(AVEBUR128Context * st,
+                                      const int **srcs,
+                                      size_t frames, int stride);
+/** \brief See \ref av_ebur128_add_frames_planar_short */
+void av_ebur128_add_frames_planar_float(AVEBUR128Context * st,
+                                        const float **srcs,
+                                        size_t frames, int stride);
+/** \brief See \ref av_ebur128_add_frames_planar_short */
+void av_ebur128_add_frames_planar_double(AVEBUR128Context * st,
+                                         const double **srcs,
+                                         size_t frames, int stride);
+
+/** \brief Get global integrated loudness in LUFS.
+ *
+ *  @param st library state.
+ *  @param out integrated loudness in LUFS. -HUGE_VAL if result is negative
+ *             infinity.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_I" has not been set.
+ */
+int av_ebur128_loudness_global(AVEBUR128Context * st, double *out);
+/** \brief Get global integrated loudness in LUFS across multiple instances.
+ *
+ *  @param sts array of library states.
+ *  @param size length of sts
+ *  @param out integrated loudness in LUFS. -HUGE_VAL if result is negative
+ *             infinity.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_I" has not been set.
+ */
+int av_ebur128_loudness_global_multiple(AVEBUR128Context ** sts,
+                                        size_t size, double *out);
+
+/** \brief Get momentary loudness (last 400ms) in LUFS.
+ *
+ *  @param st library state.
+ *  @param out momentary loudness in LUFS. -HUGE_VAL if result is negative
+ *             infinity.
+ *  @return
+ *    - 0 on success.
+ */
+int av_ebur128_loudness_momentary(AVEBUR128Context * st, double *out);
+/** \brief Get short-term loudness (last 3s) in LUFS.
+ *
+ *  @param st library state.
+ *  @param out short-term loudness in LUFS. -HUGE_VAL if result is negative
+ *             infinity.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_S" has not been set.
+ */
+int av_ebur128_loudness_shortterm(AVEBUR128Context * st, double *out);
+
+/** \brief Get loudness of the specified window in LUFS.
+ *
+ *  window must not be larger than the current window set in st.
+ *
+ *  @param st library state.
+ *  @param window window in ms to calculate loudness.
+ *  @param out loudness in LUFS. -HUGE_VAL if result is negative infinity.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if window larger than current window in st.
+ */
+int av_ebur128_loudness_window(AVEBUR128Context * st,
+                               unsigned long window, double *out);
+
+/** \brief Get loudness range (LRA) of programme in LU.
+ *
+ *  Calculates loudness range according to EBU 3342.
+ *
+ *  @param st library state.
+ *  @param out loudness range (LRA) in LU. Will not be changed in case of
+ *             error. AVERROR(EINVAL) will be returned in this case.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_LRA" has not been set.
+ */
+int av_ebur128_loudness_range(AVEBUR128Context * st, double *out);
+/** \brief Get loudness range (LRA) in LU across multiple instances.
+ *
+ *  Calculates loudness range according to EBU 3342.
+ *
+ *  @param sts array of library states.
+ *  @param size length of sts
+ *  @param out loudness range (LRA) in LU. Will not be changed in case of
+ *             error. AVERROR(EINVAL) will be returned in this case.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_LRA" has not been set.
+ */
+int av_ebur128_loudness_range_multiple(AVEBUR128Context ** sts,
+                                       size_t size, double *out);
+
+/** \brief Get maximum sample peak of selected channel in float format.
+ *
+ *  @param st library state
+ *  @param channel_number channel to analyse
+ *  @param out maximum sample peak in float format (1.0 is 0 dBFS)
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_SAMPLE_PEAK" has not been set.
+ *    - AVERROR(EINVAL) if invalid channel index.
+ */
+int av_ebur128_sample_peak(AVEBUR128Context * st,
+                           unsigned int channel_number, double *out);
+
+/** \brief Get maximum true peak of selected channel in float format.
+ *
+ *  @param st library state
+ *  @param channel_number channel to analyse
+ *  @param out maximum true peak in float format (1.0 is 0 dBFS)
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_TRUE_PEAK" has not been set.
+ *    - AVERROR(EINVAL) if invalid channel index.
+ */
+int av_ebur128_true_peak(AVEBUR128Context * st,
+                         unsigned int channel_number, double *out);
+
+/** \brief Get relative threshold in LUFS.
+ *
+ *  @param st library state
+ *  @param out relative threshold in LUFS.
+ *  @return
+ *    - 0 on success.
+ *    - AVERROR(EINVAL) if mode "AV_EBUR128_MODE_I" has not been set.
+ */
+int av_ebur128_relative_threshold(AVEBUR128Context * st, double *out);
+
+/**
+ * @}
+ * @}
+ */
+
+#endif /* AVUTIL_EBUR128_H */
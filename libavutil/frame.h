@@ -179,6 +179,12 @@ enum AVFrameSideDataType {
      * array element is implied by AVFrameSideData.size / AVRegionOfInterest.self_size.
      */
     AV_FRAME_DATA_REGIONS_OF_INTEREST,
+
+    /**
+     * Encoder analysis of the frame, shared between encoders. The data is
+     * an AVVideoAnalysis structure as defined in libavutil/video_analysis.h.
+     */
+    AV_FRAME_DATA_VIDEO_ANALYSIS,
 };
 
 enum AVActiveFormatDescription {
@@ -0,0 +1,132 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+
+#include "libavutil/common.h"
+#include "libavutil/convolution.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+
+#define NB_SAMPLES 20000
+
+static const struct {
+    int min_part, max_part;
+    int ir_len[2];
+    int flags;
+} tests[] = {
+    {   16,   16, {     5,    16 }, 0 },
+    {   16,   64, {   300,  1000 }, 0 },
+    {   32, 1024, {  7000,    40 }, 0 },
+    {   64, 8192, { 17000, 12345 }, 0 },
+    {   16,   64, {     5,  1000 }, AV_CONVOLUTION_FLAG_BLOCK },
+    {  256, 1024, {  7000,    40 }, AV_CONVOLUTION_FLAG_BLOCK },
+    { 1024, 1024, { 17000, 12345 }, AV_CONVOLUTION_FLAG_BLOCK },
+};
+
+/* Two interleaved inputs and outputs: output 0 is input 0 filtered with the
+ * first IR plus input 1 filtered with the second one, output 1 is input 1
+ * filtered with the first IR. */
+static int run_test(AVLFG *lfg, int t)
+{
+    const int *ir_len = tests[t].ir_len;
+    AVConvolutionContext *c;
+    float *ir[2], *src, *dst;
+    double max_err = 0, max_ref = 0;
+    int i, j, k, ret = 1;
+
+    ir[0] = av_malloc_array(ir_len[0], sizeof(*ir[0]));
+    ir[1] = av_malloc_array(ir_len[1], sizeof(*ir[1]));
+    src   = av_malloc_array(2 * NB_SAMPLES, sizeof(*src));
+    dst   = av_malloc_array(2 * NB_SAMPLES, sizeof(*dst));
+    c     = av_convolution_alloc(2, 2, tests[t].min_part, tests[t].max_part,
+                                 tests[t].flags);
+    if (!ir[0] || !ir[1] || !src || !dst || !c)
+        goto end;
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < ir_len[i]; j++)
+            ir[i][j] = ((int)(av_lfg_get(lfg) % 2001) - 1000) / 1000.f * expf(-4.f * j / ir_len[i]);
+    }
+    for (i = 0; i < 2 * NB_SAMPLES; i++)
+        src[i] = ((int)(av_lfg_get(lfg) % 2001) - 1000) / 1000.f;
+
+    if (av_convolution_add_ir(c, ir[0], ir_len[0]) != 0 ||
+        av_convolution_add_ir(c, ir[1], ir_len[1]) != 1 ||
+        av_convolution_add_route(c, 0, 0, 0) < 0 ||
+        av_convolution_add_route(c, 1, 0, 1) < 0 ||
+        av_convolution_add_route(c, 1, 1, 0) < 0 ||
+        av_convolution_init(c) < 0)
+        goto end;
+
+    for (i = 0; i < NB_SAMPLES; ) {
+        const float *in[2] = { src + 2 * i, src + 2 * i + 1 };
+        float *out[2]      = { dst + 2 * i, dst + 2 * i + 1 };
+        int n = 1 + av_lfg_get(lfg) % 3000;
+
+        /* in block mode, only the last call has an incomplete block */
+        if (tests[t].flags & AV_CONVOLUTION_FLAG_BLOCK)
+            n = FFMAX(n / tests[t].min_part, 1) * tests[t].min_part;
+        n = FFMIN(n, NB_SAMPLES - i);
+
+        av_convolution_process(c, out, 2, in, 2, n);
+        i += n;
+    }
+
+    for (i = 0; i < NB_SAMPLES; i++) {
+        double ref[2] = { 0 };
+
+        for (k = 0; k < ir_len[0] && k <= i; k++) {
+            ref[0] += (double)ir[0][k] * src[2 * (i - k)];
+            ref[1] += (double)ir[0][k] * src[2 * (i - k) + 1];
+        }
+        for (k = 0; k < ir_len[1] && k <= i; k++)
+            ref[0] += (double)ir[1][k] * src[2 * (i - k) + 1];
+
+        for (j = 0; j < 2; j++) {
+            max_err = FFMAX(max_err, fabs(ref[j] - dst[2 * i + j]));
+            max_ref = FFMAX(max_ref, fabs(ref[j]));
+        }
+    }
+
+    ret = max_err > 1e-5 * FFMAX(max_ref, 1);
+    printf("partitions %d-%d%s, IR %d/%d: %s\n", tests[t].min_part, tests[t].max_part,
+           tests[t].flags & AV_CONVOLUTION_FLAG_BLOCK ? " block" : "",
+           ir_len[0], ir_len[1], ret ? "FAIL" : "OK");
+
+end:
+    av_convolution_free(&c);
+    av_free(ir[0]);
+    av_free(ir[1]);
+    av_free(src);
+    av_free(dst);
+    return ret;
+}
+
+int main(void)
+{
+    AVLFG lfg;
+    int i, ret = 0;
+
+    av_lfg_init(&lfg, 0xC0FFEE);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++)
+        ret |= run_test(&lfg, i);
+
+    return ret;
+}
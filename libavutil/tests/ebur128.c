@@ -0,0 +1,121 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "libavutil/common.h"
+#include "libavutil/ebur128.h"
+#include "libavutil/mem.h"
+
+#define SAMPLE_RATE 48000
+#define CHANNELS    2
+
+static double dbfs(double v)
+{
+    return 20 * log10(v);
+}
+
+/* EBU Tech 3341 case 1: a 1 kHz stereo sine at -23 dBFS for 20 s reads
+ * -23.0 +-0.1 LUFS, whatever the number of frames given per call. */
+static int test_loudness(void)
+{
+    const int nb_frames = 20 * SAMPLE_RATE;
+    const double amp = pow(10, -23 / 20.);
+    AVEBUR128Context *st;
+    double *src, m, s, i, lra, peak;
+    int n, c, ret = 1;
+
+    src = av_malloc_array(nb_frames, CHANNELS * sizeof(*src));
+    st  = av_ebur128_alloc(CHANNELS, SAMPLE_RATE, 0,
+                           AV_EBUR128_MODE_I | AV_EBUR128_MODE_LRA |
+                           AV_EBUR128_MODE_TRUE_PEAK);
+    if (!src || !st)
+        goto end;
+
+    for (n = 0; n < nb_frames; n++)
+        for (c = 0; c < CHANNELS; c++)
+            src[n * CHANNELS + c] = amp * sin(2 * M_PI * 1000 * n / SAMPLE_RATE);
+    for (n = 0; n < nb_frames; ) {
+        int len = FFMIN(1 + (n * 7919) % 3000, nb_frames - n);
+        av_ebur128_add_frames_double(st, src + n * CHANNELS, len);
+        n += len;
+    }
+
+    if (av_ebur128_loudness_momentary(st, &m) < 0 ||
+        av_ebur128_loudness_shortterm(st, &s) < 0 ||
+        av_ebur128_loudness_global(st, &i) < 0 ||
+        av_ebur128_loudness_range(st, &lra) < 0 ||
+        av_ebur128_true_peak(st, 0, &peak) < 0)
+        goto end;
+
+    ret = fabs(m + 23) > 0.1 || fabs(s + 23) > 0.1 || fabs(i + 23) > 0.1 ||
+          lra > 0.1 || fabs(dbfs(peak) + 23) > 0.1;
+    printf("1 kHz sine, -23 dBFS: %s\n", ret ? "FAIL" : "OK");
+
+end:
+    av_ebur128_free(&st);
+    av_free(src);
+    return ret;
+}
+
+/* EBU Tech 3341 case 15: a fs/4 sine at -6 dBFS sampled 45 degrees off
+ * its peaks has a -9 dBFS sample peak, the true-peak meter must read
+ * -6 dBTP within -0.4/+0.2 dB. */
+static int test_true_peak(void)
+{
+    const int nb_frames = SAMPLE_RATE;
+    const double amp = pow(10, -6 / 20.);
+    AVEBUR128TruePeak *tp;
+    double peaks[CHANNELS] = { 0 };
+    int n, k, c, ret = 1;
+
+    tp = av_ebur128_true_peak_alloc(CHANNELS);
+    if (!tp)
+        return 1;
+
+    for (n = 0; n < nb_frames; ) {
+        int len = FFMIN(1 + n % 1013, nb_frames - n);
+        double *buf = av_ebur128_true_peak_get_buffer(tp, len);
+        if (!buf)
+            goto end;
+        for (k = 0; k < len; k++)
+            for (c = 0; c < CHANNELS; c++)
+                buf[k * CHANNELS + c] = amp * sin(M_PI / 2 * (n + k) + M_PI / 4);
+        av_ebur128_true_peak_process(tp, len, peaks);
+        n += len;
+    }
+
+    ret = 0;
+    for (c = 0; c < CHANNELS; c++)
+        ret |= dbfs(peaks[c]) < -6.4 || dbfs(peaks[c]) > -5.8;
+    printf("fs/4 sine, -6 dBTP: %s\n", ret ? "FAIL" : "OK");
+
+end:
+    av_ebur128_true_peak_free(&tp);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    ret |= test_loudness();
+    ret |= test_true_peak();
+    return ret;
+}
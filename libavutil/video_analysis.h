@@ -0,0 +1,107 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_VIDEO_ANALYSIS_H
+#define AVUTIL_VIDEO_ANALYSIS_H
+
+#include "frame.h"
+
+/**
+ * Encoder analysis of a video frame: scene changes, complexity and motion
+ * statistics computed once, possibly at a reduced resolution, and shared by
+ * all the encoders of the same content, e.g. the renditions of an adaptive
+ * bitrate ladder.
+ *
+ * The complexities are averages over blocks, so that they do not depend on
+ * the resolution of the encoded frame, only on the one of the analysis.
+ *
+ * To be used as payload of a AVFrameSideData with the
+ * AV_FRAME_DATA_VIDEO_ANALYSIS type.
+ *
+ * @note The struct should be allocated with av_video_analysis_alloc() or
+ *       av_video_analysis_create_side_data() and its size is not a part of
+ *       the public ABI.
+ */
+typedef struct AVVideoAnalysis {
+    /**
+     * Dimensions of the picture the analysis was computed on.
+     */
+    int width;
+    int height;
+
+    /**
+     * Size of the square blocks the statistics are computed on, in pixels
+     * of the analysed picture.
+     */
+    int block_size;
+
+    /**
+     * Nonzero if the frame is the first one of a new scene.
+     */
+    int scene_change;
+
+    /**
+     * Difference with the previous frame, between 0 and 1. Values above
+     * 0.3 to 0.5 usually indicate a scene change.
+     */
+    double scene_score;
+
+    /**
+     * Mean variance of the luma blocks.
+     */
+    double intra_complexity;
+
+    /**
+     * Mean variance of the motion compensated luma residual of the blocks,
+     * with the previous frame as reference. Equal to intra_complexity for
+     * the first frame.
+     */
+    double inter_complexity;
+
+    /**
+     * Fraction of the blocks cheaper to code without motion compensation,
+     * between 0 and 1.
+     */
+    double intra_ratio;
+
+    /**
+     * Mean length of the block motion vectors, in pixels of the analysed
+     * picture.
+     */
+    double motion;
+} AVVideoAnalysis;
+
+/**
+ * Allocate an AVVideoAnalysis structure and set its fields to zero.
+ *
+ * @param size if not NULL, set to the size of the allocated structure
+ * @return An AVVideoAnalysis filled with zero values or NULL on failure.
+ */
+AVVideoAnalysis *av_video_analysis_alloc(size_t *size);
+
+/**
+ * Allocate an AVVideoAnalysis structure, add it to the frame as side data of
+ * type AV_FRAME_DATA_VIDEO_ANALYSIS and set its fields to zero.
+ *
+ * @param frame The frame which the analysis should be added to.
+ * @return The AVVideoAnalysis structure to be filled by caller or NULL on
+ *         failure.
+ */
+AVVideoAnalysis *av_video_analysis_create_side_data(AVFrame *frame);
+
+#endif /* AVUTIL_VIDEO_ANALYSIS_H */
@@ -1,5 +1,5 @@
 ;*****************************************************************************
-;* x86-optimized functions for afir filter
+;* x86-optimized functions for partitioned convolution
 ;* Copyright (c) 2017 Paul B Mahol
 ;*
 ;* This file is part of FFmpeg.
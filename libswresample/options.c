@@ -124,6 +124,9 @@ static const AVOption options[]={
 { "kaiser_beta"         , "set swr Kaiser window beta"  , OFFSET(kaiser_beta)    , AV_OPT_TYPE_DOUBLE  , {.dbl=9                     }, 2      , 16        , PARAM },
 
 { "output_sample_bits"  , "set swr number of output sample bits", OFFSET(dither.output_sample_bits), AV_OPT_TYPE_INT  , {.i64=0   }, 0      , 64        , PARAM },
+
+{ "threads"             , "set number of threads channels are split between", OFFSET(threads), AV_OPT_TYPE_INT, {.i64=1 }, 0      , INT_MAX   , PARAM },
+{ "swr_threads"         , "set number of threads channels are split between", OFFSET(threads), AV_OPT_TYPE_INT, {.i64=1 }, 0      , INT_MAX   , PARAM },
 {0}
 };
 
@@ -494,25 +494,25 @@ av_cold void swri_rematrix_free(SwrContext *s){
     av_freep(&s->native_simd_one);
 }
 
-int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
+typedef struct RematrixSlice {
+    AudioData *out;
+    AudioData *in;
+    int len;
+    int len1;
+    int mustcopy;
+} RematrixSlice;
+
+static void rematrix_slice(SwrContext *s, void *arg, int jobnr, int nb_jobs)
+{
+    RematrixSlice *r = arg;
+    AudioData *out = r->out, *in = r->in;
+    int len = r->len, len1 = r->len1, mustcopy = r->mustcopy;
+    int off = len1 * out->bps;
+    int out_start = out->ch_count *  jobnr      / nb_jobs;
+    int out_end   = out->ch_count * (jobnr + 1) / nb_jobs;
     int out_i, in_i, i, j;
-    int len1 = 0;
-    int off = 0;
-
-    if(s->mix_any_f) {
-        s->mix_any_f(out->ch, (const uint8_t **)in->ch, s->native_matrix, len);
-        return 0;
-    }
 
-    if(s->mix_2_1_simd || s->mix_1_1_simd){
-        len1= len&~15;
-        off = len1 * out->bps;
-    }
-
-    av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
-    av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
-
-    for(out_i=0; out_i<out->ch_count; out_i++){
+    for(out_i=out_start; out_i<out_end; out_i++){
         switch(s->matrix_ch[out_i][0]){
         case 0:
             if(mustcopy)
@@ -572,5 +572,29 @@ int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mus
             }
         }
     }
+}
+
+int swri_rematrix(SwrContext *s, AudioData *out, AudioData *in, int len, int mustcopy){
+    RematrixSlice r;
+    int len1 = 0;
+
+    if(s->mix_any_f) {
+        s->mix_any_f(out->ch, (const uint8_t **)in->ch, s->native_matrix, len);
+        return 0;
+    }
+
+    if(s->mix_2_1_simd || s->mix_1_1_simd)
+        len1= len&~15;
+
+    av_assert0(!s->out_ch_layout || out->ch_count == av_get_channel_layout_nb_channels(s->out_ch_layout));
+    av_assert0(!s-> in_ch_layout || in ->ch_count == av_get_channel_layout_nb_channels(s-> in_ch_layout));
+
+    r.out      = out;
+    r.in       = in;
+    r.len      = len;
+    r.len1     = len1;
+    r.mustcopy = mustcopy;
+    swri_execute(s, rematrix_slice, &r, swri_get_nb_jobs(s, out->ch_count));
+
     return 0;
 }
@@ -449,7 +449,49 @@ static int set_compensation(ResampleContext *c, int sample_delta, int compensati
     return 0;
 }
 
-static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
+typedef struct ResampleSlice {
+    ResampleContext *c;
+    AudioData *dst;
+    AudioData *src;
+    int n;
+    int linear;
+} ResampleSlice;
+
+static void resample_slice(SwrContext *s, void *arg, int jobnr, int nb_jobs)
+{
+    ResampleSlice *r = arg;
+    ResampleContext *c = r->c;
+    int ch_start = r->dst->ch_count *  jobnr      / nb_jobs;
+    int ch_end   = r->dst->ch_count * (jobnr + 1) / nb_jobs;
+    int i;
+
+    for (i = ch_start; i < ch_end; i++) {
+        if (r->linear)
+            c->dsp.resample_linear(c, r->dst->ch[i], r->src->ch[i], r->n, 0);
+        else
+            c->dsp.resample_common(c, r->dst->ch[i], r->src->ch[i], r->n, 0);
+    }
+}
+
+/**
+ * Advance the filter position by n output samples, like the resample
+ * functions do when update_ctx is set.
+ *
+ * @return number of consumed input samples
+ */
+static int resample_advance(ResampleContext *c, int n)
+{
+    int64_t pos   = (int64_t)c->index * c->src_incr + c->frac + (int64_t)n * c->dst_incr;
+    int64_t index = pos / c->src_incr;
+
+    c->frac  = pos % c->src_incr;
+    c->index = index % c->phase_count;
+
+    return index / c->phase_count;
+}
+
+static int multiple_resample(SwrContext *s, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed){
+    ResampleContext *c = s->resample;
     int i;
     int av_unused mm_flags = av_get_cpu_flags();
     int need_emms = c->format == AV_SAMPLE_FMT_S16P && ARCH_X86_32 &&
@@ -492,10 +534,17 @@ static int multiple_resample(ResampleContext *c, AudioData *dst, int dst_size, A
         if (dst_size > 0) {
             /* resample_linear and resample_common should have same behavior
              * when frac and dst_incr_mod are zero */
-            resample_func = (c->linear && (c->frac || c->dst_incr_mod)) ?
-                            c->dsp.resample_linear : c->dsp.resample_common;
-            for (i = 0; i < dst->ch_count; i++)
-                *consumed = resample_func(c, dst->ch[i], src->ch[i], dst_size, i+1 == dst->ch_count);
+            int linear = c->linear && (c->frac || c->dst_incr_mod);
+            int nb_jobs = swri_get_nb_jobs(s, dst->ch_count);
+            if (nb_jobs > 1) {
+                ResampleSlice r = { c, dst, src, dst_size, linear };
+                swri_execute(s, resample_slice, &r, nb_jobs);
+                *consumed = resample_advance(c, dst_size);
+            } else {
+                resample_func = linear ? c->dsp.resample_linear : c->dsp.resample_common;
+                for (i = 0; i < dst->ch_count; i++)
+                    *consumed = resample_func(c, dst->ch[i], src->ch[i], dst_size, i+1 == dst->ch_count);
+            }
         }
     }
 
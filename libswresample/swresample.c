@@ -23,7 +23,9 @@
 #include "audioconvert.h"
 #include "libavutil/avassert.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/cpu.h"
 #include "libavutil/internal.h"
+#include "libavutil/slicethread.h"
 
 #include <float.h>
 
@@ -129,6 +131,8 @@ static void clear_context(SwrContext *s){
     swri_audio_convert_free(&s->out_convert);
     swri_audio_convert_free(&s->full_convert);
     swri_rematrix_free(s);
+    avpriv_slicethread_free(&s->slicethread);
+    s->nb_threads = 1;
 
     s->delayed_samples_fixup = 0;
     s->flushed = 0;
@@ -149,6 +153,55 @@ av_cold void swr_close(SwrContext *s){
     clear_context(s);
 }
 
+static void thread_worker(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    SwrContext *s = priv;
+    s->thread_func(s, s->thread_arg, jobnr, nb_jobs);
+}
+
+void swri_execute(SwrContext *s, swri_thread_func *func, void *arg, int nb_jobs)
+{
+    int i;
+
+    if (nb_jobs > 1 && s->slicethread) {
+        s->thread_func = func;
+        s->thread_arg  = arg;
+        avpriv_slicethread_execute(s->slicethread, nb_jobs, 0);
+    } else {
+        for (i = 0; i < nb_jobs; i++)
+            func(s, arg, i, nb_jobs);
+    }
+}
+
+int swri_get_nb_jobs(SwrContext *s, int nb_channels)
+{
+    return av_clip(nb_channels, 1, s->nb_threads);
+}
+
+static int init_threads(SwrContext *s)
+{
+    int nb_threads = s->threads ? s->threads : av_cpu_count();
+    int ret;
+
+    nb_threads = FFMIN(nb_threads, FFMAX(s->used_ch_count, s->out.ch_count));
+    if (nb_threads <= 1)
+        return 0;
+
+    ret = avpriv_slicethread_create(&s->slicethread, s, thread_worker, NULL, nb_threads);
+    if (ret == AVERROR(ENOMEM)) {
+        return ret;
+    } else if (ret < 0) {
+        /* the build has no thread support or the threads cannot be started */
+        avpriv_slicethread_free(&s->slicethread);
+        av_log(s, AV_LOG_WARNING, "Threads are not available, using a single thread\n");
+        return 0;
+    }
+    s->nb_threads = ret;
+    av_log(s, AV_LOG_VERBOSE, "Using %d threads\n", s->nb_threads);
+
+    return 0;
+}
+
 av_cold int swr_init(struct SwrContext *s){
     int ret;
     char l1[1024], l2[1024];
@@ -390,6 +443,9 @@ av_assert0(s->out.ch_count);
             goto fail;
     }
 
+    if (s->threads != 1 && (ret = init_threads(s)) < 0)
+        goto fail;
+
     return 0;
 fail:
     swr_close(s);
@@ -514,7 +570,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
         int ret, size, consumed;
         if(!s->resample_in_constraint && s->in_buffer_count){
             buf_set(&tmp, &s->in_buffer, s->in_buffer_index);
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &tmp, s->in_buffer_count, &consumed);
+            ret= s->resampler->multiple_resample(s, &out, out_count, &tmp, s->in_buffer_count, &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -534,7 +590,7 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
 
         if((s->flushed || in_count > padless) && !s->in_buffer_count){
             s->in_buffer_index=0;
-            ret= s->resampler->multiple_resample(s->resample, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
+            ret= s->resampler->multiple_resample(s, &out, out_count, &in, FFMAX(in_count-padless, 0), &consumed);
             out_count -= ret;
             ret_sum += ret;
             buf_set(&out, &out, ret);
@@ -579,6 +635,46 @@ static int resample(SwrContext *s, AudioData *out_param, int out_count,
     return ret_sum;
 }
 
+typedef struct DitherSlice {
+    AudioData *dst;
+    AudioData *src;
+    int count;
+} DitherSlice;
+
+static void dither_slice(SwrContext *s, void *arg, int jobnr, int nb_jobs)
+{
+    DitherSlice *d = arg;
+    AudioData *dst = d->dst, *src = d->src;
+    int ch_start = src->ch_count *  jobnr      / nb_jobs;
+    int ch_end   = src->ch_count * (jobnr + 1) / nb_jobs;
+    int count = d->count;
+    int ch;
+
+    if (s->dither.method < SWR_DITHER_NS){
+        if (s->mix_2_1_simd) {
+            int len1= count&~15;
+            int off = len1 * src->bps;
+
+            if(len1)
+                for(ch=ch_start; ch<ch_end; ch++)
+                    s->mix_2_1_simd(dst->ch[ch], src->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_simd_one, 0, 0, len1);
+            if(count != len1)
+                for(ch=ch_start; ch<ch_end; ch++)
+                    s->mix_2_1_f(dst->ch[ch] + off, src->ch[ch] + off, s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos + off, s->native_one, 0, 0, count - len1);
+        } else {
+            for(ch=ch_start; ch<ch_end; ch++)
+                s->mix_2_1_f(dst->ch[ch], src->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_one, 0, 0, count);
+        }
+    } else {
+        switch(s->int_sample_fmt) {
+        case AV_SAMPLE_FMT_S16P :swri_noise_shaping_int16(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_S32P :swri_noise_shaping_int32(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_FLTP :swri_noise_shaping_float(s, dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        case AV_SAMPLE_FMT_DBLP :swri_noise_shaping_double(s,dst, src, &s->dither.noise, count, ch_start, ch_end); break;
+        }
+    }
+}
+
 static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_count,
                                                       AudioData *in , int  in_count){
     AudioData *postin, *midbuf, *preout;
@@ -656,6 +752,7 @@ static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_co
     if(preout != out && out_count){
         AudioData *conv_src = preout;
         if(s->dither.method){
+            DitherSlice dither;
             int ch;
             int dither_count= FFMAX(out_count, 1<<16);
 
@@ -676,29 +773,12 @@ static int swr_convert_internal(struct SwrContext *s, AudioData *out, int out_co
             if(s->dither.noise_pos + out_count > s->dither.noise.count)
                 s->dither.noise_pos = 0;
 
-            if (s->dither.method < SWR_DITHER_NS){
-                if (s->mix_2_1_simd) {
-                    int len1= out_count&~15;
-                    int off = len1 * preout->bps;
-
-                    if(len1)
-                        for(ch=0; ch<preout->ch_count; ch++)
-                            s->mix_2_1_simd(conv_src->ch[ch], preout->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_simd_one, 0, 0, len1);
-                    if(out_count != len1)
-                        for(ch=0; ch<preout->ch_count; ch++)
-                            s->mix_2_1_f(conv_src->ch[ch] + off, preout->ch[ch] + off, s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos + off, s->native_one, 0, 0, out_count - len1);
-                } else {
-                    for(ch=0; ch<preout->ch_count; ch++)
-                        s->mix_2_1_f(conv_src->ch[ch], preout->ch[ch], s->dither.noise.ch[ch] + s->dither.noise.bps * s->dither.noise_pos, s->native_one, 0, 0, out_count);
-                }
-            } else {
-                switch(s->int_sample_fmt) {
-                case AV_SAMPLE_FMT_S16P :swri_noise_shaping_int16(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_S32P :swri_noise_shaping_int32(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_FLTP :swri_noise_shaping_float(s, conv_src, preout, &s->dither.noise, out_count); break;
-                case AV_SAMPLE_FMT_DBLP :swri_noise_shaping_double(s,conv_src, preout, &s->dither.noise, out_count); break;
-                }
-            }
+            dither.dst   = conv_src;
+            dither.src   = preout;
+            dither.count = out_count;
+            swri_execute(s, dither_slice, &dither, swri_get_nb_jobs(s, preout->ch_count));
+            if (s->dither.method >= SWR_DITHER_NS && s->dither.ns_taps)
+                s->dither.ns_pos = ((s->dither.ns_pos - out_count) % s->dither.ns_taps + s->dither.ns_taps) % s->dither.ns_taps;
             s->dither.noise_pos += out_count;
         }
 //FIXME packed doesn't need more than 1 chan here!
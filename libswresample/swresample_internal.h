@@ -42,6 +42,11 @@ typedef void (mix_2_1_func_type)(void *out, const void *in1, const void *in2, vo
 
 typedef void (mix_any_func_type)(uint8_t **out, const uint8_t **in1, void *coeffp, integer len);
 
+/**
+ * Function run by swri_execute() on a slice of channels.
+ */
+typedef void (swri_thread_func)(struct SwrContext *s, void *arg, int jobnr, int nb_jobs);
+
 typedef struct AudioData{
     uint8_t *ch[SWR_CH_MAX];    ///< samples buffer per channel
     uint8_t *data;              ///< samples buffer
@@ -71,7 +76,7 @@ struct DitherContext {
 typedef struct ResampleContext * (* resample_init_func)(struct ResampleContext *c, int out_rate, int in_rate, int filter_size, int phase_shift, int linear,
                                     double cutoff, enum AVSampleFormat format, enum SwrFilterType filter_type, double kaiser_beta, double precision, int cheby, int exact_rational);
 typedef void    (* resample_free_func)(struct ResampleContext **c);
-typedef int     (* multiple_resample_func)(struct ResampleContext *c, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
+typedef int     (* multiple_resample_func)(struct SwrContext *s, AudioData *dst, int dst_size, AudioData *src, int src_size, int *consumed);
 typedef int     (* resample_flush_func)(struct SwrContext *c);
 typedef int     (* set_compensation_func)(struct ResampleContext *c, int sample_delta, int compensation_distance);
 typedef int64_t (* get_delay_func)(struct SwrContext *s, int64_t base);
@@ -184,16 +189,37 @@ struct SwrContext {
 
     mix_any_func_type *mix_any_f;
 
+    int threads;                                    ///< user set number of threads, 0 for automatic
+    int nb_threads;                                 ///< number of threads used, 1 if single threaded
+    struct AVSliceThread *slicethread;              ///< thread pool splitting channels between threads
+    swri_thread_func *thread_func;                  ///< function run by the thread pool
+    void *thread_arg;                               ///< opaque argument of thread_func
+
     /* TODO: callbacks for ASM optimizations */
 };
 
 av_warn_unused_result
 int swri_realloc_audio(AudioData *a, int count);
 
-void swri_noise_shaping_int16 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_int32 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_float (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
-void swri_noise_shaping_double(SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count);
+/**
+ * Run func on nb_jobs slices, on the thread pool if one was created.
+ * Every job must work on a disjoint set of channels so that the output does
+ * not depend on the number of threads.
+ */
+void swri_execute(SwrContext *s, swri_thread_func *func, void *arg, int nb_jobs);
+
+/**
+ * @return number of jobs to split nb_channels channels into
+ */
+int swri_get_nb_jobs(SwrContext *s, int nb_channels);
+
+/**
+ * Noise shape channels [ch_start, ch_end). s->dither.ns_pos is not updated.
+ */
+void swri_noise_shaping_int16 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_int32 (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_float (SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
+void swri_noise_shaping_double(SwrContext *s, AudioData *dsts, const AudioData *srcs, const AudioData *noises, int count, int ch_start, int ch_end);
 
 av_warn_unused_result
 int swri_rematrix_init(SwrContext *s);
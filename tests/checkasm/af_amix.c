@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavfilter/af_amixdsp.h"
+#include "libavutil/internal.h"
+#include "checkasm.h"
+
+#define LEN    256
+#define NB_SRC 9
+
+#define randomize_buffer(buf, n)                            \
+    do {                                                    \
+        int i;                                              \
+        for (i = 0; i < n; i++)                             \
+            buf[i] = ((int)(rnd() % 2001) - 1000) / 1000.;  \
+    } while (0)
+
+#define CHECK_MIX(name, type, eps_array, eps)                                   \
+    do {                                                                        \
+        LOCAL_ALIGNED_32(type, src_buf, [NB_SRC * (LEN + 1)]);                  \
+        LOCAL_ALIGNED_32(type, dst_ref, [LEN]);                                 \
+        LOCAL_ALIGNED_32(type, dst_new, [LEN]);                                 \
+        LOCAL_ALIGNED_32(type, scale,   [NB_SRC]);                              \
+        const type *src[NB_SRC];                                                \
+        int i, nb_src, len;                                                     \
+                                                                                \
+        declare_func(void, type *dst, const type * const *src,                  \
+                     const type *scale, ptrdiff_t nb_src, ptrdiff_t len);       \
+                                                                                \
+        randomize_buffer(src_buf, NB_SRC * (LEN + 1));                          \
+        randomize_buffer(dst_ref, LEN);                                         \
+        randomize_buffer(scale, NB_SRC);                                        \
+        /* inputs are not aligned in general */                                 \
+        for (i = 0; i < NB_SRC; i++)                                            \
+            src[i] = src_buf + i * (LEN + 1) + (i & 1);                         \
+        memcpy(dst_new, dst_ref, sizeof(*dst_ref) * LEN);                       \
+                                                                                \
+        if (check_func(dsp.mix_##name, "amix_mix_" #name)) {                    \
+            for (nb_src = 1; nb_src <= NB_SRC; nb_src++) {                      \
+                for (len = 0; len <= LEN; len += 80) {                          \
+                    call_ref(dst_ref, src, scale, nb_src, len);                 \
+                    call_new(dst_new, src, scale, nb_src, len);                 \
+                    if (!eps_array(dst_ref, dst_new, eps, LEN))                 \
+                        fail();                                                 \
+                }                                                               \
+            }                                                                   \
+            bench_new(dst_new, src, scale, NB_SRC, LEN);                        \
+        }                                                                       \
+    } while (0)
+
+void checkasm_check_af_amix(void)
+{
+    AMixDSPContext dsp;
+
+    ff_amix_dsp_init(&dsp);
+
+    CHECK_MIX(float, float, float_near_abs_eps_array, 1e-4);
+    report("amix_mix_float");
+
+    CHECK_MIX(double, double, double_near_abs_eps_array, 1e-12);
+    report("amix_mix_double");
+}
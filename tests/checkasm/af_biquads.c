@@ -0,0 +1,76 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "libavfilter/af_biquads.h"
+#include "libavutil/internal.h"
+#include "checkasm.h"
+
+#define LEN 256
+
+/* one stable section per channel: resonant low-pass, high-pass, peaking
+ * and identity */
+static const double coeffs[5][BIQUAD_LANES] = {
+    {  0.0039,  0.9500,  1.0180, 1.0 },
+    {  0.0078, -1.9000, -1.9510, 0.0 },
+    {  0.0039,  0.9500,  0.9398, 0.0 },
+    {  1.9733,  1.8976,  1.9510, 0.0 },
+    { -0.9889, -0.9025, -0.9578, 0.0 },
+};
+
+void checkasm_check_af_biquads(void)
+{
+    LOCAL_ALIGNED_32(double, src,     [LEN * BIQUAD_LANES]);
+    LOCAL_ALIGNED_32(double, dst_ref, [LEN * BIQUAD_LANES]);
+    LOCAL_ALIGNED_32(double, dst_new, [LEN * BIQUAD_LANES]);
+    LOCAL_ALIGNED_32(double, state_ref, [2 * BIQUAD_LANES]);
+    LOCAL_ALIGNED_32(double, state_new, [2 * BIQUAD_LANES]);
+    LOCAL_ALIGNED_32(double, c, [5 * BIQUAD_LANES]);
+    BiquadsDSPContext dsp;
+    int i, len;
+
+    declare_func(void, double *buf, const double *coeffs, double *state,
+                 ptrdiff_t len);
+
+    ff_biquads_dsp_init(&dsp);
+
+    memcpy(c, coeffs, sizeof(coeffs));
+    for (i = 0; i < LEN * BIQUAD_LANES; i++)
+        src[i] = ((int)(rnd() % 2001) - 1000) / 1000.;
+    for (i = 0; i < 2 * BIQUAD_LANES; i++)
+        state_ref[i] = ((int)(rnd() % 2001) - 1000) / 10000.;
+
+    if (check_func(dsp.filter, "biquad_filter")) {
+        /* odd lengths and the empty block too */
+        for (len = 0; len <= LEN; len += len < 4 ? 1 : 63) {
+            memcpy(dst_ref, src, sizeof(*src) * LEN * BIQUAD_LANES);
+            memcpy(dst_new, src, sizeof(*src) * LEN * BIQUAD_LANES);
+            memcpy(state_new, state_ref, sizeof(*state_ref) * 2 * BIQUAD_LANES);
+
+            call_ref(dst_ref, c, state_ref, len);
+            call_new(dst_new, c, state_new, len);
+
+            if (!double_near_abs_eps_array(dst_ref, dst_new, 1e-12, LEN * BIQUAD_LANES) ||
+                !double_near_abs_eps_array(state_ref, state_new, 1e-12, 2 * BIQUAD_LANES))
+                fail();
+        }
+        bench_new(dst_new, c, state_new, LEN);
+    }
+    report("biquad_filter");
+}
@@ -153,8 +153,11 @@ static const struct {
     #endif
 #endif
 #if CONFIG_AVFILTER
-    #if CONFIG_AFIR_FILTER
-        { "af_afir", checkasm_check_afir },
+    #if CONFIG_AMIX_FILTER
+        { "af_amix", checkasm_check_af_amix },
+    #endif
+    #if CONFIG_BIQUAD_FILTER
+        { "af_biquads", checkasm_check_af_biquads },
     #endif
     #if CONFIG_BLEND_FILTER
         { "vf_blend", checkasm_check_blend },
@@ -179,6 +182,7 @@ static const struct {
     { "sw_rgb", checkasm_check_sw_rgb },
 #endif
 #if CONFIG_AVUTIL
+        { "convolution", checkasm_check_convolution },
         { "fixed_dsp", checkasm_check_fixed_dsp },
         { "float_dsp", checkasm_check_float_dsp },
 #endif
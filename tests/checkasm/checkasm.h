@@ -40,13 +40,15 @@
 #include "libavutil/timer.h"
 
 void checkasm_check_aacpsdsp(void);
-void checkasm_check_afir(void);
+void checkasm_check_af_amix(void);
+void checkasm_check_af_biquads(void);
 void checkasm_check_alacdsp(void);
 void checkasm_check_audiodsp(void);
 void checkasm_check_blend(void);
 void checkasm_check_blockdsp(void);
 void checkasm_check_bswapdsp(void);
 void checkasm_check_colorspace(void);
+void checkasm_check_convolution(void);
 void checkasm_check_exrdsp(void);
 void checkasm_check_fixed_dsp(void);
 void checkasm_check_flacdsp(void);
@@ -21,7 +21,7 @@
 #include <float.h>
 #include <stdint.h>
 
-#include "libavfilter/af_afir.h"
+#include "libavutil/convolution_internal.h"
 #include "libavutil/internal.h"
 #include "checkasm.h"
 
@@ -64,20 +64,20 @@ static void test_fcmul_add(const float *src0, const float *src1, const float *sr
     bench_new(odst, src1, src2, LEN);
 }
 
-void checkasm_check_afir(void)
+void checkasm_check_convolution(void)
 {
     LOCAL_ALIGNED_32(float, src0, [LEN*2+8]);
     LOCAL_ALIGNED_32(float, src1, [LEN*2+8]);
     LOCAL_ALIGNED_32(float, src2, [LEN*2+8]);
-    AudioFIRDSPContext fir = { 0 };
+    ConvolutionDSPContext dsp = { 0 };
 
-    ff_afir_init(&fir);
+    ff_convolution_dsp_init(&dsp);
 
     randomize_buffer(src0);
     randomize_buffer(src1);
     randomize_buffer(src2);
 
-    if (check_func(fir.fcmul_add, "fcmul_add"))
+    if (check_func(dsp.fcmul_add, "fcmul_add"))
         test_fcmul_add(src0, src1, src2);
     report("fcmul_add");
 }
@@ -93,6 +93,18 @@ probetags(){
     run ffprobe${PROGSUF}${EXECSUF} -show_entries format_tags -v 0 "$@"
 }
 
+probecache(){
+    cachedir="${outdir}/${test}.cache"
+    rm -rf "$cachedir"
+    mkdir -p "$cachedir" || return
+    for pass in write read; do
+        echo "$pass"
+        run ffprobe${PROGSUF}${EXECSUF} -bitexact -v verbose -probe_cache "$cachedir" -of compact -show_streams "$@" 2>"$cachedir.log" || return
+        grep -q "restored from the probe cache" "$cachedir.log" && echo "cache hit"
+    done
+    rm -rf "$cachedir" "$cachedir.log"
+}
+
 runlocal(){
     test "${V:-0}" -gt 0 && echo ${base}/"$@" ${base} >&3
     ${base}/"$@" ${base}
@@ -358,6 +370,107 @@ refcmp_metadata(){
         -f null /dev/null | awk -v ref=${ref} -v fuzz=${fuzz} -f ${base}/refcmp-metadata.awk -
 }
 
+refcmp_stats(){
+    refcmp=$1
+    format=$2
+    layout=$3
+    opts=$4
+    statsfile="${outdir}/${test}.stats"
+    ffmpeg $FLAGS $ENC_OPTS \
+        -lavfi "testsrc2=size=300x200:rate=1:duration=5,split[ref][tmp];[tmp]avgblur=4[enc];[enc][ref]${refcmp}=stats_file=${statsfile}:stats_format=${format}${opts:+:$opts}" \
+        -f null /dev/null || return
+    case "$format" in
+        csv)    awk -F, -v OFS=, 'NR > 1 { for (i = 2; i <= NF; i++) $i = sprintf("%.3f", $i) } 1' "$statsfile" ;;
+        # little-endian 64-bit fields, u for integers and f for doubles
+        binary) od -A n -v -t u1 "$statsfile" | awk -v layout="$layout" '
+            BEGIN { nf = split(layout, type, " ") }
+            {
+                for (i = 1; i <= NF; i++) {
+                    b[nb++] = $i
+                    if (nb < 8)
+                        continue
+                    nb = 0
+                    if (type[++f] == "u") {
+                        v = 0
+                        for (j = 7; j >= 0; j--)
+                            v = v * 256 + b[j]
+                        line = line sprintf(" %d", v)
+                    } else {
+                        e = (b[7] % 128) * 16 + int(b[6] / 16)
+                        m = b[6] % 16
+                        for (j = 5; j >= 0; j--)
+                            m = m * 256 + b[j]
+                        v = e ? (1 + m / 2^52) * 2^(e - 1023) : m * 2^-1074
+                        line = line sprintf(" %.3f", b[7] >= 128 ? -v : v)
+                    }
+                    if (f == nf) {
+                        print substr(line, 2)
+                        line = ""
+                        f = 0
+                    }
+                }
+            }' ;;
+    esac
+    rm -f "$statsfile"
+}
+
+signature_index(){
+    index="${outdir}/${test}.idx"
+    rm -f "$index"
+    for src in testsrc2 smptebars; do
+        ffmpeg -lavfi "${src}=size=320x240:duration=10,signature=index=${index}:index_write=1:index_label=${src}" \
+            -f null /dev/null || return
+    done
+    for src in "testsrc2=size=320x240:duration=10,trim=2:8,scale=160x120" "mandelbrot=size=320x240,trim=duration=10"; do
+        ffmpeg -lavfi "${src},signature=index=${index}:detectmode=full" -f null /dev/null 2>&1 |
+            sed -n 's/^\[Parsed_signature_[0-9]* @ [^]]*\] //p'
+    done
+    rm -f "$index"
+}
+
+tee_muxer(){
+    ffmpeg -f lavfi -i "testsrc2=size=160x120:duration=1" -c:v rawvideo -map 0 -use_thread 1 -f tee \
+        "[f=framecrc:fflags=+bitexact]${outdir}/${test}.0.crc|[f=framecrc:fflags=+bitexact]${outdir}/${test}.1.crc|[f=image2:onfail=ignore]${outdir}/${test}.raw" || return
+    cat "${outdir}/${test}.0.crc" "${outdir}/${test}.1.crc"
+    rm -f "${outdir}/${test}.0.crc" "${outdir}/${test}.1.crc" "${outdir}/${test}.raw"
+}
+
+hls_parts(){
+    # every rewrite of the playlist goes to stdout, so the partial segments
+    # and preload hints of the in-progress playlists are kept
+    (cd "$outdir" && ffmpeg "$@" -flags +bitexact -fflags +bitexact -f hls pipe:1)
+}
+
+mov_layout(){
+    file="${outdir}/${test}.mov"
+    ffmpeg "$@" -flags +bitexact -fflags +bitexact -f mov -y "$file" || return
+    do_md5sum "$file" | cut -d " " -f1
+    run ffprobe${PROGSUF}${EXECSUF} -v trace "$file" 2>&1 | sed -n "s/.*type:'\(....\)' parent:'root'.*/\1/p"
+    rm -f "$file"
+}
+
+mp4_fragments(){
+    run ffprobe${PROGSUF}${EXECSUF} -v trace -count_packets -show_entries stream=nb_read_packets "$@" 2>&1 |
+        sed -n "s/.*type:'\(....\)' parent:'root' sz: \([0-9]*\).*/\1 \2/p"
+}
+
+lowres_psnr(){
+    lowres=$1
+    threshold=$2
+    src=$3
+    shift 3
+    scale=$((1 << lowres))
+    ffmpeg -lowres $lowres -i "$src" -i "$src" "$@" \
+        -lavfi "[1:v]scale=iw/${scale}:ih/${scale}:flags=area+bitexact[ref];[0:v][ref]psnr,metadata=print:key=lavfi.psnr.psnr.y:file=-" \
+        -f null /dev/null | awk -v threshold=${threshold} -F= '
+            /^lavfi.psnr.psnr.y=/ { sum += $2; n++ }
+            END {
+                print "frames", n
+                if (n && sum / n >= threshold) print "psnr_y ok"
+                else if (n) printf "psnr_y %f below %f\n", sum / n, threshold
+            }'
+}
+
 pixfmt_conversion(){
     conversion="${test#pixfmt-}"
     outdir="tests/data/pixfmt"
@@ -1,9 +1,11 @@
 FATE_CHECKASM = fate-checkasm-aacpsdsp                                  \
-                fate-checkasm-af_afir                                   \
+                fate-checkasm-af_amix                                   \
+                fate-checkasm-af_biquads                                \
                 fate-checkasm-alacdsp                                   \
                 fate-checkasm-audiodsp                                  \
                 fate-checkasm-blockdsp                                  \
                 fate-checkasm-bswapdsp                                  \
+                fate-checkasm-convolution                               \
                 fate-checkasm-exrdsp                                    \
                 fate-checkasm-fixed_dsp                                 \
                 fate-checkasm-flacdsp                                   \
@@ -0,0 +1,15 @@
+tests/data/dash_frag_duration.mpd: TAG = GEN
+tests/data/dash_frag_duration.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+	-f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=10" -map 0 -codec:a mp2fixed \
+	-flags +bitexact -fflags +bitexact -f dash -streaming 1 -frag_duration 0.5 -seg_duration 20 \
+	-init_seg_name 'dash_frag_duration_init.m4s' -media_seg_name 'dash_frag_duration_$$Number$$.m4s' \
+	$(TARGET_PATH)/tests/data/dash_frag_duration.mpd 2>/dev/null
+
+FATE_DASHENC-$(call ALLYES, FFPROBE DASH_MUXER MP4_MUXER MOV_DEMUXER CONCAT_PROTOCOL AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-dash-frag-duration
+fate-dash-frag-duration: tests/data/dash_frag_duration.mpd ffprobe$(PROGSSUF)$(EXESUF)
+fate-dash-frag-duration: CMD = mp4_fragments "concat:$(TARGET_PATH)/tests/data/dash_frag_duration_init.m4s|$(TARGET_PATH)/tests/data/dash_frag_duration_1.m4s"
+
+FATE_FFMPEG += $(FATE_DASHENC-yes)
+
+fate-dashenc: $(FATE_DASHENC-yes)
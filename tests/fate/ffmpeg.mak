@@ -41,6 +41,23 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -idct simple -fflags +bitexact -flag
 FATE_FFMPEG-$(CONFIG_COLOR_FILTER) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER MPEG4_ENCODER) += fate-ffmpeg-chunk_encoders
+fate-ffmpeg-chunk_encoders: CMD = framecrc -lavfi testsrc=d=2:r=25:s=176x144 -flags +bitexact -c:v mpeg4 -bf 2 -qscale 5 -chunk_encoders 3 -chunk_frames 16 -fflags +bitexact
+
+# the image2 slave fails on the second frame, the other slaves go on
+FATE_FFMPEG-$(call ALLYES, LAVFI_INDEV TESTSRC2_FILTER RAWVIDEO_ENCODER TEE_MUXER FRAMECRC_MUXER IMAGE2_MUXER) += fate-ffmpeg-tee
+fate-ffmpeg-tee: CMD = tee_muxer
+
+tests/data/thumbnails.nut: TAG = GEN
+tests/data/thumbnails.nut: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+		-f lavfi -i "sws_flags=+accurate_rnd+bitexact;testsrc=r=25:s=176x144:d=10" -sws_flags '+accurate_rnd+bitexact' -pix_fmt yuv420p \
+		-c:v mpeg4 -qscale 5 -g 25 -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/tests/data/thumbnails.nut 2> /dev/null;
+
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER MPEG4_ENCODER NUT_MUXER NUT_DEMUXER MPEG4_DECODER THUMBNAIL_FILTER) += fate-ffmpeg-thumbnails
+fate-ffmpeg-thumbnails: tests/data/thumbnails.nut
+fate-ffmpeg-thumbnails: CMD = framecrc -flags +bitexact -idct simple -thumbnails 4 -thumbnail_candidates 2 -i $(TARGET_PATH)/tests/data/thumbnails.nut -vf thumbnail=2 -sws_flags +accurate_rnd+bitexact -fflags +bitexact
+
 FATE_SAMPLES_FFMPEG-$(CONFIG_RAWVIDEO_DEMUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
@@ -29,6 +29,26 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_xml
 fate-ffprobe_xml: $(FFPROBE_TEST_FILE)
 fate-ffprobe_xml: CMD = run $(FFPROBE_COMMAND) -of xml
 
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_probe_threads
+fate-ffprobe_probe_threads: $(FFPROBE_TEST_FILE)
+fate-ffprobe_probe_threads: CMD = run $(FFPROBE_COMMAND) -of compact -probe_threads 0
+fate-ffprobe_probe_threads: REF = $(SRC_PATH)/tests/ref/fate/ffprobe_compact
+
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_probe_cache
+fate-ffprobe_probe_cache: $(FFPROBE_TEST_FILE)
+fate-ffprobe_probe_cache: CMD = probecache $(FFPROBE_TEST_FILE)
+
+tests/data/probe_cache.mpg: TAG = GEN
+tests/data/probe_cache.mpg: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i "testsrc2=s=176x144:d=1" -f lavfi -i "sine=d=1" \
+	-c:v mpeg1video -c:a mp2fixed -flags +bitexact -fflags +bitexact -f mpeg -y $(TARGET_PATH)/$@ 2>/dev/null
+
+# the mpeg demuxer creates its streams while reading packets
+FATE_FFPROBE-$(call ALLYES, AVDEVICE LAVFI_INDEV TESTSRC2_FILTER SINE_FILTER MPEG1VIDEO_ENCODER MP2FIXED_ENCODER MPEG1SYSTEM_MUXER MPEGPS_DEMUXER) += fate-ffprobe_probe_cache_noheader
+fate-ffprobe_probe_cache_noheader: tests/data/probe_cache.mpg
+fate-ffprobe_probe_cache_noheader: CMD = probecache $(TARGET_PATH)/tests/data/probe_cache.mpg
+
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
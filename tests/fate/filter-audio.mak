@@ -58,6 +58,26 @@ fate-filter-acrossfade: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-acrossfade: SRC2 = $(TARGET_SAMPLES)/audio-reference/luckynight_2ch_44kHz_s16.wav
 fate-filter-acrossfade: CMD = framecrc -i $(SRC) -i $(SRC2) -filter_complex acrossfade=d=2:c1=log:c2=exp
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, AFIR AEVALSRC, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-afir
+fate-filter-afir: tests/data/asynth-44100-2.wav
+fate-filter-afir: tests/data/filtergraphs/afir
+fate-filter-afir: REF = tests/data/asynth-44100-2.wav
+fate-filter-afir: CMD = ffmpeg -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav -filter_script $(TARGET_PATH)/tests/data/filtergraphs/afir -f wav -c:a pcm_s16le -
+fate-filter-afir: CMP = oneoff
+fate-filter-afir: CMP_UNIT = s16
+fate-filter-afir: CMP_SHIFT = -40000
+fate-filter-afir: SIZE_TOLERANCE = 40000
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, AFIR AEVALSRC, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-afir-zerolat
+fate-filter-afir-zerolat: tests/data/asynth-44100-2.wav
+fate-filter-afir-zerolat: tests/data/filtergraphs/afir-zerolat
+fate-filter-afir-zerolat: REF = tests/data/asynth-44100-2.wav
+fate-filter-afir-zerolat: CMD = ffmpeg -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav -filter_script $(TARGET_PATH)/tests/data/filtergraphs/afir-zerolat -f wav -c:a pcm_s16le -
+fate-filter-afir-zerolat: CMP = oneoff
+fate-filter-afir-zerolat: CMP_UNIT = s16
+fate-filter-afir-zerolat: CMP_SHIFT = -160
+fate-filter-afir-zerolat: SIZE_TOLERANCE = 160
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, AFADE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-agate
 fate-filter-agate: tests/data/asynth-44100-2.wav
 fate-filter-agate: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -68,6 +88,21 @@ fate-filter-alimiter: tests/data/asynth-44100-2.wav
 fate-filter-alimiter: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-alimiter: CMD = framecrc -i $(SRC) -af alimiter=level_in=1:level_out=2:limit=0.2
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, LOUDNORM, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-loudnorm
+fate-filter-loudnorm: tests/data/asynth-44100-2.wav
+fate-filter-loudnorm: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-loudnorm: CMD = framecrc -i $(SRC) -af loudnorm=I=-16:TP=-6
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, LOUDNORM, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-loudnorm-linear
+fate-filter-loudnorm-linear: tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-linear: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-linear: CMD = framecrc -i $(SRC) -af loudnorm=I=-16:TP=-2:measured_I=-7.9:measured_TP=5.2:measured_LRA=6.9:measured_thresh=-17.9:linear=1
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, LOUDNORM, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-loudnorm-realtime
+fate-filter-loudnorm-realtime: tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-realtime: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-loudnorm-realtime: CMD = framecrc -i $(SRC) -af loudnorm=realtime=1:lookahead=100:I=-16:TP=-6
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, AMERGE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-amerge
 fate-filter-amerge: tests/data/asynth-44100-1.wav
 fate-filter-amerge: SRC = $(TARGET_PATH)/tests/data/asynth-44100-1.wav
@@ -99,6 +134,22 @@ fate-filter-asetrate: tests/data/asynth-44100-2.wav
 fate-filter-asetrate: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-asetrate: CMD = framecrc -i $(SRC) -frames:a 20 -af asetrate=20000
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, ATEMPO, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-atempo
+fate-filter-atempo: tests/data/asynth-44100-2.wav
+fate-filter-atempo: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-atempo: CMD = framecrc -i $(SRC) -af atempo=1.25
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, HIGHPASS EQUALIZER LOWSHELF LOWPASS, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-biquad-chain
+fate-filter-biquad-chain: tests/data/asynth-44100-2.wav
+fate-filter-biquad-chain: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquad-chain: CMD = framecrc -i $(SRC) -frames:a 20 -af highpass=f=100,equalizer=f=1000:t=o:w=1:g=-3,lowshelf=g=4:c=0x2,lowpass=f=8000:m=0.5
+
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, ASENDCMD HIGHPASS EQUALIZER LOWSHELF LOWPASS, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-biquad-chain-timeline
+fate-filter-biquad-chain-timeline: tests/data/asynth-44100-2.wav
+fate-filter-biquad-chain-timeline: tests/data/filtergraphs/biquad-chain-timeline
+fate-filter-biquad-chain-timeline: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-biquad-chain-timeline: CMD = framecrc -i $(SRC) -frames:a 20 -filter_script $(TARGET_PATH)/tests/data/filtergraphs/biquad-chain-timeline
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, CHORUS, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-chorus
 fate-filter-chorus: tests/data/asynth-22050-1.wav
 fate-filter-chorus: SRC = $(TARGET_PATH)/tests/data/asynth-22050-1.wav
@@ -109,6 +160,11 @@ fate-filter-dcshift: tests/data/asynth-44100-2.wav
 fate-filter-dcshift: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
 fate-filter-dcshift: CMD = framecrc -i $(SRC) -frames:a 20 -af dcshift=shift=0.25:limitergain=0.05
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, DYNAUDNORM, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-dynaudnorm-lookahead
+fate-filter-dynaudnorm-lookahead: tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-lookahead: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-dynaudnorm-lookahead: CMD = framecrc -i $(SRC) -af dynaudnorm=f=50:g=15:l=2
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, EARWAX, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-earwax
 fate-filter-earwax: tests/data/asynth-44100-2.wav
 fate-filter-earwax: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -128,6 +184,16 @@ fate-filter-firequalizer: CMP = oneoff
 fate-filter-firequalizer: CMP_UNIT = s16
 fate-filter-firequalizer: SIZE_TOLERANCE = 1058400 - 1097208
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, HEADPHONE AEVALSRC, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-headphone
+fate-filter-headphone: tests/data/asynth-44100-2.wav
+fate-filter-headphone: tests/data/filtergraphs/headphone
+fate-filter-headphone: REF = tests/data/asynth-44100-2.wav
+fate-filter-headphone: CMD = ffmpeg -i $(TARGET_PATH)/tests/data/asynth-44100-2.wav -filter_script $(TARGET_PATH)/tests/data/filtergraphs/headphone -f wav -c:a pcm_s16le -
+fate-filter-headphone: CMP = oneoff
+fate-filter-headphone: CMP_UNIT = s16
+fate-filter-headphone: CMP_SHIFT = -40000
+fate-filter-headphone: SIZE_TOLERANCE = 40000
+
 FATE_AFILTER-$(call FILTERDEMDECENCMUX, PAN, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-pan-mono1
 fate-filter-pan-mono1: tests/data/asynth-44100-2.wav
 fate-filter-pan-mono1: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
@@ -221,6 +287,12 @@ FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FIL
 fate-filter-hls-append: tests/data/hls-list-append.m3u8
 fate-filter-hls-append: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls-list-append.m3u8 -af asetpts=N*23
 
+FATE_AFILTER-$(call FILTERDEMDECENCMUX, AMIX ASPLIT ATRIM ASETNSAMPLES, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-filter-amix-longest
+fate-filter-amix-longest: tests/data/asynth-44100-2.wav
+fate-filter-amix-longest: tests/data/filtergraphs/amix-longest
+fate-filter-amix-longest: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
+fate-filter-amix-longest: CMD = framecrc -i $(SRC) -filter_script $(TARGET_PATH)/tests/data/filtergraphs/amix-longest
+
 FATE_AMIX += fate-filter-amix-simple
 fate-filter-amix-simple: CMD = ffmpeg -filter_complex amix -i $(SRC) -ss 3 -i $(SRC1) -f f32le -
 fate-filter-amix-simple: REF = $(SAMPLES)/filter/amix_simple.pcm
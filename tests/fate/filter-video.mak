@@ -65,6 +65,18 @@ fate-filter-paletteuse-sierra2_4a: CMD = framecrc -i $(TARGET_SAMPLES)/filter/an
 fate-filter-paletteuse: $(FATE_FILTER_PALETTEUSE)
 FATE_FILTER_SAMPLES-$(call ALLYES, PALETTEUSE_FILTER MATROSKA_DEMUXER H264_DECODER IMAGE2_DEMUXER PNG_DECODER) += $(FATE_FILTER_PALETTEUSE)
 
+PALETTEUSE_SMALL_GRAPH = testsrc2=s=160x120:d=1,split[a][b];[a]palettegen=max_colors=8[p];[b][p]paletteuse
+
+FATE_FILTER_PALETTEUSE_SMALL += fate-filter-paletteuse-small
+fate-filter-paletteuse-small: CMD = framecrc -lavfi "$(PALETTEUSE_SMALL_GRAPH)" -pix_fmt bgra
+
+# small palettes are not searched with the k-d tree, but must give the same result
+FATE_FILTER_PALETTEUSE_SMALL += fate-filter-paletteuse-small-tree
+fate-filter-paletteuse-small-tree: CMD = framecrc -lavfi "$(PALETTEUSE_SMALL_GRAPH)=color_search=nns_recursive" -pix_fmt bgra
+fate-filter-paletteuse-small-tree: REF = $(SRC_PATH)/tests/ref/fate/filter-paletteuse-small
+
+FATE_FILTER-$(call ALLYES, FFMPEG LAVFI_INDEV TESTSRC2_FILTER SPLIT_FILTER PALETTEGEN_FILTER PALETTEUSE_FILTER) += $(FATE_FILTER_PALETTEUSE_SMALL)
+
 FATE_FILTER-$(call ALLYES, AVDEVICE LIFE_FILTER) += fate-filter-lavd-life
 fate-filter-lavd-life: CMD = framecrc -f lavfi -i life=s=40x40:r=5:seed=42:mold=64:ratio=0.1:death_color=red:life_color=green -t 2
 
@@ -431,6 +443,16 @@ fate-filter-concat: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/d
 FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FPS_FILTER MPDECIMATE_FILTER) += fate-filter-mpdecimate
 fate-filter-mpdecimate: CMD = framecrc -lavfi testsrc2=r=2:d=10,fps=3,mpdecimate -r 3 -pix_fmt yuv420p
 
+ENCANALYSIS_GRAPH = testsrc2=s=176x144:r=25:d=2[a];smptebars=s=176x144:r=25:d=2[b];[a][b]concat
+ENCANALYSIS_ENC = -c:v mpeg4 -bf 2 -b_strategy 1 -g 250 -flags +bitexact
+ENCANALYSIS_DEPS = TESTSRC2_FILTER SMPTEBARS_FILTER CONCAT_FILTER MPEG4_ENCODER
+FATE_FILTER-$(call ALLYES, $(ENCANALYSIS_DEPS)) += fate-filter-encanalysis-none
+FATE_FILTER-$(call ALLYES, $(ENCANALYSIS_DEPS) ENCANALYSIS_FILTER) += fate-filter-encanalysis fate-filter-encanalysis-unused
+fate-filter-encanalysis-none: CMD = framecrc -lavfi "$(ENCANALYSIS_GRAPH)" $(ENCANALYSIS_ENC)
+fate-filter-encanalysis: CMD = framecrc -lavfi "$(ENCANALYSIS_GRAPH),encanalysis" $(ENCANALYSIS_ENC) -use_analysis 1
+fate-filter-encanalysis-unused: CMD = framecrc -lavfi "$(ENCANALYSIS_GRAPH),encanalysis" $(ENCANALYSIS_ENC)
+fate-filter-encanalysis-unused: REF = $(SRC_PATH)/tests/ref/fate/filter-encanalysis-none
+
 FATE_FILTER-$(call ALLYES, FPS_FILTER TESTSRC2_FILTER) += fate-filter-fps-up fate-filter-fps-up-round-down fate-filter-fps-up-round-up fate-filter-fps-down fate-filter-fps-down-round-down fate-filter-fps-down-round-up fate-filter-fps-down-eof-pass fate-filter-fps-start-drop fate-filter-fps-start-fill
 fate-filter-fps-up: CMD = framecrc -lavfi testsrc2=r=3:d=2,fps=7
 fate-filter-fps-up-round-down: CMD = framecrc -lavfi testsrc2=r=3:d=2,fps=7:round=down
@@ -736,6 +758,10 @@ FATE_METADATA_FILTER-$(call ALLYES, $(SCENEDETECT_DEPS)) += fate-filter-metadata
 fate-filter-metadata-scenedetect: SRC = $(TARGET_SAMPLES)/svq3/Vertical400kbit.sorenson3.mov
 fate-filter-metadata-scenedetect: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;movie='$(SRC)',select=gt(scene\,.25)"
 
+SCENEDETECT_PROXY_DEPS = FFPROBE LAVFI_INDEV TESTSRC2_FILTER SELECT_FILTER AVDEVICE
+FATE_FFPROBE-$(call ALLYES, $(SCENEDETECT_PROXY_DEPS)) += fate-filter-metadata-scenedetect-proxy
+fate-filter-metadata-scenedetect-proxy: CMD = run $(FILTER_METADATA_COMMAND) "testsrc2=s=320x240:r=5:d=2,select=scene:scene_width=80:mode=metadata"
+
 CROPDETECT_DEPS = FFPROBE LAVFI_INDEV MOVIE_FILTER CROPDETECT_FILTER SCALE_FILTER \
                   AVCODEC AVDEVICE MOV_DEMUXER H264_DECODER
 FATE_METADATA_FILTER-$(call ALLYES, $(CROPDETECT_DEPS)) += fate-filter-metadata-cropdetect
@@ -752,6 +778,10 @@ FATE_METADATA_FILTER-$(call ALLYES, $(EBUR128_METADATA_DEPS)) += fate-filter-met
 fate-filter-metadata-ebur128: SRC = $(TARGET_SAMPLES)/filter/seq-3341-7_seq-3342-5-24bit.flac
 fate-filter-metadata-ebur128: CMD = run $(FILTER_METADATA_COMMAND) "amovie='$(SRC)',ebur128=metadata=1"
 
+EBUR128_TRUEPEAK_DEPS = FFPROBE AVDEVICE LAVFI_INDEV SINE_FILTER EBUR128_FILTER
+FATE_FFPROBE-$(call ALLYES, $(EBUR128_TRUEPEAK_DEPS)) += fate-filter-metadata-ebur128-truepeak
+fate-filter-metadata-ebur128-truepeak: CMD = run $(FILTER_METADATA_COMMAND) "sine=frequency=11025:sample_rate=48000:duration=1,ebur128=metadata=1:peak=sample+true"
+
 READVITC_METADATA_DEPS = FFPROBE LAVFI_INDEV MOVIE_FILTER AVCODEC AVDEVICE \
                          AVI_DEMUXER FFVHUFF_DECODER READVITC_FILTER
 FATE_METADATA_FILTER-$(call ALLYES, $(READVITC_METADATA_DEPS)) += fate-filter-metadata-readvitc-def
@@ -793,6 +823,28 @@ fate-filter-refcmp-ssim-rgb: CMD = refcmp_metadata ssim rgb24 0.015
 FATE_FILTER_SAMPLES-$(call ALLYES, $(REFCMP_DEPS) SSIM_FILTER) += fate-filter-refcmp-ssim-yuv
 fate-filter-refcmp-ssim-yuv: CMD = refcmp_metadata ssim yuv422p 0.015
 
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) VIF_FILTER) += fate-filter-refcmp-vif-yuv fate-filter-refcmp-vif-yuv10
+fate-filter-refcmp-vif-yuv: CMD = refcmp_metadata vif yuv420p 0.001
+fate-filter-refcmp-vif-yuv10: CMD = refcmp_metadata vif yuv420p10le 0.001
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_DEPS) ADM_FILTER) += fate-filter-refcmp-adm-yuv fate-filter-refcmp-adm-yuv10
+fate-filter-refcmp-adm-yuv: CMD = refcmp_metadata adm yuv420p 0.001
+fate-filter-refcmp-adm-yuv10: CMD = refcmp_metadata adm yuv420p10le 0.001
+
+REFCMP_STATS_DEPS = FFMPEG LAVFI_INDEV TESTSRC2_FILTER AVGBLUR_FILTER
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_STATS_DEPS) PSNR_FILTER) += fate-filter-refcmp-psnr-csv fate-filter-refcmp-psnr-binary fate-filter-refcmp-psnr-binary-max
+fate-filter-refcmp-psnr-csv: CMD = refcmp_stats psnr csv
+fate-filter-refcmp-psnr-binary: CMD = refcmp_stats psnr binary "u f f f f f f f f"
+fate-filter-refcmp-psnr-binary-max: CMD = refcmp_stats psnr binary "u f f f f f f f f u u u u" output_max=1
+
+FATE_FILTER-$(call ALLYES, $(REFCMP_STATS_DEPS) SSIM_FILTER) += fate-filter-refcmp-ssim-csv fate-filter-refcmp-ssim-binary
+fate-filter-refcmp-ssim-csv: CMD = refcmp_stats ssim csv
+fate-filter-refcmp-ssim-binary: CMD = refcmp_stats ssim binary "u f f f f f"
+
+FATE_FILTER-$(call ALLYES, FFMPEG LAVFI_INDEV TESTSRC2_FILTER SMPTEBARS_FILTER MANDELBROT_FILTER TRIM_FILTER SCALE_FILTER SIGNATURE_FILTER) += fate-filter-signature-index
+fate-filter-signature-index: CMD = signature_index
+
 FATE_SAMPLES_FFPROBE += $(FATE_METADATA_FILTER-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_FILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_FILTER-yes)
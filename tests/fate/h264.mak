@@ -226,6 +226,15 @@ FATE_H264-$(call DEMDEC, FLV, H264) += fate-h264-brokensps-2580
 FATE_H264-$(call DEMDEC, MXF, H264) += fate-h264-xavc-4389
 FATE_H264-$(call DEMDEC, MOV, H264) += fate-h264-attachment-631
 FATE_H264-$(call DEMDEC, MPEGTS, H264) += fate-h264-skip-nokey fate-h264-skip-nointra
+
+# reduced resolution decoding is approximate, so compare against the
+# downscaled full resolution output instead of checksumming it
+FATE_H264-$(call ALLYES, H264_DEMUXER H264_DECODER SCALE_FILTER PSNR_FILTER METADATA_FILTER NULL_MUXER) += fate-h264-lowres-1 fate-h264-lowres-2 fate-h264-lowres-8x8
+
+# streams lowres does not support are decoded at full resolution
+FATE_H264-$(call DEMDEC, H264, H264) += fate-h264-lowres-fallback-paff fate-h264-lowres-fallback-10bit
+# and reduced resolution decoding resumes after them
+FATE_H264_FFPROBE-$(call ALLYES, H264_DEMUXER H264_DECODER CONCAT_PROTOCOL) += fate-h264-lowres-resume
 FATE_H264_FFPROBE-$(call DEMDEC, MATROSKA, H264) += fate-h264-dts_5frames
 
 FATE_SAMPLES_AVCONV += $(FATE_H264-yes)
@@ -443,6 +452,15 @@ fate-h264-3386:                                   CMD = framecrc -i $(TARGET_SAM
 fate-h264-missing-frame:                          CMD = framecrc -i $(TARGET_SAMPLES)/h264/nondeterministic_cut.h264
 fate-h264-timecode:                               CMD = framecrc -i $(TARGET_SAMPLES)/h264/crew_cif_timecode-2.h264
 
+fate-h264-lowres-1:                               CMD = lowres_psnr 1 25 $(TARGET_SAMPLES)/h264-conformance/BA1_Sony_D.jsv
+fate-h264-lowres-2:                               CMD = lowres_psnr 2 22 $(TARGET_SAMPLES)/h264-conformance/CABA3_SVA_B.264
+fate-h264-lowres-8x8:                             CMD = lowres_psnr 1 25 $(TARGET_SAMPLES)/h264-conformance/FRext/HCAFR1_HHI.264
+fate-h264-lowres-fallback-paff:                   CMD = framecrc -vsync drop -lowres 1 -i $(TARGET_SAMPLES)/h264-conformance/CVPA1_TOSHIBA_B.264
+fate-h264-lowres-fallback-paff:                   REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-cvpa1_toshiba_b
+fate-h264-lowres-fallback-10bit:                  CMD = framecrc -vsync drop -lowres 1 -i $(TARGET_SAMPLES)/h264-conformance/FRext/PPH10I1_Panasonic_A.264 -pix_fmt yuv420p10le
+fate-h264-lowres-fallback-10bit:                  REF = $(SRC_PATH)/tests/ref/fate/h264-conformance-frext-pph10i1_panasonic_a
+fate-h264-lowres-resume:                          CMD = run ffprobe$(PROGSSUF)$(EXESUF) -v 0 -lowres 1 -show_entries frame=width,height -of csv=p=0 "concat:$(TARGET_SAMPLES)/h264-conformance/CVPA1_TOSHIBA_B.264|$(TARGET_SAMPLES)/h264-conformance/BA1_Sony_D.jsv"
+
 fate-h264-reinit-%:                               CMD = framecrc -i $(TARGET_SAMPLES)/h264/$(@:fate-h264-%=%).h264 -vf format=yuv444p10le,scale=w=352:h=288
 
 fate-h264-dts_5frames:                            CMD = probeframes $(TARGET_SAMPLES)/h264/dts_5frames.mkv
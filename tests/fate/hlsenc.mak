@@ -85,6 +85,18 @@ FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FIL
 fate-hls-list-size: tests/data/hls_list_size.m3u8
 fate-hls-list-size: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_list_size.m3u8 -vf setpts=N*23
 
+tests/data/hls_io_thread.m3u8: TAG = GEN
+tests/data/hls_io_thread.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+	-f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" -f hls -hls_time 4 -map 0 \
+	-hls_list_size 4 -hls_flags delete_segments -io_thread 1 -codec:a mp2fixed \
+	-hls_segment_filename $(TARGET_PATH)/tests/data/hls_io_thread_%d.ts \
+	$(TARGET_PATH)/tests/data/hls_io_thread.m3u8 2>/dev/null
+
+FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-io-thread
+fate-hls-io-thread: tests/data/hls_io_thread.m3u8
+fate-hls-io-thread: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_io_thread.m3u8 -vf setpts=N*23
+
 tests/data/hls_segment_type_fmp4.m3u8: TAG = GEN
 tests/data/hls_segment_type_fmp4.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
@@ -97,3 +109,21 @@ FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FIL
 fate-hls-fmp4: tests/data/hls_segment_type_fmp4.m3u8
 fate-hls-fmp4: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_fmp4.m3u8 -vf setpts=N*23
 
+
+tests/data/hls_part_time.m3u8: TAG = GEN
+tests/data/hls_part_time.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< \
+	-f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=10" -map 0 -codec:a mp2fixed \
+	-hls_segment_type fmp4 -hls_fmp4_init_filename hls_part_time_init.mp4 -hls_list_size 0 \
+	-hls_time 4 -hls_part_time 1 -hls_segment_filename "$(TARGET_PATH)/tests/data/hls_part_time_%d.m4s" \
+	$(TARGET_PATH)/tests/data/hls_part_time.m3u8 2>/dev/null
+
+FATE_AFILTER-$(call ALLYES, HLS_MUXER MP4_MUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-part-time
+fate-hls-part-time: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+fate-hls-part-time: CMD = hls_parts -f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=10" -map 0 -codec:a mp2fixed \
+	-hls_segment_type fmp4 -hls_fmp4_init_filename hls_part_time_playlist_init.mp4 -hls_list_size 0 \
+	-hls_time 4 -hls_part_time 1 -hls_segment_filename hls_part_time_playlist_%d.m4s
+
+FATE_AFILTER-$(call ALLYES, HLS_DEMUXER MP4_MUXER MOV_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-part-time-decode
+fate-hls-part-time-decode: tests/data/hls_part_time.m3u8
+fate-hls-part-time-decode: CMD = framecrc -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_part_time.m3u8
@@ -43,6 +43,14 @@ FATE_LIBAVUTIL += fate-bprint
 fate-bprint: libavutil/tests/bprint$(EXESUF)
 fate-bprint: CMD = run libavutil/tests/bprint$(EXESUF)
 
+FATE_LIBAVUTIL += fate-convolution
+fate-convolution: libavutil/tests/convolution$(EXESUF)
+fate-convolution: CMD = run libavutil/tests/convolution$(EXESUF)
+
+FATE_LIBAVUTIL += fate-ebur128
+fate-ebur128: libavutil/tests/ebur128$(EXESUF)
+fate-ebur128: CMD = run libavutil/tests/ebur128$(EXESUF)
+
 FATE_LIBAVUTIL += fate-cpu
 fate-cpu: libavutil/tests/cpu$(EXESUF)
 fate-cpu: CMD = runecho libavutil/tests/cpu$(EXESUF) $(CPUFLAGS:%=-c%) $(THREADS:%=-t%)
@@ -1094,5 +1094,16 @@ fate-swr-audioconvert: CMP = stddev
 fate-swr-audioconvert: FUZZ = 0
 
 FATE_SWR += $(FATE_SWR_AUDIOCONVERT-yes)
+
+FATE_SWR_THREADS-$(call FILTERDEMDECENCMUX, ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-swr-threads
+fate-swr-threads: tests/data/asynth-48000-8.wav
+fate-swr-threads: CMD = md5 -i $(TARGET_PATH)/tests/data/asynth-48000-8.wav -af aresample=44100:swr_threads=3:ocl=5.1:osf=s16:dither_method=shibata -f wav -c:a pcm_s16le
+
+FATE_SWR_THREADS-$(call FILTERDEMDECENCMUX, ARESAMPLE, WAV, PCM_S16LE, PCM_S16LE, WAV) += fate-swr-threads-1
+fate-swr-threads-1: tests/data/asynth-48000-8.wav
+fate-swr-threads-1: CMD = md5 -i $(TARGET_PATH)/tests/data/asynth-48000-8.wav -af aresample=44100:swr_threads=1:ocl=5.1:osf=s16:dither_method=shibata -f wav -c:a pcm_s16le
+fate-swr-threads-1: REF = $(SRC_PATH)/tests/ref/fate/swr-threads
+
+FATE_SWR += $(FATE_SWR_THREADS-yes)
 FATE_FFMPEG += $(FATE_SWR)
 fate-swr: $(FATE_SWR)
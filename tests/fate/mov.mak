@@ -124,3 +124,17 @@ fate-mov-faststart-4gb-overflow: CMP = oneline
 fate-mov-faststart-4gb-overflow: REF = bc875921f151871e787c4b4023269b29
 
 fate-mov-mp4-with-mov-in24-ver: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=codec_name -select_streams 1 $(TARGET_SAMPLES)/mov/mp4-with-mov-in24-ver.mp4
+
+MOV_LAYOUT_DEPS = FFMPEG FFPROBE LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER MOV_MUXER MOV_DEMUXER
+
+FATE_MOV_FFMPEG-$(call ALLYES, $(MOV_LAYOUT_DEPS)) += fate-mov-reserve-moov
+fate-mov-reserve-moov: ffprobe$(PROGSSUF)$(EXESUF)
+fate-mov-reserve-moov: CMD = mov_layout -f lavfi -i testsrc=s=160x120:r=25 -t 0.4 -c:v mpeg4 -movflags +reserve_moov
+
+# without a duration the moov size cannot be estimated, faststart is used
+FATE_MOV_FFMPEG-$(call ALLYES, $(MOV_LAYOUT_DEPS)) += fate-mov-reserve-moov-fallback
+fate-mov-reserve-moov-fallback: ffprobe$(PROGSSUF)$(EXESUF)
+fate-mov-reserve-moov-fallback: CMD = mov_layout -f lavfi -i testsrc=s=160x120:r=25 -frames:v 10 -c:v mpeg4 -movflags +reserve_moov
+
+FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
+fate-mov: $(FATE_MOV_FFMPEG-yes)